@@ -0,0 +1,58 @@
+TEMPLATE = app
+
+CONFIG += warn_on
+
+TARGET = bench
+
+DESTDIR = bin
+OBJECTS_DIR = obj
+MOC_DIR = obj
+
+INCLUDEPATH += ./src/ ../common/ ../example3/src/ /usr/local/cuda/include /opt/AMDAPP/include
+
+LIBS += -lOpenCL
+
+QMAKE_CXXFLAGS_RELEASE = -march=native -O3 -fPIC
+
+SOURCES += \
+	src/main.cpp \
+	../common/clutils.cpp \
+	../common/programcache.cpp \
+	../common/transpose.cpp \
+	../common/elementwise.cpp \
+	../common/fusedexpr.cpp \
+	../common/reduce.cpp \
+	../common/scan.cpp \
+	../common/histogram.cpp \
+	../common/radixsort.cpp \
+	../common/clprofiler.cpp \
+	../example3/src/multigrid.cpp \
+	../example3/src/fdmblocked.cpp
+
+HEADERS += \
+	../common/clutils.h \
+	../common/programcache.h \
+	../common/transpose.h \
+	../common/elementwise.h \
+	../common/fusedexpr.h \
+	../common/reduce.h \
+	../common/scan.h \
+	../common/histogram.h \
+	../common/radixsort.h \
+	../common/clprofiler.h \
+	../example3/src/multigrid.h \
+	../example3/src/fdmblocked.h
+
+OTHER_FILES += \
+	../example1/src/matrixscalar.cl \
+	../example2/src/matrixtranspose.cl \
+	../common/transpose.cl \
+	../common/elementwise.cl \
+	../common/reduce.cl \
+	../common/scan.cl \
+	../common/histogram.cl \
+	../common/radixsort.cl \
+	../example3/src/fdmHeat.cl \
+	../example3/src/multigrid.cl \
+	../example4/src/atomics.cl \
+	../example7/src/vboproc.cl
@@ -0,0 +1,1789 @@
+// Benchmark de los kernels de los ejemplos
+//
+// Ejecuta cada kernel sobre un barrido de tamanios y de formas de work-group,
+// con ejecuciones de calentamiento y varias repeticiones medidas con eventos
+// de OpenCL. Para cada combinacion reporta tiempo medio, mediana, minimo, maximo
+// y desvio estandar, ancho de banda efectivo (GB/s) y elementos por segundo
+// (calculados con la mediana). Los resultados se pueden guardar en CSV o JSON
+// para comparar entre versiones de los kernels y entre dispositivos.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define CL_USE_DEPRECATED_OPENCL_1_1_APIS
+
+// Header de OpenCL
+#include <CL/cl.h>
+// Utilidades propias para OpenCL
+#include "clutils.h"
+#include "programcache.h"
+#include "transpose.h"
+#include "elementwise.h"
+#include "fusedexpr.h"
+#include "reduce.h"
+#include "scan.h"
+#include "histogram.h"
+#include "radixsort.h"
+#include "multigrid.h"
+#include "fdmblocked.h"
+
+using namespace std;
+
+// Parametros de la corrida
+struct BenchConfig {
+    int warmup;                // Ejecuciones de calentamiento (no medidas)
+    int trials;                // Ejecuciones medidas
+    vector<size_t> sizes;      // Tamanios a usar; vacio para los de cada kernel
+    vector<string> kernels;    // Kernels a ejecutar; vacio para todos
+    vector<HostMemMode> hostMemModes; // Modos de memoria de host a comparar (--hostmem); vacio sin --hostmem
+};
+
+// Resultado de un kernel para un tamanio y una forma de work-group
+struct BenchResult {
+    string kernel;
+    size_t size;               // Lado de la matriz o imagen, o cantidad de elementos
+    size_t workGroup[2];       // Tamanio de work-group; 0 si lo elige la clase que encola los kernels
+    string param;              // Parametro propio del kernel ("clave=valor", separados por ';')
+    int trials;
+    double meanMs;
+    double medianMs;
+    double minMs;
+    double maxMs;
+    double stddevMs;
+    double bytes;              // Bytes leidos + escritos en memoria global por ejecucion
+    double elements;           // Elementos procesados por ejecucion
+};
+
+struct BenchContext {
+    cl_context context;
+    cl_command_queue queue;
+    cl_device_id device;
+    CLDeviceInfo info;
+};
+
+// Directorio de los ejemplos, relativo a bench/bin
+#define EXAMPLES_DIR "../../"
+
+// Devuelve true si hay que ejecutar kernel segun --kernels
+// Nombres que se pueden pasar en --kernels, en el orden en que se ejecutan
+static const char* benchKernels[] = {
+    "matrixScalar", "transpose", "transposeShMem", "transposeTiled", "transposeInPlace",
+    "transposeBatched", "transposeLoop", "vectorScale", "vectorAxpy", "vectorAdd", "vectorMul",
+    "vectorFma", "vectorClamp", "fusedChain3", "fusedChain5", "stepChain3", "stepChain5",
+    "reduceSum", "reduceMin", "reduceMax", "reduceCountEq", "reduceArgMax", "scanExclusive",
+    "scanInclusive", "compact", "histogram", "radixSort", "radixSortPairs", "fdmHeat",
+    "fdmHeatBlocked", "jacobiConverge", "gaussSeidelConverge", "sorConverge", "multigridConverge",
+    "globCounter", "shMemCounter", "vboproc", "hostUpload", "hostDownload"
+};
+static const int benchKernelCount= sizeof(benchKernels) / sizeof(benchKernels[0]);
+
+static bool selected(const BenchConfig& config, const char* kernel)
+{
+    return config.kernels.empty() or
+           find(config.kernels.begin(), config.kernels.end(), kernel) != config.kernels.end();
+}
+
+// Tamanios a usar: los de --sizes, o si no se pasaron, defaults
+static vector<size_t> sizesFor(const BenchConfig& config, const size_t* defaults, int count)
+{
+    if(!config.sizes.empty())
+        return config.sizes;
+    return vector<size_t>(defaults, defaults + count);
+}
+
+// Devuelve true si entran en el dispositivo tantos buffers de bufferBytes como indica buffers
+static bool fits(const BenchContext& ctx, size_t bufferBytes, int buffers)
+{
+    return bufferBytes <= ctx.info.maxAllocSize and bufferBytes * buffers <= ctx.info.globalMemSize;
+}
+
+// Tamanio maximo de work-group con el que se puede ejecutar kernel
+static size_t kernelMaxWorkGroup(const BenchContext& ctx, cl_kernel kernel)
+{
+    size_t size;
+    cl_int error= clGetKernelWorkGroupInfo(kernel, ctx.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &size, NULL);
+    if(checkError(error, "clGetKernelWorkGroupInfo"))
+        return 1;
+    return size;
+}
+
+// Formas de work-group 2D a probar con kernel, dentro de los limites del dispositivo
+static vector<pair<size_t, size_t> > workGroupShapes2D(const BenchContext& ctx, cl_kernel kernel)
+{
+    static const size_t candidates[][2] = { {8, 8}, {16, 8}, {16, 16}, {32, 4}, {32, 8}, {32, 16}, {32, 32}, {64, 4} };
+    const size_t maxSize= kernelMaxWorkGroup(ctx, kernel);
+
+    vector<pair<size_t, size_t> > shapes;
+    for(size_t c=0; c<sizeof(candidates) / sizeof(candidates[0]); c++) {
+        const size_t x= candidates[c][0], y= candidates[c][1];
+        if(x * y <= maxSize and x <= ctx.info.maxWorkItemSizes[0] and y <= ctx.info.maxWorkItemSizes[1])
+            shapes.push_back(make_pair(x, y));
+    }
+    return shapes;
+}
+
+// Tamanios de work-group 1D a probar con kernel, dentro de los limites del dispositivo
+static vector<size_t> workGroupSizes1D(const BenchContext& ctx, cl_kernel kernel)
+{
+    const size_t maxSize= min(kernelMaxWorkGroup(ctx, kernel), ctx.info.maxWorkItemSizes[0]);
+
+    vector<size_t> sizes;
+    for(size_t size=32; size<=1024; size*=2)
+        if(size <= maxSize)
+            sizes.push_back(size);
+    return sizes;
+}
+
+// Ejecuta kernel config.warmup veces sin medir y config.trials veces midiendo
+// el tiempo de cada ejecucion (START -> END) en times
+// Devuelve false en caso de error
+static bool measure(const BenchContext& ctx, cl_kernel kernel, cl_uint dims, const size_t* global,
+                    const size_t* local, const BenchConfig& config, vector<double>& times)
+{
+    times.clear();
+    for(int t=0; t<config.warmup + config.trials; t++) {
+        cl_event event;
+        cl_int error= clEnqueueNDRangeKernel(ctx.queue, kernel, dims, NULL, global, local, 0, NULL, &event);
+        if(checkError(error, "measure: clEnqueueNDRangeKernel"))
+            return false;
+        error= clWaitForEvents(1, &event);
+        if(checkError(error, "measure: clWaitForEvents"))
+            return false;
+        if(t >= config.warmup)
+            times.push_back(eventElapsed(event));
+        clReleaseEvent(event);
+    }
+    return true;
+}
+
+// Devuelve "key=value" para la columna param de los resultados
+static string benchParam(const char* key, long value)
+{
+    ostringstream os;
+    os << key << "=" << value;
+    return os.str();
+}
+
+// Calcula las estadisticas de times, agrega el resultado a results y lo muestra por cerr
+static void addResult(vector<BenchResult>& results, const char* kernel, size_t size, size_t wgX, size_t wgY,
+                      vector<double> times, double bytes, double elements, const string& param= "")
+{
+    BenchResult r;
+    r.kernel= kernel;
+    r.size= size;
+    r.workGroup[0]= wgX;
+    r.workGroup[1]= wgY;
+    r.param= param;
+    r.trials= times.size();
+    r.bytes= bytes;
+    r.elements= elements;
+
+    sort(times.begin(), times.end());
+    const size_t n= times.size();
+    double sum= 0;
+    for(size_t i=0; i<n; i++)
+        sum+= times[i];
+    r.meanMs= sum / n;
+    double sq= 0;
+    for(size_t i=0; i<n; i++)
+        sq+= (times[i] - r.meanMs) * (times[i] - r.meanMs);
+    r.stddevMs= n > 1 ? sqrt(sq / (n - 1)) : 0;
+    r.medianMs= n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    r.minMs= times[0];
+    r.maxMs= times[n - 1];
+    results.push_back(r);
+
+    cerr << left << setw(16) << kernel << right << setw(11) << size
+         << setw(6) << wgX << "x" << left << setw(4) << wgY << right << fixed << setprecision(3)
+         << setw(11) << r.medianMs << " +- " << setw(7) << r.stddevMs << " ms"
+         << setprecision(2) << setw(10) << bytes / (r.medianMs * 1.0e6) << " GB/s"
+         << setw(10) << elements / (r.medianMs * 1.0e6) << " Gelem/s" << (param.empty() ? "" : "  ") << param << endl;
+}
+
+// Llena data con count floats aleatorios entre 0 y 1
+static void randomFloats(vector<float>& data, size_t count)
+{
+    data.resize(count);
+    for(size_t i=0; i<count; i++)
+        data[i]= (float)rand()/RAND_MAX;
+}
+
+/// matrixScalar (example1): B = k * A, matrices de n * n
+static bool benchMatrixScalar(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    if(!selected(config, "matrixScalar"))
+        return true;
+
+    cl_kernel kernel;
+    if(!loadKernel(ctx.context, &kernel, ctx.device, EXAMPLES_DIR "example1/src/matrixscalar.cl", "matrixScalar"))
+        return false;
+
+    static const size_t defaults[] = { 512, 1024, 2048, 4096 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 4);
+    const vector<pair<size_t, size_t> > shapes= workGroupShapes2D(ctx, kernel);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * n * sizeof(float);
+        if(!fits(ctx, bytes, 2))
+            continue;
+
+        vector<float> hA;
+        randomFloats(hA, (size_t)n * n);
+        cl_int error1, error2;
+        cl_mem dA= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hA[0], &error1);
+        cl_mem dB= clCreateBuffer(ctx.context, CL_MEM_WRITE_ONLY, bytes, NULL, &error2);
+        if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+            return false;
+
+        const float k= 3.5f;
+        cl_int error;
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dB);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_float), (void*)&k);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&n);
+        if(checkError(error, "benchMatrixScalar: clSetKernelArg"))
+            return false;
+
+        for(size_t w=0; w<shapes.size(); w++) {
+            size_t workGroupSize[2] = { shapes[w].first, shapes[w].second };
+            size_t ndRangeSize[2] = { (size_t)roundUp(n, workGroupSize[0]), (size_t)roundUp(n, workGroupSize[1]) };
+            vector<double> times;
+            if(!measure(ctx, kernel, 2, ndRangeSize, workGroupSize, config, times))
+                return false;
+            addResult(results, "matrixScalar", n, workGroupSize[0], workGroupSize[1], times, 2.0 * bytes, (double)n * n);
+        }
+
+        clReleaseMemObject(dA);
+        clReleaseMemObject(dB);
+    }
+
+    clReleaseKernel(kernel);
+    return true;
+}
+
+/// transpose y transposeShMem (example2): B = transpose(A), matrices de n * n
+static bool benchTranspose(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "transpose", "transposeShMem" };
+    static const size_t defaults[] = { 512, 1024, 2048, 4096 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 4);
+
+    for(int k=0; k<2; k++) {
+        if(!selected(config, kernelNames[k]))
+            continue;
+
+        cl_kernel kernel;
+        if(!loadKernel(ctx.context, &kernel, ctx.device, EXAMPLES_DIR "example2/src/matrixtranspose.cl", kernelNames[k]))
+            return false;
+
+        // transposeShMem exige work-groups de 16 x 16 (reqd_work_group_size)
+        const bool withSharedMemory= k == 1;
+        vector<pair<size_t, size_t> > shapes;
+        if(withSharedMemory)
+            shapes.push_back(make_pair(16, 16));
+        else
+            shapes= workGroupShapes2D(ctx, kernel);
+
+        for(size_t s=0; s<sizes.size(); s++) {
+            const int n= sizes[s];
+            const size_t bytes= (size_t)n * n * sizeof(float);
+            if(!fits(ctx, bytes, 2))
+                continue;
+
+            vector<float> hA;
+            randomFloats(hA, (size_t)n * n);
+            cl_int error1, error2;
+            cl_mem dA= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hA[0], &error1);
+            cl_mem dB= clCreateBuffer(ctx.context, CL_MEM_WRITE_ONLY, bytes, NULL, &error2);
+            if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+                return false;
+
+            cl_int error;
+            error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA);
+            error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dB);
+            error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&n);
+            if(withSharedMemory)
+                error |= clSetKernelArg(kernel, 3, 16 * 16 * sizeof(float), (void*)NULL);
+            if(checkError(error, "benchTranspose: clSetKernelArg"))
+                return false;
+
+            for(size_t w=0; w<shapes.size(); w++) {
+                size_t workGroupSize[2] = { shapes[w].first, shapes[w].second };
+                size_t ndRangeSize[2] = { (size_t)roundUp(n, workGroupSize[0]), (size_t)roundUp(n, workGroupSize[1]) };
+                vector<double> times;
+                if(!measure(ctx, kernel, 2, ndRangeSize, workGroupSize, config, times))
+                    return false;
+                addResult(results, kernelNames[k], n, workGroupSize[0], workGroupSize[1], times, 2.0 * bytes, (double)n * n);
+            }
+
+            clReleaseMemObject(dA);
+            clReleaseMemObject(dB);
+        }
+
+        clReleaseKernel(kernel);
+    }
+    return true;
+}
+
+// Como measure, pero encolando con engine: la transpuesta de dA en dB, o de dA en el
+// lugar si inPlace (cada ejecucion transpone de nuevo la matriz, lo que no cambia el tiempo)
+static bool measureTranspose(const BenchContext& ctx, TransposeEngine& engine, bool inPlace, cl_mem dA, cl_mem dB,
+                             int n, const BenchConfig& config, vector<double>& times)
+{
+    times.clear();
+    for(int t=0; t<config.warmup + config.trials; t++) {
+        cl_event event;
+        const bool queued= inPlace ? engine.enqueueTransposeInPlace(ctx.queue, dA, n, &event)
+                                   : engine.enqueueTranspose(ctx.queue, dA, dB, n, n, &event);
+        if(!queued)
+            return false;
+        cl_int error= clWaitForEvents(1, &event);
+        if(checkError(error, "measureTranspose: clWaitForEvents"))
+            return false;
+        if(t >= config.warmup)
+            times.push_back(eventElapsed(event));
+        clReleaseEvent(event);
+    }
+    return true;
+}
+
+/// transposeTiled y transposeInPlace (common/transpose.cl): B = transpose(A) y A = transpose(A)
+/// con tiles de tileDim x tileDim en memoria local y work-groups de tileDim x blockRows
+static bool benchTransposeTiled(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "transposeTiled", "transposeInPlace" };
+    // El tamanio del tile se fija al compilar, asi que cada forma es una compilacion distinta
+    static const int tiles[][2] = { {16, 4}, {16, 16}, {32, 4}, {32, 8}, {32, 16} };
+    static const size_t defaults[] = { 512, 1024, 2048, 4096 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 4);
+
+    for(int k=0; k<2; k++) {
+        if(!selected(config, kernelNames[k]))
+            continue;
+        const bool inPlace= k == 1;
+
+        for(size_t c=0; c<sizeof(tiles) / sizeof(tiles[0]); c++) {
+            TransposeEngine engine;
+            if(!engine.init(ctx.context, ctx.device, tiles[c][0], tiles[c][1], EXAMPLES_DIR "common/transpose.cl"))
+                return false;
+            // Si el dispositivo no admite la forma, init reduce blockRows y puede repetir una anterior
+            if(engine.getBlockRows() != tiles[c][1])
+                continue;
+
+            for(size_t s=0; s<sizes.size(); s++) {
+                const int n= sizes[s];
+                const size_t bytes= (size_t)n * n * sizeof(float);
+                if(!fits(ctx, bytes, inPlace ? 1 : 2))
+                    continue;
+
+                vector<float> hA;
+                randomFloats(hA, (size_t)n * n);
+                cl_int error1, error2= CL_SUCCESS;
+                cl_mem dA= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, &hA[0], &error1);
+                cl_mem dB= inPlace ? NULL : clCreateBuffer(ctx.context, CL_MEM_WRITE_ONLY, bytes, NULL, &error2);
+                if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+                    return false;
+
+                vector<double> times;
+                if(!measureTranspose(ctx, engine, inPlace, dA, dB, n, config, times))
+                    return false;
+                // En ambos casos cada elemento se lee y se escribe una vez
+                addResult(results, kernelNames[k], n, engine.getTileDim(), engine.getBlockRows(), times, 2.0 * bytes, (double)n * n);
+
+                clReleaseMemObject(dA);
+                if(dB)
+                    clReleaseMemObject(dB);
+            }
+        }
+    }
+    return true;
+}
+
+/// transposeBatched (common/transpose.cl): lote de matrices chicas de n * n en un solo
+/// NDRange, comparado con un kernel por matriz (transposeLoop, cada matriz en su buffer)
+/// Se mide el tiempo de host de punta a punta (encolar todo y clFinish), que incluye el
+/// costo de lanzar cada kernel.
+static bool benchTransposeBatched(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const bool batched= selected(config, "transposeBatched");
+    const bool loop= selected(config, "transposeLoop");
+    if(!batched and !loop)
+        return true;
+
+    TransposeEngine engine;
+    if(!engine.init(ctx.context, ctx.device, 32, 8, EXAMPLES_DIR "common/transpose.cl"))
+        return false;
+
+    static const size_t defaults[] = { 32, 64, 128, 256 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 4);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t matrixBytes= (size_t)n * n * sizeof(float);
+        // Lote de hasta 4096 matrices y 64 MiB
+        const int batch= (int)max((size_t)1, min((size_t)4096, ((size_t)64 << 20) / matrixBytes));
+        const size_t bytes= batch * matrixBytes;
+        if(!fits(ctx, bytes, 2))
+            continue;
+
+        vector<float> hA;
+        randomFloats(hA, (size_t)n * n * batch);
+        vector<double> times;
+
+        if(batched) {
+            cl_int error1, error2;
+            cl_mem dA= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hA[0], &error1);
+            cl_mem dB= clCreateBuffer(ctx.context, CL_MEM_WRITE_ONLY, bytes, NULL, &error2);
+            if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+                return false;
+
+            times.clear();
+            for(int t=0; t<config.warmup + config.trials; t++) {
+                const double start= hostTimeMs();
+                if(!engine.enqueueTransposeBatched(ctx.queue, dA, dB, n, n, batch))
+                    return false;
+                cl_int error= clFinish(ctx.queue);
+                if(checkError(error, "benchTransposeBatched: clFinish"))
+                    return false;
+                if(t >= config.warmup)
+                    times.push_back(hostTimeMs() - start);
+            }
+            addResult(results, "transposeBatched", n, engine.getTileDim(), engine.getBlockRows(), times,
+                      2.0 * bytes, (double)n * n * batch);
+
+            clReleaseMemObject(dA);
+            clReleaseMemObject(dB);
+        }
+
+        if(loop) {
+            // Como en example2: un par de buffers y un kernel por matriz
+            vector<cl_mem> dA(batch), dB(batch);
+            for(int m=0; m<batch; m++) {
+                cl_int error1, error2;
+                dA[m]= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, matrixBytes,
+                                      &hA[(size_t)m * n * n], &error1);
+                dB[m]= clCreateBuffer(ctx.context, CL_MEM_WRITE_ONLY, matrixBytes, NULL, &error2);
+                if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+                    return false;
+            }
+
+            times.clear();
+            for(int t=0; t<config.warmup + config.trials; t++) {
+                const double start= hostTimeMs();
+                for(int m=0; m<batch; m++)
+                    if(!engine.enqueueTranspose(ctx.queue, dA[m], dB[m], n, n))
+                        return false;
+                cl_int error= clFinish(ctx.queue);
+                if(checkError(error, "benchTransposeBatched: clFinish"))
+                    return false;
+                if(t >= config.warmup)
+                    times.push_back(hostTimeMs() - start);
+            }
+            addResult(results, "transposeLoop", n, engine.getTileDim(), engine.getBlockRows(), times,
+                      2.0 * bytes, (double)n * n * batch);
+
+            for(int m=0; m<batch; m++) {
+                clReleaseMemObject(dA[m]);
+                clReleaseMemObject(dB[m]);
+            }
+        }
+
+        if(batched and loop) {
+            const double speedup= results[results.size() - 1].medianMs / results[results.size() - 2].medianMs;
+            cerr << "  " << batch << " matrices de " << n << "x" << n << ": el lote es "
+                 << fixed << setprecision(1) << speedup << "x mas rapido que un kernel por matriz." << endl;
+        }
+    }
+    return true;
+}
+
+// Encola la operacion op de elementwise sobre buffers[0..3] de n elementos
+static bool enqueueElementwise(const BenchContext& ctx, Elementwise& elementwise, int op, cl_mem* buffers, int n, cl_event* event)
+{
+    switch(op) {
+    case 0: return elementwise.enqueueScale(ctx.queue, buffers[0], buffers[1], 2.0f, n, event);
+    case 1: return elementwise.enqueueAxpy(ctx.queue, 2.0f, buffers[0], buffers[1], n, event);
+    case 2: return elementwise.enqueueAdd(ctx.queue, buffers[0], buffers[1], buffers[2], n, event);
+    case 3: return elementwise.enqueueMul(ctx.queue, buffers[0], buffers[1], buffers[2], n, event);
+    case 4: return elementwise.enqueueFma(ctx.queue, buffers[0], buffers[1], buffers[2], buffers[3], n, event);
+    default: return elementwise.enqueueClamp(ctx.queue, buffers[0], buffers[1], 0.25f, 0.75f, n, event);
+    }
+}
+
+/// Operaciones elemento a elemento (common/elementwise.cl) sobre n floats, para cada ancho
+/// de vector. En la columna param se muestra el ancho de vector.
+static bool benchElementwise(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "vectorScale", "vectorAxpy", "vectorAdd", "vectorMul", "vectorFma", "vectorClamp" };
+    // Buffers leidos + escritos por elemento (axpy lee y escribe Y)
+    const int accesses[] = { 2, 3, 3, 3, 4, 2 };
+    const int opCount= 6;
+    bool any= false;
+    for(int op=0; op<opCount; op++)
+        any= any or selected(config, kernelNames[op]);
+    if(!any)
+        return true;
+
+    // 1M + 3, 4M + 1 y 16M elementos: los dos primeros tienen cola
+    static const size_t defaults[] = { (1 << 20) + 3, (1 << 22) + 1, 1 << 24 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(int width=1; width<=16; width*=2) {
+        Elementwise elementwise;
+        if(!elementwise.init(ctx.context, ctx.device, width, EXAMPLES_DIR "common/elementwise.cl"))
+            return false;
+
+        for(size_t s=0; s<sizes.size(); s++) {
+            const int n= sizes[s];
+            const size_t bytes= (size_t)n * sizeof(float);
+            if(!fits(ctx, bytes, 4))
+                continue;
+
+            vector<float> hData;
+            randomFloats(hData, n);
+            cl_mem buffers[4];
+            for(int b=0; b<4; b++) {
+                cl_int error;
+                buffers[b]= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error);
+                if(checkError(error, "clCreateBuffer"))
+                    return false;
+            }
+
+            for(int op=0; op<opCount; op++) {
+                if(!selected(config, kernelNames[op]))
+                    continue;
+                vector<double> times;
+                for(int t=0; t<config.warmup + config.trials; t++) {
+                    cl_event event;
+                    if(!enqueueElementwise(ctx, elementwise, op, buffers, n, &event))
+                        return false;
+                    cl_int error= clWaitForEvents(1, &event);
+                    if(checkError(error, "benchElementwise: clWaitForEvents"))
+                        return false;
+                    if(t >= config.warmup)
+                        times.push_back(eventElapsed(event));
+                    clReleaseEvent(event);
+                }
+                addResult(results, kernelNames[op], n, 0, 0, times, (double)accesses[op] * bytes, n, benchParam("vec", width));
+            }
+
+            for(int b=0; b<4; b++)
+                clReleaseMemObject(buffers[b]);
+        }
+    }
+    return true;
+}
+
+// Tiempo de host (ms) de cada una de las config.trials ejecuciones de la cadena de
+// operaciones chain (0: scale, add, clamp; 1: scale, add, mul, fma, clamp) sobre
+// buffers[0..2] con salida en out, fusionada en un kernel o paso a paso con Elementwise
+// (usando tmp como intermedio)
+static bool measureChain(const BenchContext& ctx, Elementwise& elementwise, int chain, bool fused,
+                         cl_mem* buffers, cl_mem tmp, cl_mem out, int n, const BenchConfig& config, vector<double>& times)
+{
+    FusedExpr expr;
+    if(chain == 0)
+        expr.scale(2.0f).add(buffers[1]).clamp(0.25f, 1.75f);
+    else
+        expr.scale(2.0f).add(buffers[1]).mul(buffers[2]).fma(buffers[1], buffers[2]).clamp(0.25f, 1.75f);
+
+    times.clear();
+    for(int t=0; t<config.warmup + config.trials; t++) {
+        const double start= hostTimeMs();
+        bool queued;
+        if(fused) {
+            queued= expr.enqueue(ctx.queue, buffers[0], out, n);
+        } else if(chain == 0) {
+            queued= elementwise.enqueueScale(ctx.queue, buffers[0], tmp, 2.0f, n) and
+                    elementwise.enqueueAdd(ctx.queue, tmp, buffers[1], tmp, n) and
+                    elementwise.enqueueClamp(ctx.queue, tmp, out, 0.25f, 1.75f, n);
+        } else {
+            queued= elementwise.enqueueScale(ctx.queue, buffers[0], tmp, 2.0f, n) and
+                    elementwise.enqueueAdd(ctx.queue, tmp, buffers[1], tmp, n) and
+                    elementwise.enqueueMul(ctx.queue, tmp, buffers[2], tmp, n) and
+                    elementwise.enqueueFma(ctx.queue, tmp, buffers[1], buffers[2], tmp, n) and
+                    elementwise.enqueueClamp(ctx.queue, tmp, out, 0.25f, 1.75f, n);
+        }
+        if(!queued)
+            return false;
+        cl_int error= clFinish(ctx.queue);
+        if(checkError(error, "measureChain: clFinish"))
+            return false;
+        if(t >= config.warmup)
+            times.push_back(hostTimeMs() - start);
+    }
+    return true;
+}
+
+/// Cadenas de operaciones elemento a elemento fusionadas en un kernel generado (FusedExpr)
+/// contra un kernel de Elementwise por operacion. Los GB/s se calculan en ambos casos con
+/// los bytes minimos (cada buffer distinto leido una vez y la salida escrita una vez), asi
+/// que muestran cuanto del ancho de banda se aprovecha.
+static bool benchFusion(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* fusedNames[] = { "fusedChain3", "fusedChain5" };
+    const char* stepNames[] = { "stepChain3", "stepChain5" };
+    // Buffers distintos leidos por cada cadena
+    const int inputs[] = { 2, 3 };
+
+    Elementwise elementwise;
+    if(!elementwise.init(ctx.context, ctx.device, 0, EXAMPLES_DIR "common/elementwise.cl"))
+        return false;
+
+    static const size_t defaults[] = { 1 << 20, 1 << 22, 1 << 24 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(int chain=0; chain<2; chain++) {
+        const bool fused= selected(config, fusedNames[chain]);
+        const bool stepwise= selected(config, stepNames[chain]);
+        if(!fused and !stepwise)
+            continue;
+
+        for(size_t s=0; s<sizes.size(); s++) {
+            const int n= sizes[s];
+            const size_t bytes= (size_t)n * sizeof(float);
+            if(!fits(ctx, bytes, 6))
+                continue;
+
+            cl_mem buffers[5];
+            for(int b=0; b<5; b++) {
+                vector<float> hData;
+                randomFloats(hData, n);
+                cl_int error;
+                buffers[b]= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error);
+                if(checkError(error, "clCreateBuffer"))
+                    return false;
+            }
+            // buffers[0..2]: entradas, buffers[3]: intermedio, buffers[4]: salida
+            const double totalBytes= (double)(inputs[chain] + 1) * bytes;
+
+            vector<double> times;
+            if(fused) {
+                if(!measureChain(ctx, elementwise, chain, true, buffers, buffers[3], buffers[4], n, config, times))
+                    return false;
+                addResult(results, fusedNames[chain], n, 0, 0, times, totalBytes, n, benchParam("vec", elementwise.getVectorWidth()));
+            }
+            vector<float> fusedOut;
+            cl_int error;
+            if(fused and stepwise) {
+                fusedOut.resize(n);
+                error= clEnqueueReadBuffer(ctx.queue, buffers[4], CL_TRUE, 0, bytes, &fusedOut[0], 0, NULL, NULL);
+                if(checkError(error, "benchFusion: clEnqueueReadBuffer"))
+                    return false;
+            }
+
+            if(stepwise) {
+                if(!measureChain(ctx, elementwise, chain, false, buffers, buffers[3], buffers[4], n, config, times))
+                    return false;
+                addResult(results, stepNames[chain], n, 0, 0, times, totalBytes, n, benchParam("vec", elementwise.getVectorWidth()));
+            }
+
+            if(fused and stepwise) {
+                // Sin contraccion de fma ambos caminos deben dar el mismo resultado bit a bit
+                vector<float> stepOut(n);
+                error= clEnqueueReadBuffer(ctx.queue, buffers[4], CL_TRUE, 0, bytes, &stepOut[0], 0, NULL, NULL);
+                if(checkError(error, "benchFusion: clEnqueueReadBuffer"))
+                    return false;
+                size_t errorCount= 0;
+                for(int i=0; i<n; i++)
+                    if(fusedOut[i] != stepOut[i])
+                        errorCount++;
+                const double speedup= results[results.size() - 1].medianMs / results[results.size() - 2].medianMs;
+                cerr << "  fusionado " << fixed << setprecision(1) << speedup << "x mas rapido, ";
+                if(!errorCount)
+                    cerr << "mismo resultado." << endl;
+                else
+                    cerr << errorCount << " elementos distintos." << endl;
+            }
+
+            for(int b=0; b<5; b++)
+                clReleaseMemObject(buffers[b]);
+        }
+    }
+    releaseFusedKernels();
+    return true;
+}
+
+/// Reducciones (common/reduce.cl) de n ints o floats: las dos pasadas se miden juntas.
+/// En la columna param se muestra el tipo de los datos.
+static bool benchReduce(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "reduceSum", "reduceMin", "reduceMax", "reduceCountEq", "reduceArgMax" };
+    const ReduceOp ops[] = { REDUCE_SUM, REDUCE_MIN, REDUCE_MAX, REDUCE_COUNT_EQUAL, REDUCE_ARGMAX };
+    const int opCount= 5;
+    bool any= false;
+    for(int o=0; o<opCount; o++)
+        any= any or selected(config, kernelNames[o]);
+    if(!any)
+        return true;
+
+    Reduction reduction;
+    if(!reduction.init(ctx.context, ctx.device, EXAMPLES_DIR "common/reduce.cl"))
+        return false;
+
+    static const size_t defaults[] = { 1 << 20, 1 << 24, 100000000 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * 4;
+        if(!fits(ctx, bytes, 1))
+            continue;
+
+        // Los mismos bits sirven como int y como float (floats entre 0 y 1)
+        vector<float> hData;
+        randomFloats(hData, n);
+        cl_int error;
+        cl_mem dData= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error);
+        if(checkError(error, "clCreateBuffer"))
+            return false;
+
+        for(int type=0; type<REDUCE_TYPE_COUNT; type++) {
+            for(int o=0; o<opCount; o++) {
+                if(!selected(config, kernelNames[o]))
+                    continue;
+                const void* value= &hData[0];
+                char result[8];
+                vector<double> times;
+                for(int t=0; t<config.warmup + config.trials; t++) {
+                    cl_event partialEvent, finalEvent;
+                    if(!reduction.reduce(ctx.queue, ops[o], (ReduceType)type, dData, n, result, value, &partialEvent, &finalEvent))
+                        return false;
+                    if(t >= config.warmup)
+                        times.push_back(eventElapsed(partialEvent) + eventElapsed(finalEvent));
+                    clReleaseEvent(partialEvent);
+                    clReleaseEvent(finalEvent);
+                }
+                addResult(results, kernelNames[o], n, 0, 0, times, bytes, n, type == REDUCE_FLOAT ? "type=float" : "type=int");
+            }
+        }
+
+        clReleaseMemObject(dData);
+    }
+    return true;
+}
+
+/// Scan exclusivo e inclusivo de n ints (common/scan.cl), con todos los niveles y
+/// addBlockOffsets medidos juntos con tiempo de host. En la columna param se
+/// muestran los elementos por bloque.
+static bool benchScan(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "scanExclusive", "scanInclusive" };
+    if(!selected(config, kernelNames[0]) and !selected(config, kernelNames[1]))
+        return true;
+
+    Scan scan;
+    if(!scan.init(ctx.context, ctx.device, EXAMPLES_DIR "common/scan.cl"))
+        return false;
+
+    static const size_t defaults[] = { 1 << 20, 1 << 24, 100000000 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * sizeof(cl_int);
+        if(!fits(ctx, bytes, 2))
+            continue;
+
+        vector<cl_int> hData(n);
+        for(int i=0; i<n; i++)
+            hData[i]= rand() % 16;
+        cl_int error1, error2;
+        cl_mem dIn= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error1);
+        cl_mem dOut= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, bytes, NULL, &error2);
+        if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+            return false;
+
+        for(int inclusive=0; inclusive<2; inclusive++) {
+            if(!selected(config, kernelNames[inclusive]))
+                continue;
+            vector<double> times;
+            for(int t=0; t<config.warmup + config.trials; t++) {
+                const double start= hostTimeMs();
+                if(!scan.enqueueScan(ctx.queue, dIn, dOut, n, inclusive))
+                    return false;
+                cl_int error= clFinish(ctx.queue);
+                if(checkError(error, "benchScan: clFinish"))
+                    return false;
+                if(t >= config.warmup)
+                    times.push_back(hostTimeMs() - start);
+            }
+
+            // Verificacion contra el scan en el CPU
+            vector<cl_int> hOut(n);
+            cl_int error= clEnqueueReadBuffer(ctx.queue, dOut, CL_TRUE, 0, bytes, &hOut[0], 0, NULL, NULL);
+            if(checkError(error, "benchScan: clEnqueueReadBuffer"))
+                return false;
+            size_t errorCount= 0;
+            cl_int sum= 0;
+            for(int i=0; i<n; i++) {
+                if(inclusive)
+                    sum+= hData[i];
+                if(hOut[i] != sum)
+                    errorCount++;
+                if(!inclusive)
+                    sum+= hData[i];
+            }
+
+            // Se lee la entrada y se escribe la salida; los niveles de sumas son despreciables
+            addResult(results, kernelNames[inclusive], n, scan.getBlockSize() / 2, 1, times, 2.0 * bytes, n,
+                      benchParam("block", scan.getBlockSize()));
+            if(errorCount)
+                cerr << "  " << errorCount << " elementos erroneos." << endl;
+        }
+
+        clReleaseMemObject(dIn);
+        clReleaseMemObject(dOut);
+    }
+    return true;
+}
+
+/// Compactacion (common/scan.cl) de los indices de los ints iguales a un valor que
+/// aparece con probabilidad 1/2, medida con tiempo de host incluyendo la lectura de
+/// la cantidad
+static bool benchCompact(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    if(!selected(config, "compact"))
+        return true;
+
+    Scan scan;
+    if(!scan.init(ctx.context, ctx.device, EXAMPLES_DIR "common/scan.cl"))
+        return false;
+
+    static const size_t defaults[] = { 1 << 20, 1 << 24, 100000000 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * sizeof(cl_int);
+        if(!fits(ctx, bytes, 3))
+            continue;
+
+        vector<cl_int> hData(n);
+        for(int i=0; i<n; i++)
+            hData[i]= rand() % 2;
+        const cl_int value= 1;
+        cl_int error1, error2;
+        cl_mem dData= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error1);
+        cl_mem dIndices= clCreateBuffer(ctx.context, CL_MEM_WRITE_ONLY, bytes, NULL, &error2);
+        if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+            return false;
+
+        int count= 0;
+        vector<double> times;
+        for(int t=0; t<config.warmup + config.trials; t++) {
+            const double start= hostTimeMs();
+            if(!scan.compact(ctx.queue, COMPACT_INT, COMPACT_EQUAL, dData, n, &value, NULL, dIndices, count))
+                return false;
+            if(t >= config.warmup)
+                times.push_back(hostTimeMs() - start);
+        }
+
+        // Dos lecturas de data, escritura de las posiciones y de los indices
+        addResult(results, "compact", n, scan.getBlockSize() / 2, 1, times, (3.0 * n + count) * sizeof(cl_int), n,
+                  benchParam("block", scan.getBlockSize()));
+
+        clReleaseMemObject(dData);
+        clReleaseMemObject(dIndices);
+    }
+    return true;
+}
+
+/// Histograma de 256 bins (common/histogram.cl) de n ints con distintos sesgos: una
+/// fraccion de los elementos (0, 10, 40, 90 y 100 %) es un mismo valor y el resto es
+/// uniforme. Se compara una replica por work-group con las replicas automaticas. En
+/// la columna param se muestran las replicas y el porcentaje del valor repetido.
+static bool benchHistogram(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    if(!selected(config, "histogram"))
+        return true;
+
+    const int bins= 256;
+    const cl_int lo= 0, hi= 1 << 20;
+    const int skews[] = { 0, 10, 40, 90, 100 };
+    Histogram histograms[2];
+    if(!histograms[0].init(ctx.context, ctx.device, bins, 1, EXAMPLES_DIR "common/histogram.cl") or
+       !histograms[1].init(ctx.context, ctx.device, bins, 0, EXAMPLES_DIR "common/histogram.cl"))
+        return false;
+
+    static const size_t defaults[] = { 1 << 20, 1 << 24, 100000000 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * sizeof(cl_int);
+        if(!fits(ctx, bytes, 1))
+            continue;
+
+        for(int k=0; k<5; k++) {
+            vector<cl_int> hData(n);
+            for(int i=0; i<n; i++)
+                hData[i]= rand() % 100 < skews[k] ? hi / 3 : rand() % hi;
+            cl_int error;
+            cl_mem dData= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error);
+            if(checkError(error, "clCreateBuffer"))
+                return false;
+
+            for(int h=0; h<2; h++) {
+                vector<cl_uint> result(bins);
+                vector<double> times;
+                for(int t=0; t<config.warmup + config.trials; t++) {
+                    cl_event partialEvent, mergeEvent;
+                    if(!histograms[h].histogram(ctx.queue, HISTOGRAM_INT, dData, n, &lo, &hi, &result[0],
+                                                &partialEvent, &mergeEvent))
+                        return false;
+                    if(t >= config.warmup)
+                        times.push_back(eventElapsed(partialEvent) + eventElapsed(mergeEvent));
+                    clReleaseEvent(partialEvent);
+                    clReleaseEvent(mergeEvent);
+                }
+                addResult(results, "histogram", n, 0, 0, times, bytes, n,
+                          benchParam("replicas", histograms[h].getReplicas()) + ";" + benchParam("skew", skews[k]));
+            }
+
+            clReleaseMemObject(dData);
+        }
+    }
+    return true;
+}
+
+/// Radix sort (common/radixsort.cl) de n ints aleatorios, solo claves y pares
+/// clave/valor, con digitos de 4 y de 8 bits, medido con tiempo de host sin la copia
+/// de los datos originales. En la columna param se muestran los bits del digito.
+static bool benchRadixSort(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "radixSort", "radixSortPairs" };
+    if(!selected(config, kernelNames[0]) and !selected(config, kernelNames[1]))
+        return true;
+
+    RadixSort radixSorts[2];
+    for(int r=0; r<2; r++)
+        if(!radixSorts[r].init(ctx.context, ctx.device, 4 * (r + 1), EXAMPLES_DIR "common/radixsort.cl",
+                               EXAMPLES_DIR "common/scan.cl"))
+            return false;
+
+    static const size_t defaults[] = { 1 << 20, 1 << 24, 100000000 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * sizeof(cl_int);
+        if(!fits(ctx, bytes, 5))
+            continue;
+
+        vector<cl_int> hData(n);
+        for(int i=0; i<n; i++)
+            hData[i]= rand() ^ (rand() << 16);
+        cl_int error1, error2, error3;
+        cl_mem dData= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error1);
+        cl_mem dKeys= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, bytes, NULL, &error2);
+        cl_mem dValues= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, bytes, NULL, &error3);
+        if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer") or
+           checkError(error3, "clCreateBuffer"))
+            return false;
+
+        for(int withValues=0; withValues<2; withValues++) {
+            if(!selected(config, kernelNames[withValues]))
+                continue;
+            for(int r=0; r<2; r++) {
+                vector<double> times;
+                for(int t=0; t<config.warmup + config.trials; t++) {
+                    cl_int error= clEnqueueCopyBuffer(ctx.queue, dData, dKeys, 0, 0, bytes, 0, NULL, NULL);
+                    error |= clFinish(ctx.queue);
+                    if(checkError(error, "benchRadixSort: clEnqueueCopyBuffer"))
+                        return false;
+                    const double start= hostTimeMs();
+                    if(!radixSorts[r].enqueueSort(ctx.queue, dKeys, withValues ? dValues : NULL, n))
+                        return false;
+                    error= clFinish(ctx.queue);
+                    if(checkError(error, "benchRadixSort: clFinish"))
+                        return false;
+                    if(t >= config.warmup)
+                        times.push_back(hostTimeMs() - start);
+                }
+
+                // Cada pasada lee las claves dos veces y escribe claves y valores una vez
+                const int passes= 32 / radixSorts[r].getRadixBits();
+                const double bytesPerPass= (3.0 + 2 * withValues) * bytes;
+                addResult(results, kernelNames[withValues], n, 0, 0, times, passes * bytesPerPass, n,
+                          benchParam("bits", radixSorts[r].getRadixBits()));
+            }
+        }
+
+        clReleaseMemObject(dData);
+        clReleaseMemObject(dKeys);
+        clReleaseMemObject(dValues);
+    }
+    return true;
+}
+
+/// fdmHeat (example3): un paso de Jacobi sobre una imagen de n * n
+static bool benchFdmHeat(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    if(!selected(config, "fdmHeat"))
+        return true;
+    if(!ctx.info.imageSupport) {
+        cerr << "fdmHeat: el dispositivo no soporta imagenes, se omite." << endl;
+        return true;
+    }
+
+    cl_kernel kernel;
+    if(!loadKernel(ctx.context, &kernel, ctx.device, EXAMPLES_DIR "example3/src/fdmHeat.cl", "fdmHeat"))
+        return false;
+
+    static const size_t defaults[] = { 512, 1024, 2048, 4096 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 4);
+    const vector<pair<size_t, size_t> > shapes= workGroupShapes2D(ctx, kernel);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * n * sizeof(float);
+        if(!fits(ctx, bytes, 2))
+            continue;
+
+        vector<float> hData;
+        randomFloats(hData, (size_t)n * n);
+        cl_image_format format;
+        format.image_channel_data_type= CL_FLOAT;
+        format.image_channel_order= CL_INTENSITY;
+        cl_int error1, error2;
+        cl_mem dData1= clCreateImage2D(ctx.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &format, n, n, 0, &hData[0], &error1);
+        cl_mem dData2= clCreateImage2D(ctx.context, CL_MEM_READ_WRITE, &format, n, n, 0, NULL, &error2);
+        if(checkError(error1, "clCreateImage2D") or checkError(error2, "clCreateImage2D"))
+            return false;
+
+        cl_int error;
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dData1);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dData2);
+        if(checkError(error, "benchFdmHeat: clSetKernelArg"))
+            return false;
+
+        for(size_t w=0; w<shapes.size(); w++) {
+            size_t workGroupSize[2] = { shapes[w].first, shapes[w].second };
+            size_t ndRangeSize[2] = { (size_t)roundUp(n, workGroupSize[0]), (size_t)roundUp(n, workGroupSize[1]) };
+            vector<double> times;
+            if(!measure(ctx, kernel, 2, ndRangeSize, workGroupSize, config, times))
+                return false;
+            // Ancho de banda efectivo: cada celda se lee y se escribe una vez (las lecturas
+            // de los vecinos se resuelven en la cache de texturas)
+            addResult(results, "fdmHeat", n, workGroupSize[0], workGroupSize[1], times, 2.0 * bytes, (double)n * n);
+        }
+
+        clReleaseMemObject(dData1);
+        clReleaseMemObject(dData2);
+    }
+
+    clReleaseKernel(kernel);
+    return true;
+}
+
+/// fdmHeatBlocked (example3): k pasos de Jacobi por ejecucion con el tile y su halo
+/// en memoria local, para k = 2, 4 y 8, con work-groups de 16x16 y varias celdas por
+/// work-item. El tiempo es el de una ejecucion (k pasos). En la columna param se
+/// muestran los pasos por ejecucion, las celdas por work-item y la reduccion del
+/// trafico con memoria global respecto de k ejecuciones de fdmHeat.
+static bool benchFdmHeatBlocked(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    if(!selected(config, "fdmHeatBlocked"))
+        return true;
+    if(!ctx.info.imageSupport) {
+        cerr << "fdmHeatBlocked: el dispositivo no soporta imagenes, se omite." << endl;
+        return true;
+    }
+
+    const size_t tileX= 16;
+    const size_t tileY= ctx.info.maxWorkGroupSize >= 256 ? 16 : 8;
+    const int stepCounts[] = { 2, 4, 8 };
+    static const size_t defaults[] = { 512, 1024, 2048, 4096 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 4);
+    for(int k=0; k<3; k++) {
+        const cl_int steps= stepCounts[k];
+        FDMBlockedConfig blocked;
+        if(!blocked.init(steps, tileX, tileY, ctx.info.localMemSize)) {
+            cerr << "fdmHeatBlocked: el tile con " << steps << " pasos no entra en la memoria local, se omite." << endl;
+            continue;
+        }
+        cl_program program;
+        if(!loadProgram(ctx.context, &program, ctx.device, EXAMPLES_DIR "example3/src/fdmHeat.cl", blocked.options().c_str()))
+            return false;
+        cl_int error;
+        cl_kernel kernel= clCreateKernel(program, "fdmHeatBlocked", &error);
+        if(checkError(error, "clCreateKernel"))
+            return false;
+
+        for(size_t s=0; s<sizes.size(); s++) {
+            const int n= sizes[s];
+            const size_t bytes= (size_t)n * n * sizeof(float);
+            if(!fits(ctx, bytes, 2))
+                continue;
+
+            vector<float> hData;
+            randomFloats(hData, (size_t)n * n);
+            cl_image_format format;
+            format.image_channel_data_type= CL_FLOAT;
+            format.image_channel_order= CL_INTENSITY;
+            cl_int error1, error2;
+            cl_mem dData1= clCreateImage2D(ctx.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &format, n, n, 0, &hData[0], &error1);
+            cl_mem dData2= clCreateImage2D(ctx.context, CL_MEM_READ_WRITE, &format, n, n, 0, NULL, &error2);
+            if(checkError(error1, "clCreateImage2D") or checkError(error2, "clCreateImage2D"))
+                return false;
+
+            error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dData1);
+            error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dData2);
+            error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&steps);
+            if(checkError(error, "benchFdmHeatBlocked: clSetKernelArg"))
+                return false;
+
+            size_t workGroupSize[2] = { tileX, tileY };
+            size_t ndRangeSize[2];
+            blocked.ndRange(n, n, ndRangeSize);
+            vector<double> times;
+            if(!measure(ctx, kernel, 2, ndRangeSize, workGroupSize, config, times))
+                return false;
+            // Cada celda se escribe una vez por ejecucion y se lee una vez mas la parte
+            // del halo de su tile
+            ostringstream param;
+            param << "steps=" << steps << ";cells=" << blocked.cells << ";traffic=1/" << setprecision(3)
+                  << blocked.trafficReduction();
+            addResult(results, "fdmHeatBlocked", n, tileX, tileY, times, (blocked.readsPerWrite() + 1.0) * bytes,
+                      (double)n * n * steps, param.str());
+
+            clReleaseMemObject(dData1);
+            clReleaseMemObject(dData2);
+        }
+
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+    }
+    return true;
+}
+
+// Resuelve en el dispositivo el sistema de example3 de n * n celdas con la fila
+// superior a 1 y el resto a 0 con Jacobi (solver 0, fdmHeat sobre dos imagenes),
+// Gauss-Seidel (1), SOR (2, fdmHeatRedBlack sobre un buffer) o V-cycles de
+// multigrid (3, sobre un buffer) hasta que el residuo maximo sea menor a tolerance,
+// midiendolo cada 50 iteraciones (cada ciclo con multigrid) como en example3. Devuelve en iterations las iteraciones hechas y en elapsed el tiempo de
+// host en ms, sin la subida del estado inicial.
+// Devuelve false en caso de error
+static bool solveHeat(const BenchContext& ctx, cl_kernel* kernels, Reduction& reduction, Multigrid& multigrid,
+                      int solver, int n, cl_mem* dData, cl_mem dResidual, float tolerance, int& iterations,
+                      double& elapsed)
+{
+    const int checkEvery= solver == 3 ? 1 : 50;
+    const int maxIterations= 2000000;
+    const bool jacobi= solver == 0;
+    cl_kernel kernel= kernels[jacobi ? 0 : 1];
+    cl_kernel residualKernel= kernels[jacobi ? 2 : 3];
+
+    vector<float> hData((size_t)n * n, 0.0f);
+    for(int x=0; x<n; x++)
+        hData[x]= 1.0f;
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)n, (size_t)n, 1};
+    cl_int error;
+    if(jacobi)
+        error= clEnqueueWriteImage(ctx.queue, dData[0], CL_TRUE, origin, region, 0, 0, &hData[0], 0, NULL, NULL);
+    else
+        error= clEnqueueWriteBuffer(ctx.queue, dData[0], CL_TRUE, 0, hData.size() * sizeof(float), &hData[0], 0, NULL, NULL);
+    if(checkError(error, "solveHeat: clEnqueueWrite"))
+        return false;
+
+    const float omega= solver == 2 ? 2.0f / (1.0f + sinf(M_PI / n)) : 1.0f;
+    const cl_int squared= 0;
+    error= CL_SUCCESS;
+    if(solver == 1 or solver == 2) {
+        error |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dData[0]);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_int), (void*)&n);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&n);
+        error |= clSetKernelArg(kernel, 4, sizeof(cl_float), (void*)&omega);
+    }
+    if(!jacobi) {
+        error |= clSetKernelArg(residualKernel, 0, sizeof(cl_mem), (void*)&dData[0]);
+        error |= clSetKernelArg(residualKernel, 1, sizeof(cl_int), (void*)&n);
+        error |= clSetKernelArg(residualKernel, 2, sizeof(cl_int), (void*)&n);
+        error |= clSetKernelArg(residualKernel, 3, sizeof(cl_mem), (void*)&dResidual);
+        error |= clSetKernelArg(residualKernel, 4, sizeof(cl_int), (void*)&squared);
+    } else {
+        error |= clSetKernelArg(residualKernel, 2, sizeof(cl_mem), (void*)&dResidual);
+        error |= clSetKernelArg(residualKernel, 3, sizeof(cl_int), (void*)&squared);
+    }
+    if(checkError(error, "solveHeat: clSetKernelArg"))
+        return false;
+
+    const size_t workGroupSize[2] = { 16, 8 };
+    const size_t ndRangeSize[2] = { (size_t)roundUp(jacobi ? n : (n + 1) / 2, 16), (size_t)roundUp(n, 8) };
+    const size_t residualRange[2] = { (size_t)roundUp(n, 16), (size_t)roundUp(n, 8) };
+    const double start= hostTimeMs();
+    float residual= tolerance;
+    int current= 0;
+    iterations= 0;
+    while(residual >= tolerance and iterations < maxIterations) {
+        for(int i=0; i<checkEvery; i++) {
+            if(jacobi) {
+                error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dData[current]);
+                error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dData[1 - current]);
+                error |= clEnqueueNDRangeKernel(ctx.queue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, NULL);
+                current= 1 - current;
+            } else if(solver == 3) {
+                if(!multigrid.enqueueVCycle(ctx.queue, dData[0]))
+                    return false;
+            } else {
+                // Los errores de las dos pasadas se acumulan y se verifican juntos
+                error= CL_SUCCESS;
+                for(cl_int color=0; color<2; color++) {
+                    error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&color);
+                    error |= clEnqueueNDRangeKernel(ctx.queue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, NULL);
+                }
+            }
+            if(checkError(error, "solveHeat: clEnqueueNDRangeKernel"))
+                return false;
+        }
+        iterations+= checkEvery;
+
+        // Con Jacobi, diferencia entre los dos ultimos pasos
+        if(jacobi) {
+            error  = clSetKernelArg(residualKernel, 0, sizeof(cl_mem), (void*)&dData[1 - current]);
+            error |= clSetKernelArg(residualKernel, 1, sizeof(cl_mem), (void*)&dData[current]);
+            if(checkError(error, "solveHeat: clSetKernelArg"))
+                return false;
+        }
+        error= clEnqueueNDRangeKernel(ctx.queue, residualKernel, 2, NULL, residualRange, workGroupSize, 0, NULL, NULL);
+        if(checkError(error, "solveHeat: clEnqueueNDRangeKernel") or
+           !reduction.reduce(ctx.queue, REDUCE_MAX, REDUCE_FLOAT, dResidual, n * n, &residual))
+            return false;
+    }
+    elapsed= hostTimeMs() - start;
+    return true;
+}
+
+// Verifica que los V-cycles de multigrid reduzcan el residuo maximo en el factor
+// esperado por ciclo (alrededor de 0.05) tambien con lados pares que no son 2^k + 1,
+// donde las grillas gruesas no coinciden con la mitad exacta de la fina. Parte de
+// un estado aleatorio con el borde en 0 y mide el factor medio del segundo y tercer
+// ciclo (el primero reduce mucho mas porque el error inicial es de alta frecuencia).
+// Devuelve false si el factor es mayor a maxRate o en caso de error
+static bool checkMultigridRate(const BenchContext& ctx, cl_kernel residualKernel, Reduction& reduction)
+{
+    const int width= 640, height= 480;
+    const float maxRate= 0.15f;
+    const size_t bytes= (size_t)width * height * sizeof(float);
+    if(!fits(ctx, bytes, 4))
+        return true;
+
+    Multigrid multigrid;
+    if(!multigrid.init(ctx.context, ctx.device, width, height, 2, 2, EXAMPLES_DIR "example3/src/multigrid.cl"))
+        return false;
+
+    vector<float> hData((size_t)width * height, 0.0f);
+    srand(17);
+    for(int y=1; y<height-1; y++)
+        for(int x=1; x<width-1; x++)
+            hData[x + y * width]= (float)rand()/RAND_MAX;
+    cl_int error1, error2;
+    cl_mem dData= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, &hData[0], &error1);
+    cl_mem dResidual= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, bytes, NULL, &error2);
+    if(checkError(error1, "checkMultigridRate: clCreateBuffer") or checkError(error2, "checkMultigridRate: clCreateBuffer"))
+        return false;
+
+    const cl_int squared= 0;
+    cl_int error= CL_SUCCESS;
+    error |= clSetKernelArg(residualKernel, 0, sizeof(cl_mem), (void*)&dData);
+    error |= clSetKernelArg(residualKernel, 1, sizeof(cl_int), (void*)&width);
+    error |= clSetKernelArg(residualKernel, 2, sizeof(cl_int), (void*)&height);
+    error |= clSetKernelArg(residualKernel, 3, sizeof(cl_mem), (void*)&dResidual);
+    error |= clSetKernelArg(residualKernel, 4, sizeof(cl_int), (void*)&squared);
+    if(checkError(error, "checkMultigridRate: clSetKernelArg"))
+        return false;
+
+    const size_t workGroupSize[2] = { 16, 8 };
+    const size_t residualRange[2] = { (size_t)roundUp(width, 16), (size_t)roundUp(height, 8) };
+    float residuals[4];
+    for(int cycle=0; cycle<4; cycle++) {
+        error= clEnqueueNDRangeKernel(ctx.queue, residualKernel, 2, NULL, residualRange, workGroupSize, 0, NULL, NULL);
+        if(checkError(error, "checkMultigridRate: clEnqueueNDRangeKernel") or
+           !reduction.reduce(ctx.queue, REDUCE_MAX, REDUCE_FLOAT, dResidual, width * height, &residuals[cycle]) or
+           !multigrid.enqueueVCycle(ctx.queue, dData))
+            return false;
+    }
+    clReleaseMemObject(dData);
+    clReleaseMemObject(dResidual);
+
+    const float rate= residuals[1] > 0 ? sqrtf(residuals[3] / residuals[1]) : 0.0f;
+    cerr << "  multigrid " << width << "x" << height << ": el residuo se reduce un factor " << fixed << setprecision(3)
+         << rate << " por V-cycle." << endl;
+    if(rate > maxRate) {
+        cerr << "checkMultigridRate: el factor es mayor a " << maxRate << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+/// Tiempo hasta la convergencia (residuo maximo < 1e-4) del sistema de example3 con
+/// Jacobi, Gauss-Seidel y SOR rojo-negro y multigrid. En la columna param se
+/// muestran las iteraciones (o V-cycles) hasta la convergencia; los elementos son las
+/// actualizaciones de celdas del nivel fino.
+static bool benchHeatSolvers(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "jacobiConverge", "gaussSeidelConverge", "sorConverge", "multigridConverge" };
+    if(!selected(config, kernelNames[0]) and !selected(config, kernelNames[1]) and !selected(config, kernelNames[2]) and
+       !selected(config, kernelNames[3]))
+        return true;
+    if(ctx.info.maxWorkGroupSize < 128) {
+        cerr << "heatSolvers: el dispositivo no soporta work-groups de 16x8, se omite." << endl;
+        return true;
+    }
+    // Solo Jacobi usa imagenes; los demas resuelven sobre un buffer
+    const bool jacobi= selected(config, kernelNames[0]) and ctx.info.imageSupport;
+    if(selected(config, kernelNames[0]) and !jacobi)
+        cerr << "jacobiConverge: el dispositivo no soporta imagenes, se omite." << endl;
+
+    // fdmHeat, fdmHeatRedBlack, fdmResidual y fdmResidualBuffer (los de imagenes solo con Jacobi)
+    const char* names[] = { "fdmHeat", "fdmHeatRedBlack", "fdmResidual", "fdmResidualBuffer" };
+    cl_kernel kernels[4] = { NULL, NULL, NULL, NULL };
+    for(int k=0; k<4; k++)
+        if((jacobi or k % 2) and !loadKernel(ctx.context, &kernels[k], ctx.device, EXAMPLES_DIR "example3/src/fdmHeat.cl", names[k]))
+            return false;
+    Reduction reduction;
+    if(!reduction.init(ctx.context, ctx.device, EXAMPLES_DIR "common/reduce.cl"))
+        return false;
+
+    if(selected(config, kernelNames[3]) and !checkMultigridRate(ctx, kernels[3], reduction))
+        return false;
+
+    const float tolerance= 1.0e-4f;
+    static const size_t defaults[] = { 64, 128, 256 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const int n= sizes[s];
+        const size_t bytes= (size_t)n * n * sizeof(float);
+        if(!fits(ctx, bytes, 3))
+            continue;
+
+        cl_image_format format;
+        format.image_channel_data_type= CL_FLOAT;
+        format.image_channel_order= CL_INTENSITY;
+        cl_int error1= CL_SUCCESS, error2= CL_SUCCESS, error3, error4;
+        cl_mem dImages[2] = { NULL, NULL };
+        if(jacobi) {
+            dImages[0]= clCreateImage2D(ctx.context, CL_MEM_READ_WRITE, &format, n, n, 0, NULL, &error1);
+            dImages[1]= clCreateImage2D(ctx.context, CL_MEM_READ_WRITE, &format, n, n, 0, NULL, &error2);
+        }
+        cl_mem dBuffer= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, bytes, NULL, &error3);
+        cl_mem dResidual= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, bytes, NULL, &error4);
+        if(checkError(error1, "clCreateImage2D") or checkError(error2, "clCreateImage2D") or
+           checkError(error3, "clCreateBuffer") or checkError(error4, "clCreateBuffer"))
+            return false;
+
+        Multigrid multigrid;
+        if(selected(config, kernelNames[3]) and
+           !multigrid.init(ctx.context, ctx.device, n, n, 2, 2, EXAMPLES_DIR "example3/src/multigrid.cl"))
+            return false;
+
+        for(int solver=0; solver<4; solver++) {
+            if(!selected(config, kernelNames[solver]) or (solver == 0 and !jacobi))
+                continue;
+            vector<double> times;
+            int iterations= 0;
+            for(int t=0; t<config.warmup + config.trials; t++) {
+                double elapsed;
+                if(!solveHeat(ctx, kernels, reduction, multigrid, solver, n, solver ? &dBuffer : dImages,
+                              dResidual, tolerance, iterations, elapsed))
+                    return false;
+                if(t >= config.warmup)
+                    times.push_back(elapsed);
+            }
+            // Jacobi lee y escribe cada celda por iteracion; rojo-negro lee el buffer
+            // completo y escribe la mitad en cada una de sus dos pasadas. Un V-cycle
+            // hace 4 de esas en el nivel fino, mas la restriccion y la prolongacion
+            // (y los niveles gruesos, que suman alrededor de un tercio mas)
+            const double bytesPerIteration= solver == 3 ? (4 * 3.0 + 3.0) * bytes * 4 / 3 :
+                                             solver ? 3.0 * bytes : 2.0 * bytes;
+            addResult(results, kernelNames[solver], n, 0, 0, times, bytesPerIteration * iterations,
+                      (double)n * n * iterations, benchParam("iterations", iterations));
+        }
+
+        if(jacobi) {
+            clReleaseMemObject(dImages[0]);
+            clReleaseMemObject(dImages[1]);
+        }
+        clReleaseMemObject(dBuffer);
+        clReleaseMemObject(dResidual);
+    }
+
+    for(int k=0; k<4; k++)
+        if(kernels[k])
+            clReleaseKernel(kernels[k]);
+    return true;
+}
+
+/// globCounter y shMemCounter (example4): cuenta las ocurrencias de un valor en n enteros
+static bool benchCounters(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    const char* kernelNames[] = { "globCounter", "shMemCounter" };
+    static const size_t defaults[] = { 1 << 20, 1 << 24, 1 << 26 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+
+    for(int k=0; k<2; k++) {
+        if(!selected(config, kernelNames[k]))
+            continue;
+
+        cl_kernel kernel;
+        if(!loadKernel(ctx.context, &kernel, ctx.device, EXAMPLES_DIR "example4/src/atomics.cl", kernelNames[k]))
+            return false;
+        const bool withSharedMemory= k == 1;
+        const vector<size_t> workGroupSizes= workGroupSizes1D(ctx, kernel);
+
+        for(size_t s=0; s<sizes.size(); s++) {
+            const cl_uint n= sizes[s];
+            const size_t bytes= (size_t)n * sizeof(cl_int);
+            if(!fits(ctx, bytes, 1))
+                continue;
+
+            // Los mismos datos que example4: el 40% de los elementos es igual a countingValue
+            srand(31);
+            const cl_int countingValue= rand();
+            vector<cl_int> hA(n);
+            for(cl_uint i=0; i<n; i++)
+                hA[i]= ((float)rand()/RAND_MAX < 0.4f) ? countingValue : rand();
+
+            cl_int error1, error2;
+            cl_mem dA= clCreateBuffer(ctx.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, bytes, &hA[0], &error1);
+            cl_mem dCounter= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &error2);
+            if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+                return false;
+
+            cl_int error;
+            error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA);
+            error |= clSetKernelArg(kernel, 1, sizeof(cl_uint), (void*)&n);
+            error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&countingValue);
+            if(withSharedMemory) {
+                error |= clSetKernelArg(kernel, 3, sizeof(cl_uint), (void*)NULL);
+                error |= clSetKernelArg(kernel, 4, sizeof(cl_mem), (void*)&dCounter);
+            } else {
+                error |= clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&dCounter);
+            }
+            if(checkError(error, "benchCounters: clSetKernelArg"))
+                return false;
+
+            // El contador acumula entre ejecuciones, solo interesa el tiempo
+            for(size_t w=0; w<workGroupSizes.size(); w++) {
+                const size_t workGroupSize= workGroupSizes[w];
+                const size_t ndRangeSize= roundUp(n, workGroupSize);
+                vector<double> times;
+                if(!measure(ctx, kernel, 1, &ndRangeSize, &workGroupSize, config, times))
+                    return false;
+                addResult(results, kernelNames[k], n, workGroupSize, 1, times, (double)bytes, (double)n);
+            }
+
+            clReleaseMemObject(dA);
+            clReleaseMemObject(dCounter);
+        }
+
+        clReleaseKernel(kernel);
+    }
+    return true;
+}
+
+/// vboproc (example7): un paso de integracion de n particulas (float8 cada una)
+/// Se usa un buffer comun en lugar del VBO de OpenGL
+static bool benchVboproc(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    if(!selected(config, "vboproc"))
+        return true;
+
+    cl_kernel kernel;
+    if(!loadKernel(ctx.context, &kernel, ctx.device, EXAMPLES_DIR "example7/src/vboproc.cl", "vboproc"))
+        return false;
+
+    static const size_t defaults[] = { 32768, 1 << 20, 1 << 22 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 3);
+    const vector<size_t> workGroupSizes= workGroupSizes1D(ctx, kernel);
+    for(size_t s=0; s<sizes.size(); s++) {
+        const cl_int n= sizes[s];
+        const size_t bytes= (size_t)n * 8 * sizeof(float);
+        if(!fits(ctx, bytes, 1))
+            continue;
+
+        // Posicion en el cubo [-1, 1], masa entre 1 y 2, velocidad nula
+        vector<float> hVbo((size_t)n * 8, 0.0f);
+        for(cl_int i=0; i<n; i++) {
+            float* particle= &hVbo[(size_t)i * 8];
+            for(int c=0; c<3; c++)
+                particle[c]= 2.0f * rand()/RAND_MAX - 1.0f;
+            particle[3]= 1.0f + (float)rand()/RAND_MAX;
+        }
+
+        cl_int error;
+        cl_mem dVbo= clCreateBuffer(ctx.context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, bytes, &hVbo[0], &error);
+        if(checkError(error, "clCreateBuffer"))
+            return false;
+
+        cl_float3 cubeLimits;
+        cubeLimits.s[0]= cubeLimits.s[1]= cubeLimits.s[2]= 2.0f;
+        cubeLimits.s[3]= 0.0f;
+        const cl_float dt= 0.01f;
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dVbo);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_int), (void*)&n);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_float3), (void*)&cubeLimits);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_float), (void*)&dt);
+        if(checkError(error, "benchVboproc: clSetKernelArg"))
+            return false;
+
+        for(size_t w=0; w<workGroupSizes.size(); w++) {
+            const size_t workGroupSize= workGroupSizes[w];
+            const size_t ndRangeSize= roundUp(n, workGroupSize);
+            vector<double> times;
+            if(!measure(ctx, kernel, 1, &ndRangeSize, &workGroupSize, config, times))
+                return false;
+            addResult(results, "vboproc", n, workGroupSize, 1, times, 2.0 * bytes, (double)n);
+        }
+
+        clReleaseMemObject(dVbo);
+    }
+
+    clReleaseKernel(kernel);
+    return true;
+}
+
+static void writeCsv(ostream& os, const BenchContext& ctx, const BenchConfig& config, const vector<BenchResult>& results)
+{
+    os << "# device: " << ctx.info.name << " (" << ctx.info.platformName << ", driver " << ctx.info.driverVersion << ")" << endl;
+    os << "# warmup: " << config.warmup << ", trials: " << config.trials << endl;
+    os << "kernel,size,wg_x,wg_y,param,trials,mean_ms,median_ms,min_ms,max_ms,stddev_ms,cv_pct,gb_s,gelem_s" << endl;
+    os << setprecision(6);
+    for(size_t i=0; i<results.size(); i++) {
+        const BenchResult& r= results[i];
+        os << r.kernel << "," << r.size << "," << r.workGroup[0] << "," << r.workGroup[1] << "," << r.param << "," << r.trials << ","
+           << r.meanMs << "," << r.medianMs << "," << r.minMs << "," << r.maxMs << "," << r.stddevMs << ","
+           << 100.0 * r.stddevMs / r.meanMs << "," << r.bytes / (r.medianMs * 1.0e6) << ","
+           << r.elements / (r.medianMs * 1.0e6) << endl;
+    }
+}
+
+static void writeJson(ostream& os, const BenchContext& ctx, const BenchConfig& config, const vector<BenchResult>& results)
+{
+    os << setprecision(6);
+    os << "{" << endl;
+    os << "  \"device\": {\"name\": \"" << jsonEscape(ctx.info.name) << "\", \"platform\": \"" << jsonEscape(ctx.info.platformName)
+       << "\", \"version\": \"" << jsonEscape(ctx.info.version) << "\", \"driver\": \"" << jsonEscape(ctx.info.driverVersion)
+       << "\", \"type\": \"" << ctx.info.typeName() << "\", \"computeUnits\": " << ctx.info.computeUnits << "}," << endl;
+    os << "  \"warmup\": " << config.warmup << "," << endl;
+    os << "  \"trials\": " << config.trials << "," << endl;
+    os << "  \"results\": [" << endl;
+    for(size_t i=0; i<results.size(); i++) {
+        const BenchResult& r= results[i];
+        os << "    {\"kernel\": \"" << r.kernel << "\", \"size\": " << r.size << ", \"workGroup\": [" << r.workGroup[0]
+           << ", " << r.workGroup[1] << "], \"param\": \"" << jsonEscape(r.param) << "\", \"trials\": " << r.trials << ", \"meanMs\": " << r.meanMs
+           << ", \"medianMs\": " << r.medianMs << ", \"minMs\": " << r.minMs << ", \"maxMs\": " << r.maxMs
+           << ", \"stddevMs\": " << r.stddevMs << ", \"gbPerSec\": " << r.bytes / (r.medianMs * 1.0e6)
+           << ", \"gelemPerSec\": " << r.elements / (r.medianMs * 1.0e6) << "}"
+           << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    os << "  ]" << endl;
+    os << "}" << endl;
+}
+
+// Escribe los resultados con writer en path, o en cout si path es 0
+static bool writeResults(void (*writer)(ostream&, const BenchContext&, const BenchConfig&, const vector<BenchResult>&),
+                         const char* path, const BenchContext& ctx, const BenchConfig& config,
+                         const vector<BenchResult>& results)
+{
+    if(!path) {
+        writer(cout, ctx, config, results);
+        return true;
+    }
+
+    ofstream os(path);
+    if(!os.is_open()) {
+        cerr << "Error al crear archivo '" << path << "'." << endl;
+        return false;
+    }
+    writer(os, ctx, config, results);
+    cerr << "Resultados escritos en '" << path << "'." << endl;
+    return true;
+}
+
+/// hostUpload y hostDownload (--hostmem): transferencias de n floats entre el host y el
+/// dispositivo con cada forma de reservar la memoria de host (common/clutils.h): malloc
+/// con copias, buffer de staging pinned y zero-copy con map/unmap. Se mide con tiempo de
+/// host desde que se encola hasta que termina: la subida hasta que el dispositivo puede
+/// usar los datos y la bajada hasta que el host puede leerlos. En zero-copy sobre una GPU
+/// discreta parte del costo se traslada a los kernels que leen el buffer. En la columna
+/// param se muestra el modo.
+static bool benchHostMem(const BenchContext& ctx, const BenchConfig& config, vector<BenchResult>& results)
+{
+    // Sin --hostmem solo se ejecutan si se piden por nombre en --kernels
+    const char* kernelNames[] = { "hostUpload", "hostDownload" };
+    bool run[2];
+    for(int k=0; k<2; k++)
+        run[k]= selected(config, kernelNames[k]) and (!config.hostMemModes.empty() or !config.kernels.empty());
+    if(!run[0] and !run[1])
+        return true;
+
+    const HostMemMode allModes[] = { HOST_MEM_MALLOC, HOST_MEM_PINNED, HOST_MEM_ZEROCOPY };
+    const vector<HostMemMode> modes= config.hostMemModes.empty() ? vector<HostMemMode>(allModes, allModes + 3) :
+                                                                   config.hostMemModes;
+    static const size_t defaults[] = { 1 << 18, 1 << 20, 1 << 22, 1 << 24 };
+    const vector<size_t> sizes= sizesFor(config, defaults, 4);
+    for(int k=0; k<2; k++) {
+        if(!run[k])
+            continue;
+        const bool upload= k == 0;
+        for(size_t s=0; s<sizes.size(); s++) {
+            const size_t n= sizes[s];
+            const size_t bytes= n * sizeof(float);
+            if(!fits(ctx, bytes, 1))
+                continue;
+
+            for(size_t m=0; m<modes.size(); m++) {
+                HostBuffer buffer;
+                if(!createHostBuffer(ctx.context, ctx.queue, upload ? CL_MEM_READ_ONLY : CL_MEM_WRITE_ONLY, bytes,
+                                     modes[m], buffer)) {
+                    releaseHostBuffer(ctx.queue, buffer);
+                    return false;
+                }
+                if(upload) {
+                    float* data= (float*)buffer.host;
+                    for(size_t i=0; i<n; i++)
+                        data[i]= (float)rand() / RAND_MAX;
+                }
+
+                vector<double> times;
+                for(int t=0; t<config.warmup + config.trials; t++) {
+                    const double start= hostTimeMs();
+                    bool ok= upload ? enqueueUpload(ctx.queue, buffer) : enqueueDownload(ctx.queue, buffer, CL_TRUE);
+                    ok= ok and !checkError(clFinish(ctx.queue), "benchHostMem: clFinish");
+                    const double elapsed= hostTimeMs() - start;
+                    // En zero-copy la subida deja el buffer sin mapear y la bajada mapeado:
+                    // se vuelve al estado inicial fuera de la medicion
+                    if(ok and buffer.mode == HOST_MEM_ZEROCOPY)
+                        ok= upload ? mapHostBuffer(ctx.queue, buffer) : enqueueUpload(ctx.queue, buffer);
+                    if(!ok) {
+                        releaseHostBuffer(ctx.queue, buffer);
+                        return false;
+                    }
+                    if(t >= config.warmup)
+                        times.push_back(elapsed);
+                }
+                addResult(results, kernelNames[k], n, 0, 0, times, bytes, n,
+                          string("mem=") + hostMemModeName(modes[m]));
+                releaseHostBuffer(ctx.queue, buffer);
+            }
+        }
+    }
+    return true;
+}
+
+// Separa una lista de valores separados por comas
+static vector<string> splitList(const char* text)
+{
+    vector<string> items;
+    stringstream ss(text);
+    string item;
+    while(getline(ss, item, ','))
+        if(!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+int main(int argc, char *argv[])
+{
+    // Procesar --device y --list-devices (seleccion del dispositivo OpenCL)
+    parseDeviceArgs(argc, argv);
+
+    BenchConfig config;
+    config.warmup= 3;
+    config.trials= 10;
+
+    const char* value;
+    if(extractArg(argc, argv, "--warmup", &value) and value)
+        config.warmup= atoi(value);
+    if(extractArg(argc, argv, "--trials", &value) and value)
+        config.trials= atoi(value);
+    if(extractArg(argc, argv, "--sizes", &value) and value) {
+        const vector<string> sizes= splitList(value);
+        for(size_t i=0; i<sizes.size(); i++)
+            config.sizes.push_back(strtoul(sizes[i].c_str(), NULL, 10));
+    }
+    if(extractArg(argc, argv, "--kernels", &value) and value)
+        config.kernels= splitList(value);
+    // --hostmem[=m1,m2,...] agrega la comparacion de transferencias con malloc, pinned y
+    // zero-copy (todos si no se indican)
+    bool hostMemError= false;
+    if(extractArg(argc, argv, "--hostmem", &value)) {
+        const vector<string> modes= value ? splitList(value) : vector<string>();
+        for(size_t i=0; i<modes.size(); i++) {
+            HostMemMode mode;
+            if(parseHostMemMode(modes[i].c_str(), mode))
+                config.hostMemModes.push_back(mode);
+            else
+                hostMemError= true;
+        }
+        if(config.hostMemModes.empty()) {
+            config.hostMemModes.push_back(HOST_MEM_MALLOC);
+            config.hostMemModes.push_back(HOST_MEM_PINNED);
+            config.hostMemModes.push_back(HOST_MEM_ZEROCOPY);
+        }
+    }
+    const char* csvPath= 0;
+    const char* jsonPath= 0;
+    const bool csv= extractArg(argc, argv, "--csv", &csvPath);
+    const bool json= extractArg(argc, argv, "--json", &jsonPath);
+
+    if(argc > 1 or config.warmup < 0 or config.trials < 1 or hostMemError) {
+        cerr << "usage: ./bench [--kernels=k1,k2,...] [--sizes=s1,s2,...] [--warmup=N] [--trials=N]"
+                " [--hostmem[=malloc,pinned,zerocopy]] [--csv[=file]] [--json[=file]] [--device=<spec>] [--list-devices]" << endl;
+        cerr << "Kernels:";
+        for(int k=0; k<benchKernelCount; k++)
+            cerr << (k ? ", " : " ") << benchKernels[k];
+        cerr << endl;
+        return EXIT_FAILURE;
+    }
+    for(size_t i=0; i<config.kernels.size(); i++) {
+        if(find(benchKernels, benchKernels + benchKernelCount, config.kernels[i]) == benchKernels + benchKernelCount) {
+            cerr << "Kernel desconocido: " << config.kernels[i] << " (ver ./bench --help)." << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    BenchContext ctx;
+    if(!setupOpenCL(ctx.context, ctx.queue, ctx.device, &ctx.info))
+        return EXIT_FAILURE;
+
+    // Datos reproducibles entre corridas
+    srand(42);
+
+    cerr << "Calentamiento: " << config.warmup << ", repeticiones: " << config.trials << endl;
+    cerr << left << setw(16) << "kernel" << right << setw(11) << "tamanio" << setw(11) << "work-group"
+         << setw(17) << "mediana" << setw(18) << "ancho de banda" << setw(17) << "elementos" << endl;
+
+    vector<BenchResult> results;
+    if(!benchMatrixScalar(ctx, config, results) or
+       !benchTranspose(ctx, config, results) or
+       !benchTransposeTiled(ctx, config, results) or
+       !benchTransposeBatched(ctx, config, results) or
+       !benchElementwise(ctx, config, results) or
+       !benchFusion(ctx, config, results) or
+       !benchReduce(ctx, config, results) or
+       !benchScan(ctx, config, results) or
+       !benchCompact(ctx, config, results) or
+       !benchHistogram(ctx, config, results) or
+       !benchRadixSort(ctx, config, results) or
+       !benchFdmHeat(ctx, config, results) or
+       !benchFdmHeatBlocked(ctx, config, results) or
+       !benchHeatSolvers(ctx, config, results) or
+       !benchCounters(ctx, config, results) or
+       !benchVboproc(ctx, config, results) or
+       !benchHostMem(ctx, config, results))
+        return EXIT_FAILURE;
+    printProgramCacheStats();
+
+    if(csv and !writeResults(writeCsv, csvPath, ctx, config, results))
+        return EXIT_FAILURE;
+    if(json and !writeResults(writeJson, jsonPath, ctx, config, results))
+        return EXIT_FAILURE;
+
+    clReleaseCommandQueue(ctx.queue);
+    clReleaseContext(ctx.context);
+
+    return EXIT_SUCCESS;
+}
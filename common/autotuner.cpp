@@ -0,0 +1,328 @@
+#include "autotuner.h"
+#include "clutils.h"
+#include "programcache.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+using namespace std;
+
+// Tamanio de work-group elegido
+struct WorkGroupSize {
+    size_t local[3];
+};
+
+// Limites del kernel en el dispositivo
+struct KernelLimits {
+    string name;
+    size_t maxSize;          // CL_KERNEL_WORK_GROUP_SIZE
+    size_t multiple;         // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+    size_t compileSize[3];   // CL_KERNEL_COMPILE_WORK_GROUP_SIZE (reqd_work_group_size)
+    size_t maxItems[3];      // CL_DEVICE_MAX_WORK_ITEM_SIZES
+};
+
+// Ejecuciones medidas por candidato (se toma la mas rapida)
+static const int tuneTrials= 3;
+
+// Resultados por clave completa (los del archivo y los medidos en esta ejecucion)
+static map<string, WorkGroupSize> tunedSizes;
+// Resultados por dispositivo, kernel y tamanio, para no recalcular la clave en cada llamada
+static map<string, WorkGroupSize> kernelSizes;
+static bool fileLoaded= false;
+// Los programas con varios threads (example3_gl) pueden llamar a tuneWorkGroup en paralelo
+static pthread_mutex_t tunerLock= PTHREAD_MUTEX_INITIALIZER;
+
+// Modo segun EAGPGPU_AUTOTUNE
+enum TuneMode { TUNE_ON, TUNE_OFF, TUNE_RETUNE };
+
+static TuneMode tuneMode()
+{
+    const char* env= getenv("EAGPGPU_AUTOTUNE");
+    if(!env)
+        return TUNE_ON;
+    if(!strcmp(env, "off") or !strcmp(env, "0"))
+        return TUNE_OFF;
+    if(!strcmp(env, "retune"))
+        return TUNE_RETUNE;
+    return TUNE_ON;
+}
+
+static string tunerFilePath()
+{
+    const string directory= getCacheDirectory();
+    if(directory.empty())
+        return "";
+    return directory + "/workgroups.txt";
+}
+
+// Hash FNV-1a de 64 bits en hexadecimal, para acortar las claves en el archivo
+static string hashKey(const string& key)
+{
+    unsigned long long hash= 14695981039346656037ULL;
+    for(size_t i=0; i<key.size(); i++) {
+        hash^= (unsigned char)key[i];
+        hash*= 1099511628211ULL;
+    }
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", hash);
+    return text;
+}
+
+// Carga los resultados guardados. Cada linea del archivo tiene la clave, el
+// tamanio de work-group y, como referencia, el kernel y el tamanio del problema.
+static void loadTunerFile()
+{
+    fileLoaded= true;
+    const string path= tunerFilePath();
+    if(path.empty())
+        return;
+
+    ifstream is(path.c_str());
+    string line;
+    while(getline(is, line)) {
+        istringstream ls(line);
+        string key;
+        WorkGroupSize size;
+        if(ls >> key >> size.local[0] >> size.local[1] >> size.local[2])
+            tunedSizes[key]= size;
+    }
+}
+
+// Agrega un resultado al archivo. Se escribe una linea corta por vez, asi que
+// varios procesos pueden agregar resultados a la vez.
+static void storeTunerResult(const string& key, const WorkGroupSize& size, const string& comment)
+{
+    const string path= tunerFilePath();
+    if(path.empty() or !makeDirectories(getCacheDirectory()))
+        return;
+
+    ofstream os(path.c_str(), ios::app);
+    os << key << " " << size.local[0] << " " << size.local[1] << " " << size.local[2] << " " << comment << endl;
+}
+
+static bool getKernelLimits(cl_kernel kernel, cl_device_id device, KernelLimits& limits)
+{
+    char name[256];
+    cl_int error;
+    error  = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name), name, NULL);
+    error |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &limits.maxSize, NULL);
+    error |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_COMPILE_WORK_GROUP_SIZE, 3 * sizeof(size_t), limits.compileSize, NULL);
+    error |= clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, 3 * sizeof(size_t), limits.maxItems, NULL);
+    if(checkError(error, "tuneWorkGroup: clGetKernelWorkGroupInfo"))
+        return false;
+    limits.name= name;
+
+    // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE es de OpenCL 1.1
+    error= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &limits.multiple, NULL);
+    if(error != CL_SUCCESS or !limits.multiple or limits.multiple > limits.maxSize)
+        limits.multiple= 1;
+
+    return true;
+}
+
+// Devuelve true si size es un tamanio de work-group valido para el kernel
+static bool isValid(cl_uint dims, const KernelLimits& limits, const WorkGroupSize& size)
+{
+    size_t total= 1;
+    for(cl_uint d=0; d<3; d++) {
+        const size_t local= d < dims ? size.local[d] : 1;
+        if(!local or local > limits.maxItems[d] or size.local[d] != local)
+            return false;
+        total*= local;
+    }
+    return total <= limits.maxSize;
+}
+
+// Tamanio de work-group por defecto: 256 work-items en 1D, 16 x 16 en 2D y 3D,
+// reducido hasta entrar en los limites del kernel
+static WorkGroupSize defaultSize(cl_uint dims, const KernelLimits& limits)
+{
+    WorkGroupSize size;
+    size.local[0]= dims == 1 ? 256 : 16;
+    size.local[1]= dims >= 2 ? 16 : 1;
+    size.local[2]= 1;
+    for(cl_uint d=0; d<dims; d++)
+        while(size.local[d] > limits.maxItems[d])
+            size.local[d]/= 2;
+    // Reducir alternando dimensiones, empezando por la mas lenta
+    for(int d= dims - 1; !isValid(dims, limits, size); d= d > 0 ? d - 1 : dims - 1)
+        if(size.local[d] > 1)
+            size.local[d]/= 2;
+    return size;
+}
+
+// Candidatos: potencias de 2 con un total de work-items multiplo del tamanio preferido
+// y que no excedan demasiado el tamanio del problema en cada dimension
+static vector<WorkGroupSize> candidateSizes(cl_uint dims, const KernelLimits& limits, const size_t* problemSize)
+{
+    // Menor total de work-items a considerar: el multiplo preferido (en CPUs suele ser 1)
+    const size_t minTotal= min(max(limits.multiple, (size_t)16), limits.maxSize);
+
+    vector<WorkGroupSize> candidates;
+    const size_t maxX= limits.maxItems[0];
+    const size_t maxY= dims >= 2 ? limits.maxItems[1] : 1;
+    for(size_t x=1; x<=maxX; x*=2) {
+        if(x >= 2 * problemSize[0] and x > 1)
+            break;
+        for(size_t y=1; y<=maxY; y*=2) {
+            if(dims >= 2 and y >= 2 * problemSize[1] and y > 1)
+                break;
+            const size_t total= x * y;
+            if(total > limits.maxSize)
+                break;
+            if(total < minTotal or total % limits.multiple)
+                continue;
+
+            WorkGroupSize size;
+            size.local[0]= x;
+            size.local[1]= y;
+            size.local[2]= 1;
+            candidates.push_back(size);
+        }
+    }
+    // Sin candidatos (problema muy chico o limites poco comunes) usar el tamanio por defecto
+    if(candidates.empty())
+        candidates.push_back(defaultSize(dims, limits));
+    return candidates;
+}
+
+// Mide el tiempo (ms) de la ejecucion mas rapida de kernel con local. Devuelve
+// un valor negativo si el kernel no se puede ejecutar con ese tamanio.
+static double timeCandidate(cl_command_queue queue, cl_kernel kernel, cl_uint dims,
+                            const size_t* problemSize, const WorkGroupSize& size)
+{
+    size_t ndRangeSize[3];
+    for(cl_uint d=0; d<dims; d++)
+        ndRangeSize[d]= (problemSize[d] + size.local[d] - 1) / size.local[d] * size.local[d];
+
+    double best= -1;
+    // Una ejecucion de calentamiento y tuneTrials medidas
+    for(int t=0; t<=tuneTrials; t++) {
+        cl_event event;
+        cl_int error= clEnqueueNDRangeKernel(queue, kernel, dims, NULL, ndRangeSize, size.local, 0, NULL, &event);
+        if(error != CL_SUCCESS)
+            return -1;
+        error= clWaitForEvents(1, &event);
+        if(error == CL_SUCCESS and t > 0) {
+            const double elapsed= eventElapsed(event);
+            if(best < 0 or elapsed < best)
+                best= elapsed;
+        }
+        clReleaseEvent(event);
+        if(error != CL_SUCCESS)
+            return -1;
+    }
+    return best;
+}
+
+static string sizeText(cl_uint dims, const size_t* sizes)
+{
+    ostringstream text;
+    for(cl_uint d=0; d<dims; d++)
+        text << (d ? "x" : "") << sizes[d];
+    return text.str();
+}
+
+bool tuneWorkGroup(cl_command_queue queue, cl_kernel kernel, cl_uint dims,
+                   const size_t* problemSize, size_t* localSize)
+{
+    if(dims < 1 or dims > 3) {
+        cerr << "tuneWorkGroup: cantidad de dimensiones invalida." << endl;
+        return false;
+    }
+
+    pthread_mutex_lock(&tunerLock);
+
+    cl_device_id device;
+    KernelLimits limits;
+    cl_int error= clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+    if(checkError(error, "tuneWorkGroup: clGetCommandQueueInfo") or !getKernelLimits(kernel, device, limits)) {
+        pthread_mutex_unlock(&tunerLock);
+        return false;
+    }
+
+    // Resultado ya calculado para este kernel y tamanio. La clave no usa los punteros
+    // del kernel ni de la cola, que el driver puede reutilizar al liberarlos, sino el
+    // nombre del kernel, el dispositivo y los limites del kernel compilado
+    ostringstream kernelKey;
+    kernelKey << device << " " << limits.name << " " << limits.maxSize << " "
+              << sizeText(3, limits.compileSize) << " " << sizeText(dims, problemSize);
+    map<string, WorkGroupSize>::iterator found= kernelSizes.find(kernelKey.str());
+    if(found != kernelSizes.end()) {
+        memcpy(localSize, found->second.local, dims * sizeof(size_t));
+        pthread_mutex_unlock(&tunerLock);
+        return true;
+    }
+
+    WorkGroupSize size;
+    const TuneMode mode= tuneMode();
+    if(limits.compileSize[0]) {
+        // El kernel exige un tamanio con reqd_work_group_size
+        memcpy(size.local, limits.compileSize, sizeof(size.local));
+    } else if(mode == TUNE_OFF) {
+        size= defaultSize(dims, limits);
+    } else {
+        if(!fileLoaded)
+            loadTunerFile();
+
+        // Clave: dispositivo, kernel y tamanio del problema
+        const string key= hashKey(getDeviceString(device, CL_DEVICE_NAME) + ";" +
+                                  getDeviceString(device, CL_DEVICE_VERSION) + ";" +
+                                  getDeviceString(device, CL_DRIVER_VERSION) + ";" +
+                                  limits.name + ";" + sizeText(dims, problemSize));
+        map<string, WorkGroupSize>::iterator stored= tunedSizes.find(key);
+        if(mode != TUNE_RETUNE and stored != tunedSizes.end() and isValid(dims, limits, stored->second)) {
+            size= stored->second;
+        } else {
+            // Medir todos los candidatos. Primero se espera a que terminen los comandos
+            // anteriores de la cola, para no medirlos junto con el kernel.
+            clFinish(queue);
+            const vector<WorkGroupSize> candidates= candidateSizes(dims, limits, problemSize);
+            double bestTime= -1;
+            for(size_t c=0; c<candidates.size(); c++) {
+                const double elapsed= timeCandidate(queue, kernel, dims, problemSize, candidates[c]);
+                if(elapsed >= 0 and (bestTime < 0 or elapsed < bestTime)) {
+                    bestTime= elapsed;
+                    size= candidates[c];
+                }
+            }
+            if(bestTime < 0) {
+                cerr << "tuneWorkGroup: no se pudo ejecutar '" << limits.name << "' con ningun tamanio de work-group." << endl;
+                pthread_mutex_unlock(&tunerLock);
+                return false;
+            }
+
+            cerr << "Autotuner:\t\t\t\t'" << limits.name << "' (" << sizeText(dims, problemSize) << "): work-group "
+                 << sizeText(dims, size.local) << ", " << bestTime << " ms (" << candidates.size() << " candidatos)." << endl;
+            tunedSizes[key]= size;
+            storeTunerResult(key, size, limits.name + " " + sizeText(dims, problemSize));
+        }
+    }
+
+    for(cl_uint d=dims; d<3; d++)
+        size.local[d]= 1;
+    kernelSizes[kernelKey.str()]= size;
+    memcpy(localSize, size.local, dims * sizeof(size_t));
+
+    pthread_mutex_unlock(&tunerLock);
+    return true;
+}
+
+bool tuneNDRange(cl_command_queue queue, cl_kernel kernel, cl_uint dims,
+                 const size_t* problemSize, size_t* localSize, size_t* ndRangeSize)
+{
+    if(!tuneWorkGroup(queue, kernel, dims, problemSize, localSize))
+        return false;
+    for(cl_uint d=0; d<dims; d++)
+        ndRangeSize[d]= (problemSize[d] + localSize[d] - 1) / localSize[d] * localSize[d];
+    return true;
+}
@@ -0,0 +1,46 @@
+/*
+ * autotuner.h
+ *
+ * Eleccion automatica del tamanio de work-group de un kernel
+ *
+ * El mejor tamanio de work-group depende del kernel, del dispositivo y del
+ * tamanio del problema, y un tamanio fijo puede directamente fallar en
+ * dispositivos con un CL_KERNEL_WORK_GROUP_SIZE menor. El autotuner consulta
+ * los limites del kernel y del dispositivo, arma una lista de candidatos
+ * (multiplos de CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE), ejecuta el
+ * kernel con cada uno y se queda con el mas rapido.
+ *
+ * Los resultados se guardan en memoria y en el archivo workgroups.txt del
+ * directorio de la cache de programas (ver programcache.h), con una clave
+ * formada por el nombre, version y driver del dispositivo, el nombre del
+ * kernel y el tamanio del problema. Si el kernel declara
+ * reqd_work_group_size se usa ese tamanio sin medir.
+ *
+ * Variables de entorno:
+ *  - EAGPGPU_AUTOTUNE: con "off" o "0" no se mide nada y se usa un tamanio
+ *    por defecto valido para el kernel; con "retune" se ignoran los
+ *    resultados guardados y se vuelve a medir (por ejemplo despues de
+ *    modificar un kernel, ya que la clave no incluye el codigo fuente).
+ */
+
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <CL/cl.h>
+
+// Devuelve en localSize el tamanio de work-group para ejecutar kernel en queue
+// sobre un problema de problemSize elementos en cada una de sus dims dimensiones
+// (1 a 3). Los argumentos del kernel deben estar seteados: para medir, el kernel
+// se encola varias veces sobre queue con el NDRange redondeado a multiplos de
+// cada candidato, asi que debe poder ejecutarse repetidamente sin afectar el
+// resultado del programa (o llamarse antes de inicializar sus datos).
+// Devuelve false en caso de error.
+bool tuneWorkGroup(cl_command_queue queue, cl_kernel kernel, cl_uint dims,
+                   const size_t* problemSize, size_t* localSize);
+
+// Igual que tuneWorkGroup, y ademas calcula en ndRangeSize el tamanio global
+// redondeado hacia arriba a multiplos de localSize
+bool tuneNDRange(cl_command_queue queue, cl_kernel kernel, cl_uint dims,
+                 const size_t* problemSize, size_t* localSize, size_t* ndRangeSize);
+
+#endif // AUTOTUNER_H
@@ -0,0 +1,351 @@
+#include "clprofiler.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+// Cantidad maxima de registros guardados, para programas interactivos que corren
+// indefinidamente. Al superarla se descartan los mas viejos.
+static const size_t maxRecords= 1000000;
+
+// Toma el mutex mientras exista el objeto
+class ScopedLock
+{
+public:
+    ScopedLock(pthread_mutex_t& mutex) : mutex(mutex) { pthread_mutex_lock(&mutex); }
+    ~ScopedLock() { pthread_mutex_unlock(&mutex); }
+private:
+    pthread_mutex_t& mutex;
+};
+
+CLProfiler::CLProfiler()
+{
+    enabled= false;
+    pthread_mutex_init(&lock, NULL);
+}
+
+CLProfiler::~CLProfiler()
+{
+    clear();
+    pthread_mutex_destroy(&lock);
+}
+
+CLProfiler& CLProfiler::instance()
+{
+    static CLProfiler profiler;
+    return profiler;
+}
+
+void CLProfiler::parseArgs(int& argc, char** argv)
+{
+    if(extractArg(argc, argv, "--profile"))
+        enabled= true;
+
+    const char* path;
+    if(extractArg(argc, argv, "--trace", &path) and path) {
+        enabled= true;
+        tracePath= path;
+    }
+}
+
+void CLProfiler::record(const char* name, cl_event event)
+{
+    if(!enabled or !event)
+        return;
+
+    clRetainEvent(event);
+    ScopedLock guard(lock);
+    Pending entry;
+    entry.name= name;
+    entry.event= event;
+    pending.push_back(entry);
+}
+
+int CLProfiler::trackOf(cl_command_queue queue)
+{
+    map<cl_command_queue, int>::iterator it= tracks.find(queue);
+    if(it != tracks.end())
+        return it->second;
+
+    const int track= trackNames.size();
+    ostringstream name;
+    name << "Cola " << track;
+    tracks[queue]= track;
+    trackNames.push_back(name.str());
+    return track;
+}
+
+void CLProfiler::setQueueName(cl_command_queue queue, const char* name)
+{
+    ScopedLock guard(lock);
+    trackNames[trackOf(queue)]= name;
+}
+
+void CLProfiler::collect(bool wait)
+{
+    ScopedLock guard(lock);
+
+    list<Pending>::iterator it= pending.begin();
+    while(it != pending.end()) {
+        cl_int status;
+        if(wait)
+            clWaitForEvents(1, &it->event);
+        clGetEventInfo(it->event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+        if(status > CL_COMPLETE) {
+            ++it;
+            continue;
+        }
+
+        Record entry;
+        cl_command_queue queue;
+        cl_int error;
+        error  = clGetEventProfilingInfo(it->event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &entry.queued, NULL);
+        error |= clGetEventProfilingInfo(it->event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &entry.submit, NULL);
+        error |= clGetEventProfilingInfo(it->event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &entry.start, NULL);
+        error |= clGetEventProfilingInfo(it->event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &entry.end, NULL);
+        error |= clGetEventInfo(it->event, CL_EVENT_COMMAND_QUEUE, sizeof(cl_command_queue), &queue, NULL);
+        // Los comandos con error o de colas sin profiling se descartan
+        if(error == CL_SUCCESS and status == CL_COMPLETE) {
+            entry.name= it->name;
+            entry.track= trackOf(queue);
+            if(records.size() >= maxRecords)
+                records.erase(records.begin(), records.begin() + maxRecords / 2);
+            records.push_back(entry);
+        }
+
+        clReleaseEvent(it->event);
+        it= pending.erase(it);
+    }
+}
+
+bool CLProfiler::getStats(const char* name, Stats& stats)
+{
+    ScopedLock guard(lock);
+
+    vector<double> times;
+    double queued= 0;
+    for(size_t i=0; i<records.size(); i++) {
+        if(records[i].name != name)
+            continue;
+        times.push_back((records[i].end - records[i].start) * 1.0e-6);
+        queued+= (records[i].start - records[i].queued) * 1.0e-6;
+    }
+    if(times.empty())
+        return false;
+
+    sort(times.begin(), times.end());
+    const size_t count= times.size();
+    stats.count= count;
+    stats.total= 0;
+    for(size_t i=0; i<count; i++)
+        stats.total+= times[i];
+    stats.min= times[0];
+    stats.max= times[count - 1];
+    stats.median= count % 2 ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2;
+    stats.p99= times[min(count - 1, (size_t)(0.99 * count))];
+    stats.meanQueued= queued / count;
+    return true;
+}
+
+void CLProfiler::printSummary()
+{
+    // Nombres de comandos en orden de primera aparicion
+    vector<string> names;
+    {
+        ScopedLock guard(lock);
+        for(size_t i=0; i<records.size(); i++)
+            if(find(names.begin(), names.end(), records[i].name) == names.end())
+                names.push_back(records[i].name);
+    }
+    if(names.empty())
+        return;
+
+    cerr << "Perfil de comandos OpenCL (ms):" << endl;
+    cerr << left << setw(24) << "comando" << right << setw(8) << "cant" << setw(11) << "total" << setw(10) << "min"
+         << setw(10) << "mediana" << setw(10) << "p99" << setw(10) << "max" << setw(10) << "espera" << endl;
+    cerr << fixed << setprecision(3);
+    for(size_t i=0; i<names.size(); i++) {
+        Stats stats;
+        if(!getStats(names[i].c_str(), stats))
+            continue;
+        cerr << left << setw(24) << names[i] << right << setw(8) << stats.count << setw(11) << stats.total
+             << setw(10) << stats.min << setw(10) << stats.median << setw(10) << stats.p99
+             << setw(10) << stats.max << setw(10) << stats.meanQueued << endl;
+    }
+}
+
+// Intervalos [start, end) unidos y ordenados
+typedef vector< pair<cl_ulong, cl_ulong> > Intervals;
+
+static void mergeIntervals(Intervals& intervals)
+{
+    sort(intervals.begin(), intervals.end());
+    Intervals merged;
+    for(size_t i=0; i<intervals.size(); i++) {
+        if(!merged.empty() and intervals[i].first <= merged.back().second)
+            merged.back().second= max(merged.back().second, intervals[i].second);
+        else
+            merged.push_back(intervals[i]);
+    }
+    intervals.swap(merged);
+}
+
+// Tiempo total de intervals que cae en [from, to)
+static cl_ulong busyBetween(const Intervals& intervals, cl_ulong from, cl_ulong to)
+{
+    cl_ulong busy= 0;
+    for(size_t i=0; i<intervals.size(); i++) {
+        const cl_ulong start= max(intervals[i].first, from);
+        const cl_ulong end= min(intervals[i].second, to);
+        if(start < end)
+            busy+= end - start;
+    }
+    return busy;
+}
+
+// Tiempo en que se solapan dos listas de intervalos unidos y ordenados
+static cl_ulong overlap(const Intervals& a, const Intervals& b)
+{
+    cl_ulong total= 0;
+    size_t i= 0, j= 0;
+    while(i < a.size() and j < b.size()) {
+        const cl_ulong start= max(a[i].first, b[j].first);
+        const cl_ulong end= min(a[i].second, b[j].second);
+        if(start < end)
+            total+= end - start;
+        if(a[i].second < b[j].second)
+            i++;
+        else
+            j++;
+    }
+    return total;
+}
+
+void CLProfiler::printQueueTimeline(double spanMs)
+{
+    ScopedLock guard(lock);
+
+    // Intervalos de ejecucion de cada cola
+    vector<Intervals> busy(trackNames.size());
+    cl_ulong last= 0;
+    for(size_t i=0; i<records.size(); i++) {
+        busy[records[i].track].push_back(make_pair(records[i].start, records[i].end));
+        last= max(last, records[i].end);
+    }
+    int used= 0;
+    for(size_t t=0; t<busy.size(); t++) {
+        mergeIntervals(busy[t]);
+        if(!busy[t].empty())
+            used++;
+    }
+    if(used < 2)
+        return;
+
+    cerr << "Colas OpenCL (ms):" << endl;
+    cerr << fixed << setprecision(3);
+    for(size_t t=0; t<busy.size(); t++) {
+        if(busy[t].empty())
+            continue;
+        cerr << left << setw(24) << trackNames[t] << right << setw(11)
+             << busyBetween(busy[t], 0, ~(cl_ulong)0) * 1.0e-6 << " ocupada";
+        for(size_t u=0; u<busy.size(); u++) {
+            if(u == t or busy[u].empty())
+                continue;
+            cerr << ", " << overlap(busy[t], busy[u]) * 1.0e-6 << " junto con " << trackNames[u];
+        }
+        cerr << endl;
+    }
+
+    // Timeline de texto: '#' si la cola ejecuto en la mayor parte de la columna,
+    // '+' si ejecuto algo y '.' si no
+    const int columns= 64;
+    const cl_ulong span= spanMs * 1.0e6;
+    const cl_ulong from= last > span ? last - span : 0;
+    cerr << "Timeline de los ultimos " << spanMs << " ms:" << endl;
+    for(size_t t=0; t<busy.size(); t++) {
+        if(busy[t].empty())
+            continue;
+        string row;
+        for(int c=0; c<columns; c++) {
+            const cl_ulong start= from + span * c / columns;
+            const cl_ulong end= from + span * (c + 1) / columns;
+            const cl_ulong time= busyBetween(busy[t], start, end);
+            row+= time * 2 > end - start ? '#' : (time ? '+' : '.');
+        }
+        cerr << left << setw(24) << trackNames[t] << right << "|" << row << "|" << endl;
+    }
+}
+
+bool CLProfiler::writeChromeTrace(const char* path)
+{
+    ScopedLock guard(lock);
+
+    ofstream os(path);
+    if(!os.is_open()) {
+        cerr << "Error al crear archivo '" << path << "'." << endl;
+        return false;
+    }
+
+    // Los tiempos se escriben en microsegundos desde el primer comando encolado
+    cl_ulong origin= ~(cl_ulong)0;
+    for(size_t i=0; i<records.size(); i++)
+        origin= min(origin, records[i].queued);
+
+    os << fixed << setprecision(3);
+    // Las comas van antes de cada entrada salvo la primera, de cualquiera de los dos tipos
+    os << "{\"traceEvents\":[" << endl;
+    const char* separator= "";
+    for(size_t t=0; t<trackNames.size(); t++) {
+        os << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << t
+           << ",\"args\":{\"name\":\"" << jsonEscape(trackNames[t]) << "\"}}";
+        separator= ",\n";
+    }
+    for(size_t i=0; i<records.size(); i++) {
+        const Record& r= records[i];
+        os << separator << "{\"name\":\"" << jsonEscape(r.name) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << r.track
+           << ",\"ts\":" << (r.start - origin) * 1.0e-3 << ",\"dur\":" << (r.end - r.start) * 1.0e-3
+           << ",\"args\":{\"queued_us\":" << (r.queued - origin) * 1.0e-3
+           << ",\"submit_us\":" << (r.submit - origin) * 1.0e-3 << "}}";
+        separator= ",\n";
+    }
+    os << endl;
+    os << "]}" << endl;
+
+    return bool(os);
+}
+
+void CLProfiler::finish()
+{
+    if(!enabled)
+        return;
+
+    collect(true);
+    printSummary();
+    printQueueTimeline();
+    if(!tracePath.empty() and writeChromeTrace(tracePath.c_str()))
+        cerr << "Timeline escrito en '" << tracePath << "'." << endl;
+}
+
+void CLProfiler::clear()
+{
+    ScopedLock guard(lock);
+
+    for(list<Pending>::iterator it= pending.begin(); it != pending.end(); ++it)
+        clReleaseEvent(it->event);
+    pending.clear();
+    records.clear();
+}
+
+ProfiledEvent::~ProfiledEvent()
+{
+    // Si el enqueue fallo el evento queda en NULL
+    if(event) {
+        CLProfiler::instance().record(name, event);
+        clReleaseEvent(event);
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * clprofiler.h
+ *
+ * Registro de tiempos de los comandos encolados en OpenCL
+ *
+ * Cada comando que se quiere medir se encola pasando como evento de salida
+ * un ProfiledEvent temporal, que al terminar el enqueue registra el evento:
+ *
+ *     clEnqueueWriteBuffer(queue, ..., 0, NULL, ProfiledEvent("write A"));
+ *
+ * o, con un evento propio, llamando a record() despues del enqueue. Al
+ * recolectar (collect) se leen los tiempos QUEUED, SUBMIT, START y END de
+ * cada evento (las colas deben crearse con CL_QUEUE_PROFILING_ENABLE) y se
+ * agrupan por nombre de comando y por cola. Con el profiler deshabilitado
+ * ProfiledEvent se convierte en NULL, asi que los enqueue no crean eventos.
+ *
+ * Se puede encolar desde varios threads mientras otro recolecta: el profiler
+ * solo ve los eventos una vez que el enqueue termino de escribirlos.
+ *
+ * Se puede mostrar un resumen por comando (printSummary) o escribir un
+ * timeline en el formato JSON de Chrome tracing (writeChromeTrace), que se
+ * abre en chrome://tracing o en https://ui.perfetto.dev, con una fila por cola.
+ * Con varias colas, printQueueTimeline muestra cuanto se solaparon.
+ */
+
+#ifndef CLPROFILER_H
+#define CLPROFILER_H
+
+#include <CL/cl.h>
+
+#include <pthread.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+class CLProfiler
+{
+public:
+    CLProfiler();
+    ~CLProfiler();
+
+    // Profiler global, compartido por todos los modulos del programa
+    static CLProfiler& instance();
+
+    // Procesa y elimina de argv los argumentos del profiler:
+    //  --profile         Habilita el profiler y muestra el resumen al terminar
+    //  --trace=<archivo> Ademas escribe el timeline de Chrome tracing en archivo
+    void parseArgs(int& argc, char** argv);
+
+    void setEnabled(bool enable) { enabled= enable; }
+    bool isEnabled() const { return enabled; }
+
+    // Registra un evento ya creado por el llamador (el profiler lo retiene)
+    void record(const char* name, cl_event event);
+
+    // Nombre con que se muestra la cola queue en el resumen y el timeline
+    void setQueueName(cl_command_queue queue, const char* name);
+
+    // Lee los tiempos de los eventos registrados. Si wait es true espera a que
+    // terminen todos los comandos; si no, solo procesa los que ya terminaron.
+    void collect(bool wait= true);
+
+    // Muestra por cerr, para cada comando, cantidad, tiempo total, minimo, mediana,
+    // p99 y maximo de ejecucion (START -> END), y la espera media en cola (QUEUED -> START)
+    void printSummary();
+
+    // Con comandos de mas de una cola, muestra por cerr el tiempo en que cada cola
+    // estuvo ejecutando, cuanto de ese tiempo se solapo con cada otra cola, y un
+    // timeline de texto de los ultimos spanMs milisegundos con una fila por cola
+    void printQueueTimeline(double spanMs= 16);
+
+    // Escribe el timeline de los comandos en formato Chrome tracing
+    // Devuelve false en caso de error
+    bool writeChromeTrace(const char* path);
+
+    // Estadisticas de un comando, en ms
+    struct Stats {
+        int count;
+        double total;
+        double min;
+        double median;
+        double p99;
+        double max;
+        double meanQueued;
+    };
+    // Devuelve false si no hay registros del comando name
+    bool getStats(const char* name, Stats& stats);
+
+    // Recolecta, muestra el resumen y escribe el timeline segun lo pedido en parseArgs
+    void finish();
+
+    // Descarta todos los registros
+    void clear();
+
+private:
+    struct Pending {
+        std::string name;
+        cl_event event;
+    };
+    struct Record {
+        std::string name;
+        int track;
+        cl_ulong queued;
+        cl_ulong submit;
+        cl_ulong start;
+        cl_ulong end;
+    };
+
+    int trackOf(cl_command_queue queue);
+
+    bool enabled;
+    std::string tracePath;
+
+    std::list<Pending> pending;
+    std::vector<Record> records;
+    std::map<cl_command_queue, int> tracks;
+    std::vector<std::string> trackNames;
+    pthread_mutex_t lock;
+};
+
+// Evento de salida de un comando a medir con el nombre name (ver arriba). Se usa
+// como temporal en la expresion del enqueue: al destruirse registra el evento en
+// CLProfiler::instance() con record y lo libera.
+class ProfiledEvent
+{
+public:
+    explicit ProfiledEvent(const char* name) : name(name), event(NULL) {}
+    ~ProfiledEvent();
+
+    // NULL si el profiler esta deshabilitado
+    operator cl_event*() { return CLProfiler::instance().isEnabled() ? &event : NULL; }
+
+private:
+    ProfiledEvent(const ProfiledEvent&);
+    ProfiledEvent& operator=(const ProfiledEvent&);
+
+    const char* name;
+    cl_event event;
+};
+
+#endif // CLPROFILER_H
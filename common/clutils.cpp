@@ -1,30 +1,329 @@
 #include "clutils.h"
+#include "programcache.h"
 
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <algorithm>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
 
 using namespace std;
 
-bool setupOpenCL(cl_context& context, cl_command_queue& queue, cl_device_id& device)
+// Dispositivo elegido con --device (ver parseDeviceArgs)
+static string deviceArgSpec;
+
+static string platformString(cl_platform_id platform, cl_platform_info param)
 {
-    cl_int clError;
+    size_t length;
+    cl_int error= clGetPlatformInfo(platform, param, 0, NULL, &length);
+    if(checkError(error, "platformString: clGetPlatformInfo") or !length)
+        return "";
+
+    vector<char> text(length);
+    error= clGetPlatformInfo(platform, param, length, &text[0], NULL);
+    if(checkError(error, "platformString: clGetPlatformInfo"))
+        return "";
+
+    return string(&text[0]);
+}
+
+static string toLower(string text)
+{
+    for(size_t i=0; i<text.size(); i++)
+        text[i]= tolower(text[i]);
+    return text;
+}
+
+bool CLDeviceInfo::hasExtension(const char* ext) const
+{
+    // Las extensiones estan separadas por espacios
+    const string padded= " " + extensions + " ";
+    return padded.find(" " + string(ext) + " ") != string::npos;
+}
+
+const char* CLDeviceInfo::typeName() const
+{
+    if(type & CL_DEVICE_TYPE_GPU)
+        return "GPU";
+    if(type & CL_DEVICE_TYPE_CPU)
+        return "CPU";
+    if(type & CL_DEVICE_TYPE_ACCELERATOR)
+        return "Accelerator";
+    return "Other";
+}
+
+bool getDeviceInfo(cl_device_id device, CLDeviceInfo& info)
+{
+    cl_bool imageSupport, hostUnifiedMemory;
+    info.device= device;
+
+    // Cada consulta se verifica por separado, para informar el codigo y el parametro
+    // que fallo
+    struct Query {
+        cl_device_info param;
+        size_t size;
+        void* value;
+        const char* name;
+    };
+    const Query queries[] = {
+        { CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &info.platform, "CL_DEVICE_PLATFORM" },
+        { CL_DEVICE_TYPE, sizeof(cl_device_type), &info.type, "CL_DEVICE_TYPE" },
+        { CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &info.computeUnits, "CL_DEVICE_MAX_COMPUTE_UNITS" },
+        { CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &info.clockMHz, "CL_DEVICE_MAX_CLOCK_FREQUENCY" },
+        { CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &info.globalMemSize, "CL_DEVICE_GLOBAL_MEM_SIZE" },
+        { CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &info.localMemSize, "CL_DEVICE_LOCAL_MEM_SIZE" },
+        { CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &info.maxAllocSize, "CL_DEVICE_MAX_MEM_ALLOC_SIZE" },
+        { CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &info.maxWorkGroupSize, "CL_DEVICE_MAX_WORK_GROUP_SIZE" },
+        { CL_DEVICE_MAX_WORK_ITEM_SIZES, 3 * sizeof(size_t), info.maxWorkItemSizes, "CL_DEVICE_MAX_WORK_ITEM_SIZES" },
+        { CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &info.preferredVectorWidthFloat, "CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT" },
+        { CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &imageSupport, "CL_DEVICE_IMAGE_SUPPORT" },
+        { CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &hostUnifiedMemory, "CL_DEVICE_HOST_UNIFIED_MEMORY" }
+    };
+    for(size_t q=0; q<sizeof(queries) / sizeof(queries[0]); q++) {
+        cl_int error= clGetDeviceInfo(device, queries[q].param, queries[q].size, queries[q].value, NULL);
+        if(checkError(error, (string("getDeviceInfo: clGetDeviceInfo(") + queries[q].name + ")").c_str()))
+            return false;
+    }
+
+    info.imageSupport= imageSupport;
+    info.hostUnifiedMemory= hostUnifiedMemory;
+
+    info.platformName= platformString(info.platform, CL_PLATFORM_NAME);
+    info.name= getDeviceString(device, CL_DEVICE_NAME);
+    info.vendor= getDeviceString(device, CL_DEVICE_VENDOR);
+    info.version= getDeviceString(device, CL_DEVICE_VERSION);
+    info.driverVersion= getDeviceString(device, CL_DRIVER_VERSION);
+    info.extensions= getDeviceString(device, CL_DEVICE_EXTENSIONS);
+
+    // Throughput estimado: cada unidad de computo de una GPU tiene muchas mas
+    // unidades aritmeticas que un core de CPU
+    double typeFactor= 1.0;
+    if(info.type & CL_DEVICE_TYPE_GPU)
+        typeFactor= 8.0;
+    else if(info.type & CL_DEVICE_TYPE_ACCELERATOR)
+        typeFactor= 4.0;
+    info.score= info.computeUnits * (double)(info.clockMHz ? info.clockMHz : 1) * typeFactor;
+
+    return true;
+}
+
+bool enumerateDevices(vector<CLDeviceInfo>& devices)
+{
+    devices.clear();
+
+    cl_uint platformCount;
+    cl_int error= clGetPlatformIDs(0, NULL, &platformCount);
+    if(checkError(error, "enumerateDevices: clGetPlatformIDs"))
+        return false;
+    if(!platformCount) {
+        cerr << "No se encontraron plataformas OpenCL." << endl;
+        return false;
+    }
+    vector<cl_platform_id> platforms(platformCount);
+    error= clGetPlatformIDs(platformCount, &platforms[0], NULL);
+    if(checkError(error, "enumerateDevices: clGetPlatformIDs"))
+        return false;
+
+    for(cl_uint p=0; p<platformCount; p++) {
+        // Una plataforma sin dispositivos no es un error, y una que falla se saltea
+        // sin dejar de listar las demas
+        cl_uint deviceCount;
+        error= clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL, &deviceCount);
+        if(error == CL_DEVICE_NOT_FOUND or (error == CL_SUCCESS and !deviceCount))
+            continue;
+        if(checkError(error, "enumerateDevices: clGetDeviceIDs"))
+            continue;
+
+        vector<cl_device_id> ids(deviceCount);
+        error= clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, deviceCount, &ids[0], NULL);
+        if(checkError(error, "enumerateDevices: clGetDeviceIDs"))
+            continue;
+
+        for(cl_uint d=0; d<deviceCount; d++) {
+            CLDeviceInfo info;
+            if(getDeviceInfo(ids[d], info))
+                devices.push_back(info);
+        }
+    }
+
+    if(devices.empty()) {
+        cerr << "No se encontraron dispositivos OpenCL." << endl;
+        return false;
+    }
+    return true;
+}
+
+void printDevices(const vector<CLDeviceInfo>& devices)
+{
+    int platformIndex= -1, deviceIndex= 0;
+    for(size_t i=0; i<devices.size(); i++) {
+        if(!i or devices[i].platform != devices[i-1].platform) {
+            platformIndex++;
+            deviceIndex= 0;
+            cerr << "Plataforma " << platformIndex << ": " << devices[i].platformName << endl;
+        }
+        const CLDeviceInfo& info= devices[i];
+        cerr << "  [" << i << "] " << platformIndex << ":" << deviceIndex++ << "  " << info.typeName() << "  " << info.name
+             << "  (" << info.computeUnits << " CUs @ " << info.clockMHz << " MHz, "
+             << info.globalMemSize/1024/1024 << " MiB, work-group max " << info.maxWorkGroupSize
+             << (info.imageSupport ? ", imagenes" : "")
+             << (info.hasExtension("cl_khr_gl_sharing") ? ", GL" : "") << ")" << endl;
+    }
+}
+
+// Devuelve true si a es mejor dispositivo que b
+static bool betterDevice(const CLDeviceInfo& a, const CLDeviceInfo& b)
+{
+    if(a.score != b.score)
+        return a.score > b.score;
+    if(a.globalMemSize != b.globalMemSize)
+        return a.globalMemSize > b.globalMemSize;
+    return a.maxWorkGroupSize > b.maxWorkGroupSize;
+}
 
-    // Obtener informacion de la plataforma
-    cl_platform_id platform;
-    clError= clGetPlatformIDs(1, &platform, NULL);
-    if(checkError(clError, "setupOpenCL: clGetPlatformIDs"))
+static bool meetsRequirements(const CLDeviceInfo& info, int requirements)
+{
+    if((requirements & DEVICE_REQUIRE_IMAGES) and !info.imageSupport)
+        return false;
+    if((requirements & DEVICE_REQUIRE_GL_SHARING) and !info.hasExtension("cl_khr_gl_sharing"))
         return false;
+    return true;
+}
 
-    // Seleccionar la GPU por defecto
-    clError= clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-    if(checkError(clError, "setupOpenCL: clGetDeviceIDs"))
+bool selectDevice(CLDeviceInfo& info, const char* spec, int requirements)
+{
+    vector<CLDeviceInfo> devices;
+    if(!enumerateDevices(devices))
         return false;
 
-    context= clCreateContext(0, 1, &device, NULL, NULL, &clError);
+    // Prioridad: parametro, --device, EAGPGPU_DEVICE
+    if(!spec and !deviceArgSpec.empty())
+        spec= deviceArgSpec.c_str();
+    if(!spec)
+        spec= getenv("EAGPGPU_DEVICE");
+    const string filter= spec ? toLower(spec) : "";
+
+    // Indice de plataforma de cada dispositivo, en el orden de printDevices
+    vector<int> platformIndex(devices.size()), deviceIndex(devices.size());
+    for(size_t i=0; i<devices.size(); i++) {
+        const bool newPlatform= !i or devices[i].platform != devices[i-1].platform;
+        platformIndex[i]= !i ? 0 : platformIndex[i-1] + (newPlatform ? 1 : 0);
+        deviceIndex[i]= newPlatform ? 0 : deviceIndex[i-1] + 1;
+    }
+
+    int p, d;
+    char extra;
+    const bool byPair= sscanf(filter.c_str(), "%d:%d%c", &p, &d, &extra) == 2;
+    const bool byIndex= !byPair and sscanf(filter.c_str(), "%d%c", &d, &extra) == 1;
+
+    int best= -1;
+    for(size_t i=0; i<devices.size(); i++) {
+        const CLDeviceInfo& candidate= devices[i];
+        bool matches;
+        if(filter.empty())
+            matches= true;
+        else if(byPair)
+            matches= platformIndex[i] == p and deviceIndex[i] == d;
+        else if(byIndex)
+            matches= (int)i == d;
+        else if(filter == "gpu")
+            matches= candidate.type & CL_DEVICE_TYPE_GPU;
+        else if(filter == "cpu")
+            matches= candidate.type & CL_DEVICE_TYPE_CPU;
+        else if(filter == "accelerator")
+            matches= candidate.type & CL_DEVICE_TYPE_ACCELERATOR;
+        else
+            matches= toLower(candidate.platformName + " " + candidate.name).find(filter) != string::npos;
+
+        if(matches and meetsRequirements(candidate, requirements) and
+           (best < 0 or betterDevice(candidate, devices[best])))
+            best= i;
+    }
+
+    if(best < 0) {
+        cerr << "No hay un dispositivo OpenCL que cumpla '" << (spec ? spec : "") << "'";
+        if(requirements & DEVICE_REQUIRE_IMAGES)
+            cerr << " con soporte de imagenes";
+        if(requirements & DEVICE_REQUIRE_GL_SHARING)
+            cerr << " con interoperabilidad OpenGL";
+        cerr << ". Dispositivos disponibles:" << endl;
+        printDevices(devices);
+        return false;
+    }
+
+    info= devices[best];
+    return true;
+}
+
+bool extractArg(int& argc, char** argv, const char* name, const char** value)
+{
+    const size_t nameLength= strlen(name);
+    for(int i=1; i<argc; i++) {
+        if(strncmp(argv[i], name, nameLength) != 0)
+            continue;
+        if(argv[i][nameLength] != '\0' and argv[i][nameLength] != '=')
+            continue;
+
+        if(value)
+            *value= argv[i][nameLength] == '=' ? argv[i] + nameLength + 1 : 0;
+
+        // Desplazar el resto de los argumentos (argv[argc] es siempre NULL)
+        for(int j=i; j<argc; j++)
+            argv[j]= argv[j+1];
+        argc--;
+        return true;
+    }
+    return false;
+}
+
+void parseDeviceArgs(int& argc, char** argv)
+{
+    if(extractArg(argc, argv, "--list-devices")) {
+        vector<CLDeviceInfo> devices;
+        if(enumerateDevices(devices))
+            printDevices(devices);
+        exit(EXIT_SUCCESS);
+    }
+
+    const char* spec;
+    if(extractArg(argc, argv, "--device", &spec)) {
+        if(!spec or !*spec) {
+            cerr << "parseDeviceArgs: --device requiere un valor" << endl;
+            cerr << "Uso: --device=<gpu|cpu|accelerator|P:D|N|nombre> o --list-devices" << endl;
+            exit(EXIT_FAILURE);
+        }
+        deviceArgSpec= spec;
+    }
+}
+
+bool setupOpenCL(cl_context& context, cl_command_queue& queue, cl_device_id& device,
+                 CLDeviceInfo* info, int requirements)
+{
+    cl_int clError;
+
+    // Elegir el dispositivo entre todas las plataformas
+    CLDeviceInfo selected;
+    if(!selectDevice(selected, 0, requirements))
+        return false;
+    device= selected.device;
+    if(info)
+        *info= selected;
+    cerr << "Dispositivo: " << selected.name << " (" << selected.typeName() << ", " << selected.platformName << ")." << endl;
+
+    cl_context_properties props[] = {
+        CL_CONTEXT_PLATFORM, (cl_context_properties)selected.platform,
+        0
+    };
+    context= clCreateContext(props, 1, &device, NULL, NULL, &clError);
     if(checkError(clError, "setupOpenCL: clCreateContext"))
         return false;
 
-    // Crear una cola de comandos la GPU seleccionada
+    // Crear una cola de comandos para el dispositivo seleccionado
     queue= clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &clError);
     if(checkError(clError, "setupOpenCL: clCreateCommandQueue"))
         return false;
@@ -32,6 +331,259 @@ bool setupOpenCL(cl_context& context, cl_command_queue& queue, cl_device_id& dev
     return true;
 }
 
+bool setupOpenCLMulti(cl_context& context, vector<cl_command_queue>& queues,
+                      vector<cl_device_id>& devices, int subDevices)
+{
+    cl_int clError;
+
+    CLDeviceInfo selected;
+    if(!selectDevice(selected))
+        return false;
+
+    devices.clear();
+    if(subDevices > 0) {
+        // Particionar el dispositivo en partes iguales de unidades de computo
+        cl_uint maxSubDevices;
+        clError= clGetDeviceInfo(selected.device, CL_DEVICE_PARTITION_MAX_SUB_DEVICES, sizeof(cl_uint), &maxSubDevices, NULL);
+        if(checkError(clError, "setupOpenCLMulti: clGetDeviceInfo"))
+            return false;
+        if(maxSubDevices < 2) {
+            cerr << "El dispositivo " << selected.name << " no se puede particionar." << endl;
+            return false;
+        }
+        if((cl_uint)subDevices > maxSubDevices)
+            subDevices= maxSubDevices;
+        // Cada sub-dispositivo necesita al menos una unidad de computo
+        if((cl_uint)subDevices > selected.computeUnits) {
+            cerr << "El dispositivo " << selected.name << " tiene " << selected.computeUnits
+                 << " unidades de computo, se usan " << selected.computeUnits << " sub-dispositivos." << endl;
+            subDevices= selected.computeUnits;
+        }
+        const cl_uint unitsPerDevice= subDevices > 0 ? selected.computeUnits / subDevices : 0;
+        if(!unitsPerDevice) {
+            cerr << "setupOpenCLMulti: no se puede particionar " << selected.name << " en " << subDevices
+                 << " partes de " << selected.computeUnits << " unidades de computo." << endl;
+            return false;
+        }
+
+        const cl_device_partition_property props[] = {
+            CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)unitsPerDevice,
+            0
+        };
+        cl_uint count;
+        clError= clCreateSubDevices(selected.device, props, 0, NULL, &count);
+        if(checkError(clError, "setupOpenCLMulti: clCreateSubDevices"))
+            return false;
+        devices.resize(count);
+        clError= clCreateSubDevices(selected.device, props, count, &devices[0], NULL);
+        if(checkError(clError, "setupOpenCLMulti: clCreateSubDevices"))
+            return false;
+
+        // Si la division no es exacta pueden sobrar sub-dispositivos
+        while(devices.size() > (size_t)subDevices) {
+            clReleaseDevice(devices.back());
+            devices.pop_back();
+        }
+    } else {
+        // Todos los dispositivos de la plataforma (un contexto no puede mezclar plataformas)
+        cl_uint count;
+        clError= clGetDeviceIDs(selected.platform, CL_DEVICE_TYPE_ALL, 0, NULL, &count);
+        if(checkError(clError, "setupOpenCLMulti: clGetDeviceIDs"))
+            return false;
+        devices.resize(count);
+        clError= clGetDeviceIDs(selected.platform, CL_DEVICE_TYPE_ALL, count, &devices[0], NULL);
+        if(checkError(clError, "setupOpenCLMulti: clGetDeviceIDs"))
+            return false;
+    }
+
+    cl_context_properties props[] = {
+        CL_CONTEXT_PLATFORM, (cl_context_properties)selected.platform,
+        0
+    };
+    context= clCreateContext(props, devices.size(), &devices[0], NULL, NULL, &clError);
+    if(checkError(clError, "setupOpenCLMulti: clCreateContext"))
+        return false;
+
+    queues.resize(devices.size());
+    for(size_t i=0; i<devices.size(); i++) {
+        queues[i]= clCreateCommandQueue(context, devices[i], CL_QUEUE_PROFILING_ENABLE, &clError);
+        if(checkError(clError, "setupOpenCLMulti: clCreateCommandQueue"))
+            return false;
+    }
+
+    return true;
+}
+
+bool parseHostMemMode(const char* text, HostMemMode& mode)
+{
+    if(!strcmp(text, "malloc"))
+        mode= HOST_MEM_MALLOC;
+    else if(!strcmp(text, "pinned"))
+        mode= HOST_MEM_PINNED;
+    else if(!strcmp(text, "zerocopy"))
+        mode= HOST_MEM_ZEROCOPY;
+    else
+        return false;
+    return true;
+}
+
+const char* hostMemModeName(HostMemMode mode)
+{
+    switch(mode) {
+        case HOST_MEM_MALLOC:   return "malloc";
+        case HOST_MEM_PINNED:   return "pinned";
+        case HOST_MEM_ZEROCOPY: return "zerocopy";
+    }
+    return "unknown";
+}
+
+bool createHostBuffer(cl_context context, cl_command_queue queue, cl_mem_flags flags, size_t bytes,
+                      HostMemMode mode, HostBuffer& buffer)
+{
+    cl_int error;
+
+    buffer.mode= mode;
+    buffer.bytes= bytes;
+    buffer.host= NULL;
+    buffer.device= NULL;
+    buffer.staging= NULL;
+    buffer.aligned= NULL;
+    buffer.mapped= false;
+
+    switch(mode) {
+    case HOST_MEM_MALLOC:
+        buffer.host= malloc(bytes);
+        if(!buffer.host)
+            return false;
+        buffer.device= clCreateBuffer(context, flags, bytes, NULL, &error);
+        return !checkError(error, "createHostBuffer: clCreateBuffer");
+
+    case HOST_MEM_PINNED:
+        // El runtime reserva memoria de host page-locked para el buffer de staging,
+        // desde la que el dispositivo puede copiar por DMA sin copias intermedias
+        buffer.staging= clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL, &error);
+        if(checkError(error, "createHostBuffer: clCreateBuffer"))
+            return false;
+        buffer.host= clEnqueueMapBuffer(queue, buffer.staging, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, NULL, NULL, &error);
+        if(checkError(error, "createHostBuffer: clEnqueueMapBuffer"))
+            return false;
+        buffer.device= clCreateBuffer(context, flags, bytes, NULL, &error);
+        return !checkError(error, "createHostBuffer: clCreateBuffer");
+
+    case HOST_MEM_ZEROCOPY: {
+        // Para que el runtime pueda usar la memoria sin copiarla, debe estar alineada
+        // a pagina (o a CL_DEVICE_MEM_BASE_ADDR_ALIGN si es mayor) y su tamanio debe
+        // ser multiplo de una linea de cache
+        cl_device_id device;
+        cl_uint baseAlignBits;
+        error  = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+        error |= clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &baseAlignBits, NULL);
+        if(checkError(error, "createHostBuffer: clGetDeviceInfo"))
+            return false;
+        const size_t alignment= max((size_t)4096, (size_t)baseAlignBits / 8);
+        const size_t alignedBytes= (bytes + 63) / 64 * 64;
+        if(posix_memalign(&buffer.aligned, alignment, alignedBytes) != 0)
+            return false;
+
+        buffer.device= clCreateBuffer(context, flags | CL_MEM_USE_HOST_PTR, alignedBytes, buffer.aligned, &error);
+        if(checkError(error, "createHostBuffer: clCreateBuffer"))
+            return false;
+        // Un kernel no puede usar un buffer mapeado: los de salida quedan sin mapear
+        // (se mapean en enqueueDownload) y los de entrada se mapean para que el host
+        // escriba los datos, hasta enqueueUpload
+        if(flags & CL_MEM_WRITE_ONLY)
+            return true;
+        return mapHostBuffer(queue, buffer);
+    }
+    }
+    return false;
+}
+
+bool mapHostBuffer(cl_command_queue queue, HostBuffer& buffer)
+{
+    if(buffer.mode != HOST_MEM_ZEROCOPY or buffer.mapped)
+        return true;
+
+    cl_int error;
+    buffer.host= clEnqueueMapBuffer(queue, buffer.device, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, buffer.bytes, 0, NULL, NULL, &error);
+    if(checkError(error, "mapHostBuffer: clEnqueueMapBuffer"))
+        return false;
+    buffer.mapped= true;
+    return true;
+}
+
+bool enqueueUpload(cl_command_queue queue, HostBuffer& buffer, cl_event* event)
+{
+    cl_int error;
+    if(buffer.mode == HOST_MEM_ZEROCOPY) {
+        if(!buffer.mapped) {
+            if(event)
+                *event= NULL;
+            return true;
+        }
+        error= clEnqueueUnmapMemObject(queue, buffer.device, buffer.host, 0, NULL, event);
+        buffer.mapped= false;
+        return !checkError(error, "enqueueUpload: clEnqueueUnmapMemObject");
+    }
+
+    error= clEnqueueWriteBuffer(queue, buffer.device, CL_FALSE, 0, buffer.bytes, buffer.host, 0, NULL, event);
+    return !checkError(error, "enqueueUpload: clEnqueueWriteBuffer");
+}
+
+bool enqueueDownload(cl_command_queue queue, HostBuffer& buffer, cl_bool blocking, cl_event* event)
+{
+    cl_int error;
+    if(buffer.mode == HOST_MEM_ZEROCOPY) {
+        // Siempre se mapea despues de los kernels, aunque el host tuviera mapeado el
+        // buffer: en una GPU discreta el map es el que trae los datos
+        if(buffer.mapped) {
+            error= clEnqueueUnmapMemObject(queue, buffer.device, buffer.host, 0, NULL, NULL);
+            buffer.mapped= false;
+            if(checkError(error, "enqueueDownload: clEnqueueUnmapMemObject"))
+                return false;
+        }
+        buffer.host= clEnqueueMapBuffer(queue, buffer.device, blocking, CL_MAP_READ | CL_MAP_WRITE, 0, buffer.bytes, 0, NULL, event, &error);
+        if(checkError(error, "enqueueDownload: clEnqueueMapBuffer"))
+            return false;
+        buffer.mapped= true;
+        return true;
+    }
+
+    error= clEnqueueReadBuffer(queue, buffer.device, blocking, 0, buffer.bytes, buffer.host, 0, NULL, event);
+    return !checkError(error, "enqueueDownload: clEnqueueReadBuffer");
+}
+
+void releaseHostBuffer(cl_command_queue queue, HostBuffer& buffer)
+{
+    switch(buffer.mode) {
+    case HOST_MEM_MALLOC:
+        free(buffer.host);
+        break;
+    case HOST_MEM_PINNED:
+        if(buffer.host)
+            clEnqueueUnmapMemObject(queue, buffer.staging, buffer.host, 0, NULL, NULL);
+        break;
+    case HOST_MEM_ZEROCOPY:
+        if(buffer.mapped)
+            clEnqueueUnmapMemObject(queue, buffer.device, buffer.host, 0, NULL, NULL);
+        break;
+    }
+    // Esperar los unmap antes de liberar los buffers y la memoria alineada
+    clFinish(queue);
+
+    if(buffer.device)
+        clReleaseMemObject(buffer.device);
+    if(buffer.staging)
+        clReleaseMemObject(buffer.staging);
+    free(buffer.aligned);
+
+    buffer.host= NULL;
+    buffer.device= NULL;
+    buffer.staging= NULL;
+    buffer.aligned= NULL;
+    buffer.mapped= false;
+}
+
 string clErrorToString(cl_int err)
 {
     switch (err) {
@@ -119,7 +671,55 @@ float eventElapsed(cl_event event)
     return float(end_time - start_time) * 1.0e-6f; // in ms.
 }
 
-bool loadKernel(cl_context context, cl_kernel* kernel, cl_device_id device, const char* path, const char* kernelName)
+double hostTimeMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1.0e3 + now.tv_nsec * 1.0e-6;
+}
+
+string getDeviceString(cl_device_id device, cl_device_info param)
+{
+    size_t length;
+    cl_int error= clGetDeviceInfo(device, param, 0, NULL, &length);
+    if(checkError(error, "getDeviceString: clGetDeviceInfo") or !length)
+        return "";
+
+    vector<char> text(length);
+    error= clGetDeviceInfo(device, param, length, &text[0], NULL);
+    if(checkError(error, "getDeviceString: clGetDeviceInfo"))
+        return "";
+
+    return string(&text[0]);
+}
+
+string jsonEscape(const string& text)
+{
+    string escaped;
+    for(size_t i=0; i<text.size(); i++) {
+        const unsigned char c= text[i];
+        switch(c) {
+        case '"':  escaped+= "\\\""; break;
+        case '\\': escaped+= "\\\\"; break;
+        case '\n': escaped+= "\\n"; break;
+        case '\r': escaped+= "\\r"; break;
+        case '\t': escaped+= "\\t"; break;
+        case '\b': escaped+= "\\b"; break;
+        case '\f': escaped+= "\\f"; break;
+        default:
+            if(c < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                escaped+= code;
+            } else {
+                escaped+= c;
+            }
+        }
+    }
+    return escaped;
+}
+
+bool loadProgram(cl_context context, cl_program* program, cl_device_id device, const char* path, const char* options)
 {
     // Cargar texto de programa a un string
     char* programText;
@@ -128,21 +728,29 @@ bool loadKernel(cl_context context, cl_kernel* kernel, cl_device_id device, cons
         cerr << "Error al cargar archivo de programa." << endl;
         return false;
     }
-    // Crear programa
-    cl_int error;
-    cl_program program;
-    program= clCreateProgramWithSource(context, 1, (const char **)&programText, (const size_t *)&programLength, &error);
+    // Crear y compilar el programa para todos los dispositivos del contexto,
+    // reutilizando el binario de una ejecucion anterior si es posible
+    const bool built= buildProgramCached(context, programText, programLength, options, program);
     free(programText);
-    if(checkError(error, "loadKernel: clCreateProgramWithSource"))
-        return false;
-    // Compilar programa para todos los dispositivos del contexto
-    error= clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if(checkError(error, "loadKernel: clBuildProgram")) {
-        checkProgramBuild(program, device);
+    if(!built) {
+        if(*program) {
+            checkProgramBuild(*program, device);
+            clReleaseProgram(*program);
+        }
         return false;
     }
 
+    return true;
+}
+
+bool loadKernel(cl_context context, cl_kernel* kernel, cl_device_id device, const char* path, const char* kernelName)
+{
+    cl_program program;
+    if(!loadProgram(context, &program, device, path))
+        return false;
+
     // Crear kernel a partir del programa (un programa puede tener varios kernels)
+    cl_int error;
     *kernel= clCreateKernel(program, kernelName, &error);
     if(checkError(error, "loadKernel: clCreateKernel"))
         return false;
@@ -10,9 +10,153 @@
 
 #include <CL/cl.h>
 
+#include <string>
+#include <vector>
+
+// Capacidades de un dispositivo OpenCL, usadas para elegir el dispositivo
+// y para adaptar los tamanios de trabajo a cada uno
+struct CLDeviceInfo {
+    cl_platform_id platform;
+    cl_device_id device;
+
+    std::string platformName;
+    std::string name;
+    std::string vendor;
+    std::string version;
+    std::string driverVersion;
+    std::string extensions;
+
+    cl_device_type type;
+    cl_uint computeUnits;
+    cl_uint clockMHz;
+    cl_ulong globalMemSize;
+    cl_ulong localMemSize;
+    cl_ulong maxAllocSize;
+    size_t maxWorkGroupSize;
+    size_t maxWorkItemSizes[3];
+    cl_uint preferredVectorWidthFloat;
+    bool imageSupport;
+    bool hostUnifiedMemory;
+
+    // Puntaje para elegir el dispositivo mas rapido (ver selectDevice)
+    double score;
+
+    // Devuelve true si el dispositivo soporta la extension ext
+    bool hasExtension(const char* ext) const;
+    // Tipo de dispositivo como texto ("GPU", "CPU", ...)
+    const char* typeName() const;
+};
+
+// Requerimientos que puede exigir un programa al elegir el dispositivo
+enum DeviceRequirements {
+    DEVICE_REQUIRE_IMAGES= 1,     // Soporte de imagenes
+    DEVICE_REQUIRE_GL_SHARING= 2  // Interoperabilidad con OpenGL (cl_khr_gl_sharing)
+};
+
+// Llena info con las capacidades del dispositivo device
+// Devuelve false en caso de error
+bool getDeviceInfo(cl_device_id device, CLDeviceInfo& info);
+
+// Enumera todos los dispositivos de todas las plataformas disponibles
+// Devuelve false en caso de error o si no hay ningun dispositivo
+bool enumerateDevices(std::vector<CLDeviceInfo>& devices);
+
+// Muestra la lista de dispositivos por cerr, con el indice a usar en --device
+void printDevices(const std::vector<CLDeviceInfo>& devices);
+
+// Elige un dispositivo segun spec, que puede ser:
+//  - "gpu", "cpu" o "accelerator": el mejor dispositivo de ese tipo
+//  - "P:D": el dispositivo D de la plataforma P (indices de printDevices)
+//  - "N": el dispositivo N de la lista completa
+//  - cualquier otro texto: el mejor dispositivo cuyo nombre o plataforma lo contenga
+//    (sin distinguir mayusculas, por ejemplo "pocl" o "nvidia")
+// Si spec es 0 se usa el valor de --device (ver parseDeviceArgs), o si no se
+// paso, la variable de entorno EAGPGPU_DEVICE. Sin ninguno de ellos se elige el
+// dispositivo de mayor puntaje: unidades de computo x frecuencia x un factor por
+// tipo (GPU > acelerador > CPU), desempatando por memoria global y por tamanio
+// maximo de work-group.
+// Solo se consideran los dispositivos que cumplen requirements (DeviceRequirements).
+// Devuelve false si ningun dispositivo cumple.
+bool selectDevice(CLDeviceInfo& info, const char* spec= 0, int requirements= 0);
+
+// Procesa y elimina de argv los argumentos de seleccion de dispositivo:
+//  --device=<spec>  Dispositivo a usar (ver selectDevice)
+//  --list-devices   Muestra los dispositivos disponibles y termina el programa
+// --device sin valor (por ejemplo "--device gpu") es un error y termina el programa.
+// Debe llamarse al inicio de main, antes de procesar el resto de los argumentos
+void parseDeviceArgs(int& argc, char** argv);
+
+// Busca en argv el argumento "name" o "name=valor" y lo elimina de argv.
+// Si value no es 0 se escribe en el el valor (o 0 si no tenia).
+// Devuelve true si se encontro el argumento.
+bool extractArg(int& argc, char** argv, const char* name, const char** value= 0);
+
 // Configura OpenCL y setea el contexto, command queue y device pasados por referencia
+// El dispositivo se elige con selectDevice; si info no es 0 se copian ahi sus capacidades
+// Devuelve false en caso de error
+bool setupOpenCL(cl_context& context, cl_command_queue& queue, cl_device_id& device,
+                 CLDeviceInfo* info= 0, int requirements= 0);
+
+// Configura un contexto con varios dispositivos y una command queue (con profiling)
+// para cada uno, para repartir un computo entre todos ellos.
+// Si subDevices es 0 se usan todos los dispositivos de la plataforma del dispositivo
+// elegido con selectDevice. Si es mayor a 0, el dispositivo elegido se particiona en
+// subDevices sub-dispositivos con la misma cantidad de unidades de computo cada uno
+// (clCreateSubDevices, tipicamente sobre una CPU).
+// Los dispositivos se liberan con clReleaseDevice.
+// Devuelve false en caso de error
+bool setupOpenCLMulti(cl_context& context, std::vector<cl_command_queue>& queues,
+                      std::vector<cl_device_id>& devices, int subDevices= 0);
+
+// Formas de reservar la memoria del host de un buffer que se sube o baja del dispositivo
+enum HostMemMode {
+    HOST_MEM_MALLOC,   // malloc y copias con clEnqueueWriteBuffer/clEnqueueReadBuffer
+    HOST_MEM_PINNED,   // Buffer de staging CL_MEM_ALLOC_HOST_PTR ("pinned"), mapeado de forma
+                       // persistente, y copias desde/hacia el buffer del dispositivo
+    HOST_MEM_ZEROCOPY  // Un unico buffer CL_MEM_USE_HOST_PTR sobre memoria alineada, accedido
+                       // con map/unmap. En dispositivos CPU no hay ninguna copia.
+};
+
+// Buffer con su memoria de host y de dispositivo, ver createHostBuffer
+struct HostBuffer {
+    HostMemMode mode;
+    size_t bytes;
+    void* host;      // Datos en el host. En zero-copy solo es valido mientras esta mapeado.
+    cl_mem device;   // Buffer que usan los kernels
+    cl_mem staging;  // Buffer pinned (solo HOST_MEM_PINNED)
+    void* aligned;   // Memoria alineada de CL_MEM_USE_HOST_PTR (solo HOST_MEM_ZEROCOPY)
+    bool mapped;
+};
+
+// Interpreta "malloc", "pinned" o "zerocopy". Devuelve false si text no es ninguno.
+bool parseHostMemMode(const char* text, HostMemMode& mode);
+const char* hostMemModeName(HostMemMode mode);
+
+// Crea un buffer de bytes bytes con los flags de acceso flags (CL_MEM_READ_ONLY, ...)
+// para el kernel, reservando la memoria del host segun mode. Al terminar,
+// buffer.host es valido para escribir los datos de entrada, salvo en zero-copy con
+// CL_MEM_WRITE_ONLY: el buffer de salida queda sin mapear hasta enqueueDownload.
 // Devuelve false en caso de error
-bool setupOpenCL(cl_context& context, cl_command_queue& queue, cl_device_id& device);
+bool createHostBuffer(cl_context context, cl_command_queue queue, cl_mem_flags flags, size_t bytes,
+                      HostMemMode mode, HostBuffer& buffer);
+
+// Encola lo necesario para que los kernels vean los datos de buffer.host: una copia
+// (malloc y pinned) o el unmap (zero-copy). Luego buffer.host no debe usarse hasta
+// llamar a enqueueDownload o mapHostBuffer. Si event no es 0 se devuelve el evento
+// (NULL si no hubo que encolar nada).
+bool enqueueUpload(cl_command_queue queue, HostBuffer& buffer, cl_event* event= 0);
+
+// Encola lo necesario para tener en buffer.host los datos que escribieron los kernels:
+// una copia (malloc y pinned) o un map (zero-copy). buffer.host puede cambiar. En
+// zero-copy el buffer queda mapeado: hay que llamar a enqueueUpload antes de volver a
+// usarlo en un kernel.
+bool enqueueDownload(cl_command_queue queue, HostBuffer& buffer, cl_bool blocking, cl_event* event= 0);
+
+// Hace valido buffer.host sin traer los datos del dispositivo (solo mapea en zero-copy)
+bool mapHostBuffer(cl_command_queue queue, HostBuffer& buffer);
+
+// Libera la memoria de host y de dispositivo de buffer
+void releaseHostBuffer(cl_command_queue queue, HostBuffer& buffer);
 
 // Si error es diferente a CL_SUCCESS muestra el error y devuelve true
 // Si se pasa el parametro msg, se muestra adicionalmente ese mensaje de error
@@ -25,6 +169,22 @@ int roundUp(int count, int multiple);
 // Devuelve el tiempo en milisegundos desde desde el inicio al fin de event
 float eventElapsed(cl_event event);
 
+// Devuelve un tiempo en milisegundos de un reloj monotono del host
+double hostTimeMs();
+
+// Devuelve como string el parametro param (de tipo texto) del dispositivo device
+std::string getDeviceString(cl_device_id device, cl_device_info param);
+
+// Devuelve text escapado para ponerlo entre comillas en un string JSON: comillas,
+// barras invertidas y caracteres de control (\n, \t, ... o \u00XX)
+std::string jsonEscape(const std::string& text);
+
+// Carga el programa del archivo .cl indicado en path y lo compila con las opciones
+// options (puede ser 0) para todos los dispositivos del contexto, usando la cache
+// de programas compilados (ver programcache.h)
+// Devuelve false en caso de error
+bool loadProgram(cl_context context, cl_program* program, cl_device_id device, const char* path, const char* options= 0);
+
 // Carga un kernel llamado kernelName en el archivo .cl indicado en path
 // Devuelve false en caso de error
 bool loadKernel(cl_context context, cl_kernel* kernel, cl_device_id device, const char* path, const char* kernelName);
@@ -0,0 +1,117 @@
+// Operaciones elemento a elemento sobre vectores de n floats
+//
+// Se compila con -D VECTOR_WIDTH=<1, 2, 4, 8 o 16> (ver elementwise.h). Cada
+// work-item procesa VECTOR_WIDTH elementos por iteracion con vloadn/vstoren, y
+// recorre el vector con un grid-stride loop: el work-item i procesa los grupos
+// i, i + get_global_size(0), i + 2 * get_global_size(0), etc. Asi el NDRange no
+// depende de n y se puede lanzar solo la cantidad de work-groups que llenan el
+// dispositivo.
+//
+// Si n no es multiplo de VECTOR_WIDTH, los ultimos n % VECTOR_WIDTH elementos
+// (la cola) se procesan de a uno en un segundo loop.
+
+// Sin contraer a * x + y en un fma: el resultado no depende del compilador y es
+// el mismo que el del kernel fusionado equivalente (ver fusedexpr.h)
+#pragma OPENCL FP_CONTRACT OFF
+
+#ifndef VECTOR_WIDTH
+#define VECTOR_WIDTH 4
+#endif
+
+#if VECTOR_WIDTH == 1
+typedef float floatv;
+#define LOADV(i, p)     (p)[i]
+#define STOREV(v, i, p) (p)[i]= (v)
+#else
+// Dos niveles para que VECTOR_WIDTH se expanda antes de concatenar
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+typedef CAT(float, VECTOR_WIDTH) floatv;
+#define LOADV(i, p)     CAT(vload, VECTOR_WIDTH)(i, p)
+#define STOREV(v, i, p) CAT(vstore, VECTOR_WIDTH)(v, i, p)
+#endif
+
+// Primer elemento de la cola y paso del grid-stride loop
+#define VEC_COUNT (n / VECTOR_WIDTH)
+#define TAIL_START (VEC_COUNT * VECTOR_WIDTH)
+#define STRIDE ((int)get_global_size(0))
+
+// B = k * A
+__kernel void vectorScale(
+    __global const float* A,
+    __global float* B,
+    float k,
+    int n)
+{
+    for(int i= get_global_id(0); i<VEC_COUNT; i+=STRIDE)
+        STOREV(k * LOADV(i, A), i, B);
+    for(int i= TAIL_START + get_global_id(0); i<n; i+=STRIDE)
+        B[i]= k * A[i];
+}
+
+// Y = a * X + Y
+__kernel void vectorAxpy(
+    __global const float* X,
+    __global float* Y,
+    float a,
+    int n)
+{
+    for(int i= get_global_id(0); i<VEC_COUNT; i+=STRIDE)
+        STOREV(a * LOADV(i, X) + LOADV(i, Y), i, Y);
+    for(int i= TAIL_START + get_global_id(0); i<n; i+=STRIDE)
+        Y[i]= a * X[i] + Y[i];
+}
+
+// C = A + B
+__kernel void vectorAdd(
+    __global const float* A,
+    __global const float* B,
+    __global float* C,
+    int n)
+{
+    for(int i= get_global_id(0); i<VEC_COUNT; i+=STRIDE)
+        STOREV(LOADV(i, A) + LOADV(i, B), i, C);
+    for(int i= TAIL_START + get_global_id(0); i<n; i+=STRIDE)
+        C[i]= A[i] + B[i];
+}
+
+// C = A * B
+__kernel void vectorMul(
+    __global const float* A,
+    __global const float* B,
+    __global float* C,
+    int n)
+{
+    for(int i= get_global_id(0); i<VEC_COUNT; i+=STRIDE)
+        STOREV(LOADV(i, A) * LOADV(i, B), i, C);
+    for(int i= TAIL_START + get_global_id(0); i<n; i+=STRIDE)
+        C[i]= A[i] * B[i];
+}
+
+// D = A * B + C, con un solo redondeo (fma)
+__kernel void vectorFma(
+    __global const float* A,
+    __global const float* B,
+    __global const float* C,
+    __global float* D,
+    int n)
+{
+    for(int i= get_global_id(0); i<VEC_COUNT; i+=STRIDE)
+        STOREV(fma(LOADV(i, A), LOADV(i, B), LOADV(i, C)), i, D);
+    for(int i= TAIL_START + get_global_id(0); i<n; i+=STRIDE)
+        D[i]= fma(A[i], B[i], C[i]);
+}
+
+// B = min(max(A, lo), hi)
+__kernel void vectorClamp(
+    __global const float* A,
+    __global float* B,
+    float lo,
+    float hi,
+    int n)
+{
+    for(int i= get_global_id(0); i<VEC_COUNT; i+=STRIDE)
+        STOREV(clamp(LOADV(i, A), lo, hi), i, B);
+    for(int i= TAIL_START + get_global_id(0); i<n; i+=STRIDE)
+        B[i]= clamp(A[i], lo, hi);
+}
@@ -0,0 +1,172 @@
+#include "elementwise.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+// Nombres de los kernels, en el orden de Elementwise::Op
+static const char* kernelNames[] = { "vectorScale", "vectorAxpy", "vectorAdd", "vectorMul", "vectorFma", "vectorClamp" };
+
+// Work-groups por unidad de computo: suficientes para ocultar la latencia de memoria
+static const size_t groupsPerComputeUnit= 8;
+
+Elementwise::Elementwise()
+{
+    program= NULL;
+    for(int op=0; op<OP_COUNT; op++) {
+        kernels[op]= NULL;
+        localSizes[op]= 1;
+    }
+    vectorWidth= 0;
+    maxGroups= 0;
+}
+
+bool Elementwise::init(cl_context context, cl_device_id device, int vectorWidth, const char* path)
+{
+    release();
+
+    cl_uint preferredWidth, computeUnits;
+    cl_int error;
+    error  = clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &preferredWidth, NULL);
+    error |= clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    if(checkError(error, "Elementwise::init: clGetDeviceInfo"))
+        return false;
+
+    if(!vectorWidth)
+        vectorWidth= preferredWidth;
+    // Redondear para abajo a un ancho valido de OpenCL (1, 2, 4, 8 o 16)
+    int width= 1;
+    while(width * 2 <= min(vectorWidth, 16))
+        width*= 2;
+    this->vectorWidth= width;
+    maxGroups= max(computeUnits, 1u) * groupsPerComputeUnit;
+
+    ostringstream options;
+    options << "-D VECTOR_WIDTH=" << width;
+    if(!loadProgram(context, &program, device, path, options.str().c_str())) {
+        program= NULL;
+        return false;
+    }
+
+    for(int op=0; op<OP_COUNT; op++) {
+        kernels[op]= clCreateKernel(program, kernelNames[op], &error);
+        if(checkError(error, "Elementwise::init: clCreateKernel"))
+            return false;
+
+        // Hasta 256 work-items, en multiplos del tamanio preferido por el kernel
+        size_t maxSize, multiple;
+        error  = clGetKernelWorkGroupInfo(kernels[op], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxSize, NULL);
+        error |= clGetKernelWorkGroupInfo(kernels[op], device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &multiple, NULL);
+        if(checkError(error, "Elementwise::init: clGetKernelWorkGroupInfo"))
+            return false;
+        const size_t size= min(maxSize, (size_t)256);
+        localSizes[op]= (multiple and size >= multiple) ? size / multiple * multiple : size;
+    }
+
+    return true;
+}
+
+bool Elementwise::enqueue(Op op, cl_command_queue queue, int n, cl_event* event)
+{
+    // Un work-item por grupo de vectorWidth elementos (y al menos un work-group, para la
+    // cola), sin pasar de maxGroups work-groups: el resto lo cubre el grid-stride loop
+    const size_t localSize= localSizes[op];
+    const size_t vectors= max((size_t)n / vectorWidth, (size_t)1);
+    const size_t groups= min((vectors + localSize - 1) / localSize, maxGroups);
+    const size_t ndRangeSize= groups * localSize;
+
+    cl_int error= clEnqueueNDRangeKernel(queue, kernels[op], 1, NULL, &ndRangeSize, &localSize, 0, NULL, event);
+    if(checkError(error, "Elementwise: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+bool Elementwise::enqueueScale(cl_command_queue queue, cl_mem A, cl_mem B, float k, int n, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(kernels[SCALE], 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(kernels[SCALE], 1, sizeof(cl_mem), &B);
+    error |= clSetKernelArg(kernels[SCALE], 2, sizeof(cl_float), &k);
+    error |= clSetKernelArg(kernels[SCALE], 3, sizeof(cl_int), &n);
+    if(checkError(error, "Elementwise::enqueueScale: clSetKernelArg"))
+        return false;
+    return enqueue(SCALE, queue, n, event);
+}
+
+bool Elementwise::enqueueAxpy(cl_command_queue queue, float a, cl_mem X, cl_mem Y, int n, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(kernels[AXPY], 0, sizeof(cl_mem), &X);
+    error |= clSetKernelArg(kernels[AXPY], 1, sizeof(cl_mem), &Y);
+    error |= clSetKernelArg(kernels[AXPY], 2, sizeof(cl_float), &a);
+    error |= clSetKernelArg(kernels[AXPY], 3, sizeof(cl_int), &n);
+    if(checkError(error, "Elementwise::enqueueAxpy: clSetKernelArg"))
+        return false;
+    return enqueue(AXPY, queue, n, event);
+}
+
+bool Elementwise::enqueueAdd(cl_command_queue queue, cl_mem A, cl_mem B, cl_mem C, int n, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(kernels[ADD], 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(kernels[ADD], 1, sizeof(cl_mem), &B);
+    error |= clSetKernelArg(kernels[ADD], 2, sizeof(cl_mem), &C);
+    error |= clSetKernelArg(kernels[ADD], 3, sizeof(cl_int), &n);
+    if(checkError(error, "Elementwise::enqueueAdd: clSetKernelArg"))
+        return false;
+    return enqueue(ADD, queue, n, event);
+}
+
+bool Elementwise::enqueueMul(cl_command_queue queue, cl_mem A, cl_mem B, cl_mem C, int n, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(kernels[MUL], 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(kernels[MUL], 1, sizeof(cl_mem), &B);
+    error |= clSetKernelArg(kernels[MUL], 2, sizeof(cl_mem), &C);
+    error |= clSetKernelArg(kernels[MUL], 3, sizeof(cl_int), &n);
+    if(checkError(error, "Elementwise::enqueueMul: clSetKernelArg"))
+        return false;
+    return enqueue(MUL, queue, n, event);
+}
+
+bool Elementwise::enqueueFma(cl_command_queue queue, cl_mem A, cl_mem B, cl_mem C, cl_mem D, int n, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(kernels[FMA], 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(kernels[FMA], 1, sizeof(cl_mem), &B);
+    error |= clSetKernelArg(kernels[FMA], 2, sizeof(cl_mem), &C);
+    error |= clSetKernelArg(kernels[FMA], 3, sizeof(cl_mem), &D);
+    error |= clSetKernelArg(kernels[FMA], 4, sizeof(cl_int), &n);
+    if(checkError(error, "Elementwise::enqueueFma: clSetKernelArg"))
+        return false;
+    return enqueue(FMA, queue, n, event);
+}
+
+bool Elementwise::enqueueClamp(cl_command_queue queue, cl_mem A, cl_mem B, float lo, float hi, int n, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(kernels[CLAMP], 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(kernels[CLAMP], 1, sizeof(cl_mem), &B);
+    error |= clSetKernelArg(kernels[CLAMP], 2, sizeof(cl_float), &lo);
+    error |= clSetKernelArg(kernels[CLAMP], 3, sizeof(cl_float), &hi);
+    error |= clSetKernelArg(kernels[CLAMP], 4, sizeof(cl_int), &n);
+    if(checkError(error, "Elementwise::enqueueClamp: clSetKernelArg"))
+        return false;
+    return enqueue(CLAMP, queue, n, event);
+}
+
+void Elementwise::release()
+{
+    for(int op=0; op<OP_COUNT; op++) {
+        if(kernels[op])
+            clReleaseKernel(kernels[op]);
+        kernels[op]= NULL;
+    }
+    if(program)
+        clReleaseProgram(program);
+    program= NULL;
+}
@@ -0,0 +1,73 @@
+/*
+ * elementwise.h
+ *
+ * Operaciones elemento a elemento (scale, axpy, add, mul, fma y clamp) sobre
+ * buffers de n floats
+ *
+ * Los kernels de elementwise.cl leen y escriben de a VECTOR_WIDTH floats por
+ * work-item, con el ancho elegido por dispositivo segun
+ * CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT (en CPUs suele ser 4 u 8, lo que
+ * permite usar SIMD; en GPUs suele ser 1). El NDRange es 1D y de tamanio fijo
+ * (algunos work-groups por unidad de computo): cada work-item recorre el
+ * buffer con un grid-stride loop, asi que n puede ser cualquier valor, incluso
+ * no multiplo del ancho del vector.
+ *
+ * Estas operaciones estan limitadas por el ancho de banda de memoria: el tiempo
+ * esperado es la cantidad de bytes leidos y escritos dividida por el ancho de
+ * banda del dispositivo.
+ */
+
+#ifndef ELEMENTWISE_H
+#define ELEMENTWISE_H
+
+#include <CL/cl.h>
+
+class Elementwise
+{
+public:
+    Elementwise();
+    ~Elementwise() { release(); }
+
+    // Compila los kernels de path para vectores de vectorWidth floats (1, 2, 4, 8
+    // o 16). Con vectorWidth 0 se usa CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT.
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, int vectorWidth= 0,
+              const char* path= "../../common/elementwise.cl");
+
+    // Todas las operaciones encolan un kernel sobre n elementos. Si event no es
+    // NULL devuelven el evento del kernel. Devuelven false en caso de error.
+
+    // B = k * A
+    bool enqueueScale(cl_command_queue queue, cl_mem A, cl_mem B, float k, int n, cl_event* event= 0);
+    // Y = a * X + Y
+    bool enqueueAxpy(cl_command_queue queue, float a, cl_mem X, cl_mem Y, int n, cl_event* event= 0);
+    // C = A + B
+    bool enqueueAdd(cl_command_queue queue, cl_mem A, cl_mem B, cl_mem C, int n, cl_event* event= 0);
+    // C = A * B
+    bool enqueueMul(cl_command_queue queue, cl_mem A, cl_mem B, cl_mem C, int n, cl_event* event= 0);
+    // D = A * B + C
+    bool enqueueFma(cl_command_queue queue, cl_mem A, cl_mem B, cl_mem C, cl_mem D, int n, cl_event* event= 0);
+    // B = min(max(A, lo), hi)
+    bool enqueueClamp(cl_command_queue queue, cl_mem A, cl_mem B, float lo, float hi, int n, cl_event* event= 0);
+
+    int getVectorWidth() const { return vectorWidth; }
+
+    // Libera el programa y los kernels
+    void release();
+
+private:
+    enum Op { SCALE, AXPY, ADD, MUL, FMA, CLAMP, OP_COUNT };
+
+    // Encola el kernel de op (con sus argumentos ya seteados) sobre n elementos
+    bool enqueue(Op op, cl_command_queue queue, int n, cl_event* event);
+
+    cl_program program;
+    cl_kernel kernels[OP_COUNT];
+    size_t localSizes[OP_COUNT];
+
+    int vectorWidth;
+    // Cantidad maxima de work-groups por ejecucion
+    size_t maxGroups;
+};
+
+#endif // ELEMENTWISE_H
@@ -0,0 +1,265 @@
+#include "fusedexpr.h"
+#include "clutils.h"
+#include "programcache.h"
+
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+#include <pthread.h>
+
+using namespace std;
+
+// Kernel generado y compilado para un contexto y dispositivo
+struct FusedKernel {
+    cl_program program;
+    cl_kernel kernel;
+    int vectorWidth;
+    size_t localSize;
+    size_t maxGroups;
+};
+
+// Kernels compilados, por codigo fuente, contexto y dispositivo
+static map<string, FusedKernel> fusedKernels;
+// Protege fusedKernels y los argumentos de los kernels, que se comparten entre expresiones
+static pthread_mutex_t fusedLock= PTHREAD_MUTEX_INITIALIZER;
+
+// Mismo esquema que elementwise.cl: VECTOR_WIDTH floats por work-item y grid-stride loop
+static const char* prelude=
+    "#pragma OPENCL FP_CONTRACT OFF\n"
+    "#if VECTOR_WIDTH == 1\n"
+    "typedef float floatv;\n"
+    "#define LOADV(i, p)     (p)[i]\n"
+    "#define STOREV(v, i, p) (p)[i]= (v)\n"
+    "#else\n"
+    "#define CAT_(a, b) a##b\n"
+    "#define CAT(a, b) CAT_(a, b)\n"
+    "typedef CAT(float, VECTOR_WIDTH) floatv;\n"
+    "#define LOADV(i, p)     CAT(vload, VECTOR_WIDTH)(i, p)\n"
+    "#define STOREV(v, i, p) CAT(vstore, VECTOR_WIDTH)(v, i, p)\n"
+    "#endif\n"
+    "#define VEC_COUNT (n / VECTOR_WIDTH)\n"
+    "#define TAIL_START (VEC_COUNT * VECTOR_WIDTH)\n"
+    "#define STRIDE ((int)get_global_size(0))\n\n";
+
+// Work-groups por unidad de computo (igual que Elementwise)
+static const size_t groupsPerComputeUnit= 8;
+
+FusedExpr& FusedExpr::scale(float k)
+{
+    scalars.push_back(k);
+    return addStep(SCALE, scalars.size() - 1, 0);
+}
+
+FusedExpr& FusedExpr::addScalar(float c)
+{
+    scalars.push_back(c);
+    return addStep(ADD_SCALAR, scalars.size() - 1, 0);
+}
+
+FusedExpr& FusedExpr::add(cl_mem B)
+{
+    operands.push_back(B);
+    return addStep(ADD, operands.size() - 1, 0);
+}
+
+FusedExpr& FusedExpr::mul(cl_mem B)
+{
+    operands.push_back(B);
+    return addStep(MUL, operands.size() - 1, 0);
+}
+
+FusedExpr& FusedExpr::fma(cl_mem B, cl_mem C)
+{
+    operands.push_back(B);
+    operands.push_back(C);
+    return addStep(FMA, operands.size() - 2, operands.size() - 1);
+}
+
+FusedExpr& FusedExpr::clamp(float lo, float hi)
+{
+    scalars.push_back(lo);
+    scalars.push_back(hi);
+    return addStep(CLAMP, scalars.size() - 2, scalars.size() - 1);
+}
+
+FusedExpr& FusedExpr::addStep(StepType type, int operand0, int operand1)
+{
+    Step step;
+    step.type= type;
+    step.operand[0]= operand0;
+    step.operand[1]= operand1;
+    steps.push_back(step);
+    return *this;
+}
+
+void FusedExpr::clear()
+{
+    steps.clear();
+    operands.clear();
+    scalars.clear();
+}
+
+string FusedExpr::stepsSource(bool vector) const
+{
+    ostringstream os;
+    for(size_t s=0; s<steps.size(); s++) {
+        const int a= steps[s].operand[0];
+        const int b= steps[s].operand[1];
+        ostringstream load0, load1;
+        if(vector) {
+            load0 << "LOADV(i, op" << a << ")";
+            load1 << "LOADV(i, op" << b << ")";
+        } else {
+            load0 << "op" << a << "[i]";
+            load1 << "op" << b << "[i]";
+        }
+        os << "        x= ";
+        switch(steps[s].type) {
+        case SCALE:      os << "s" << a << " * x"; break;
+        case ADD_SCALAR: os << "x + s" << a; break;
+        case ADD:        os << "x + " << load0.str(); break;
+        case MUL:        os << "x * " << load0.str(); break;
+        case FMA:        os << "fma(x, " << load0.str() << ", " << load1.str() << ")"; break;
+        case CLAMP:      os << "clamp(x, s" << a << ", s" << b << ")"; break;
+        }
+        os << ";\n";
+    }
+    return os.str();
+}
+
+string FusedExpr::source() const
+{
+    // Argumentos: entrada, operandos, escalares, salida y cantidad de elementos
+    ostringstream os;
+    os << prelude;
+    os << "__kernel void fusedExpr(\n";
+    os << "    __global const float* in,\n";
+    for(size_t o=0; o<operands.size(); o++)
+        os << "    __global const float* op" << o << ",\n";
+    for(size_t c=0; c<scalars.size(); c++)
+        os << "    float s" << c << ",\n";
+    os << "    __global float* out,\n";
+    os << "    int n)\n";
+    os << "{\n";
+    os << "    for(int i= get_global_id(0); i<VEC_COUNT; i+=STRIDE) {\n";
+    os << "        floatv x= LOADV(i, in);\n";
+    os << stepsSource(true);
+    os << "        STOREV(x, i, out);\n";
+    os << "    }\n";
+    os << "    for(int i= TAIL_START + get_global_id(0); i<n; i+=STRIDE) {\n";
+    os << "        float x= in[i];\n";
+    os << stepsSource(false);
+    os << "        out[i]= x;\n";
+    os << "    }\n";
+    os << "}\n";
+    return os.str();
+}
+
+// Genera y compila el kernel para source en context y device
+static bool buildFusedKernel(cl_context context, cl_device_id device, const string& source, FusedKernel& fused)
+{
+    cl_uint preferredWidth, computeUnits;
+    cl_int error;
+    error  = clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &preferredWidth, NULL);
+    error |= clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    if(checkError(error, "FusedExpr: clGetDeviceInfo"))
+        return false;
+    fused.vectorWidth= 1;
+    while(fused.vectorWidth * 2 <= (int)min(preferredWidth, 16u))
+        fused.vectorWidth*= 2;
+    fused.maxGroups= max(computeUnits, 1u) * groupsPerComputeUnit;
+
+    ostringstream options;
+    options << "-D VECTOR_WIDTH=" << fused.vectorWidth;
+    if(!buildProgramCached(context, source.c_str(), source.size(), options.str().c_str(), &fused.program)) {
+        if(fused.program) {
+            checkProgramBuild(fused.program, device);
+            clReleaseProgram(fused.program);
+        }
+        return false;
+    }
+
+    fused.kernel= clCreateKernel(fused.program, "fusedExpr", &error);
+    if(checkError(error, "FusedExpr: clCreateKernel")) {
+        clReleaseProgram(fused.program);
+        return false;
+    }
+
+    size_t maxSize, multiple;
+    error  = clGetKernelWorkGroupInfo(fused.kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxSize, NULL);
+    error |= clGetKernelWorkGroupInfo(fused.kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &multiple, NULL);
+    if(checkError(error, "FusedExpr: clGetKernelWorkGroupInfo")) {
+        clReleaseKernel(fused.kernel);
+        clReleaseProgram(fused.program);
+        return false;
+    }
+    const size_t size= min(maxSize, (size_t)256);
+    fused.localSize= (multiple and size >= multiple) ? size / multiple * multiple : size;
+
+    return true;
+}
+
+bool FusedExpr::enqueue(cl_command_queue queue, cl_mem A, cl_mem out, int n, cl_event* event)
+{
+    cl_context context;
+    cl_device_id device;
+    cl_int error;
+    error  = clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(cl_context), &context, NULL);
+    error |= clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+    if(checkError(error, "FusedExpr::enqueue: clGetCommandQueueInfo"))
+        return false;
+
+    const string text= source();
+    ostringstream key;
+    key << context << " " << device << "\n" << text;
+
+    pthread_mutex_lock(&fusedLock);
+    map<string, FusedKernel>::iterator it= fusedKernels.find(key.str());
+    if(it == fusedKernels.end()) {
+        FusedKernel fused;
+        if(!buildFusedKernel(context, device, text, fused)) {
+            pthread_mutex_unlock(&fusedLock);
+            return false;
+        }
+        it= fusedKernels.insert(make_pair(key.str(), fused)).first;
+    }
+    const FusedKernel& fused= it->second;
+
+    cl_uint arg= 0;
+    error= clSetKernelArg(fused.kernel, arg++, sizeof(cl_mem), &A);
+    for(size_t o=0; o<operands.size(); o++)
+        error |= clSetKernelArg(fused.kernel, arg++, sizeof(cl_mem), &operands[o]);
+    for(size_t c=0; c<scalars.size(); c++)
+        error |= clSetKernelArg(fused.kernel, arg++, sizeof(cl_float), &scalars[c]);
+    error |= clSetKernelArg(fused.kernel, arg++, sizeof(cl_mem), &out);
+    error |= clSetKernelArg(fused.kernel, arg++, sizeof(cl_int), &n);
+    if(checkError(error, "FusedExpr::enqueue: clSetKernelArg")) {
+        pthread_mutex_unlock(&fusedLock);
+        return false;
+    }
+
+    // Igual que Elementwise: hasta maxGroups work-groups y grid-stride loop
+    const size_t localSize= fused.localSize;
+    const size_t vectors= max((size_t)n / fused.vectorWidth, (size_t)1);
+    const size_t groups= min((vectors + localSize - 1) / localSize, fused.maxGroups);
+    const size_t ndRangeSize= groups * localSize;
+    error= clEnqueueNDRangeKernel(queue, fused.kernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL, event);
+    pthread_mutex_unlock(&fusedLock);
+    if(checkError(error, "FusedExpr::enqueue: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+void releaseFusedKernels()
+{
+    pthread_mutex_lock(&fusedLock);
+    for(map<string, FusedKernel>::iterator it= fusedKernels.begin(); it != fusedKernels.end(); ++it) {
+        clReleaseKernel(it->second.kernel);
+        clReleaseProgram(it->second.program);
+    }
+    fusedKernels.clear();
+    pthread_mutex_unlock(&fusedLock);
+}
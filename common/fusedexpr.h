@@ -0,0 +1,93 @@
+/*
+ * fusedexpr.h
+ *
+ * Fusion de operaciones elemento a elemento en un solo kernel
+ *
+ * Encadenar operaciones con kernels separados (por ejemplo escalar, sumar y
+ * recortar con Elementwise) lee y escribe el buffer completo en cada paso. Un
+ * FusedExpr arma la cadena de operaciones en el host, genera el codigo de un
+ * unico kernel que las aplica sobre cada elemento en registros y lo compila
+ * la primera vez que se usa, de forma que se lee cada entrada y se escribe la
+ * salida una sola vez.
+ *
+ * Los escalares se pasan como argumentos del kernel, asi que expresiones con
+ * la misma estructura y distintas constantes comparten el kernel. Los kernels
+ * compilados se guardan en memoria por contexto y dispositivo, y los binarios
+ * en la cache de programas (ver programcache.h).
+ *
+ * El kernel generado usa #pragma OPENCL FP_CONTRACT OFF: sin contraer a*b+c en
+ * un fma, el resultado es el mismo bit a bit que aplicar los pasos por separado
+ * con Elementwise.
+ *
+ * Ejemplo: out = clamp(2 * A + B, 0, 1)
+ *     FusedExpr expr;
+ *     expr.scale(2).add(B).clamp(0, 1);
+ *     expr.enqueue(queue, A, out, n);
+ */
+
+#ifndef FUSEDEXPR_H
+#define FUSEDEXPR_H
+
+#include <CL/cl.h>
+
+#include <string>
+#include <vector>
+
+class FusedExpr
+{
+public:
+    FusedExpr() {}
+
+    // Operaciones sobre el valor actual x, que empieza siendo el buffer de entrada
+    // Los buffers deben tener al menos n elementos al encolar
+
+    // x = k * x
+    FusedExpr& scale(float k);
+    // x = x + c
+    FusedExpr& addScalar(float c);
+    // x = x + B
+    FusedExpr& add(cl_mem B);
+    // x = x * B
+    FusedExpr& mul(cl_mem B);
+    // x = x * B + C, con un solo redondeo (fma)
+    FusedExpr& fma(cl_mem B, cl_mem C);
+    // x = min(max(x, lo), hi)
+    FusedExpr& clamp(float lo, float hi);
+
+    // Cantidad de operaciones
+    int size() const { return steps.size(); }
+
+    // Descarta todas las operaciones
+    void clear();
+
+    // Codigo fuente del kernel generado (VECTOR_WIDTH se define al compilar)
+    std::string source() const;
+
+    // Encola out = expr(A) sobre n elementos en queue. La primera vez que se usa una
+    // expresion con esta estructura en el dispositivo de queue se compila el kernel.
+    // out puede ser A. Si event no es NULL devuelve el evento del kernel.
+    // Devuelve false en caso de error
+    bool enqueue(cl_command_queue queue, cl_mem A, cl_mem out, int n, cl_event* event= 0);
+
+private:
+    enum StepType { SCALE, ADD_SCALAR, ADD, MUL, FMA, CLAMP };
+
+    struct Step {
+        StepType type;
+        int operand[2];  // Indices en operands (buffers) o scalars segun type
+    };
+
+    FusedExpr& addStep(StepType type, int operand0, int operand1);
+    // Una linea de codigo por operacion sobre x; los operandos se leen con LOADV si vector
+    std::string stepsSource(bool vector) const;
+
+    std::vector<Step> steps;
+    std::vector<cl_mem> operands;
+    std::vector<float> scalars;
+};
+
+// Libera todos los kernels generados por FusedExpr
+// Debe llamarse antes de liberar los contextos en los que se usaron
+void releaseFusedKernels();
+
+#endif // FUSEDEXPR_H
@@ -0,0 +1,81 @@
+// Histograma de arreglos de int o float con histogramas locales privados por
+// work-group
+//
+// Se compila con -D T=<int|float> -D BINS=<bins> -D REPLICAS=<replicas>, y
+// -D T_FLOAT si T es float. Los BINS bins dividen [lo, hi) en intervalos iguales;
+// los elementos fuera de ese rango (y los NaN) no se cuentan.
+//
+// Pasada 1 (histogramLocal): cada work-group cuenta con atomics locales (como
+// shMemCounter en example4) en REPLICAS copias de su histograma, y escribe la suma
+// de las copias como su histograma parcial. Cada work-item usa la copia
+// get_local_id(0) % REPLICAS, asi que con datos concentrados en pocos bins los
+// atomics sobre un mismo bin se reparten entre REPLICAS direcciones. Las copias de
+// un bin son contiguas para que caigan en bancos distintos.
+// Pasada 2 (histogramMerge): un work-item por bin suma los parciales de todos los
+// work-groups. Ninguna de las dos pasadas usa atomics globales.
+
+#ifdef T_FLOAT
+// Bin de x en [lo, hi), o -1 si esta fuera del rango
+int binOf(T x, T lo, T hi)
+{
+    if(!(x >= lo && x < hi))
+        return -1;
+    // El redondeo puede dar BINS para x muy cerca de hi
+    return min((int)((x - lo) * ((float)BINS / (hi - lo))), BINS - 1);
+}
+#else
+int binOf(T x, T lo, T hi)
+{
+    if(x < lo || x >= hi)
+        return -1;
+    return (int)(((long)x - lo) * BINS / ((long)hi - lo));
+}
+#endif
+
+// Pasada 1: partials[g * BINS + b] = elementos del bin b que procesa el work-group g.
+// bins debe tener lugar para REPLICAS * BINS contadores.
+__kernel void histogramLocal(
+    __global const T* data,
+    int n,
+    T lo,
+    T hi,
+    __global uint* partials,
+    __local uint* bins)
+{
+    const int lid= get_local_id(0);
+    const int localSize= get_local_size(0);
+    for(int i= lid; i<REPLICAS * BINS; i+=localSize)
+        bins[i]= 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const int replica= lid % REPLICAS;
+    for(int i= get_global_id(0); i<n; i+=get_global_size(0)) {
+        const int bin= binOf(data[i], lo, hi);
+        if(bin >= 0)
+            atomic_inc(&bins[bin * REPLICAS + replica]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    __global uint* partial= partials + get_group_id(0) * BINS;
+    for(int b= lid; b<BINS; b+=localSize) {
+        uint sum= 0;
+        for(int r=0; r<REPLICAS; r++)
+            sum+= bins[b * REPLICAS + r];
+        partial[b]= sum;
+    }
+}
+
+// Pasada 2 (un work-item por bin): histogram[b] = suma de los count parciales del bin b
+__kernel void histogramMerge(
+    __global const uint* partials,
+    int count,
+    __global uint* histogram)
+{
+    const int b= get_global_id(0);
+    if(b >= BINS)
+        return;
+    uint sum= 0;
+    for(int g=0; g<count; g++)
+        sum+= partials[g * BINS + b];
+    histogram[b]= sum;
+}
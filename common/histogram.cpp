@@ -0,0 +1,193 @@
+#include "histogram.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+// Work-groups por unidad de computo en la primera pasada
+static const size_t groupsPerComputeUnit= 8;
+// Maximo de replicas elegidas automaticamente
+static const int maxAutoReplicas= 32;
+
+// Deshace un build a medias: libera el programa y los kernels ya creados y deja
+// los slots en NULL para que el siguiente build lo vuelva a intentar
+static bool discardBuild(cl_program program, cl_kernel& first, cl_kernel& second)
+{
+    if(first)
+        clReleaseKernel(first);
+    if(second)
+        clReleaseKernel(second);
+    first= NULL;
+    second= NULL;
+    clReleaseProgram(program);
+    return false;
+}
+
+Histogram::Histogram()
+{
+    context= NULL;
+    device= NULL;
+    bins= 0;
+    replicas= 0;
+    for(int type=0; type<HISTOGRAM_TYPE_COUNT; type++) {
+        programs[type]= NULL;
+        localKernels[type]= NULL;
+        mergeKernels[type]= NULL;
+        localSizes[type]= 1;
+    }
+    partials= NULL;
+    resultBuffer= NULL;
+    maxGroups= 0;
+}
+
+bool Histogram::init(cl_context context, cl_device_id device, int bins, int replicas, const char* path)
+{
+    release();
+    this->context= context;
+    this->device= device;
+    this->path= path;
+
+    if(bins < 1) {
+        cerr << "Histogram::init: cantidad de bins invalida: " << bins << endl;
+        return false;
+    }
+    this->bins= bins;
+
+    cl_uint computeUnits;
+    cl_ulong localMemory;
+    cl_int error;
+    error  = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    error |= clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemory, NULL);
+    if(checkError(error, "Histogram::init: clGetDeviceInfo"))
+        return false;
+    maxGroups= max(computeUnits, 1u) * groupsPerComputeUnit;
+
+    // Las replicas automaticas usan hasta la mitad de la memoria local para no
+    // limitar la cantidad de work-groups por unidad de computo
+    const size_t histogramBytes= bins * sizeof(cl_uint);
+    const int fitting= localMemory / histogramBytes;
+    if(fitting < 1) {
+        cerr << "Histogram::init: " << bins << " bins no entran en la memoria local ("
+             << localMemory << " bytes)" << endl;
+        return false;
+    }
+    if(replicas < 1)
+        replicas= min(max((int)(localMemory / 2 / histogramBytes), 1), maxAutoReplicas);
+    this->replicas= min(replicas, fitting);
+
+    cl_int error1, error2;
+    partials= clCreateBuffer(context, CL_MEM_READ_WRITE, maxGroups * histogramBytes, NULL, &error1);
+    resultBuffer= clCreateBuffer(context, CL_MEM_READ_WRITE, histogramBytes, NULL, &error2);
+    if(checkError(error1, "Histogram::init: clCreateBuffer") or checkError(error2, "Histogram::init: clCreateBuffer"))
+        return false;
+
+    return true;
+}
+
+bool Histogram::build(HistogramType type)
+{
+    if(programs[type])
+        return true;
+
+    ostringstream options;
+    options << (type == HISTOGRAM_FLOAT ? "-D T=float -D T_FLOAT" : "-D T=int")
+            << " -D BINS=" << bins << " -D REPLICAS=" << replicas;
+    cl_program program;
+    if(!loadProgram(context, &program, device, path.c_str(), options.str().c_str()))
+        return false;
+
+    // El programa se guarda en la cache solo cuando todos sus kernels estan creados
+    cl_int error;
+    localKernels[type]= clCreateKernel(program, "histogramLocal", &error);
+    if(checkError(error, "Histogram: clCreateKernel"))
+        return discardBuild(program, localKernels[type], mergeKernels[type]);
+    mergeKernels[type]= clCreateKernel(program, "histogramMerge", &error);
+    if(checkError(error, "Histogram: clCreateKernel"))
+        return discardBuild(program, localKernels[type], mergeKernels[type]);
+
+    size_t kernelMax;
+    error= clGetKernelWorkGroupInfo(localKernels[type], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelMax, NULL);
+    if(checkError(error, "Histogram: clGetKernelWorkGroupInfo"))
+        return discardBuild(program, localKernels[type], mergeKernels[type]);
+    localSizes[type]= min(kernelMax, (size_t)256);
+    programs[type]= program;
+
+    return true;
+}
+
+bool Histogram::enqueueHistogram(cl_command_queue queue, HistogramType type, cl_mem data, int n,
+                                 const void* lo, const void* hi, cl_mem histogram,
+                                 cl_event* partialEvent, cl_event* mergeEvent)
+{
+    if(!build(type))
+        return false;
+    cl_kernel localKernel= localKernels[type];
+    cl_kernel mergeKernel= mergeKernels[type];
+
+    // Un work-item por elemento, sin pasar de maxGroups work-groups: cada work-group
+    // de mas agrega bins sumas a la segunda pasada
+    const size_t localSize= localSizes[type];
+    const size_t groups= max(min(((size_t)n + localSize - 1) / localSize, maxGroups), (size_t)1);
+    const size_t ndRangeSize= groups * localSize;
+    const int partialCount= groups;
+    const size_t mergeLocal= 64;
+    const size_t mergeSize= ((size_t)bins + mergeLocal - 1) / mergeLocal * mergeLocal;
+
+    cl_int error;
+    error  = clSetKernelArg(localKernel, 0, sizeof(cl_mem), &data);
+    error |= clSetKernelArg(localKernel, 1, sizeof(cl_int), &n);
+    error |= clSetKernelArg(localKernel, 2, 4, lo);
+    error |= clSetKernelArg(localKernel, 3, 4, hi);
+    error |= clSetKernelArg(localKernel, 4, sizeof(cl_mem), &partials);
+    error |= clSetKernelArg(localKernel, 5, (size_t)replicas * bins * sizeof(cl_uint), NULL);
+    error |= clSetKernelArg(mergeKernel, 0, sizeof(cl_mem), &partials);
+    error |= clSetKernelArg(mergeKernel, 1, sizeof(cl_int), &partialCount);
+    error |= clSetKernelArg(mergeKernel, 2, sizeof(cl_mem), &histogram);
+    if(checkError(error, "Histogram::enqueueHistogram: clSetKernelArg"))
+        return false;
+
+    error= clEnqueueNDRangeKernel(queue, localKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL, partialEvent);
+    if(checkError(error, "Histogram::enqueueHistogram: clEnqueueNDRangeKernel"))
+        return false;
+    error= clEnqueueNDRangeKernel(queue, mergeKernel, 1, NULL, &mergeSize, NULL, 0, NULL, mergeEvent);
+    if(checkError(error, "Histogram::enqueueHistogram: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+bool Histogram::histogram(cl_command_queue queue, HistogramType type, cl_mem data, int n,
+                          const void* lo, const void* hi, cl_uint* histogram,
+                          cl_event* partialEvent, cl_event* mergeEvent)
+{
+    if(!enqueueHistogram(queue, type, data, n, lo, hi, resultBuffer, partialEvent, mergeEvent))
+        return false;
+    cl_int error= clEnqueueReadBuffer(queue, resultBuffer, CL_TRUE, 0, bins * sizeof(cl_uint), histogram, 0, NULL, NULL);
+    if(checkError(error, "Histogram::histogram: clEnqueueReadBuffer"))
+        return false;
+    return true;
+}
+
+void Histogram::release()
+{
+    for(int type=0; type<HISTOGRAM_TYPE_COUNT; type++) {
+        if(localKernels[type])
+            clReleaseKernel(localKernels[type]);
+        if(mergeKernels[type])
+            clReleaseKernel(mergeKernels[type]);
+        if(programs[type])
+            clReleaseProgram(programs[type]);
+        programs[type]= NULL;
+        localKernels[type]= NULL;
+        mergeKernels[type]= NULL;
+    }
+    if(partials)
+        clReleaseMemObject(partials);
+    if(resultBuffer)
+        clReleaseMemObject(resultBuffer);
+    partials= NULL;
+    resultBuffer= NULL;
+}
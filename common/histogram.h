@@ -0,0 +1,87 @@
+/*
+ * histogram.h
+ *
+ * Histogramas de arreglos de int o float en el dispositivo con una cantidad de
+ * bins configurable
+ *
+ * Como shMemCounter en example4, los conteos se hacen con atomics en memoria
+ * local: cada work-group acumula un histograma privado y al final se juntan los
+ * parciales de todos los work-groups con una segunda pasada (ver histogram.cl).
+ * Con datos sesgados (muchos elementos en pocos bins) los atomics locales sobre un
+ * mismo bin se serializan, asi que cada work-group mantiene varias replicas de su
+ * histograma y cada work-item incrementa una de ellas.
+ *
+ * La cantidad de bins y de replicas se fija en init. Cada tipo de datos es un
+ * programa compilado con distintas opciones; se compila la primera vez que se usa.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <CL/cl.h>
+
+#include <string>
+
+enum HistogramType {
+    HISTOGRAM_INT,
+    HISTOGRAM_FLOAT,
+    HISTOGRAM_TYPE_COUNT
+};
+
+class Histogram
+{
+public:
+    Histogram();
+    ~Histogram() { release(); }
+
+    // Prepara histogramas de bins bins con replicas replicas por work-group (0 para
+    // usar las que entren en la mitad de la memoria local, hasta 32). Las replicas se
+    // reducen si no entran en la memoria local. Los programas de path se compilan al
+    // usar cada tipo.
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, int bins, int replicas= 0,
+              const char* path= "../../common/histogram.cl");
+
+    // Encola el histograma de los n elementos de tipo type de data en histogram (bins
+    // cl_uint). lo y hi (un cl_int o cl_float segun type) son los limites del rango
+    // [lo, hi) que se divide en bins iguales; los elementos fuera del rango no se cuentan.
+    // Si partialEvent o mergeEvent no son NULL devuelven los eventos de cada pasada.
+    // Devuelve false en caso de error
+    bool enqueueHistogram(cl_command_queue queue, HistogramType type, cl_mem data, int n,
+                          const void* lo, const void* hi, cl_mem histogram,
+                          cl_event* partialEvent= 0, cl_event* mergeEvent= 0);
+
+    // Igual que enqueueHistogram, pero espera el resultado y lo copia a histogram
+    // (bins cl_uint en memoria de host)
+    bool histogram(cl_command_queue queue, HistogramType type, cl_mem data, int n,
+                   const void* lo, const void* hi, cl_uint* histogram,
+                   cl_event* partialEvent= 0, cl_event* mergeEvent= 0);
+
+    int getBins() const { return bins; }
+    int getReplicas() const { return replicas; }
+
+    // Libera los programas, kernels y buffers
+    void release();
+
+private:
+    // Compila el programa de type si todavia no se compilo
+    bool build(HistogramType type);
+
+    cl_context context;
+    cl_device_id device;
+    std::string path;
+    int bins;
+    int replicas;
+
+    cl_program programs[HISTOGRAM_TYPE_COUNT];
+    cl_kernel localKernels[HISTOGRAM_TYPE_COUNT];
+    cl_kernel mergeKernels[HISTOGRAM_TYPE_COUNT];
+    size_t localSizes[HISTOGRAM_TYPE_COUNT];
+
+    // Histogramas parciales de la primera pasada (maxGroups * bins) y resultado de histogram()
+    cl_mem partials;
+    cl_mem resultBuffer;
+    size_t maxGroups;
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,251 @@
+#include "programcache.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Identificador del formato de los archivos de la cache
+static const char cacheMagic[8]= { 'E', 'A', 'G', 'C', 'L', 'B', 'I', '1' };
+
+static ProgramCacheStats cacheStats= { 0, 0, 0, 0.0 };
+
+// Hash FNV-1a de 64 bits
+static cl_ulong fnv1a(const char* data, size_t length, cl_ulong hash= 14695981039346656037ULL)
+{
+    for(size_t i=0; i<length; i++) {
+        hash^= (unsigned char)data[i];
+        hash*= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static string hexString(cl_ulong value)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+    return text;
+}
+
+string getCacheDirectory()
+{
+    const char* env= getenv("EAGPGPU_CL_CACHE");
+    if(env) {
+        if(!strcmp(env, "off") or !strcmp(env, "0"))
+            return "";
+        return env;
+    }
+    const char* home= getenv("HOME");
+    if(home)
+        return string(home) + "/.cache/eagpgpu-cl";
+    return "clcache";
+}
+
+bool makeDirectories(const string& path)
+{
+    for(size_t pos= path.find('/', 1); ; pos= path.find('/', pos + 1)) {
+        const string partial= path.substr(0, pos);
+        if(mkdir(partial.c_str(), 0755) != 0) {
+            struct stat info;
+            if(stat(partial.c_str(), &info) != 0 or !S_ISDIR(info.st_mode))
+                return false;
+        }
+        if(pos == string::npos)
+            return true;
+    }
+}
+
+// Arma la clave de un programa: hash del fuente, opciones y datos de cada dispositivo
+static string programKey(const vector<cl_device_id>& devices, const char* source, size_t length, const char* options)
+{
+    ostringstream key;
+    key << "src=" << hexString(fnv1a(source, length)) << "\n";
+    key << "opt=" << (options ? options : "") << "\n";
+    for(size_t i=0; i<devices.size(); i++) {
+        key << "dev=" << getDeviceString(devices[i], CL_DEVICE_NAME)
+            << ";" << getDeviceString(devices[i], CL_DEVICE_VERSION)
+            << ";" << getDeviceString(devices[i], CL_DRIVER_VERSION) << "\n";
+    }
+    return key.str();
+}
+
+// Intenta cargar los binarios de path. Devuelve false si el archivo no existe
+// o no corresponde a key.
+static bool readCacheFile(const string& path, const string& key, size_t deviceCount,
+                          vector< vector<unsigned char> >& binaries)
+{
+    ifstream is(path.c_str(), ios::binary);
+    if(!is.is_open())
+        return false;
+
+    char magic[sizeof(cacheMagic)];
+    cl_uint keyLength, count;
+    is.read(magic, sizeof(magic));
+    is.read((char*)&keyLength, sizeof(keyLength));
+    if(!is or memcmp(magic, cacheMagic, sizeof(magic)) or keyLength != key.size())
+        return false;
+
+    string storedKey(keyLength, '\0');
+    is.read(&storedKey[0], keyLength);
+    is.read((char*)&count, sizeof(count));
+    if(!is or storedKey != key or count != deviceCount)
+        return false;
+
+    binaries.resize(count);
+    for(cl_uint i=0; i<count; i++) {
+        cl_ulong size;
+        is.read((char*)&size, sizeof(size));
+        if(!is or !size)
+            return false;
+        binaries[i].resize(size);
+        is.read((char*)&binaries[i][0], size);
+    }
+    return bool(is);
+}
+
+// Escribe los binarios de program en path. Se escribe primero a un archivo temporal
+// y luego se renombra, asi otro proceso nunca lee un archivo a medio escribir.
+static bool writeCacheFile(const string& path, const string& key, cl_program program, size_t deviceCount)
+{
+    vector<size_t> sizes(deviceCount);
+    cl_int error= clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, deviceCount * sizeof(size_t), &sizes[0], NULL);
+    if(checkError(error, "writeCacheFile: clGetProgramInfo"))
+        return false;
+
+    vector< vector<unsigned char> > binaries(deviceCount);
+    vector<unsigned char*> pointers(deviceCount);
+    for(size_t i=0; i<deviceCount; i++) {
+        // Algunos runtimes no generan binarios; en ese caso no hay nada para guardar
+        if(!sizes[i])
+            return false;
+        binaries[i].resize(sizes[i]);
+        pointers[i]= &binaries[i][0];
+    }
+    error= clGetProgramInfo(program, CL_PROGRAM_BINARIES, deviceCount * sizeof(unsigned char*), &pointers[0], NULL);
+    if(checkError(error, "writeCacheFile: clGetProgramInfo"))
+        return false;
+
+    ostringstream tempPath;
+    tempPath << path << ".tmp" << getpid();
+    ofstream os(tempPath.str().c_str(), ios::binary);
+    if(!os.is_open())
+        return false;
+
+    const cl_uint keyLength= key.size();
+    const cl_uint count= deviceCount;
+    os.write(cacheMagic, sizeof(cacheMagic));
+    os.write((const char*)&keyLength, sizeof(keyLength));
+    os.write(key.data(), keyLength);
+    os.write((const char*)&count, sizeof(count));
+    for(size_t i=0; i<deviceCount; i++) {
+        const cl_ulong size= sizes[i];
+        os.write((const char*)&size, sizeof(size));
+        os.write((const char*)&binaries[i][0], size);
+    }
+    os.close();
+    if(!os or rename(tempPath.str().c_str(), path.c_str()) != 0) {
+        remove(tempPath.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+// Crea y compila el programa desde los binarios. Devuelve false (sin mostrar errores)
+// si el runtime rechaza alguno de los binarios.
+static bool buildFromBinaries(cl_context context, const vector<cl_device_id>& devices,
+                              const vector< vector<unsigned char> >& binaries,
+                              const char* options, cl_program* program)
+{
+    const size_t count= devices.size();
+    vector<size_t> sizes(count);
+    vector<const unsigned char*> pointers(count);
+    vector<cl_int> binaryStatus(count);
+    for(size_t i=0; i<count; i++) {
+        sizes[i]= binaries[i].size();
+        pointers[i]= &binaries[i][0];
+    }
+
+    cl_int error;
+    *program= clCreateProgramWithBinary(context, count, &devices[0], &sizes[0], &pointers[0], &binaryStatus[0], &error);
+    if(error != CL_SUCCESS)
+        return false;
+
+    // Aun con binarios es necesario llamar a clBuildProgram
+    error= clBuildProgram(*program, 0, NULL, options, NULL, NULL);
+    if(error != CL_SUCCESS) {
+        clReleaseProgram(*program);
+        return false;
+    }
+    return true;
+}
+
+bool buildProgramCached(cl_context context, const char* source, size_t length,
+                        const char* options, cl_program* program)
+{
+    const double startTime= hostTimeMs();
+    *program= NULL;
+
+    // Dispositivos del contexto, el programa se compila para todos
+    cl_uint deviceCount;
+    cl_int error= clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES, sizeof(cl_uint), &deviceCount, NULL);
+    if(checkError(error, "buildProgramCached: clGetContextInfo"))
+        return false;
+    vector<cl_device_id> devices(deviceCount);
+    error= clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceCount * sizeof(cl_device_id), &devices[0], NULL);
+    if(checkError(error, "buildProgramCached: clGetContextInfo"))
+        return false;
+
+    const string directory= getCacheDirectory();
+    string key, path;
+    if(!directory.empty()) {
+        key= programKey(devices, source, length, options);
+        path= directory + "/" + hexString(fnv1a(key.data(), key.size())) + ".bin";
+
+        vector< vector<unsigned char> > binaries;
+        if(readCacheFile(path, key, deviceCount, binaries) and
+           buildFromBinaries(context, devices, binaries, options, program)) {
+            cacheStats.hits++;
+            cacheStats.buildMs+= hostTimeMs() - startTime;
+            return true;
+        }
+    }
+
+    // No hay binario valido: compilar desde el fuente
+    cacheStats.misses++;
+    *program= clCreateProgramWithSource(context, 1, &source, &length, &error);
+    if(checkError(error, "buildProgramCached: clCreateProgramWithSource")) {
+        *program= NULL;
+        return false;
+    }
+    error= clBuildProgram(*program, 0, NULL, options, NULL, NULL);
+    cacheStats.buildMs+= hostTimeMs() - startTime;
+    if(checkError(error, "buildProgramCached: clBuildProgram"))
+        return false;
+
+    if(!directory.empty() and makeDirectories(directory) and
+       writeCacheFile(path, key, *program, deviceCount))
+        cacheStats.stores++;
+
+    return true;
+}
+
+ProgramCacheStats getProgramCacheStats()
+{
+    return cacheStats;
+}
+
+void printProgramCacheStats()
+{
+    cerr << "Cache de programas:\t\t\t" << cacheStats.hits << " hits, " << cacheStats.misses << " misses, "
+         << cacheStats.stores << " guardados, " << cacheStats.buildMs << " ms de compilacion." << endl;
+}
@@ -0,0 +1,64 @@
+/*
+ * programcache.h
+ *
+ * Cache en disco de programas OpenCL compilados
+ *
+ * Compilar un programa desde el codigo fuente puede tardar cientos de
+ * milisegundos (especialmente en runtimes de CPU). La cache guarda los
+ * binarios (CL_PROGRAM_BINARIES) de cada programa compilado y en las
+ * siguientes ejecuciones los recarga con clCreateProgramWithBinary.
+ *
+ * La clave de cada entrada se forma con un hash del codigo fuente, las
+ * opciones de compilacion y el nombre, version y version del driver de
+ * cada dispositivo del contexto. Si no hay binario para la clave, o el
+ * binario es rechazado por el runtime, se compila desde el fuente.
+ *
+ * Variables de entorno:
+ *  - EAGPGPU_CL_CACHE: directorio de la cache (por defecto
+ *    $HOME/.cache/eagpgpu-cl o ./clcache si no existe HOME).
+ *    Con el valor "off" o "0" se deshabilita la cache.
+ *
+ * Nota: la clave no incluye archivos agregados con #include desde el
+ * codigo del programa.
+ */
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <CL/cl.h>
+
+#include <stddef.h>
+#include <string>
+
+// Contadores de la cache, acumulados desde el inicio del programa
+struct ProgramCacheStats {
+    int hits;       // Programas recargados desde un binario de la cache
+    int misses;     // Programas compilados desde el codigo fuente
+    int stores;     // Binarios escritos en la cache
+    double buildMs; // Tiempo total (ms) de creacion y compilacion de programas
+};
+
+// Crea un programa a partir del codigo fuente source (de largo length) y lo compila
+// con las opciones options (puede ser 0) para todos los dispositivos de context.
+// Si existe un binario valido en la cache se usa en lugar de compilar el fuente.
+// Devuelve false en caso de error. Si falla la compilacion, program queda
+// creado para poder consultar el log con checkProgramBuild; si falla antes
+// de crearlo, program es NULL.
+bool buildProgramCached(cl_context context, const char* source, size_t length,
+                        const char* options, cl_program* program);
+
+// Devuelve los contadores de la cache
+ProgramCacheStats getProgramCacheStats();
+
+// Muestra los contadores de la cache por cerr
+void printProgramCacheStats();
+
+// Directorio de la cache (ver EAGPGPU_CL_CACHE), o string vacio si esta deshabilitada
+// Tambien lo usan otras caches en disco, como la del autotuner
+std::string getCacheDirectory();
+
+// Crea el directorio path y todos sus padres
+// Devuelve false en caso de error
+bool makeDirectories(const std::string& path);
+
+#endif // PROGRAMCACHE_H
@@ -0,0 +1,180 @@
+// Radix sort LSD de claves de 32 bits, con o sin valores asociados
+//
+// Se compila con -D RADIX_BITS=<4|8> -D ITEMS=<elementos por work-item>, y
+// -D SIGNED_KEYS si las claves son int (si no son uint) y -D WITH_VALUES si
+// cada clave tiene un valor de 32 bits asociado.
+//
+// Cada pasada ordena por el digito de RADIX_BITS bits que empieza en el bit
+// shift. El arreglo se divide en tiles de get_local_size(0) * ITEMS elementos,
+// uno por work-group:
+//  1. radixHistogram: cada work-group cuenta los digitos de su tile con atomics
+//     locales y escribe groupHist[digito * numGroups + grupo].
+//  2. El host hace el scan exclusivo de groupHist (common/scan.cl): queda la
+//     posicion en la salida del primer elemento de cada digito de cada tile.
+//  3. radixScatter: cada work-group ordena su tile por digito en memoria local
+//     en forma estable (conteo por work-item y scan de los conteos) y lo escribe
+//     en la salida; los elementos consecutivos de un mismo digito van a
+//     posiciones consecutivas, asi que la escritura queda casi coalescida.
+
+#define RADIX (1 << RADIX_BITS)
+
+#ifdef SIGNED_KEYS
+// Con el bit de signo invertido el orden de los int coincide con el de los uint
+#define DIGIT(key, shift) ((((key) ^ 0x80000000u) >> (shift)) & (RADIX - 1))
+#else
+#define DIGIT(key, shift) (((key) >> (shift)) & (RADIX - 1))
+#endif
+
+// Pasada 1: groupHist[d * numGroups + g] = elementos con digito d en el tile g
+__kernel void radixHistogram(
+    __global const uint* keys,
+    int n,
+    int shift,
+    __global uint* groupHist,
+    int numGroups,
+    __local uint* hist)
+{
+    const int lid= get_local_id(0);
+    const int localSize= get_local_size(0);
+    const int group= get_group_id(0);
+    for(int d= lid; d<RADIX; d+=localSize)
+        hist[d]= 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const int tileStart= group * localSize * ITEMS;
+    for(int j=0; j<ITEMS; j++) {
+        const int i= tileStart + j * localSize + lid;
+        if(i < n)
+            atomic_inc(&hist[DIGIT(keys[i], shift)]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int d= lid; d<RADIX; d+=localSize)
+        groupHist[d * numGroups + group]= hist[d];
+}
+
+// Scan exclusivo en el lugar de los RADIX * get_local_size(0) valores de counts:
+// cada work-item suma RADIX valores consecutivos, se escanean las sumas en temp
+// (get_local_size(0) valores) y cada work-item reparte su prefijo
+void scanCounts(__local uint* counts, __local uint* temp)
+{
+    const int lid= get_local_id(0);
+    const int localSize= get_local_size(0);
+    __local uint* segment= counts + lid * RADIX;
+    uint sum= 0;
+    for(int s=0; s<RADIX; s++)
+        sum+= segment[s];
+    temp[lid]= sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Scan inclusivo de Hillis-Steele de las sumas
+    for(int offset=1; offset<localSize; offset*=2) {
+        const uint left= lid >= offset ? temp[lid - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        temp[lid]+= left;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    uint running= temp[lid] - sum;
+    for(int s=0; s<RADIX; s++) {
+        const uint count= segment[s];
+        segment[s]= running;
+        running+= count;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// Pasada 3: escribe el tile de cada work-group ordenado por digito en la posicion
+// de offsets (scan exclusivo de groupHist). Memoria local:
+//  - counts: RADIX * get_local_size(0) uints
+//  - temp: get_local_size(0) uints
+//  - groupStart: RADIX uints
+//  - tileKeys y tileValues: get_local_size(0) * ITEMS uints
+__kernel void radixScatter(
+    __global const uint* keysIn,
+    __global uint* keysOut,
+#ifdef WITH_VALUES
+    __global const uint* valuesIn,
+    __global uint* valuesOut,
+#endif
+    int n,
+    int shift,
+    __global const uint* offsets,
+    int numGroups,
+    __local uint* counts,
+    __local uint* temp,
+    __local uint* groupStart,
+    __local uint* tileKeys,
+    __local uint* tileValues)
+{
+    const int lid= get_local_id(0);
+    const int localSize= get_local_size(0);
+    const int group= get_group_id(0);
+    const int tileStart= group * localSize * ITEMS;
+    const int tileSize= min(localSize * ITEMS, n - tileStart);
+
+    // Carga coalescida del tile
+    for(int j=0; j<ITEMS; j++) {
+        const int i= j * localSize + lid;
+        if(i < tileSize) {
+            tileKeys[i]= keysIn[tileStart + i];
+#ifdef WITH_VALUES
+            tileValues[i]= valuesIn[tileStart + i];
+#endif
+        }
+    }
+    // counts[d * localSize + lid]: elementos con digito d del work-item lid. Cada
+    // work-item solo usa su columna.
+    for(int d=0; d<RADIX; d++)
+        counts[d * localSize + lid]= 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Cada work-item toma ITEMS elementos consecutivos del tile
+    uint keys[ITEMS];
+#ifdef WITH_VALUES
+    uint values[ITEMS];
+#endif
+    for(int j=0; j<ITEMS; j++) {
+        const int i= lid * ITEMS + j;
+        if(i < tileSize) {
+            keys[j]= tileKeys[i];
+#ifdef WITH_VALUES
+            values[j]= tileValues[i];
+#endif
+            counts[DIGIT(keys[j], shift) * localSize + lid]++;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Despues del scan, counts[d * localSize + lid] es la posicion en el tile
+    // ordenado del primer elemento con digito d del work-item lid
+    scanCounts(counts, temp);
+    for(int d= lid; d<RADIX; d+=localSize)
+        groupStart[d]= counts[d * localSize];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int j=0; j<ITEMS; j++) {
+        const int i= lid * ITEMS + j;
+        if(i < tileSize) {
+            const int rank= counts[DIGIT(keys[j], shift) * localSize + lid]++;
+            tileKeys[rank]= keys[j];
+#ifdef WITH_VALUES
+            tileValues[rank]= values[j];
+#endif
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int j=0; j<ITEMS; j++) {
+        const int rank= j * localSize + lid;
+        if(rank < tileSize) {
+            const uint key= tileKeys[rank];
+            const uint digit= DIGIT(key, shift);
+            const int position= offsets[digit * numGroups + group] + rank - groupStart[digit];
+            keysOut[position]= key;
+#ifdef WITH_VALUES
+            valuesOut[position]= tileValues[rank];
+#endif
+        }
+    }
+}
@@ -0,0 +1,264 @@
+#include "radixsort.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+// Elementos por work-item de cada tile segun los bits del digito
+static const int itemsPerWorkItem4= 4;
+static const int itemsPerWorkItem8= 8;
+
+// Bytes de memoria local de radixScatter con work-groups de localSize y tiles de
+// localSize * items elementos (ver radixsort.cl)
+static size_t scatterLocalBytes(int radix, size_t localSize, int items, bool withValues)
+{
+    const size_t tile= localSize * items;
+    return (radix * localSize + localSize + radix + tile + (withValues ? tile : 1)) * sizeof(cl_uint);
+}
+
+// Deshace un build a medias: libera el programa y los kernels ya creados y deja
+// los slots en NULL para que el siguiente build lo vuelva a intentar
+static bool discardBuild(cl_program program, cl_kernel& first, cl_kernel& second)
+{
+    if(first)
+        clReleaseKernel(first);
+    if(second)
+        clReleaseKernel(second);
+    first= NULL;
+    second= NULL;
+    clReleaseProgram(program);
+    return false;
+}
+
+RadixSort::RadixSort()
+{
+    context= NULL;
+    device= NULL;
+    radixBits= 4;
+    for(int v=0; v<2; v++) {
+        for(int s=0; s<2; s++) {
+            programs[v][s]= NULL;
+            histogramKernels[v][s]= NULL;
+            scatterKernels[v][s]= NULL;
+            localSizes[v][s]= 1;
+            items[v][s]= 1;
+        }
+    }
+    tempKeys= NULL;
+    tempKeysCapacity= 0;
+    tempValues= NULL;
+    tempValuesCapacity= 0;
+    groupHist= NULL;
+    groupHistCapacity= 0;
+    localMemory= 0;
+}
+
+bool RadixSort::init(cl_context context, cl_device_id device, int radixBits, const char* path, const char* scanPath)
+{
+    release();
+    this->context= context;
+    this->device= device;
+    this->path= path;
+
+    // La cantidad de pasadas (32 / radixBits) tiene que ser par
+    if(radixBits != 4 and radixBits != 8) {
+        cerr << "RadixSort::init: bits de digito invalidos: " << radixBits << " (4 u 8)" << endl;
+        return false;
+    }
+    this->radixBits= radixBits;
+
+    cl_int error= clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemory, NULL);
+    if(checkError(error, "RadixSort::init: clGetDeviceInfo"))
+        return false;
+
+    return scan.init(context, device, scanPath);
+}
+
+bool RadixSort::build(bool withValues, bool signedKeys)
+{
+    if(programs[withValues][signedKeys])
+        return true;
+
+    // Tamanio de work-group potencia de 2 (hasta 256) cuya memoria local entra en el dispositivo
+    const int radix= 1 << radixBits;
+    const int itemCount= radixBits == 4 ? itemsPerWorkItem4 : itemsPerWorkItem8;
+    size_t deviceMax;
+    cl_int error= clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &deviceMax, NULL);
+    if(checkError(error, "RadixSort: clGetDeviceInfo"))
+        return false;
+    size_t localSize= 1;
+    while(localSize * 2 <= min(deviceMax, (size_t)256))
+        localSize*= 2;
+    while(localSize > 1 and scatterLocalBytes(radix, localSize, itemCount, withValues) > localMemory)
+        localSize/= 2;
+    if(scatterLocalBytes(radix, localSize, itemCount, withValues) > localMemory) {
+        cerr << "RadixSort: los digitos de " << radixBits << " bits no entran en la memoria local ("
+             << localMemory << " bytes)" << endl;
+        return false;
+    }
+
+    ostringstream options;
+    options << "-D RADIX_BITS=" << radixBits << " -D ITEMS=" << itemCount;
+    if(signedKeys)
+        options << " -D SIGNED_KEYS";
+    if(withValues)
+        options << " -D WITH_VALUES";
+    cl_program program;
+    if(!loadProgram(context, &program, device, path.c_str(), options.str().c_str()))
+        return false;
+
+    // El programa se guarda en la cache solo cuando todos sus kernels estan creados
+    histogramKernels[withValues][signedKeys]= clCreateKernel(program, "radixHistogram", &error);
+    if(checkError(error, "RadixSort: clCreateKernel"))
+        return discardBuild(program, histogramKernels[withValues][signedKeys], scatterKernels[withValues][signedKeys]);
+    scatterKernels[withValues][signedKeys]= clCreateKernel(program, "radixScatter", &error);
+    if(checkError(error, "RadixSort: clCreateKernel"))
+        return discardBuild(program, histogramKernels[withValues][signedKeys], scatterKernels[withValues][signedKeys]);
+
+    // Los dos kernels recorren los mismos tiles, asi que usan el mismo tamanio
+    size_t histogramMax, scatterMax;
+    error  = clGetKernelWorkGroupInfo(histogramKernels[withValues][signedKeys], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &histogramMax, NULL);
+    error |= clGetKernelWorkGroupInfo(scatterKernels[withValues][signedKeys], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &scatterMax, NULL);
+    if(checkError(error, "RadixSort: clGetKernelWorkGroupInfo"))
+        return discardBuild(program, histogramKernels[withValues][signedKeys], scatterKernels[withValues][signedKeys]);
+    while(localSize > 1 and (localSize > histogramMax or localSize > scatterMax))
+        localSize/= 2;
+    localSizes[withValues][signedKeys]= localSize;
+    items[withValues][signedKeys]= itemCount;
+    programs[withValues][signedKeys]= program;
+
+    return true;
+}
+
+bool RadixSort::reserve(cl_mem& buffer, size_t& capacity, size_t bytes)
+{
+    if(buffer and capacity >= bytes)
+        return true;
+    if(buffer)
+        clReleaseMemObject(buffer);
+    buffer= NULL;
+    capacity= 0;
+
+    cl_int error;
+    buffer= clCreateBuffer(context, CL_MEM_READ_WRITE, max(bytes, sizeof(cl_uint)), NULL, &error);
+    if(checkError(error, "RadixSort: clCreateBuffer"))
+        return false;
+    capacity= bytes;
+    return true;
+}
+
+bool RadixSort::enqueueSort(cl_command_queue queue, cl_mem keys, cl_mem values, int n, bool signedKeys,
+                            cl_event* event)
+{
+    if(n < 0) {
+        cerr << "RadixSort::enqueueSort: cantidad de elementos invalida: " << n << endl;
+        return false;
+    }
+    const bool withValues= values != NULL;
+    if(!build(withValues, signedKeys))
+        return false;
+    cl_kernel histogramKernel= histogramKernels[withValues][signedKeys];
+    cl_kernel scatterKernel= scatterKernels[withValues][signedKeys];
+
+    const int radix= 1 << radixBits;
+    const size_t localSize= localSizes[withValues][signedKeys];
+    const int itemCount= items[withValues][signedKeys];
+    const size_t tile= localSize * itemCount;
+    const size_t groups= max(((size_t)n + tile - 1) / tile, (size_t)1);
+    const size_t ndRangeSize= groups * localSize;
+    const int numGroups= groups;
+    const int histogramCount= radix * numGroups;
+
+    const size_t bytes= (size_t)n * sizeof(cl_uint);
+    if(!reserve(tempKeys, tempKeysCapacity, bytes) or
+       (withValues and !reserve(tempValues, tempValuesCapacity, bytes)) or
+       !reserve(groupHist, groupHistCapacity, histogramCount * sizeof(cl_uint)))
+        return false;
+
+    // Argumentos fijos de todas las pasadas
+    cl_int error;
+    const int valueArgs= withValues ? 2 : 0;
+    error  = clSetKernelArg(histogramKernel, 1, sizeof(cl_int), &n);
+    error |= clSetKernelArg(histogramKernel, 3, sizeof(cl_mem), &groupHist);
+    error |= clSetKernelArg(histogramKernel, 4, sizeof(cl_int), &numGroups);
+    error |= clSetKernelArg(histogramKernel, 5, radix * sizeof(cl_uint), NULL);
+    error |= clSetKernelArg(scatterKernel, 2 + valueArgs, sizeof(cl_int), &n);
+    error |= clSetKernelArg(scatterKernel, 4 + valueArgs, sizeof(cl_mem), &groupHist);
+    error |= clSetKernelArg(scatterKernel, 5 + valueArgs, sizeof(cl_int), &numGroups);
+    error |= clSetKernelArg(scatterKernel, 6 + valueArgs, radix * localSize * sizeof(cl_uint), NULL);
+    error |= clSetKernelArg(scatterKernel, 7 + valueArgs, localSize * sizeof(cl_uint), NULL);
+    error |= clSetKernelArg(scatterKernel, 8 + valueArgs, radix * sizeof(cl_uint), NULL);
+    error |= clSetKernelArg(scatterKernel, 9 + valueArgs, tile * sizeof(cl_uint), NULL);
+    error |= clSetKernelArg(scatterKernel, 10 + valueArgs, (withValues ? tile : 1) * sizeof(cl_uint), NULL);
+    if(checkError(error, "RadixSort::enqueueSort: clSetKernelArg"))
+        return false;
+
+    // Las pasadas alternan entre los buffers de entrada y los temporales; como son
+    // una cantidad par, la ultima escribe en los de entrada
+    const int passes= 32 / radixBits;
+    for(int pass=0; pass<passes; pass++) {
+        const cl_int shift= pass * radixBits;
+        cl_mem keysIn= pass % 2 ? tempKeys : keys;
+        cl_mem keysOut= pass % 2 ? keys : tempKeys;
+        cl_mem valuesIn= pass % 2 ? tempValues : values;
+        cl_mem valuesOut= pass % 2 ? values : tempValues;
+
+        error  = clSetKernelArg(histogramKernel, 0, sizeof(cl_mem), &keysIn);
+        error |= clSetKernelArg(histogramKernel, 2, sizeof(cl_int), &shift);
+        error |= clSetKernelArg(scatterKernel, 0, sizeof(cl_mem), &keysIn);
+        error |= clSetKernelArg(scatterKernel, 1, sizeof(cl_mem), &keysOut);
+        if(withValues) {
+            error |= clSetKernelArg(scatterKernel, 2, sizeof(cl_mem), &valuesIn);
+            error |= clSetKernelArg(scatterKernel, 3, sizeof(cl_mem), &valuesOut);
+        }
+        error |= clSetKernelArg(scatterKernel, 3 + valueArgs, sizeof(cl_int), &shift);
+        if(checkError(error, "RadixSort::enqueueSort: clSetKernelArg"))
+            return false;
+
+        error= clEnqueueNDRangeKernel(queue, histogramKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL, NULL);
+        if(checkError(error, "RadixSort::enqueueSort: clEnqueueNDRangeKernel"))
+            return false;
+        // Posicion en la salida de cada digito de cada tile
+        if(!scan.enqueueScan(queue, groupHist, groupHist, histogramCount, false))
+            return false;
+        error= clEnqueueNDRangeKernel(queue, scatterKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL,
+                                      pass == passes - 1 ? event : NULL);
+        if(checkError(error, "RadixSort::enqueueSort: clEnqueueNDRangeKernel"))
+            return false;
+    }
+
+    return true;
+}
+
+void RadixSort::release()
+{
+    for(int v=0; v<2; v++) {
+        for(int s=0; s<2; s++) {
+            if(histogramKernels[v][s])
+                clReleaseKernel(histogramKernels[v][s]);
+            if(scatterKernels[v][s])
+                clReleaseKernel(scatterKernels[v][s]);
+            if(programs[v][s])
+                clReleaseProgram(programs[v][s]);
+            programs[v][s]= NULL;
+            histogramKernels[v][s]= NULL;
+            scatterKernels[v][s]= NULL;
+        }
+    }
+    if(tempKeys)
+        clReleaseMemObject(tempKeys);
+    if(tempValues)
+        clReleaseMemObject(tempValues);
+    if(groupHist)
+        clReleaseMemObject(groupHist);
+    tempKeys= NULL;
+    tempKeysCapacity= 0;
+    tempValues= NULL;
+    tempValuesCapacity= 0;
+    groupHist= NULL;
+    groupHistCapacity= 0;
+    scan.release();
+}
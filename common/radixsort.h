@@ -0,0 +1,81 @@
+/*
+ * radixsort.h
+ *
+ * Ordenamiento de arreglos de claves de 32 bits (int o uint), con o sin un valor
+ * de 32 bits asociado a cada clave, con radix sort LSD en el dispositivo
+ *
+ * Cada pasada ordena en forma estable por un digito de 4 u 8 bits, desde el menos
+ * significativo: los histogramas locales de digitos de cada tile se escanean con
+ * Scan (common/scan.h) para obtener la posicion de salida de cada digito de cada
+ * tile, y cada work-group ordena su tile en memoria local antes de escribirlo
+ * (ver radixsort.cl). La cantidad de pasadas es par (8 u 4), asi que el resultado
+ * queda en los buffers de entrada.
+ *
+ * Con digitos de 8 bits los conteos por work-item ocupan 16 veces mas memoria
+ * local, asi que los work-groups son mas chicos; los digitos de 4 bits suelen ser
+ * mas rapidos.
+ */
+
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <CL/cl.h>
+
+#include <string>
+
+#include "scan.h"
+
+class RadixSort
+{
+public:
+    RadixSort();
+    ~RadixSort() { release(); }
+
+    // Prepara el ordenamiento por digitos de radixBits bits (4 u 8) para context y
+    // device. Los programas de path se compilan al usarse; scanPath es el de Scan.
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, int radixBits= 4,
+              const char* path= "../../common/radixsort.cl", const char* scanPath= "../../common/scan.cl");
+
+    // Encola el ordenamiento ascendente y estable de las n claves de keys (cl_int si
+    // signedKeys, si no cl_uint). Si values no es NULL sus n valores de 32 bits se
+    // reordenan junto con las claves.
+    // Si event no es NULL devuelve el evento del ultimo kernel.
+    // Devuelve false en caso de error
+    bool enqueueSort(cl_command_queue queue, cl_mem keys, cl_mem values, int n, bool signedKeys= true,
+                     cl_event* event= 0);
+
+    int getRadixBits() const { return radixBits; }
+
+    // Libera los programas, kernels y buffers
+    void release();
+
+private:
+    // Compila el programa con o sin valores y claves con o sin signo si todavia no se compilo
+    bool build(bool withValues, bool signedKeys);
+    // Agranda buffer (de capacity bytes) si tiene menos de bytes bytes
+    bool reserve(cl_mem& buffer, size_t& capacity, size_t bytes);
+
+    cl_context context;
+    cl_device_id device;
+    std::string path;
+    int radixBits;
+    Scan scan;
+
+    cl_program programs[2][2];
+    cl_kernel histogramKernels[2][2];
+    cl_kernel scatterKernels[2][2];
+    size_t localSizes[2][2];
+    int items[2][2];
+
+    // Claves y valores intermedios entre pasadas e histogramas de los tiles
+    cl_mem tempKeys;
+    size_t tempKeysCapacity;
+    cl_mem tempValues;
+    size_t tempValuesCapacity;
+    cl_mem groupHist;
+    size_t groupHistCapacity;
+    cl_ulong localMemory;
+};
+
+#endif // RADIXSORT_H
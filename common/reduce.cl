@@ -0,0 +1,136 @@
+// Reducciones de arreglos de int o float (suma, minimo, maximo, conteo con
+// predicado y argmax) en dos pasadas, sin atomics globales
+//
+// Se compila con -D T=<int|float> -D OP=<operacion> (ver reduce.h), y -D T_FLOAT
+// si T es float. Cada operacion define:
+//  - ACC: tipo del acumulador (puede ser distinto de T, por ejemplo long para
+//    sumar ints sin desborde o uint para contar)
+//  - identity(): elemento neutro de combine
+//  - map(x, i, value): valor acumulable del elemento x de indice i
+//  - combine(a, b): operacion asociativa que junta dos acumuladores
+//
+// Pasada 1 (reducePartial): cada work-item acumula en privado los elementos que
+// le tocan con un grid-stride loop, luego el work-group reduce sus acumuladores
+// en memoria local con un arbol y escribe un parcial por work-group.
+// Pasada 2 (reduceFinal): un unico work-group reduce los parciales de la misma
+// forma y escribe el resultado.
+//
+// El arbol asume que el tamanio del work-group es potencia de 2.
+
+#define OP_SUM           0
+#define OP_MIN           1
+#define OP_MAX           2
+#define OP_COUNT_EQUAL   3
+#define OP_COUNT_LESS    4
+#define OP_COUNT_GREATER 5
+#define OP_ARGMAX        6
+
+#ifdef T_FLOAT
+#define T_MIN (-INFINITY)
+#define T_MAX INFINITY
+#else
+#define T_MIN INT_MIN
+#define T_MAX INT_MAX
+#endif
+
+#if OP == OP_SUM
+#ifdef T_FLOAT
+typedef float ACC;
+#else
+typedef long ACC;
+#endif
+ACC identity() { return 0; }
+ACC map(T x, int i, T value) { return x; }
+ACC combine(ACC a, ACC b) { return a + b; }
+
+#elif OP == OP_MIN
+typedef T ACC;
+ACC identity() { return T_MAX; }
+ACC map(T x, int i, T value) { return x; }
+ACC combine(ACC a, ACC b) { return min(a, b); }
+
+#elif OP == OP_MAX
+typedef T ACC;
+ACC identity() { return T_MIN; }
+ACC map(T x, int i, T value) { return x; }
+ACC combine(ACC a, ACC b) { return max(a, b); }
+
+#elif OP == OP_COUNT_EQUAL || OP == OP_COUNT_LESS || OP == OP_COUNT_GREATER
+typedef uint ACC;
+ACC identity() { return 0; }
+#if OP == OP_COUNT_EQUAL
+ACC map(T x, int i, T value) { return x == value ? 1 : 0; }
+#elif OP == OP_COUNT_LESS
+ACC map(T x, int i, T value) { return x < value ? 1 : 0; }
+#else
+ACC map(T x, int i, T value) { return x > value ? 1 : 0; }
+#endif
+ACC combine(ACC a, ACC b) { return a + b; }
+
+#elif OP == OP_ARGMAX
+// Valor maximo y su indice. Con valores iguales gana el menor indice, asi que el
+// resultado no depende del orden en que se combinan los parciales.
+typedef struct {
+    T value;
+    int index;
+} ACC;
+ACC identity() { ACC a; a.value= T_MIN; a.index= INT_MAX; return a; }
+ACC map(T x, int i, T value) { ACC a; a.value= x; a.index= i; return a; }
+ACC combine(ACC a, ACC b)
+{
+    if(a.value > b.value || (a.value == b.value && a.index < b.index))
+        return a;
+    return b;
+}
+
+#else
+#error "OP no definida"
+#endif
+
+// Reduce el acumulador de cada work-item del work-group en scratch y devuelve el
+// resultado (valido en todos los work-items)
+ACC reduceLocal(ACC acc, __local ACC* scratch)
+{
+    const int lid= get_local_id(0);
+    scratch[lid]= acc;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int s= get_local_size(0) / 2; s>0; s>>=1) {
+        if(lid < s)
+            scratch[lid]= combine(scratch[lid], scratch[lid + s]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    return scratch[0];
+}
+
+// Pasada 1: partials[g] = reduccion de los elementos que procesa el work-group g
+__kernel void reducePartial(
+    __global const T* data,
+    int n,
+    T value,
+    __global ACC* partials,
+    __local ACC* scratch)
+{
+    ACC acc= identity();
+    for(int i= get_global_id(0); i<n; i+=get_global_size(0))
+        acc= combine(acc, map(data[i], i, value));
+
+    acc= reduceLocal(acc, scratch);
+    if(!get_local_id(0))
+        partials[get_group_id(0)]= acc;
+}
+
+// Pasada 2 (un solo work-group): result[0] = reduccion de los count parciales
+__kernel void reduceFinal(
+    __global const ACC* partials,
+    int count,
+    __global ACC* result,
+    __local ACC* scratch)
+{
+    ACC acc= identity();
+    for(int i= get_local_id(0); i<count; i+=get_local_size(0))
+        acc= combine(acc, partials[i]);
+
+    acc= reduceLocal(acc, scratch);
+    if(!get_local_id(0))
+        result[0]= acc;
+}
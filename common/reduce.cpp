@@ -0,0 +1,189 @@
+#include "reduce.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+// Work-groups por unidad de computo en la primera pasada
+static const size_t groupsPerComputeUnit= 8;
+
+// Tamanio en bytes del acumulador (ACC en reduce.cl) de op con datos de tipo type
+static size_t accumulatorBytes(ReduceOp op, ReduceType type)
+{
+    switch(op) {
+    case REDUCE_SUM:    return type == REDUCE_INT ? sizeof(cl_long) : sizeof(cl_float);
+    case REDUCE_ARGMAX: return 2 * sizeof(cl_int);
+    default:            return 4;
+    }
+}
+
+// Deshace un build a medias: libera el programa y los kernels ya creados y deja
+// los slots en NULL para que el siguiente build lo vuelva a intentar
+static bool discardBuild(cl_program program, cl_kernel& first, cl_kernel& second)
+{
+    if(first)
+        clReleaseKernel(first);
+    if(second)
+        clReleaseKernel(second);
+    first= NULL;
+    second= NULL;
+    clReleaseProgram(program);
+    return false;
+}
+
+Reduction::Reduction()
+{
+    context= NULL;
+    device= NULL;
+    for(int op=0; op<REDUCE_OP_COUNT; op++) {
+        for(int type=0; type<REDUCE_TYPE_COUNT; type++) {
+            programs[op][type]= NULL;
+            partialKernels[op][type]= NULL;
+            finalKernels[op][type]= NULL;
+            localSizes[op][type]= 1;
+        }
+    }
+    partials= NULL;
+    resultBuffer= NULL;
+    maxGroups= 0;
+}
+
+bool Reduction::init(cl_context context, cl_device_id device, const char* path)
+{
+    release();
+    this->context= context;
+    this->device= device;
+    this->path= path;
+
+    cl_uint computeUnits;
+    cl_int error= clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    if(checkError(error, "Reduction::init: clGetDeviceInfo"))
+        return false;
+    maxGroups= max(computeUnits, 1u) * groupsPerComputeUnit;
+
+    // El acumulador mas grande es de 8 bytes (cl_long o valor + indice)
+    cl_int error1, error2;
+    partials= clCreateBuffer(context, CL_MEM_READ_WRITE, maxGroups * 8, NULL, &error1);
+    resultBuffer= clCreateBuffer(context, CL_MEM_READ_WRITE, 8, NULL, &error2);
+    if(checkError(error1, "Reduction::init: clCreateBuffer") or checkError(error2, "Reduction::init: clCreateBuffer"))
+        return false;
+
+    return true;
+}
+
+bool Reduction::build(ReduceOp op, ReduceType type)
+{
+    if(programs[op][type])
+        return true;
+
+    ostringstream options;
+    options << "-D OP=" << op << (type == REDUCE_FLOAT ? " -D T=float -D T_FLOAT" : " -D T=int");
+    cl_program program;
+    if(!loadProgram(context, &program, device, path.c_str(), options.str().c_str()))
+        return false;
+
+    // El programa se guarda en la cache solo cuando todos sus kernels estan creados
+    cl_int error;
+    partialKernels[op][type]= clCreateKernel(program, "reducePartial", &error);
+    if(checkError(error, "Reduction: clCreateKernel"))
+        return discardBuild(program, partialKernels[op][type], finalKernels[op][type]);
+    finalKernels[op][type]= clCreateKernel(program, "reduceFinal", &error);
+    if(checkError(error, "Reduction: clCreateKernel"))
+        return discardBuild(program, partialKernels[op][type], finalKernels[op][type]);
+
+    // El arbol en memoria local necesita un work-group de tamanio potencia de 2
+    size_t partialMax, finalMax;
+    error  = clGetKernelWorkGroupInfo(partialKernels[op][type], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &partialMax, NULL);
+    error |= clGetKernelWorkGroupInfo(finalKernels[op][type], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &finalMax, NULL);
+    if(checkError(error, "Reduction: clGetKernelWorkGroupInfo"))
+        return discardBuild(program, partialKernels[op][type], finalKernels[op][type]);
+    const size_t maxSize= min(min(partialMax, finalMax), (size_t)256);
+    size_t localSize= 1;
+    while(localSize * 2 <= maxSize)
+        localSize*= 2;
+    localSizes[op][type]= localSize;
+    programs[op][type]= program;
+
+    return true;
+}
+
+bool Reduction::enqueueReduce(cl_command_queue queue, ReduceOp op, ReduceType type, cl_mem data, int n,
+                              cl_mem result, const void* value, cl_event* partialEvent, cl_event* finalEvent)
+{
+    if(!build(op, type))
+        return false;
+    cl_kernel partialKernel= partialKernels[op][type];
+    cl_kernel finalKernel= finalKernels[op][type];
+
+    // Un work-item por elemento, sin pasar de maxGroups work-groups
+    const size_t localSize= localSizes[op][type];
+    const size_t groups= max(min(((size_t)n + localSize - 1) / localSize, maxGroups), (size_t)1);
+    const size_t ndRangeSize= groups * localSize;
+    const int partialCount= groups;
+    const size_t scratchBytes= localSize * accumulatorBytes(op, type);
+    const cl_int zero= 0;
+
+    cl_int error;
+    error  = clSetKernelArg(partialKernel, 0, sizeof(cl_mem), &data);
+    error |= clSetKernelArg(partialKernel, 1, sizeof(cl_int), &n);
+    error |= clSetKernelArg(partialKernel, 2, 4, value ? value : &zero);
+    error |= clSetKernelArg(partialKernel, 3, sizeof(cl_mem), &partials);
+    error |= clSetKernelArg(partialKernel, 4, scratchBytes, NULL);
+    error |= clSetKernelArg(finalKernel, 0, sizeof(cl_mem), &partials);
+    error |= clSetKernelArg(finalKernel, 1, sizeof(cl_int), &partialCount);
+    error |= clSetKernelArg(finalKernel, 2, sizeof(cl_mem), &result);
+    error |= clSetKernelArg(finalKernel, 3, scratchBytes, NULL);
+    if(checkError(error, "Reduction::enqueueReduce: clSetKernelArg"))
+        return false;
+
+    error= clEnqueueNDRangeKernel(queue, partialKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL, partialEvent);
+    if(checkError(error, "Reduction::enqueueReduce: clEnqueueNDRangeKernel"))
+        return false;
+    error= clEnqueueNDRangeKernel(queue, finalKernel, 1, NULL, &localSize, &localSize, 0, NULL, finalEvent);
+    if(checkError(error, "Reduction::enqueueReduce: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+bool Reduction::reduce(cl_command_queue queue, ReduceOp op, ReduceType type, cl_mem data, int n,
+                       void* result, const void* value, cl_event* partialEvent, cl_event* finalEvent)
+{
+    if(!enqueueReduce(queue, op, type, data, n, resultBuffer, value, partialEvent, finalEvent))
+        return false;
+    cl_int error= clEnqueueReadBuffer(queue, resultBuffer, CL_TRUE, 0, resultBytes(op, type), result, 0, NULL, NULL);
+    if(checkError(error, "Reduction::reduce: clEnqueueReadBuffer"))
+        return false;
+    return true;
+}
+
+size_t Reduction::resultBytes(ReduceOp op, ReduceType type)
+{
+    return accumulatorBytes(op, type);
+}
+
+void Reduction::release()
+{
+    for(int op=0; op<REDUCE_OP_COUNT; op++) {
+        for(int type=0; type<REDUCE_TYPE_COUNT; type++) {
+            if(partialKernels[op][type])
+                clReleaseKernel(partialKernels[op][type]);
+            if(finalKernels[op][type])
+                clReleaseKernel(finalKernels[op][type]);
+            if(programs[op][type])
+                clReleaseProgram(programs[op][type]);
+            programs[op][type]= NULL;
+            partialKernels[op][type]= NULL;
+            finalKernels[op][type]= NULL;
+        }
+    }
+    if(partials)
+        clReleaseMemObject(partials);
+    if(resultBuffer)
+        clReleaseMemObject(resultBuffer);
+    partials= NULL;
+    resultBuffer= NULL;
+}
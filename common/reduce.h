@@ -0,0 +1,98 @@
+/*
+ * reduce.h
+ *
+ * Reducciones de arreglos de int o float en el dispositivo: suma, minimo,
+ * maximo, conteo de elementos que cumplen un predicado y argmax
+ *
+ * A diferencia de contar con atomic_inc (globCounter y shMemCounter en
+ * example4), la reduccion no usa atomics globales: cada work-item acumula en
+ * privado con un grid-stride loop, cada work-group reduce sus acumuladores en
+ * memoria local con un arbol y escribe un parcial, y una segunda pasada con un
+ * solo work-group reduce los parciales (ver reduce.cl). Se lanzan solo los
+ * work-groups necesarios para llenar el dispositivo, asi que la cantidad de
+ * parciales no depende de n y la segunda pasada es despreciable.
+ *
+ * Cada combinacion de operacion y tipo es un programa compilado con distintas
+ * opciones; se compila la primera vez que se usa.
+ *
+ * Tamanio y formato del resultado segun la operacion:
+ *  - REDUCE_SUM: cl_long para int (sin desborde), cl_float para float
+ *  - REDUCE_MIN, REDUCE_MAX: cl_int o cl_float
+ *  - REDUCE_COUNT_*: cl_uint
+ *  - REDUCE_ARGMAX: el valor maximo (cl_int o cl_float) seguido de su indice
+ *    (cl_int); con valores repetidos, el menor indice
+ */
+
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <CL/cl.h>
+
+#include <string>
+
+enum ReduceOp {
+    REDUCE_SUM,
+    REDUCE_MIN,
+    REDUCE_MAX,
+    REDUCE_COUNT_EQUAL,    // Elementos == value
+    REDUCE_COUNT_LESS,     // Elementos < value
+    REDUCE_COUNT_GREATER,  // Elementos > value
+    REDUCE_ARGMAX,
+    REDUCE_OP_COUNT
+};
+
+enum ReduceType {
+    REDUCE_INT,
+    REDUCE_FLOAT,
+    REDUCE_TYPE_COUNT
+};
+
+class Reduction
+{
+public:
+    Reduction();
+    ~Reduction() { release(); }
+
+    // Reserva el buffer de parciales para context y device. Los programas de
+    // path se compilan al usar cada operacion.
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, const char* path= "../../common/reduce.cl");
+
+    // Encola la reduccion op de los n elementos de tipo type de data y escribe el
+    // resultado al inicio de result (de resultBytes(op, type) bytes). value es el
+    // valor de comparacion de REDUCE_COUNT_* (un cl_int o cl_float segun type).
+    // Si partialEvent o finalEvent no son NULL devuelven los eventos de cada pasada.
+    // Devuelve false en caso de error
+    bool enqueueReduce(cl_command_queue queue, ReduceOp op, ReduceType type, cl_mem data, int n,
+                       cl_mem result, const void* value= 0, cl_event* partialEvent= 0, cl_event* finalEvent= 0);
+
+    // Igual que enqueueReduce, pero espera el resultado y lo copia a result (memoria de host)
+    bool reduce(cl_command_queue queue, ReduceOp op, ReduceType type, cl_mem data, int n,
+                void* result, const void* value= 0, cl_event* partialEvent= 0, cl_event* finalEvent= 0);
+
+    // Tamanio en bytes del resultado de op sobre datos de tipo type
+    static size_t resultBytes(ReduceOp op, ReduceType type);
+
+    // Libera los programas, kernels y buffers
+    void release();
+
+private:
+    // Compila el programa de op y type si todavia no se compilo
+    bool build(ReduceOp op, ReduceType type);
+
+    cl_context context;
+    cl_device_id device;
+    std::string path;
+
+    cl_program programs[REDUCE_OP_COUNT][REDUCE_TYPE_COUNT];
+    cl_kernel partialKernels[REDUCE_OP_COUNT][REDUCE_TYPE_COUNT];
+    cl_kernel finalKernels[REDUCE_OP_COUNT][REDUCE_TYPE_COUNT];
+    size_t localSizes[REDUCE_OP_COUNT][REDUCE_TYPE_COUNT];
+
+    // Parciales de la primera pasada (maxGroups acumuladores) y resultado de reduce()
+    cl_mem partials;
+    cl_mem resultBuffer;
+    size_t maxGroups;
+};
+
+#endif // REDUCE_H
@@ -0,0 +1,193 @@
+// Prefix scan (suma acumulada) de ints y compactacion de arreglos
+//
+// Se compila con -D T=<int|float> -D PRED=<predicado> (ver scan.h). T y PRED solo
+// afectan a los kernels de compactacion.
+//
+// scanBlocks aplica el algoritmo de Blelloch (up-sweep y down-sweep en memoria
+// local, O(n) sumas) a bloques de 2 * get_local_size(0) elementos y escribe la
+// suma de cada bloque en blockSums. Para n arbitrario el host escanea
+// blockSums de la misma forma (recursivamente si hace falta) y luego suma a cada
+// bloque su desplazamiento con addBlockOffsets.
+//
+// El tamanio del work-group debe ser potencia de 2. Los indices en memoria
+// local se desplazan un lugar cada NUM_BANKS elementos para que los accesos con
+// stride del arbol no caigan en el mismo banco.
+
+#define NUM_BANKS 32
+#define LOG_NUM_BANKS 5
+#define CONFLICT_FREE(i) ((i) + ((i) >> LOG_NUM_BANKS))
+
+#define PRED_EQUAL   0
+#define PRED_LESS    1
+#define PRED_GREATER 2
+
+#ifndef T
+#define T int
+#endif
+#ifndef PRED
+#define PRED PRED_EQUAL
+#endif
+
+#if PRED == PRED_EQUAL
+#define MATCHES(x, value) ((x) == (value))
+#elif PRED == PRED_LESS
+#define MATCHES(x, value) ((x) < (value))
+#else
+#define MATCHES(x, value) ((x) > (value))
+#endif
+
+// Scan exclusivo en temp de un bloque de 2 * get_local_size(0) valores: cada
+// work-item aporta a (posicion lid del bloque) y b (posicion lid + get_local_size(0)).
+// Devuelve en a y b sus resultados exclusivos, y la suma total del bloque.
+int blockScan(int* a, int* b, __local int* temp)
+{
+    const int lid= get_local_id(0);
+    const int blockSize= 2 * get_local_size(0);
+    const int ai= lid;
+    const int bi= lid + get_local_size(0);
+    temp[CONFLICT_FREE(ai)]= *a;
+    temp[CONFLICT_FREE(bi)]= *b;
+
+    // Up-sweep: arbol de sumas parciales, la raiz queda en el ultimo elemento
+    int offset= 1;
+    for(int d= blockSize >> 1; d>0; d>>=1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(lid < d) {
+            const int left= offset * (2 * lid + 1) - 1;
+            const int right= offset * (2 * lid + 2) - 1;
+            temp[CONFLICT_FREE(right)]+= temp[CONFLICT_FREE(left)];
+        }
+        offset*= 2;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    const int total= temp[CONFLICT_FREE(blockSize - 1)];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if(!lid)
+        temp[CONFLICT_FREE(blockSize - 1)]= 0;
+
+    // Down-sweep: se baja por el arbol repartiendo los prefijos
+    for(int d=1; d<blockSize; d*=2) {
+        offset>>= 1;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(lid < d) {
+            const int left= offset * (2 * lid + 1) - 1;
+            const int right= offset * (2 * lid + 2) - 1;
+            const int t= temp[CONFLICT_FREE(left)];
+            temp[CONFLICT_FREE(left)]= temp[CONFLICT_FREE(right)];
+            temp[CONFLICT_FREE(right)]+= t;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    *a= temp[CONFLICT_FREE(ai)];
+    *b= temp[CONFLICT_FREE(bi)];
+    return total;
+}
+
+// Scan de cada bloque de in en out (exclusivo, o inclusivo si inclusive != 0),
+// y suma de cada bloque en blockSums. in y out pueden ser el mismo buffer.
+__kernel void scanBlocks(
+    __global const int* in,
+    __global int* out,
+    __global int* blockSums,
+    int n,
+    int inclusive,
+    __local int* temp)
+{
+    const int blockStart= get_group_id(0) * 2 * get_local_size(0);
+    const int ga= blockStart + get_local_id(0);
+    const int gb= ga + get_local_size(0);
+    const int xa= ga < n ? in[ga] : 0;
+    const int xb= gb < n ? in[gb] : 0;
+
+    int a= xa, b= xb;
+    const int total= blockScan(&a, &b, temp);
+    if(inclusive) {
+        a+= xa;
+        b+= xb;
+    }
+    if(ga < n)
+        out[ga]= a;
+    if(gb < n)
+        out[gb]= b;
+    if(!get_local_id(0))
+        blockSums[get_group_id(0)]= total;
+}
+
+// data[i] += offsets[i / (2 * get_local_size(0))]: desplazamiento de cada bloque
+// (el scan exclusivo de blockSums)
+__kernel void addBlockOffsets(
+    __global int* data,
+    __global const int* offsets,
+    int n)
+{
+    const int offset= offsets[get_group_id(0)];
+    const int blockStart= get_group_id(0) * 2 * get_local_size(0);
+    const int ga= blockStart + get_local_id(0);
+    const int gb= ga + get_local_size(0);
+    if(ga < n)
+        data[ga]+= offset;
+    if(gb < n)
+        data[gb]+= offset;
+}
+
+// Como scanBlocks (exclusivo) pero sobre el predicado de cada elemento de data:
+// positions[i] es la cantidad de elementos que cumplen el predicado antes de i
+// dentro de su bloque
+__kernel void scanPredicate(
+    __global const T* data,
+    int n,
+    T value,
+    __global int* positions,
+    __global int* blockSums,
+    __local int* temp)
+{
+    const int blockStart= get_group_id(0) * 2 * get_local_size(0);
+    const int ga= blockStart + get_local_id(0);
+    const int gb= ga + get_local_size(0);
+    int a= (ga < n && MATCHES(data[ga], value)) ? 1 : 0;
+    int b= (gb < n && MATCHES(data[gb], value)) ? 1 : 0;
+
+    const int total= blockScan(&a, &b, temp);
+    if(ga < n)
+        positions[ga]= a;
+    if(gb < n)
+        positions[gb]= b;
+    if(!get_local_id(0))
+        blockSums[get_group_id(0)]= total;
+}
+
+// Escribe los elementos de data que cumplen el predicado (en outValues) y sus
+// indices (en outIndices) en forma contigua y en orden. Cualquiera de los dos
+// puede ser NULL. La posicion de salida es la de scanPredicate mas el
+// desplazamiento del bloque; el ultimo elemento escribe la cantidad total en count.
+__kernel void compactScatter(
+    __global const T* data,
+    int n,
+    T value,
+    __global const int* positions,
+    __global const int* offsets,
+    __global T* outValues,
+    __global int* outIndices,
+    __global int* count)
+{
+    const int offset= offsets[get_group_id(0)];
+    const int blockStart= get_group_id(0) * 2 * get_local_size(0);
+    for(int k=0; k<2; k++) {
+        const int i= blockStart + get_local_id(0) + k * get_local_size(0);
+        if(i >= n)
+            return;
+        const T x= data[i];
+        const bool matches= MATCHES(x, value);
+        const int position= offset + positions[i];
+        if(matches) {
+            if(outValues)
+                outValues[position]= x;
+            if(outIndices)
+                outIndices[position]= i;
+        }
+        if(i == n - 1)
+            *count= position + (matches ? 1 : 0);
+    }
+}
@@ -0,0 +1,315 @@
+#include "scan.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+// Opciones de compilacion de cada tipo y predicado (ver scan.cl)
+static const char* typeOptions[COMPACT_TYPE_COUNT] = { "-D T=int", "-D T=float" };
+
+// Ints de memoria local de un bloque de blockSize elementos (CONFLICT_FREE en scan.cl)
+static size_t localInts(size_t blockSize)
+{
+    return blockSize + blockSize / 32;
+}
+
+// Libera los kernels creados hasta el momento y deja los slots en NULL
+static void releaseKernels(cl_kernel& first, cl_kernel& second)
+{
+    if(first)
+        clReleaseKernel(first);
+    if(second)
+        clReleaseKernel(second);
+    first= NULL;
+    second= NULL;
+}
+
+// Deshace un build a medias para que el siguiente build lo vuelva a intentar
+static bool discardBuild(cl_program program, cl_kernel& first, cl_kernel& second)
+{
+    releaseKernels(first, second);
+    clReleaseProgram(program);
+    return false;
+}
+
+Scan::Scan()
+{
+    context= NULL;
+    device= NULL;
+    for(int type=0; type<COMPACT_TYPE_COUNT; type++) {
+        for(int pred=0; pred<COMPACT_PREDICATE_COUNT; pred++) {
+            programs[type][pred]= NULL;
+            scanPredicateKernels[type][pred]= NULL;
+            scatterKernels[type][pred]= NULL;
+        }
+    }
+    scanBlocksKernel= NULL;
+    addOffsetsKernel= NULL;
+    localSize= 1;
+    positions= NULL;
+    positionsCapacity= 0;
+    countBuffer= NULL;
+}
+
+bool Scan::init(cl_context context, cl_device_id device, const char* path)
+{
+    release();
+    this->context= context;
+    this->device= device;
+    this->path= path;
+
+    // El programa de ints con igualdad tiene ademas los kernels del scan, y fija
+    // el tamanio de work-group de todos
+    if(!build(COMPACT_INT, COMPACT_EQUAL))
+        return false;
+
+    cl_int error;
+    countBuffer= clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, &error);
+    if(checkError(error, "Scan::init: clCreateBuffer"))
+        return false;
+
+    return true;
+}
+
+bool Scan::build(CompactType type, CompactPredicate pred)
+{
+    if(programs[type][pred])
+        return true;
+
+    ostringstream options;
+    options << typeOptions[type] << " -D PRED=" << pred;
+    cl_program program;
+    if(!loadProgram(context, &program, device, path.c_str(), options.str().c_str()))
+        return false;
+
+    // El programa se guarda en la cache solo cuando todos sus kernels estan creados
+    cl_int error;
+    scanPredicateKernels[type][pred]= clCreateKernel(program, "scanPredicate", &error);
+    if(checkError(error, "Scan: clCreateKernel"))
+        return discardBuild(program, scanPredicateKernels[type][pred], scatterKernels[type][pred]);
+    scatterKernels[type][pred]= clCreateKernel(program, "compactScatter", &error);
+    if(checkError(error, "Scan: clCreateKernel"))
+        return discardBuild(program, scanPredicateKernels[type][pred], scatterKernels[type][pred]);
+
+    size_t predicateMax, scatterMax;
+    error  = clGetKernelWorkGroupInfo(scanPredicateKernels[type][pred], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &predicateMax, NULL);
+    error |= clGetKernelWorkGroupInfo(scatterKernels[type][pred], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &scatterMax, NULL);
+    if(checkError(error, "Scan: clGetKernelWorkGroupInfo"))
+        return discardBuild(program, scanPredicateKernels[type][pred], scatterKernels[type][pred]);
+
+    if(scanBlocksKernel) {
+        // Los demas programas usan el tamanio ya elegido
+        if(predicateMax < localSize or scatterMax < localSize) {
+            cerr << "Scan: tamanio de work-group " << localSize << " no soportado por los kernels de compactacion" << endl;
+            return discardBuild(program, scanPredicateKernels[type][pred], scatterKernels[type][pred]);
+        }
+        programs[type][pred]= program;
+        return true;
+    }
+
+    // Los kernels del scan generico salen del primer programa que se compila
+    scanBlocksKernel= clCreateKernel(program, "scanBlocks", &error);
+    addOffsetsKernel= error == CL_SUCCESS ? clCreateKernel(program, "addBlockOffsets", &error) : NULL;
+    if(checkError(error, "Scan: clCreateKernel")) {
+        releaseKernels(scanBlocksKernel, addOffsetsKernel);
+        return discardBuild(program, scanPredicateKernels[type][pred], scatterKernels[type][pred]);
+    }
+
+    // El arbol de blockScan necesita un work-group de tamanio potencia de 2
+    size_t scanMax, addMax;
+    error  = clGetKernelWorkGroupInfo(scanBlocksKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &scanMax, NULL);
+    error |= clGetKernelWorkGroupInfo(addOffsetsKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &addMax, NULL);
+    if(checkError(error, "Scan: clGetKernelWorkGroupInfo")) {
+        releaseKernels(scanBlocksKernel, addOffsetsKernel);
+        return discardBuild(program, scanPredicateKernels[type][pred], scatterKernels[type][pred]);
+    }
+    const size_t maxSize= min(min(min(scanMax, addMax), min(predicateMax, scatterMax)), (size_t)256);
+    localSize= 1;
+    while(localSize * 2 <= maxSize)
+        localSize*= 2;
+    programs[type][pred]= program;
+
+    return true;
+}
+
+bool Scan::reserve(cl_mem& buffer, size_t& capacity, size_t count)
+{
+    if(buffer and capacity >= count)
+        return true;
+    if(buffer)
+        clReleaseMemObject(buffer);
+    buffer= NULL;
+    capacity= 0;
+
+    cl_int error;
+    buffer= clCreateBuffer(context, CL_MEM_READ_WRITE, max(count, (size_t)1) * sizeof(cl_int), NULL, &error);
+    if(checkError(error, "Scan: clCreateBuffer"))
+        return false;
+    capacity= count;
+    return true;
+}
+
+bool Scan::scanLevel(cl_command_queue queue, cl_mem in, cl_mem out, int n, bool inclusive, size_t level, cl_event* event)
+{
+    const size_t blockSize= 2 * localSize;
+    const size_t blocks= max(((size_t)n + blockSize - 1) / blockSize, (size_t)1);
+    const size_t ndRangeSize= blocks * localSize;
+    if(levelBuffers.size() <= level) {
+        levelBuffers.resize(level + 1, NULL);
+        levelCapacities.resize(level + 1, 0);
+    }
+    if(!reserve(levelBuffers[level], levelCapacities[level], blocks))
+        return false;
+    cl_mem blockSums= levelBuffers[level];
+
+    const cl_int inclusiveArg= inclusive ? 1 : 0;
+    cl_int error;
+    error  = clSetKernelArg(scanBlocksKernel, 0, sizeof(cl_mem), &in);
+    error |= clSetKernelArg(scanBlocksKernel, 1, sizeof(cl_mem), &out);
+    error |= clSetKernelArg(scanBlocksKernel, 2, sizeof(cl_mem), &blockSums);
+    error |= clSetKernelArg(scanBlocksKernel, 3, sizeof(cl_int), &n);
+    error |= clSetKernelArg(scanBlocksKernel, 4, sizeof(cl_int), &inclusiveArg);
+    error |= clSetKernelArg(scanBlocksKernel, 5, localInts(blockSize) * sizeof(cl_int), NULL);
+    if(checkError(error, "Scan::enqueueScan: clSetKernelArg"))
+        return false;
+    error= clEnqueueNDRangeKernel(queue, scanBlocksKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL,
+                                  blocks == 1 ? event : NULL);
+    if(checkError(error, "Scan::enqueueScan: clEnqueueNDRangeKernel"))
+        return false;
+    if(blocks == 1)
+        return true;
+
+    // Desplazamiento de cada bloque: scan exclusivo (en el lugar) de las sumas
+    if(!scanLevel(queue, blockSums, blockSums, blocks, false, level + 1, NULL))
+        return false;
+
+    error  = clSetKernelArg(addOffsetsKernel, 0, sizeof(cl_mem), &out);
+    error |= clSetKernelArg(addOffsetsKernel, 1, sizeof(cl_mem), &blockSums);
+    error |= clSetKernelArg(addOffsetsKernel, 2, sizeof(cl_int), &n);
+    if(checkError(error, "Scan::enqueueScan: clSetKernelArg"))
+        return false;
+    error= clEnqueueNDRangeKernel(queue, addOffsetsKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL, event);
+    if(checkError(error, "Scan::enqueueScan: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+bool Scan::enqueueScan(cl_command_queue queue, cl_mem in, cl_mem out, int n, bool inclusive, cl_event* event)
+{
+    return scanLevel(queue, in, out, n, inclusive, 0, event);
+}
+
+bool Scan::enqueueCompact(cl_command_queue queue, CompactType type, CompactPredicate pred, cl_mem data, int n,
+                          const void* value, cl_mem outValues, cl_mem outIndices, cl_mem count, cl_event* event)
+{
+    if(!build(type, pred))
+        return false;
+
+    // Sin elementos el scatter no escribe count (lo escribe el ultimo elemento)
+    if(n <= 0) {
+        static const cl_int zero= 0;
+        cl_int error= clEnqueueWriteBuffer(queue, count, CL_FALSE, 0, sizeof(cl_int), &zero, 0, NULL, event);
+        return !checkError(error, "Scan::enqueueCompact: clEnqueueWriteBuffer");
+    }
+
+    cl_kernel predicateKernel= scanPredicateKernels[type][pred];
+    cl_kernel scatterKernel= scatterKernels[type][pred];
+
+    const size_t blockSize= 2 * localSize;
+    const size_t blocks= max(((size_t)n + blockSize - 1) / blockSize, (size_t)1);
+    const size_t ndRangeSize= blocks * localSize;
+    if(levelBuffers.empty()) {
+        levelBuffers.push_back(NULL);
+        levelCapacities.push_back(0);
+    }
+    if(!reserve(levelBuffers[0], levelCapacities[0], blocks) or !reserve(positions, positionsCapacity, n))
+        return false;
+    cl_mem blockSums= levelBuffers[0];
+
+    cl_int error;
+    error  = clSetKernelArg(predicateKernel, 0, sizeof(cl_mem), &data);
+    error |= clSetKernelArg(predicateKernel, 1, sizeof(cl_int), &n);
+    error |= clSetKernelArg(predicateKernel, 2, 4, value);
+    error |= clSetKernelArg(predicateKernel, 3, sizeof(cl_mem), &positions);
+    error |= clSetKernelArg(predicateKernel, 4, sizeof(cl_mem), &blockSums);
+    error |= clSetKernelArg(predicateKernel, 5, localInts(blockSize) * sizeof(cl_int), NULL);
+    if(checkError(error, "Scan::enqueueCompact: clSetKernelArg"))
+        return false;
+    error= clEnqueueNDRangeKernel(queue, predicateKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL, NULL);
+    if(checkError(error, "Scan::enqueueCompact: clEnqueueNDRangeKernel"))
+        return false;
+
+    // Desplazamiento de cada bloque en la salida
+    if(!scanLevel(queue, blockSums, blockSums, blocks, false, 1, NULL))
+        return false;
+
+    // Un buffer NULL se pasa como argumento NULL (el kernel no escribe esa salida)
+    error  = clSetKernelArg(scatterKernel, 0, sizeof(cl_mem), &data);
+    error |= clSetKernelArg(scatterKernel, 1, sizeof(cl_int), &n);
+    error |= clSetKernelArg(scatterKernel, 2, 4, value);
+    error |= clSetKernelArg(scatterKernel, 3, sizeof(cl_mem), &positions);
+    error |= clSetKernelArg(scatterKernel, 4, sizeof(cl_mem), &blockSums);
+    error |= clSetKernelArg(scatterKernel, 5, sizeof(cl_mem), outValues ? &outValues : NULL);
+    error |= clSetKernelArg(scatterKernel, 6, sizeof(cl_mem), outIndices ? &outIndices : NULL);
+    error |= clSetKernelArg(scatterKernel, 7, sizeof(cl_mem), &count);
+    if(checkError(error, "Scan::enqueueCompact: clSetKernelArg"))
+        return false;
+    error= clEnqueueNDRangeKernel(queue, scatterKernel, 1, NULL, &ndRangeSize, &localSize, 0, NULL, event);
+    if(checkError(error, "Scan::enqueueCompact: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+bool Scan::compact(cl_command_queue queue, CompactType type, CompactPredicate pred, cl_mem data, int n,
+                   const void* value, cl_mem outValues, cl_mem outIndices, int& count, cl_event* event)
+{
+    if(!enqueueCompact(queue, type, pred, data, n, value, outValues, outIndices, countBuffer, event))
+        return false;
+    cl_int result;
+    cl_int error= clEnqueueReadBuffer(queue, countBuffer, CL_TRUE, 0, sizeof(cl_int), &result, 0, NULL, NULL);
+    if(checkError(error, "Scan::compact: clEnqueueReadBuffer"))
+        return false;
+    count= result;
+    return true;
+}
+
+void Scan::release()
+{
+    for(int type=0; type<COMPACT_TYPE_COUNT; type++) {
+        for(int pred=0; pred<COMPACT_PREDICATE_COUNT; pred++) {
+            if(scanPredicateKernels[type][pred])
+                clReleaseKernel(scanPredicateKernels[type][pred]);
+            if(scatterKernels[type][pred])
+                clReleaseKernel(scatterKernels[type][pred]);
+            if(programs[type][pred])
+                clReleaseProgram(programs[type][pred]);
+            programs[type][pred]= NULL;
+            scanPredicateKernels[type][pred]= NULL;
+            scatterKernels[type][pred]= NULL;
+        }
+    }
+    if(scanBlocksKernel)
+        clReleaseKernel(scanBlocksKernel);
+    if(addOffsetsKernel)
+        clReleaseKernel(addOffsetsKernel);
+    scanBlocksKernel= NULL;
+    addOffsetsKernel= NULL;
+
+    for(size_t i=0; i<levelBuffers.size(); i++)
+        if(levelBuffers[i])
+            clReleaseMemObject(levelBuffers[i]);
+    levelBuffers.clear();
+    levelCapacities.clear();
+    if(positions)
+        clReleaseMemObject(positions);
+    if(countBuffer)
+        clReleaseMemObject(countBuffer);
+    positions= NULL;
+    positionsCapacity= 0;
+    countBuffer= NULL;
+}
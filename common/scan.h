@@ -0,0 +1,109 @@
+/*
+ * scan.h
+ *
+ * Prefix scan (suma acumulada exclusiva o inclusiva) de arreglos de int y
+ * compactacion de arreglos (stream compaction)
+ *
+ * El scan usa el algoritmo de Blelloch por bloques de 2 * tamanio de
+ * work-group elementos en memoria local (ver scan.cl). Para n arbitrario se
+ * escanean las sumas de los bloques con el mismo algoritmo, en tantos niveles
+ * como haga falta, y luego se suma a cada bloque su desplazamiento.
+ *
+ * La compactacion escribe en forma contigua y en el orden original los
+ * elementos que cumplen un predicado y/o sus indices, y la cantidad de
+ * elementos que lo cumplen. El predicado se evalua dentro del scan (sin un
+ * arreglo intermedio de flags) y el desplazamiento de cada bloque se suma al
+ * escribir, asi que data se lee dos veces y solo se escriben las posiciones
+ * locales y la salida.
+ *
+ * Los buffers intermedios se reservan en la primera llamada y se reutilizan
+ * mientras alcancen. Cada combinacion de tipo y predicado es un programa
+ * compilado con distintas opciones; se compila la primera vez que se usa.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <CL/cl.h>
+
+#include <string>
+#include <vector>
+
+enum CompactPredicate {
+    COMPACT_EQUAL,    // Elementos == value
+    COMPACT_LESS,     // Elementos < value
+    COMPACT_GREATER,  // Elementos > value
+    COMPACT_PREDICATE_COUNT
+};
+
+enum CompactType {
+    COMPACT_INT,
+    COMPACT_FLOAT,
+    COMPACT_TYPE_COUNT
+};
+
+class Scan
+{
+public:
+    Scan();
+    ~Scan() { release(); }
+
+    // Los programas de path se compilan al usarse
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, const char* path= "../../common/scan.cl");
+
+    // Encola out[i] = in[0] + ... + in[i-1] (exclusivo) o in[0] + ... + in[i]
+    // (inclusivo) para los n ints de in. in y out pueden ser el mismo buffer.
+    // Si event no es NULL devuelve el evento del ultimo kernel.
+    // Devuelve false en caso de error
+    bool enqueueScan(cl_command_queue queue, cl_mem in, cl_mem out, int n, bool inclusive,
+                     cl_event* event= 0);
+
+    // Encola la compactacion de los n elementos de tipo type de data que cumplen
+    // el predicado pred con value (un cl_int o cl_float segun type): sus valores
+    // se escriben en outValues y sus indices en outIndices (cualquiera puede ser
+    // NULL; deben tener lugar para n elementos en el peor caso), y la cantidad en
+    // el primer cl_int de count (0 si n es 0).
+    // Si event no es NULL devuelve el evento del ultimo kernel.
+    // Devuelve false en caso de error
+    bool enqueueCompact(cl_command_queue queue, CompactType type, CompactPredicate pred, cl_mem data, int n,
+                        const void* value, cl_mem outValues, cl_mem outIndices, cl_mem count, cl_event* event= 0);
+
+    // Igual que enqueueCompact, pero espera a que termine y devuelve la cantidad en count
+    bool compact(cl_command_queue queue, CompactType type, CompactPredicate pred, cl_mem data, int n,
+                 const void* value, cl_mem outValues, cl_mem outIndices, int& count, cl_event* event= 0);
+
+    // Elementos que procesa cada work-group (2 * tamanio de work-group)
+    int getBlockSize() const { return 2 * localSize; }
+
+    // Libera los programas, kernels y buffers
+    void release();
+
+private:
+    // Compila el programa de type y pred si todavia no se compilo
+    bool build(CompactType type, CompactPredicate pred);
+    // Agranda buffer (de capacity ints) si tiene menos de count ints
+    bool reserve(cl_mem& buffer, size_t& capacity, size_t count);
+    // Scan de n ints de in en out usando los buffers de sumas de bloques desde level
+    bool scanLevel(cl_command_queue queue, cl_mem in, cl_mem out, int n, bool inclusive, size_t level, cl_event* event);
+
+    cl_context context;
+    cl_device_id device;
+    std::string path;
+
+    cl_program programs[COMPACT_TYPE_COUNT][COMPACT_PREDICATE_COUNT];
+    cl_kernel scanBlocksKernel;
+    cl_kernel addOffsetsKernel;
+    cl_kernel scanPredicateKernels[COMPACT_TYPE_COUNT][COMPACT_PREDICATE_COUNT];
+    cl_kernel scatterKernels[COMPACT_TYPE_COUNT][COMPACT_PREDICATE_COUNT];
+    size_t localSize;
+
+    // Sumas de bloques de cada nivel, posiciones locales de la compactacion y cantidad
+    std::vector<cl_mem> levelBuffers;
+    std::vector<size_t> levelCapacities;
+    cl_mem positions;
+    size_t positionsCapacity;
+    cl_mem countBuffer;
+};
+
+#endif // SCAN_H
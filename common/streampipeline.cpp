@@ -0,0 +1,105 @@
+#include "streampipeline.h"
+#include "clutils.h"
+#include "clprofiler.h"
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+StreamPipeline::StreamPipeline()
+{
+    elapsed= 0;
+}
+
+bool StreamPipeline::init(cl_context context, cl_device_id device, int depth, size_t inputBytes, size_t outputBytes)
+{
+    release();
+
+    cl_int error;
+    for(int s=0; s<depth; s++) {
+        cl_command_queue queue= clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &error);
+        if(checkError(error, "StreamPipeline::init: clCreateCommandQueue"))
+            return false;
+        queues.push_back(queue);
+
+        ostringstream name;
+        name << "Slot " << s;
+        CLProfiler::instance().setQueueName(queue, name.str().c_str());
+
+        cl_mem input= clCreateBuffer(context, CL_MEM_READ_ONLY, inputBytes, NULL, &error);
+        if(checkError(error, "StreamPipeline::init: clCreateBuffer"))
+            return false;
+        inputs.push_back(input);
+
+        cl_mem output= clCreateBuffer(context, CL_MEM_WRITE_ONLY, outputBytes, NULL, &error);
+        if(checkError(error, "StreamPipeline::init: clCreateBuffer"))
+            return false;
+        outputs.push_back(output);
+    }
+
+    return true;
+}
+
+bool StreamPipeline::run(StreamJob& job)
+{
+    const int depth= queues.size();
+    const int chunks= job.chunkCount();
+
+    const double startTime= hostTimeMs();
+    for(int c=0; c<chunks; c++) {
+        const int s= c % depth;
+        if(!job.enqueueUpload(c, queues[s], inputs[s]) or
+           !job.enqueueCompute(c, queues[s], inputs[s], outputs[s]) or
+           !job.enqueueDownload(c, queues[s], outputs[s]))
+            return false;
+
+        // Enviar los comandos al dispositivo para que el slot empiece a trabajar
+        // mientras se encolan los siguientes chunks
+        cl_int error= clFlush(queues[s]);
+        if(checkError(error, "StreamPipeline::run: clFlush"))
+            return false;
+    }
+
+    for(int s=0; s<depth; s++) {
+        cl_int error= clFinish(queues[s]);
+        if(checkError(error, "StreamPipeline::run: clFinish"))
+            return false;
+    }
+    elapsed= hostTimeMs() - startTime;
+
+    return true;
+}
+
+void StreamPipeline::release()
+{
+    for(size_t s=0; s<queues.size(); s++)
+        clReleaseCommandQueue(queues[s]);
+    for(size_t s=0; s<inputs.size(); s++)
+        clReleaseMemObject(inputs[s]);
+    for(size_t s=0; s<outputs.size(); s++)
+        clReleaseMemObject(outputs[s]);
+    queues.clear();
+    inputs.clear();
+    outputs.clear();
+}
+
+bool runStreamPipeline(const char* label, cl_context context, cl_device_id device, StreamJob& job,
+                       int depth, size_t chunkBytes, size_t totalBytes)
+{
+    StreamPipeline pipeline;
+    if(!pipeline.init(context, device, depth, chunkBytes, chunkBytes))
+        return false;
+    // El calentamiento no se registra en el profiler
+    CLProfiler& profiler= CLProfiler::instance();
+    const bool profiling= profiler.isEnabled();
+    profiler.setEnabled(false);
+    const bool warmedUp= pipeline.run(job);
+    profiler.setEnabled(profiling);
+    if(!warmedUp or !pipeline.run(job))
+        return false;
+
+    const double gbs= 2.0 * totalBytes / (pipeline.elapsedMs() * 1.0e6);
+    cerr << label << ":\t" << pipeline.elapsedMs() << " ms, " << gbs << " GB/s de punta a punta." << endl;
+    return true;
+}
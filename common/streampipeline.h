@@ -0,0 +1,81 @@
+/*
+ * streampipeline.h
+ *
+ * Procesamiento por chunks con subida, computo y bajada solapados
+ *
+ * Los datos se dividen en chunks que se procesan en "slots". Cada slot tiene
+ * su propia command queue en orden y su propio par de buffers de entrada y
+ * salida, del tamanio de un chunk. El chunk c usa el slot c % depth, asi que
+ * mientras un slot sube su chunk otro puede estar ejecutando el kernel y otro
+ * bajando resultados (double/triple buffering). El orden de cada cola garantiza
+ * que un slot no se reutiliza hasta terminar de bajar su chunk anterior.
+ *
+ * Como solo se reservan depth chunks en el dispositivo, se pueden procesar
+ * datos mas grandes que la memoria del dispositivo.
+ */
+
+#ifndef STREAMPIPELINE_H
+#define STREAMPIPELINE_H
+
+#include <CL/cl.h>
+
+#include <vector>
+
+// Trabajo a procesar con un StreamPipeline. Cada metodo solo debe encolar
+// operaciones no bloqueantes en queue.
+class StreamJob
+{
+public:
+    virtual ~StreamJob() {}
+
+    // Cantidad total de chunks
+    virtual int chunkCount()= 0;
+
+    // Encola la subida del chunk desde el host al buffer input
+    virtual bool enqueueUpload(int chunk, cl_command_queue queue, cl_mem input)= 0;
+    // Encola el computo del chunk, leyendo de input y escribiendo en output
+    virtual bool enqueueCompute(int chunk, cl_command_queue queue, cl_mem input, cl_mem output)= 0;
+    // Encola la bajada del chunk desde el buffer output al host
+    virtual bool enqueueDownload(int chunk, cl_command_queue queue, cl_mem output)= 0;
+};
+
+class StreamPipeline
+{
+public:
+    StreamPipeline();
+    ~StreamPipeline() { release(); }
+
+    // Crea depth slots, cada uno con una command queue y un buffer de entrada de
+    // inputBytes y uno de salida de outputBytes
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, int depth, size_t inputBytes, size_t outputBytes);
+
+    // Procesa todos los chunks de job y espera a que terminen
+    // Devuelve false en caso de error
+    bool run(StreamJob& job);
+
+    // Tiempo en ms de la ultima llamada a run
+    double elapsedMs() const { return elapsed; }
+
+    int getDepth() const { return queues.size(); }
+
+    // Libera las colas y buffers
+    void release();
+
+private:
+    std::vector<cl_command_queue> queues;
+    std::vector<cl_mem> inputs;
+    std::vector<cl_mem> outputs;
+
+    double elapsed;
+};
+
+// Ejecuta job con un pipeline de depth slots de chunkBytes y muestra el ancho de banda
+// de punta a punta (subida + bajada) de totalBytes, precedido por label. Se hace una
+// primera pasada de calentamiento; el perfil de comandos solo incluye la pasada medida.
+// No llama a CLProfiler::finish, para que el llamador muestre todas las pasadas juntas.
+// Devuelve false en caso de error
+bool runStreamPipeline(const char* label, cl_context context, cl_device_id device, StreamJob& job,
+                       int depth, size_t chunkBytes, size_t totalBytes);
+
+#endif // STREAMPIPELINE_H
@@ -0,0 +1,125 @@
+// Transpuesta de matrices por tiles en memoria local
+//
+// Se compila con -D TILE_DIM=<lado del tile> -D BLOCK_ROWS=<filas del work-group>
+// (ver transpose.h). Cada work-group es de TILE_DIM x BLOCK_ROWS work-items y
+// procesa un tile de TILE_DIM x TILE_DIM elementos, asi que cada work-item copia
+// TILE_DIM / BLOCK_ROWS elementos.
+//
+// El tile en memoria local tiene una columna de relleno (TILE_DIM + 1): al leer
+// una columna del tile, work-items consecutivos acceden a direcciones separadas
+// por TILE_DIM + 1 palabras, que caen en bancos distintos de la memoria local.
+//
+// Ningun work-item sale antes de la barrera: los accesos fuera de la matriz
+// (tiles del borde) se saltean con condiciones, pero todos llegan a barrier().
+
+#ifndef TILE_DIM
+#define TILE_DIM 32
+#endif
+#ifndef BLOCK_ROWS
+#define BLOCK_ROWS 8
+#endif
+
+// Transpone el tile (groupY, groupX) de A, de rows * cols, a B, de cols * rows
+void transposeTile(
+    __global const float* A,
+    __global float* B,
+    int rows,
+    int cols,
+    int groupX,
+    int groupY,
+    __local float tile[TILE_DIM][TILE_DIM + 1])
+{
+    const int tx= get_local_id(0);
+    const int ty= get_local_id(1);
+
+    // (1) Leer el tile de A (lectura coalesciente por filas de A)
+    const int x= groupX * TILE_DIM + tx; // Columna de A
+    const int y= groupY * TILE_DIM + ty; // Fila de A
+    for(int k=0; k<TILE_DIM; k+=BLOCK_ROWS)
+        if(x < cols && y + k < rows)
+            tile[ty + k][tx]= A[(y + k) * cols + x];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // (2) Escribir el tile transpuesto en B (escritura coalesciente por filas de B)
+    const int bx= groupY * TILE_DIM + tx; // Columna de B (fila de A)
+    const int by= groupX * TILE_DIM + ty; // Fila de B (columna de A)
+    for(int k=0; k<TILE_DIM; k+=BLOCK_ROWS)
+        if(bx < rows && by + k < cols)
+            B[(by + k) * rows + bx]= tile[tx][ty + k];
+}
+
+// B = transpose(A), con A de rows * cols y B de cols * rows
+__kernel __attribute__(( reqd_work_group_size(TILE_DIM, BLOCK_ROWS, 1) ))
+void transposeTiled(
+    __global const float* A,
+    __global float* B,
+    int rows,
+    int cols)
+{
+    __local float tile[TILE_DIM][TILE_DIM + 1];
+    transposeTile(A, B, rows, cols, get_group_id(0), get_group_id(1), tile);
+}
+
+// B[m] = transpose(A[m]) para un lote de matrices de rows * cols
+// La dimension 2 del NDRange es el indice de la matriz. La matriz m empieza en
+// A + m * strideA y su transpuesta en B + m * strideB (strides en elementos).
+__kernel __attribute__(( reqd_work_group_size(TILE_DIM, BLOCK_ROWS, 1) ))
+void transposeBatched(
+    __global const float* A,
+    __global float* B,
+    int rows,
+    int cols,
+    int strideA,
+    int strideB)
+{
+    __local float tile[TILE_DIM][TILE_DIM + 1];
+    const size_t m= get_global_id(2);
+    transposeTile(A + m * strideA, B + m * strideB, rows, cols, get_group_id(0), get_group_id(1), tile);
+}
+
+// A = transpose(A), con A de n * n
+// Se lanza un work-group por tile. El work-group del tile (gy, gx), con gx > gy,
+// intercambia su tile con el simetrico (gx, gy); los de la diagonal transponen su
+// propio tile y los de debajo de la diagonal no hacen nada.
+__kernel __attribute__(( reqd_work_group_size(TILE_DIM, BLOCK_ROWS, 1) ))
+void transposeInPlace(
+    __global float* A,
+    int n)
+{
+    __local float tileA[TILE_DIM][TILE_DIM + 1];
+    __local float tileB[TILE_DIM][TILE_DIM + 1];
+
+    const int gx= get_group_id(0);
+    const int gy= get_group_id(1);
+    // Sale el work-group completo, asi que ningun work-item queda esperando en la barrera
+    if(gx < gy)
+        return;
+    const bool diagonal= gx == gy;
+
+    const int tx= get_local_id(0);
+    const int ty= get_local_id(1);
+
+    // Tile A: filas gy, columnas gx. Tile B (el simetrico): filas gx, columnas gy.
+    const int ax= gx * TILE_DIM + tx;
+    const int ay= gy * TILE_DIM + ty;
+    const int bx= gy * TILE_DIM + tx;
+    const int by= gx * TILE_DIM + ty;
+
+    for(int k=0; k<TILE_DIM; k+=BLOCK_ROWS) {
+        if(ax < n && ay + k < n)
+            tileA[ty + k][tx]= A[(ay + k) * n + ax];
+        if(!diagonal && bx < n && by + k < n)
+            tileB[ty + k][tx]= A[(by + k) * n + bx];
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // En la posicion del tile A va la transpuesta del tile B y viceversa
+    for(int k=0; k<TILE_DIM; k+=BLOCK_ROWS) {
+        if(ax < n && ay + k < n)
+            A[(ay + k) * n + ax]= diagonal ? tileA[tx][ty + k] : tileB[tx][ty + k];
+        if(!diagonal && bx < n && by + k < n)
+            A[(by + k) * n + bx]= tileA[tx][ty + k];
+    }
+}
@@ -0,0 +1,180 @@
+#include "transpose.h"
+#include "clutils.h"
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+TransposeEngine::TransposeEngine()
+{
+    program= NULL;
+    transposeKernel= NULL;
+    batchedKernel= NULL;
+    inPlaceKernel= NULL;
+    tileDim= 0;
+    blockRows= 0;
+}
+
+bool TransposeEngine::init(cl_context context, cl_device_id device, int tileDim, int blockRows, const char* path)
+{
+    release();
+
+    if(tileDim <= 0 or blockRows <= 0 or tileDim % blockRows) {
+        cerr << "TransposeEngine::init: blockRows (" << blockRows << ") debe dividir a tileDim ("
+             << tileDim << ")." << endl;
+        return false;
+    }
+
+    size_t deviceMax;
+    size_t maxItems[3];
+    cl_int error;
+    error  = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &deviceMax, NULL);
+    error |= clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, 3 * sizeof(size_t), maxItems, NULL);
+    if(checkError(error, "TransposeEngine::init: clGetDeviceInfo"))
+        return false;
+    if((size_t)tileDim > maxItems[0]) {
+        cerr << "TransposeEngine::init: tileDim " << tileDim << " mayor que el maximo del dispositivo ("
+             << maxItems[0] << ")." << endl;
+        return false;
+    }
+
+    // Reducir el work-group hasta que entre en el dispositivo y en los limites
+    // del kernel compilado (que pueden ser menores por uso de registros)
+    for(;;) {
+        this->tileDim= tileDim;
+        this->blockRows= blockRows;
+
+        const size_t groupSize= tileDim * blockRows;
+        if(groupSize <= deviceMax and (size_t)blockRows <= maxItems[1]) {
+            if(!build(context, device, path))
+                return false;
+
+            size_t kernelMax[3];
+            error  = clGetKernelWorkGroupInfo(transposeKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelMax[0], NULL);
+            error |= clGetKernelWorkGroupInfo(batchedKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelMax[1], NULL);
+            error |= clGetKernelWorkGroupInfo(inPlaceKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelMax[2], NULL);
+            if(checkError(error, "TransposeEngine::init: clGetKernelWorkGroupInfo"))
+                return false;
+            if(groupSize <= kernelMax[0] and groupSize <= kernelMax[1] and groupSize <= kernelMax[2])
+                return true;
+            release();
+        }
+
+        if(blockRows == 1 or tileDim % (blockRows / 2)) {
+            cerr << "TransposeEngine::init: el dispositivo no admite work-groups de " << tileDim
+                 << " work-items." << endl;
+            return false;
+        }
+        blockRows/= 2;
+    }
+}
+
+bool TransposeEngine::build(cl_context context, cl_device_id device, const char* path)
+{
+    ostringstream options;
+    options << "-D TILE_DIM=" << tileDim << " -D BLOCK_ROWS=" << blockRows;
+    if(!loadProgram(context, &program, device, path, options.str().c_str())) {
+        program= NULL;
+        return false;
+    }
+
+    cl_int error;
+    transposeKernel= clCreateKernel(program, "transposeTiled", &error);
+    if(checkError(error, "TransposeEngine::init: clCreateKernel"))
+        return false;
+    batchedKernel= clCreateKernel(program, "transposeBatched", &error);
+    if(checkError(error, "TransposeEngine::init: clCreateKernel"))
+        return false;
+    inPlaceKernel= clCreateKernel(program, "transposeInPlace", &error);
+    if(checkError(error, "TransposeEngine::init: clCreateKernel"))
+        return false;
+
+    return true;
+}
+
+bool TransposeEngine::enqueueTranspose(cl_command_queue queue, cl_mem A, cl_mem B, int rows, int cols, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(transposeKernel, 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(transposeKernel, 1, sizeof(cl_mem), &B);
+    error |= clSetKernelArg(transposeKernel, 2, sizeof(int), &rows);
+    error |= clSetKernelArg(transposeKernel, 3, sizeof(int), &cols);
+    if(checkError(error, "TransposeEngine::enqueueTranspose: clSetKernelArg"))
+        return false;
+
+    // Un work-group por tile: tileDim work-items en x, blockRows en y
+    const size_t localSize[2]= { (size_t)tileDim, (size_t)blockRows };
+    const size_t ndRangeSize[2]= { (size_t)roundUp(cols, tileDim),
+                                   (size_t)(roundUp(rows, tileDim) / tileDim * blockRows) };
+    error= clEnqueueNDRangeKernel(queue, transposeKernel, 2, NULL, ndRangeSize, localSize, 0, NULL, event);
+    if(checkError(error, "TransposeEngine::enqueueTranspose: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+bool TransposeEngine::enqueueTransposeBatched(cl_command_queue queue, cl_mem A, cl_mem B, int rows, int cols, int batch,
+                                              int strideA, int strideB, cl_event* event)
+{
+    if(!strideA)
+        strideA= rows * cols;
+    if(!strideB)
+        strideB= rows * cols;
+
+    cl_int error;
+    error  = clSetKernelArg(batchedKernel, 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(batchedKernel, 1, sizeof(cl_mem), &B);
+    error |= clSetKernelArg(batchedKernel, 2, sizeof(int), &rows);
+    error |= clSetKernelArg(batchedKernel, 3, sizeof(int), &cols);
+    error |= clSetKernelArg(batchedKernel, 4, sizeof(int), &strideA);
+    error |= clSetKernelArg(batchedKernel, 5, sizeof(int), &strideB);
+    if(checkError(error, "TransposeEngine::enqueueTransposeBatched: clSetKernelArg"))
+        return false;
+
+    // Los tiles de todas las matrices en un solo NDRange: la dimension 2 es la matriz
+    const size_t localSize[3]= { (size_t)tileDim, (size_t)blockRows, 1 };
+    const size_t ndRangeSize[3]= { (size_t)roundUp(cols, tileDim),
+                                   (size_t)(roundUp(rows, tileDim) / tileDim * blockRows),
+                                   (size_t)batch };
+    error= clEnqueueNDRangeKernel(queue, batchedKernel, 3, NULL, ndRangeSize, localSize, 0, NULL, event);
+    if(checkError(error, "TransposeEngine::enqueueTransposeBatched: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+bool TransposeEngine::enqueueTransposeInPlace(cl_command_queue queue, cl_mem A, int n, cl_event* event)
+{
+    cl_int error;
+    error  = clSetKernelArg(inPlaceKernel, 0, sizeof(cl_mem), &A);
+    error |= clSetKernelArg(inPlaceKernel, 1, sizeof(int), &n);
+    if(checkError(error, "TransposeEngine::enqueueTransposeInPlace: clSetKernelArg"))
+        return false;
+
+    // Se lanzan todos los tiles; los de debajo de la diagonal terminan enseguida
+    const size_t localSize[2]= { (size_t)tileDim, (size_t)blockRows };
+    const size_t ndRangeSize[2]= { (size_t)roundUp(n, tileDim),
+                                   (size_t)(roundUp(n, tileDim) / tileDim * blockRows) };
+    error= clEnqueueNDRangeKernel(queue, inPlaceKernel, 2, NULL, ndRangeSize, localSize, 0, NULL, event);
+    if(checkError(error, "TransposeEngine::enqueueTransposeInPlace: clEnqueueNDRangeKernel"))
+        return false;
+
+    return true;
+}
+
+void TransposeEngine::release()
+{
+    if(transposeKernel)
+        clReleaseKernel(transposeKernel);
+    if(batchedKernel)
+        clReleaseKernel(batchedKernel);
+    if(inPlaceKernel)
+        clReleaseKernel(inPlaceKernel);
+    if(program)
+        clReleaseProgram(program);
+    program= NULL;
+    transposeKernel= NULL;
+    batchedKernel= NULL;
+    inPlaceKernel= NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ * transpose.h
+ *
+ * Transpuesta de matrices de floats por tiles en memoria local
+ *
+ * Cada work-group copia un tile de tileDim x tileDim elementos a memoria local
+ * leyendo filas de la matriz original y lo escribe transpuesto, tambien por
+ * filas, de forma que tanto las lecturas como las escrituras en memoria global
+ * son coalescientes. Los tiles locales tienen una columna de relleno para
+ * evitar conflictos de bancos al leerlos por columnas (ver transpose.cl).
+ *
+ * El work-group es de tileDim x blockRows work-items, asi que cada work-item
+ * copia tileDim / blockRows elementos. Las matrices pueden ser rectangulares y
+ * de cualquier tamanio: los tiles del borde se recortan dentro del kernel.
+ *
+ * Para muchas matrices chicas (de 32x32 a 256x256, por ejemplo) el costo de
+ * lanzar un kernel por matriz domina el tiempo; enqueueTransposeBatched
+ * transpone un lote de matrices guardadas en un mismo buffer con un solo
+ * NDRange de tres dimensiones (la tercera es el indice de la matriz).
+ */
+
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <CL/cl.h>
+
+class TransposeEngine
+{
+public:
+    TransposeEngine();
+    ~TransposeEngine() { release(); }
+
+    // Compila los kernels de path para tiles de tileDim x tileDim y work-groups
+    // de tileDim x blockRows. blockRows debe dividir a tileDim; si el dispositivo
+    // no admite work-groups de ese tamanio se reduce blockRows a la mitad.
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, int tileDim= 32, int blockRows= 8,
+              const char* path= "../../common/transpose.cl");
+
+    // Encola B = transpose(A), con A de rows * cols y B de cols * rows
+    // Si event no es NULL devuelve el evento del kernel
+    // Devuelve false en caso de error
+    bool enqueueTranspose(cl_command_queue queue, cl_mem A, cl_mem B, int rows, int cols,
+                          cl_event* event= 0);
+
+    // Encola B[m] = transpose(A[m]) para batch matrices de rows * cols en una sola
+    // ejecucion del kernel. La matriz m empieza en el elemento m * strideA de A y su
+    // transpuesta en el elemento m * strideB de B; con stride 0 las matrices estan
+    // contiguas (stride rows * cols).
+    // Si event no es NULL devuelve el evento del kernel
+    // Devuelve false en caso de error
+    bool enqueueTransposeBatched(cl_command_queue queue, cl_mem A, cl_mem B, int rows, int cols, int batch,
+                                 int strideA= 0, int strideB= 0, cl_event* event= 0);
+
+    // Encola A = transpose(A) sin buffer auxiliar, con A de n * n
+    // Si event no es NULL devuelve el evento del kernel
+    // Devuelve false en caso de error
+    bool enqueueTransposeInPlace(cl_command_queue queue, cl_mem A, int n, cl_event* event= 0);
+
+    int getTileDim() const { return tileDim; }
+    int getBlockRows() const { return blockRows; }
+
+    // Libera el programa y los kernels
+    void release();
+
+private:
+    bool build(cl_context context, cl_device_id device, const char* path);
+
+    cl_program program;
+    cl_kernel transposeKernel;
+    cl_kernel batchedKernel;
+    cl_kernel inPlaceKernel;
+
+    int tileDim;
+    int blockRows;
+};
+
+#endif // TRANSPOSE_H
@@ -14,10 +14,21 @@ QMAKE_CXXFLAGS_RELEASE = -march=native -O3 -fPIC
 
 SOURCES += \
 	src/main.cpp \
-	../common/clutils.cpp
+	../common/clutils.cpp \
+	../common/programcache.cpp \
+	../common/clprofiler.cpp \
+	../common/autotuner.cpp \
+	../common/streampipeline.cpp \
+	../common/elementwise.cpp
 
 HEADERS += \
-	../common/clutils.h
+	../common/clutils.h \
+	../common/programcache.h \
+	../common/clprofiler.h \
+	../common/autotuner.h \
+	../common/streampipeline.h \
+	../common/elementwise.h
 
 OTHER_FILES += \
-	src/matrixscalar.cl
+	src/matrixscalar.cl \
+	../common/elementwise.cl
@@ -4,14 +4,354 @@
 #include <CL/cl.h>
 // Utilidades propias para OpenCL
 #include "clutils.h"
+#include "clprofiler.h"
+#include "autotuner.h"
+#include "programcache.h"
+#include "streampipeline.h"
+#include "elementwise.h"
+
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
 
 using namespace std;
 
+// Llena la matriz A de n * n con datos aleatorios entre 0 y 1, y devuelve un valor
+// aleatorio entre 0 y 100 para k
+static float initData(float* hA, int n)
+{
+    srand(42);
+    for(int i=0; i<n; i++)
+        for(int j=0; j<n; j++)
+            hA[(size_t)i * n + j]= (float)rand()/RAND_MAX;
+    return (float)rand()/RAND_MAX * 100;
+}
+
+// Devuelve la cantidad de elementos de B distintos de k * A
+static size_t countErrors(const float* hA, const float* hB, float k, int n)
+{
+    size_t errorCount= 0;
+    for(size_t index=0; index<(size_t)n * n; index++) {
+        // Comparamos bit-a-bit porque ambos procesadores deberian implementar el estandar
+        // de floating point IEEE 754-2008
+        if(hB[index] != k * hA[index])
+            errorCount++;
+    }
+    return errorCount;
+}
+
+// Calcula B = k * A repartiendo la matriz en bandas de filas entre varios dispositivos
+// (o sub-dispositivos, ver setupOpenCLMulti). Cada dispositivo tiene su propia command
+// queue y sus propios buffers con solo su banda, de forma que la matriz completa no
+// necesita entrar en la memoria de un unico dispositivo.
+static bool runMultiDevice(int n, int subDevices)
+{
+    cl_context clContext;
+    vector<cl_command_queue> queues;
+    vector<cl_device_id> devices;
+    if(!setupOpenCLMulti(clContext, queues, devices, subDevices))
+        return false;
+    const int deviceCount= devices.size();
+
+    // El programa se compila para todos los dispositivos del contexto
+    cl_kernel kernel;
+    if(!loadKernel(clContext, &kernel, devices[0], "../src/matrixscalar.cl", "matrixScalarBand"))
+        return false;
+    printProgramCacheStats();
+
+    // Repartir las filas en proporcion al puntaje de cada dispositivo
+    vector<CLDeviceInfo> infos(deviceCount);
+    double totalScore= 0;
+    for(int d=0; d<deviceCount; d++) {
+        if(!getDeviceInfo(devices[d], infos[d]))
+            return false;
+        totalScore+= infos[d].score;
+    }
+    vector<int> firstRow(deviceCount + 1);
+    double accumScore= 0;
+    for(int d=0; d<deviceCount; d++) {
+        firstRow[d]= (int)(n * accumScore / totalScore);
+        accumScore+= infos[d].score;
+    }
+    firstRow[deviceCount]= n;
+
+    const size_t rowBytes= (size_t)n * sizeof(float);
+    float* hA= (float*)malloc(rowBytes * n);
+    float* hB= (float*)malloc(rowBytes * n);
+    if(!hA or !hB) {
+        cerr << "Error al reservar memoria." << endl;
+        return false;
+    }
+    const float k= initData(hA, n);
+
+    // Los comandos de cada dispositivo se registran con su indice para separarlos en el perfil
+    CLProfiler& profiler= CLProfiler::instance();
+    vector<string> writeNames(deviceCount), kernelNames(deviceCount), readNames(deviceCount);
+    for(int d=0; d<deviceCount; d++) {
+        ostringstream suffix;
+        suffix << " [" << d << "]";
+        writeNames[d]= "subida" + suffix.str();
+        kernelNames[d]= "matrixScalarBand" + suffix.str();
+        readNames[d]= "bajada" + suffix.str();
+        profiler.setQueueName(queues[d], ("Dispositivo" + suffix.str() + " " + infos[d].name).c_str());
+    }
+
+    // Reservar los buffers de cada banda y elegir el tamanio de work-group de cada
+    // dispositivo antes de medir (el autotuner ejecuta el kernel varias veces)
+    vector<cl_mem> dA(deviceCount, (cl_mem)NULL), dB(deviceCount, (cl_mem)NULL);
+    vector<size_t> workGroupSizes(2 * deviceCount), ndRangeSizes(2 * deviceCount);
+    for(int d=0; d<deviceCount; d++) {
+        const int rows= firstRow[d+1] - firstRow[d];
+        const size_t bandBytes= rows * rowBytes;
+        // Con matrices muy chicas un dispositivo puede quedar sin filas
+        if(!rows)
+            continue;
+
+        cl_int error1, error2;
+        dA[d]= clCreateBuffer(clContext, CL_MEM_READ_ONLY, bandBytes, NULL, &error1);
+        dB[d]= clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, bandBytes, NULL, &error2);
+        if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+            return false;
+
+        cl_int error;
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA[d]);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dB[d]);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_float), (void*)&k);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&rows);
+        error |= clSetKernelArg(kernel, 4, sizeof(cl_int), (void*)&n);
+        const size_t problemSize[2] = { (size_t)n, (size_t)rows };
+        if(checkError(error, "clSetKernelArg") or
+           !tuneNDRange(queues[d], kernel, 2, problemSize, &workGroupSizes[2 * d], &ndRangeSizes[2 * d]))
+            return false;
+    }
+
+    const double startTime= hostTimeMs();
+    for(int d=0; d<deviceCount; d++) {
+        const int rows= firstRow[d+1] - firstRow[d];
+        const size_t bandBytes= rows * rowBytes;
+        const size_t offset= firstRow[d] * (size_t)n;
+        if(!rows)
+            continue;
+
+        // Todas las operaciones son asincronicas: cada dispositivo avanza en paralelo
+        cl_int error;
+        error  = clEnqueueWriteBuffer(queues[d], dA[d], CL_FALSE, 0, bandBytes, hA + offset, 0, NULL, ProfiledEvent(writeNames[d].c_str()));
+        // Los argumentos se copian al encolar, asi que el mismo kernel sirve para todas las colas
+        error |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA[d]);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dB[d]);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_float), (void*)&k);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&rows);
+        error |= clSetKernelArg(kernel, 4, sizeof(cl_int), (void*)&n);
+        error |= clEnqueueNDRangeKernel(queues[d], kernel, 2, NULL, &ndRangeSizes[2 * d], &workGroupSizes[2 * d], 0, NULL,
+                                         ProfiledEvent(kernelNames[d].c_str()));
+        error |= clEnqueueReadBuffer(queues[d], dB[d], CL_FALSE, 0, bandBytes, hB + offset, 0, NULL, ProfiledEvent(readNames[d].c_str()));
+        error |= clFlush(queues[d]);
+        if(checkError(error, "runMultiDevice: encolar banda"))
+            return false;
+    }
+    for(int d=0; d<deviceCount; d++)
+        clFinish(queues[d]);
+    const double elapsed= hostTimeMs() - startTime;
+
+    cerr << "Tamanio matriz:\t\t\t\t(" << n << ", " << n << "), ~" << rowBytes * n / 1024 / 1024 << " MiB." << endl;
+    cerr << fixed << setprecision(2);
+    for(int d=0; d<deviceCount; d++)
+        cerr << "Dispositivo " << d << " (" << infos[d].name << "): filas " << firstRow[d] << "-" << firstRow[d+1]-1
+             << ", work-group (" << workGroupSizes[2 * d] << ", " << workGroupSizes[2 * d + 1] << ")." << endl;
+    cerr << "Tiempo total (" << deviceCount << " dispositivos):\t" << elapsed << " ms." << endl;
+    profiler.finish();
+
+    cerr << "Verificando salida." << endl;
+    const size_t errorCount= countErrors(hA, hB, k, n);
+    if(!errorCount)
+        cerr << "Salida OK :D" << endl;
+    else
+        cerr << errorCount << " elementos erroneos." << endl;
+
+    free(hA);
+    free(hB);
+    for(int d=0; d<deviceCount; d++) {
+        if(dA[d]) {
+            clReleaseMemObject(dA[d]);
+            clReleaseMemObject(dB[d]);
+        }
+        clReleaseCommandQueue(queues[d]);
+        clReleaseDevice(devices[d]);
+    }
+    clReleaseKernel(kernel);
+    clReleaseContext(clContext);
+
+    return !errorCount;
+}
+
+// Calcula B = k * A por bandas de chunkRows filas, cada banda es un chunk de un StreamPipeline
+class MatrixScalarJob : public StreamJob
+{
+public:
+    MatrixScalarJob(cl_kernel kernel, const float* hA, float* hB, float k, int n, int chunkRows) :
+        kernel(kernel), hA(hA), hB(hB), k(k), n(n), chunkRows(chunkRows) {}
+
+    int chunkCount() { return (n + chunkRows - 1) / chunkRows; }
+
+    bool enqueueUpload(int chunk, cl_command_queue queue, cl_mem input)
+    {
+        cl_int error= clEnqueueWriteBuffer(queue, input, CL_FALSE, 0, rows(chunk) * n * sizeof(float),
+                                           hA + offset(chunk), 0, NULL, ProfiledEvent("subida chunk"));
+        return !checkError(error, "MatrixScalarJob: clEnqueueWriteBuffer");
+    }
+
+    bool enqueueCompute(int chunk, cl_command_queue queue, cl_mem input, cl_mem output)
+    {
+        const int bandRows= rows(chunk);
+
+        cl_int error;
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&input);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&output);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_float), (void*)&k);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&bandRows);
+        error |= clSetKernelArg(kernel, 4, sizeof(cl_int), (void*)&n);
+        // El kernel no modifica input, asi que el autotuner puede ejecutarlo sobre el chunk
+        size_t problemSize[2] = { (size_t)n, (size_t)bandRows };
+        size_t workGroupSize[2], ndRangeSize[2];
+        if(!tuneNDRange(queue, kernel, 2, problemSize, workGroupSize, ndRangeSize))
+            return false;
+        error |= clEnqueueNDRangeKernel(queue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL,
+                                         ProfiledEvent("matrixScalarBand"));
+        return !checkError(error, "MatrixScalarJob: clEnqueueNDRangeKernel");
+    }
+
+    bool enqueueDownload(int chunk, cl_command_queue queue, cl_mem output)
+    {
+        cl_int error= clEnqueueReadBuffer(queue, output, CL_FALSE, 0, rows(chunk) * n * sizeof(float),
+                                          hB + offset(chunk), 0, NULL, ProfiledEvent("bajada chunk"));
+        return !checkError(error, "MatrixScalarJob: clEnqueueReadBuffer");
+    }
+
+private:
+    int rows(int chunk) { return min(chunkRows, n - chunk * chunkRows); }
+    size_t offset(int chunk) { return (size_t)chunk * chunkRows * n; }
+
+    cl_kernel kernel;
+    const float* hA;
+    float* hB;
+    float k;
+    int n;
+    int chunkRows;
+};
+
+// Compara el camino serie (subir toda la matriz, un kernel, bajar toda la matriz) con el
+// pipeline por bandas de chunkRows filas y depth colas
+static bool runStreaming(int n, int chunkRows, int depth)
+{
+    cl_context clContext;
+    cl_command_queue clQueue;
+    cl_device_id clDevice;
+    CLDeviceInfo info;
+    if(!setupOpenCL(clContext, clQueue, clDevice, &info))
+        return false;
+
+    cl_kernel kernel;
+    if(!loadKernel(clContext, &kernel, clDevice, "../src/matrixscalar.cl", "matrixScalarBand"))
+        return false;
+    printProgramCacheStats();
+
+    const size_t matrixBytes= (size_t)n * n * sizeof(float);
+    const size_t chunkBytes= (size_t)chunkRows * n * sizeof(float);
+    float* hA= (float*)malloc(matrixBytes);
+    float* hB= (float*)malloc(matrixBytes);
+    if(!hA or !hB) {
+        cerr << "Error al reservar memoria." << endl;
+        return false;
+    }
+    const float k= initData(hA, n);
+
+    cerr << "Tamanio matriz:\t(" << n << ", " << n << "), ~" << matrixBytes/1024/1024 << " MiB." << endl;
+    cerr << "Chunks:\t\t" << (n + chunkRows - 1) / chunkRows << " de " << chunkRows << " filas, " << depth << " colas." << endl;
+    cerr << fixed << setprecision(2);
+
+    // El camino serie solo es posible si la matriz entra en el dispositivo
+    if(matrixBytes <= info.maxAllocSize and 2 * matrixBytes <= info.globalMemSize) {
+        MatrixScalarJob serialJob(kernel, hA, hB, k, n, n);
+        if(!runStreamPipeline("Serie", clContext, clDevice, serialJob, 1, matrixBytes, matrixBytes))
+            return false;
+    } else {
+        cerr << "Serie:\t\tla matriz no entra en el dispositivo, se omite." << endl;
+    }
+
+    memset(hB, 0, matrixBytes);
+    MatrixScalarJob streamJob(kernel, hA, hB, k, n, chunkRows);
+    if(!runStreamPipeline("Pipeline", clContext, clDevice, streamJob, depth, chunkBytes, matrixBytes))
+        return false;
+
+    const size_t errorCount= countErrors(hA, hB, k, n);
+    if(!errorCount)
+        cerr << "Salida OK :D" << endl;
+    else
+        cerr << errorCount << " elementos erroneos." << endl;
+
+    free(hA);
+    free(hB);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(clQueue);
+    clReleaseContext(clContext);
+
+    return !errorCount;
+}
+
 int main(int argc, char *argv[])
 {
+    // Procesar --device y --list-devices (seleccion del dispositivo OpenCL)
+    parseDeviceArgs(argc, argv);
+    // Los tiempos de los comandos se registran siempre; --trace=<archivo> ademas
+    // escribe el timeline en formato Chrome tracing
+    CLProfiler& profiler= CLProfiler::instance();
+    profiler.setEnabled(true);
+    profiler.parseArgs(argc, argv);
+
+    // --multi reparte la matriz entre todos los dispositivos de la plataforma
+    // --multi=N reparte la matriz entre N sub-dispositivos del dispositivo elegido
+    const char* multiArg;
+    const bool multiDevice= extractArg(argc, argv, "--multi", &multiArg);
+    // --stream[=filas] procesa la matriz por bandas de filas (256 por defecto) con
+    // subida, computo y bajada solapados en --depth=N colas (3 por defecto)
+    const char* streamArg;
+    const char* depthArg= 0;
+    const bool streaming= extractArg(argc, argv, "--stream", &streamArg);
+    extractArg(argc, argv, "--depth", &depthArg);
+    // --vector[=ancho] usa vectorScale de common/elementwise.cl (1D, de a ancho floats por
+    // work-item; sin ancho se usa el preferido por el dispositivo) en lugar de matrixScalar
+    const char* vectorArg;
+    const bool vectorized= extractArg(argc, argv, "--vector", &vectorArg);
+    // --hostmem={malloc|pinned|zerocopy} elige como se reserva la memoria del host
+    const char* hostMemArg;
+    HostMemMode hostMem= HOST_MEM_MALLOC;
+    if(extractArg(argc, argv, "--hostmem", &hostMemArg) and (!hostMemArg or !parseHostMemMode(hostMemArg, hostMem))) {
+        cerr << "Parametro de --hostmem incorrecto, debe ser malloc, pinned o zerocopy." << endl;
+        return EXIT_FAILURE;
+    }
+
     /// Definicion del tamanio de los datos
     // Dimension de la matrices, por defecto 2048 x 2048
     const int n= (argc==2) ? atoi(argv[1]) : 2048;
+
+    if(multiDevice)
+        return runMultiDevice(n, multiArg ? atoi(multiArg) : 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if(streaming) {
+        const int chunkRows= min(streamArg ? atoi(streamArg) : 256, n);
+        const int depth= depthArg ? atoi(depthArg) : 3;
+        if(chunkRows < 1 or depth < 1) {
+            cerr << "Parametros de --stream o --depth incorrectos." << endl;
+            return EXIT_FAILURE;
+        }
+        // Un solo resumen del profiler para las dos pasadas (serie y pipeline)
+        const bool ok= runStreaming(n, chunkRows, depth);
+        CLProfiler::instance().finish();
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // Tamanio en bytes de las matrices (por defecto 2048*2048*4 = 16 MiB)
     const int matrixBytes= n * n * sizeof(float);
   
@@ -26,127 +366,125 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
 
     /// Cargar el programa a ejecutar en GPU
-    // Cargar texto de programa a un string
+    // Crear y compilar el programa para todos los dispositivos del contexto. Si el
+    // programa ya se compilo en una ejecucion anterior se recarga el binario de la cache.
     cerr << "Cargando programa." << endl;
-    char* programText;
-    size_t programLength;
-    if(!loadProgramText("../src/matrixscalar.cl", &programText, &programLength)) {
-        cerr << "Error al cargar archivo de programa." << endl;
-        return EXIT_FAILURE;
-    }
-    // Crear programa
     cl_int error;
-    cl_program program;
-    program= clCreateProgramWithSource(clContext, 1, (const char **)&programText, (const size_t *)&programLength, &error);
-    if(checkError(error, "clCreateProgramWithSource"))
-        return EXIT_FAILURE;
-    // Compilar programa para todos los dispositivos del contexto
-    error= clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if(checkError(error, "clBuildProgram"))
-        return EXIT_FAILURE;
-    // Crear kernel a partir del programa (un programa puede tener varios kernels)
-    cl_kernel kernel;
-    kernel= clCreateKernel(program, "matrixScalar", &error);
-    if(checkError(error, "clCreateKernel"))
-        return EXIT_FAILURE;
+    cl_program program= NULL;
+    cl_kernel kernel= NULL;
+    Elementwise elementwise;
+    if(vectorized) {
+        if(!elementwise.init(clContext, clDevice, vectorArg ? atoi(vectorArg) : 0))
+            return EXIT_FAILURE;
+    } else {
+        if(!loadProgram(clContext, &program, clDevice, "../src/matrixscalar.cl"))
+            return EXIT_FAILURE;
+        // Crear kernel a partir del programa (un programa puede tener varios kernels)
+        kernel= clCreateKernel(program, "matrixScalar", &error);
+        if(checkError(error, "clCreateKernel"))
+            return EXIT_FAILURE;
+    }
+    printProgramCacheStats();
 
     /// Alocacion de memoria
-    //  - Matriz hA: Entrada en memoria de CPU (Host)
-    //  - Matriz dA: Entrada en memoria de GPU (Device)
-    //  - Matriz hB: Salida en memoria de CPU (Host). Memoria de solo lectura para el kernel.
-    //  - Matriz dB: Salida en memoria de GPU (Device). Memoria de solo escritura para el kernel.
+    //  - Matriz A: Entrada. bufA.host en memoria de CPU (Host), bufA.device en memoria de GPU
+    //    (Device), de solo lectura para el kernel.
+    //  - Matriz B: Salida. bufB.host en memoria de CPU (Host), bufB.device en memoria de GPU
+    //    (Device), de solo escritura para el kernel.
+    // La memoria del host se reserva segun --hostmem (ver HostMemMode en clutils.h)
     // Se usara indexado row-major: http://en.wikipedia.org/wiki/Row-major
-    cerr << "Reservando memoria." << endl;
-
-    float* hA= (float*)malloc(matrixBytes);
-    float* hB= (float*)malloc(matrixBytes);
+    cerr << "Reservando memoria (" << hostMemModeName(hostMem) << ")." << endl;
 
-    cl_int error1, error2;
-    cl_mem dA= clCreateBuffer(clContext, CL_MEM_READ_ONLY, matrixBytes, NULL, &error1);
-    cl_mem dB= clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, matrixBytes, NULL, &error2);
-
-    //  Verificar que se pudo reservar toda memoria
-    if(!hA or !hB or checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer")) {
+    HostBuffer bufA, bufB;
+    if(!createHostBuffer(clContext, clQueue, CL_MEM_READ_ONLY, matrixBytes, hostMem, bufA) or
+       !createHostBuffer(clContext, clQueue, CL_MEM_WRITE_ONLY, matrixBytes, hostMem, bufB)) {
         cerr << "Error al reservar memoria." << endl;
         return EXIT_FAILURE;
     }
 
     /// Inicializacion de los datos
     // 1. Llenar la matriz A de entrada en el CPU con datos aleatorios entre 0 y 1
-    cerr << "Inicializando datos." << endl;
-    srand(42);
-    for(int i=0; i<n; i++)
-        for(int j=0; j<n; j++)
-            hA[i * n + j]= (float)rand()/RAND_MAX;
     // Asignar un valor aleatorio entre 0 y 100 para k
-    const float k= (float)rand()/RAND_MAX * 100;
+    cerr << "Inicializando datos." << endl;
+    const float k= initData((float*)bufA.host, n);
 
     /// Upload de los datos (Host -> GPU)
-    // 2. Subir los datos de entrada a la GPU (de hA a dA)
+    // 2. Subir los datos de entrada a la GPU (de bufA.host a bufA.device)
     // Esta operacion se realiza de forma asincronica: se encola en el queue y el programa continua
+    // En zero-copy no hay copia: solo se desmapea el buffer para que lo use el kernel
     cerr << "Subiendo datos de entrada." << endl;
-    error= clEnqueueWriteBuffer(clQueue, dA, CL_FALSE, 0, matrixBytes, hA, 0, NULL, NULL);
-    if(checkError(error, "clEnqueueWriteBuffer"))
+    const double startTime= hostTimeMs();
+    if(!enqueueUpload(clQueue, bufA, ProfiledEvent("subida A")))
         return EXIT_FAILURE;
 
     /// Ejecucion del kernel
-    // Primero se determina el tamanio de work-group y la cantidad total de threads en el NDRange
-    size_t workGroupSize[2] = { 16, 16 };
-    // Para cada dimension se redondea hacia arriba la cantidad de threads total para que sea
-    // multiplo del tamanio del work-group
-    size_t ndRangeSize[2];
-    ndRangeSize[0]= roundUp(n, workGroupSize[0]);
-    ndRangeSize[1]= roundUp(n, workGroupSize[1]);
-    // Setean los parametros del kernel, y luego se encola su ejecucion
+    // Con --vector la matriz se trata como un vector de n * n floats
     cerr << "Ejecutando kernel." << endl;
-    error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA);
-    error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dB);
-    error |= clSetKernelArg(kernel, 2, sizeof(cl_float), (void*)&k);
-    error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&n);
-    error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, NULL);
-    if(checkError(error, "clEnqueueNDRangeKernel"))
-        return EXIT_FAILURE;
+    size_t workGroupSize[2] = { 0, 0 }, ndRangeSize[2] = { 0, 0 };
+    if(vectorized) {
+        if(!elementwise.enqueueScale(clQueue, bufA.device, bufB.device, k, n * n, ProfiledEvent("vectorScale")))
+            return EXIT_FAILURE;
+    } else {
+        // Setean los parametros del kernel
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&bufA.device);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&bufB.device);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_float), (void*)&k);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&n);
+        // Luego se determina el tamanio de work-group (ver autotuner.h) y la cantidad total de
+        // threads en el NDRange: para cada dimension se redondea hacia arriba la cantidad de
+        // threads total para que sea multiplo del tamanio del work-group
+        const size_t problemSize[2] = { (size_t)n, (size_t)n };
+        if(!tuneNDRange(clQueue, kernel, 2, problemSize, workGroupSize, ndRangeSize))
+            return EXIT_FAILURE;
+        // Y se encola su ejecucion
+        error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, ProfiledEvent("matrixScalar"));
+        if(checkError(error, "clEnqueueNDRangeKernel"))
+            return EXIT_FAILURE;
+    }
 
     /// Download de los resultados (GPU -> Host)
     // Esta vez indicamos que la operacion sea sincronica, por lo que el CPU va a quedar esperando
     // a que se ejecuten las tareas anteriores de la cola (paso 2 y 3) asi como esta tarea
-    error= clEnqueueReadBuffer(clQueue, dB, CL_TRUE, 0, matrixBytes, hB, 0, NULL, NULL);
-    if(checkError(error, "clEnqueueReadBuffer"))
+    // En zero-copy no hay copia: se mapea el buffer para leerlo desde el host
+    if(!enqueueDownload(clQueue, bufB, CL_TRUE, ProfiledEvent("bajada B")))
         return EXIT_FAILURE;
+    const double elapsed= hostTimeMs() - startTime;
 
     cerr << "Tamanio matriz:\t\t\t\t(" << n << ", " << n << "), " << n * n << " elementos," << " ~" << matrixBytes/1024/1024 << " MiB." << endl;
-    cerr << "Cantidad de Work-groups en el Grid:\t(" << ndRangeSize[0]/workGroupSize[0] << ", " << ndRangeSize[1]/workGroupSize[1] << ")" << endl;
-    cerr << "Tamanio de Work-groups:\t\t\t(" << workGroupSize[0] << ", " << workGroupSize[1] << ")" << endl;
-    cerr << "Tamanio global de Grid:\t\t\t(" << ndRangeSize[0] << ", " << ndRangeSize[1] << ")" << endl;
+    if(vectorized) {
+        cerr << "Ancho de vector:\t\t\t" << elementwise.getVectorWidth() << " floats por work-item." << endl;
+    } else {
+        cerr << "Cantidad de Work-groups en el Grid:\t(" << ndRangeSize[0]/workGroupSize[0] << ", " << ndRangeSize[1]/workGroupSize[1] << ")" << endl;
+        cerr << "Tamanio de Work-groups:\t\t\t(" << workGroupSize[0] << ", " << workGroupSize[1] << ")" << endl;
+        cerr << "Tamanio global de Grid:\t\t\t(" << ndRangeSize[0] << ", " << ndRangeSize[1] << ")" << endl;
+    }
+    cerr << "Memoria del host:\t\t\t" << hostMemModeName(hostMem) << endl;
+    cerr << "Tiempo total:\t\t\t\t" << elapsed << " ms, " << 2.0 * matrixBytes / (elapsed * 1.0e6) << " GB/s." << endl;
+    // Tiempos de subida, kernel y bajada, y la espera de cada comando en la cola
+    profiler.finish();
     
     /// Verificacion del computo
+    // En zero-copy hay que volver a mapear A para leerla desde el host
     cerr << "Verificando salida." << endl;
-    int errorCount= 0;
-    for(int i=0; i<n; i++) {
-        for(int j=0; j<n; j++) {
-            const int index= i * n + j;
-            // Comparamos bit-a-bit porque ambos procesadores deberian implementar el estandar
-            // de floating point IEEE 754-2008
-            if(hB[index] != k * hA[index])
-                errorCount++;
-        }
-    }
+    if(!mapHostBuffer(clQueue, bufA))
+        return EXIT_FAILURE;
+    const size_t errorCount= countErrors((float*)bufA.host, (float*)bufB.host, k, n);
     if(!errorCount)
         cerr << "Salida OK :D" << endl;
     else
         cerr << errorCount << " elementos erroneos." << endl;
     
     /// Liberacion de memoria reservada (en CPU y GPU)
-    // libero memoria de Host
+    // libero memoria de Host y de Dispositivo
     cerr << "Liberacion de Memoria reservada." << endl;
-    free(hA);
-    free(hB);
-    // libero memoria de Dispositivo
-    clReleaseMemObject(dA);
-    clReleaseMemObject(dB);
+    releaseHostBuffer(clQueue, bufA);
+    releaseHostBuffer(clQueue, bufB);
     // libero objetos de OpenCL
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
+    elementwise.release();
+    if(kernel)
+        clReleaseKernel(kernel);
+    if(program)
+        clReleaseProgram(program);
     clReleaseCommandQueue(clQueue);
     clReleaseContext(clContext);
     
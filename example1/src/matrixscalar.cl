@@ -19,3 +19,22 @@ __kernel void matrixScalar(
     const int index= i * n + j;
     B[index]= k * A[index];
 }
+
+// Igual que matrixScalar pero para una banda de rows filas de una matriz de n
+// columnas. Se usa para repartir la matriz entre varios dispositivos.
+__kernel void matrixScalarBand(
+    __global float* A,
+    __global float* B,
+    float k,
+    int rows,
+    int n)
+{
+    int i= get_global_id(1); // Fila dentro de la banda
+    int j= get_global_id(0); // Columna
+
+    if(i>=rows || j>=n)
+        return;
+
+    const int index= i * n + j;
+    B[index]= k * A[index];
+}
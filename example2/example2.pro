@@ -16,10 +16,21 @@ QMAKE_CXXFLAGS_RELEASE = -march=native -O3 -fPIC
 
 SOURCES += \
 	src/main.cpp \
-	../common/clutils.cpp
+	../common/clutils.cpp \
+	../common/programcache.cpp \
+	../common/clprofiler.cpp \
+	../common/autotuner.cpp \
+	../common/streampipeline.cpp \
+	../common/transpose.cpp
 
 HEADERS += \
-	../common/clutils.h
+	../common/clutils.h \
+	../common/programcache.h \
+	../common/clprofiler.h \
+	../common/autotuner.h \
+	../common/streampipeline.h \
+	../common/transpose.h
 
 OTHER_FILES += \
-	src/matrixtranspose.cl
+	src/matrixtranspose.cl \
+	../common/transpose.cl
@@ -6,32 +6,214 @@
 #include <CL/cl.h>
 // Utilidades propias para OpenCL
 #include "clutils.h"
+#include "clprofiler.h"
+#include "autotuner.h"
+#include "programcache.h"
+#include "streampipeline.h"
+#include "transpose.h"
+
+#include <algorithm>
 
 #define BLOCKSIZE 16
 
 using namespace std;
 
+// Calcula B = transpose(A) por bandas de chunkRows filas de B. La banda de filas
+// [r, r+rows) de B es la transpuesta de la banda de columnas [r, r+rows) de A, que
+// se sube como una matriz de n * rows con clEnqueueWriteBufferRect.
+class TransposeJob : public StreamJob
+{
+public:
+    TransposeJob(cl_kernel kernel, const float* hA, float* hB, int n, int chunkRows) :
+        kernel(kernel), hA(hA), hB(hB), n(n), chunkRows(chunkRows) {}
+
+    int chunkCount() { return (n + chunkRows - 1) / chunkRows; }
+
+    bool enqueueUpload(int chunk, cl_command_queue queue, cl_mem input)
+    {
+        // Origen y region en bytes en x, en filas en y
+        size_t bufferOrigin[3] = { 0, 0, 0 };
+        size_t hostOrigin[3] = { chunk * chunkRows * sizeof(float), 0, 0 };
+        size_t region[3] = { rows(chunk) * sizeof(float), (size_t)n, 1 };
+        cl_int error= clEnqueueWriteBufferRect(queue, input, CL_FALSE, bufferOrigin, hostOrigin, region,
+                                               rows(chunk) * sizeof(float), 0, n * sizeof(float), 0,
+                                               hA, 0, NULL, ProfiledEvent("subida chunk"));
+        return !checkError(error, "TransposeJob: clEnqueueWriteBufferRect");
+    }
+
+    bool enqueueCompute(int chunk, cl_command_queue queue, cl_mem input, cl_mem output)
+    {
+        // input es de n filas * bandCols columnas, output de bandCols filas * n columnas
+        const int bandCols= rows(chunk);
+
+        cl_int error;
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&input);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&output);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&n);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&bandCols);
+        size_t problemSize[2] = { (size_t)n, (size_t)bandCols };
+        size_t workGroupSize[2], ndRangeSize[2];
+        if(!tuneNDRange(queue, kernel, 2, problemSize, workGroupSize, ndRangeSize))
+            return false;
+        error |= clEnqueueNDRangeKernel(queue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL,
+                                         ProfiledEvent("transposeRect"));
+        return !checkError(error, "TransposeJob: clEnqueueNDRangeKernel");
+    }
+
+    bool enqueueDownload(int chunk, cl_command_queue queue, cl_mem output)
+    {
+        cl_int error= clEnqueueReadBuffer(queue, output, CL_FALSE, 0, rows(chunk) * n * sizeof(float),
+                                          hB + (size_t)chunk * chunkRows * n, 0, NULL,
+                                          ProfiledEvent("bajada chunk"));
+        return !checkError(error, "TransposeJob: clEnqueueReadBuffer");
+    }
+
+private:
+    int rows(int chunk) { return min(chunkRows, n - chunk * chunkRows); }
+
+    cl_kernel kernel;
+    const float* hA;
+    float* hB;
+    int n;
+    int chunkRows;
+};
+
+// Compara el camino serie (subir toda la matriz, un kernel, bajar toda la matriz) con el
+// pipeline por bandas de chunkRows filas y depth colas
+static bool runStreaming(int n, int chunkRows, int depth)
+{
+    cl_context clContext;
+    cl_command_queue clQueue;
+    cl_device_id clDevice;
+    CLDeviceInfo info;
+    if(!setupOpenCL(clContext, clQueue, clDevice, &info))
+        return false;
+
+    cl_kernel kernel;
+    if(!loadKernel(clContext, &kernel, clDevice, "../src/matrixtranspose.cl", "transposeRect"))
+        return false;
+    printProgramCacheStats();
+
+    const size_t matrixBytes= (size_t)n * n * sizeof(float);
+    const size_t chunkBytes= (size_t)chunkRows * n * sizeof(float);
+    float* hA= (float*)malloc(matrixBytes);
+    float* hB= (float*)malloc(matrixBytes);
+    if(!hA or !hB) {
+        cerr << "Error al reservar memoria." << endl;
+        return false;
+    }
+    srand(42);
+    for(size_t i=0; i<(size_t)n * n; i++)
+        hA[i]= (float)rand()/RAND_MAX;
+
+    cerr << "Tamanio matriz:\t(" << n << ", " << n << "), ~" << matrixBytes/1024/1024 << " MiB." << endl;
+    cerr << "Chunks:\t\t" << (n + chunkRows - 1) / chunkRows << " de " << chunkRows << " filas, " << depth << " colas." << endl;
+    cerr << fixed << setprecision(2);
+
+    // El camino serie solo es posible si la matriz entra en el dispositivo
+    if(matrixBytes <= info.maxAllocSize and 2 * matrixBytes <= info.globalMemSize) {
+        TransposeJob serialJob(kernel, hA, hB, n, n);
+        if(!runStreamPipeline("Serie", clContext, clDevice, serialJob, 1, matrixBytes, matrixBytes))
+            return false;
+    } else {
+        cerr << "Serie:\t\tla matriz no entra en el dispositivo, se omite." << endl;
+    }
+
+    memset(hB, 0, matrixBytes);
+    TransposeJob streamJob(kernel, hA, hB, n, chunkRows);
+    if(!runStreamPipeline("Pipeline", clContext, clDevice, streamJob, depth, chunkBytes, matrixBytes))
+        return false;
+
+    size_t errorCount= 0;
+    for(size_t i=0; i<(size_t)n; i++)
+        for(size_t j=0; j<(size_t)n; j++)
+            if(hB[i * n + j] != hA[j * n + i])
+                errorCount++;
+    if(!errorCount)
+        cerr << "Salida OK :D" << endl;
+    else
+        cerr << errorCount << " elementos erroneos." << endl;
+
+    free(hA);
+    free(hB);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(clQueue);
+    clReleaseContext(clContext);
+
+    return !errorCount;
+}
+
 int main(int argc, char *argv[])
 {
+    // Procesar --device y --list-devices (seleccion del dispositivo OpenCL)
+    parseDeviceArgs(argc, argv);
+    // Los tiempos de los comandos se registran siempre; --trace=<archivo> ademas
+    // escribe el timeline en formato Chrome tracing
+    CLProfiler& profiler= CLProfiler::instance();
+    profiler.setEnabled(true);
+    profiler.parseArgs(argc, argv);
+    // --stream[=filas] procesa la matriz por bandas de filas (256 por defecto) con
+    // subida, computo y bajada solapados en --depth=N colas (3 por defecto)
+    const char* streamArg;
+    const char* depthArg= 0;
+    const bool streaming= extractArg(argc, argv, "--stream", &streamArg);
+    extractArg(argc, argv, "--depth", &depthArg);
+    // --hostmem={malloc|pinned|zerocopy} elige como se reserva la memoria del host
+    const char* hostMemArg;
+    HostMemMode hostMem= HOST_MEM_MALLOC;
+    if(extractArg(argc, argv, "--hostmem", &hostMemArg) and (!hostMemArg or !parseHostMemMode(hostMemArg, hostMem))) {
+        cerr << "Parametro de --hostmem incorrecto, debe ser malloc, pinned o zerocopy." << endl;
+        return EXIT_FAILURE;
+    }
   
     /// Argumentos de entrada al programa
+    const char* usage= "usage: ./matrixtranspose {sharedmem|globalmem|tiled|inplace} [rows [cols]] [--stream[=rows] [--depth=N]] [--hostmem={malloc|pinned|zerocopy}] [--device=<spec>] [--list-devices] [--trace=<file>]";
     if(argc < 2) {
-      cerr << "usage: ./matrixtranspose {sharedmem|globalmem} [matrixSize]" << endl;
+      cerr << usage << endl;
       return EXIT_FAILURE;      
     }
     
+    // sharedmem y globalmem usan los kernels de matrixtranspose.cl; tiled e inplace
+    // usan TransposeEngine (tiles de 32x32 en memoria local, ver common/transpose.h)
     const char* memoryParam = argv[1];
-    if(strcmp(memoryParam, "sharedmem") != 0 and strcmp(memoryParam, "globalmem") != 0) {
-      cerr << "usage: ./matrixtranspose {sharedmem|globalmem} [matrixSize]" << endl;
+    if(strcmp(memoryParam, "sharedmem") != 0 and strcmp(memoryParam, "globalmem") != 0 and
+       strcmp(memoryParam, "tiled") != 0 and strcmp(memoryParam, "inplace") != 0) {
+      cerr << usage << endl;
       cerr << "Parametro incorrecto: " << memoryParam << endl;
       return EXIT_FAILURE;      
     }
     
     const bool withSharedMemory = (strcmp(memoryParam, "sharedmem")==0) ? true : false;
-    // Dimension de la matriz, por defecto 2048 x 2048
-    const int n= (argc==3) ? atoi(argv[2]) : 2048;
+    const bool tiled = strcmp(memoryParam, "tiled")==0;
+    const bool inPlace = strcmp(memoryParam, "inplace")==0;
+    // Dimensiones de la matriz, por defecto 2048 x 2048. Solo tiled admite matrices rectangulares.
+    const int rows= (argc>=3) ? atoi(argv[2]) : 2048;
+    const int cols= (argc>=4) ? atoi(argv[3]) : rows;
+    if(rows < 1 or cols < 1 or (rows != cols and !tiled)) {
+      cerr << usage << endl;
+      cerr << "Dimensiones incorrectas: solo el modo tiled admite matrices rectangulares." << endl;
+      return EXIT_FAILURE;
+    }
+    const int n= rows;
     // Tamanio en bytes de la matriz (por defecto 2048*2048*4 = 16 MiB)
-    const int matrixBytes= n * n * sizeof(float);
+    const size_t matrixBytes= (size_t)rows * cols * sizeof(float);
+
+    if(streaming) {
+        if(tiled or inPlace) {
+            cerr << "--stream solo esta disponible en los modos sharedmem y globalmem." << endl;
+            return EXIT_FAILURE;
+        }
+        const int chunkRows= min(streamArg ? atoi(streamArg) : 256, n);
+        const int depth= depthArg ? atoi(depthArg) : 3;
+        if(chunkRows < 1 or depth < 1) {
+            cerr << "Parametros de --stream o --depth incorrectos." << endl;
+            return EXIT_FAILURE;
+        }
+        // Un solo resumen del profiler para las dos pasadas (serie y pipeline)
+        const bool ok= runStreaming(n, chunkRows, depth);
+        CLProfiler::instance().finish();
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
     
     /// Inicializacion
     cerr << "Configurando OpenCL." << endl;
@@ -43,54 +225,45 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
 
     /// Cargar del programa a ejecutar en GPU
-    // Cargar texto de programa a un string
+    // Crear y compilar el programa para todos los dispositivos del contexto. Si el
+    // programa ya se compilo en una ejecucion anterior se recarga el binario de la cache.
     cerr << "Cargando programa." << endl;
-    char* programText;
-    size_t programLength;
-    if(!loadProgramText("../src/matrixtranspose.cl", &programText, &programLength)) {
-        cerr << "Error al cargar archivo de programa." << endl;
-        return EXIT_FAILURE;
-    }
-    // Crear programa
     cl_int error;
-    cl_program program;
-    program= clCreateProgramWithSource(clContext, 1, (const char **)&programText, (const size_t *)&programLength, &error);
-    if(checkError(error, "clCreateProgramWithSource"))
-        return EXIT_FAILURE;
-    // Compilar programa para todos los dispositivos del contexto
-    error= clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if(checkError(error, "clBuildProgram")) {
-	checkProgramBuild(program, clDevice);
-        return EXIT_FAILURE;
+    cl_program program= NULL;
+    cl_kernel kernel= NULL;
+    TransposeEngine engine;
+    const char* kernelName;
+    if(tiled or inPlace) {
+        if(!engine.init(clContext, clDevice))
+            return EXIT_FAILURE;
+        kernelName= tiled ? "transposeTiled" : "transposeInPlace";
+    } else {
+        if(!loadProgram(clContext, &program, clDevice, "../src/matrixtranspose.cl"))
+            return EXIT_FAILURE;
+        kernelName = (withSharedMemory) ? "transposeShMem" : "transpose";
+        // Crear kernel a partir del programa (un programa puede tener varios kernels)
+        kernel= clCreateKernel(program, kernelName, &error);
+        if(checkError(error, "clCreateKernel"))
+            return EXIT_FAILURE;
     }
-    
-    const char* kernelName = (withSharedMemory) ? "transposeShMem" : "transpose";	
-    // Crear kernel a partir del programa (un programa puede tener varios kernels)
-    cl_kernel kernel;
-    kernel= clCreateKernel(program, kernelName, &error);
-    if(checkError(error, "clCreateKernel"))
-        return EXIT_FAILURE;
+    printProgramCacheStats();
 
     //
     // Reserva de memoria
     //
 
-    //  - Matriz hA: Entrada en memoria de CPU (Host)
-    //  - Matriz dA: Entrada en memoria de GPU (Device)
-    //  - Matriz hB: Salida en memoria de CPU (Host). Memoria de solo lectura para el kernel.
-    //  - Matriz dB: Salida en memoria de GPU (Device). Memoria de solo escritura para el kernel.
+    //  - Matriz A: Entrada. bufA.host en memoria de CPU (Host), bufA.device en memoria de GPU
+    //    (Device), de solo lectura para el kernel (de lectura y escritura en inplace, donde
+    //    tambien es la salida).
+    //  - Matriz B: Salida. bufB.host en memoria de CPU (Host), bufB.device en memoria de GPU
+    //    (Device), de solo escritura para el kernel. No se usa en inplace.
+    // La memoria del host se reserva segun --hostmem (ver HostMemMode en clutils.h)
     // Se usara indexado row-major: http://en.wikipedia.org/wiki/Row-major
-    cerr << "Reservando memoria." << endl;
-
-    float* hA= (float*)malloc(matrixBytes);
-    float* hB= (float*)malloc(matrixBytes);
-
-    cl_int error1, error2;
-    cl_mem dA= clCreateBuffer(clContext, CL_MEM_READ_ONLY, matrixBytes, NULL, &error1);
-    cl_mem dB= clCreateBuffer(clContext, CL_MEM_WRITE_ONLY, matrixBytes, NULL, &error2);
+    cerr << "Reservando memoria (" << hostMemModeName(hostMem) << ")." << endl;
 
-    //  Verificar que se pudo reservar toda memoria
-    if(!hA or !hB or checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer")) {
+    HostBuffer bufA, bufB;
+    if(!createHostBuffer(clContext, clQueue, inPlace ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY, matrixBytes, hostMem, bufA) or
+       (!inPlace and !createHostBuffer(clContext, clQueue, CL_MEM_WRITE_ONLY, matrixBytes, hostMem, bufB))) {
         cerr << "Error al reservar memoria." << endl;
         return EXIT_FAILURE;
     }
@@ -98,66 +271,106 @@ int main(int argc, char *argv[])
     /// Inicializacion de los datos
     // 1. Llenar la matriz A de entrada en el CPU con datos aleatorios entre 0 y 1
     cerr << "Inicializando datos." << endl;
+    float* hA= (float*)bufA.host;
     srand(42);
-    for(int i=0; i<n; i++)
-        for(int j=0; j<n; j++) 
-            hA[i * n + j]= (float)rand()/RAND_MAX;
+    for(int i=0; i<rows; i++)
+        for(int j=0; j<cols; j++) 
+            hA[i * cols + j]= (float)rand()/RAND_MAX;
+    // En inplace la salida pisa a A, asi que se guarda una copia para verificar
+    float* original= 0;
+    if(inPlace) {
+        original= (float*)malloc(matrixBytes);
+        if(!original) {
+            cerr << "Error al reservar memoria." << endl;
+            return EXIT_FAILURE;
+        }
+        memcpy(original, hA, matrixBytes);
+    }
     
-    /// Subir los datos de entrada a la GPU (de hA a dA)
+    /// Subir los datos de entrada a la GPU (de bufA.host a bufA.device)
     // Esta operacion se realiza de forma asincronica: se encola en el queue y el programa continua
+    // En zero-copy no hay copia: solo se desmapea el buffer para que lo use el kernel
     cerr << "Subiendo datos de entrada." << endl;
-    error= clEnqueueWriteBuffer(clQueue, dA, CL_FALSE, 0, matrixBytes, hA, 0, NULL, NULL);
-    if(checkError(error, "clEnqueueWriteBuffer"))
+    if(!enqueueUpload(clQueue, bufA, ProfiledEvent("subida A")))
         return EXIT_FAILURE;
     
     /// Ejecutar el kernel
-    // Primero se determina el tamanio de work-group y la cantidad total de threads en el NDRange
-    size_t workGroupSize[2] = { BLOCKSIZE, BLOCKSIZE };
-    // Para cada dimension se redondea hacia arriba la cantidad de threads total para que sea
-    // multiplo del tamanio del work-group
-    size_t ndRangeSize[2];
-    ndRangeSize[0]= roundUp(n, workGroupSize[0]);
-    ndRangeSize[1]= roundUp(n, workGroupSize[1]);
     // Setean los parametros del kernel, y luego se encola su ejecucion
     cerr << "Ejecutando kernel \'" << kernelName << "\'." << endl;
-    error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA);
-    error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dB);
-    error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&n);
-    if (withSharedMemory) { // en caso de querer usar memoria compartida, debo pasar como argumento su tamanio
-	error |= clSetKernelArg(kernel, 3, BLOCKSIZE * BLOCKSIZE * sizeof(float), (void*) NULL);
-    }
-    cl_event kernelExecEvent;
-    error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, &kernelExecEvent);
-    if(checkError(error, "clEnqueueNDRangeKernel"))
-        return EXIT_FAILURE;
+    size_t workGroupSize[2], ndRangeSize[2];
+    if(tiled or inPlace) {
+        // TransposeEngine lanza un work-group de tileDim x blockRows por tile de tileDim x tileDim
+        const int tileDim= engine.getTileDim();
+        workGroupSize[0]= tileDim;
+        workGroupSize[1]= engine.getBlockRows();
+        ndRangeSize[0]= roundUp(cols, tileDim);
+        ndRangeSize[1]= roundUp(rows, tileDim) / tileDim * workGroupSize[1];
+        const bool queued= tiled ? engine.enqueueTranspose(clQueue, bufA.device, bufB.device, rows, cols, ProfiledEvent(kernelName))
+                                 : engine.enqueueTransposeInPlace(clQueue, bufA.device, n, ProfiledEvent(kernelName));
+        if(!queued)
+            return EXIT_FAILURE;
+    } else {
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&bufA.device);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&bufB.device);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&n);
+        if (withSharedMemory) { // en caso de querer usar memoria compartida, debo pasar como argumento su tamanio
+            error |= clSetKernelArg(kernel, 3, BLOCKSIZE * BLOCKSIZE * sizeof(float), (void*) NULL);
+        }
+        // El tamanio de work-group lo elige el autotuner (transposeShMem exige BLOCKSIZE x BLOCKSIZE
+        // con reqd_work_group_size, y el autotuner lo respeta). Para cada dimension se redondea
+        // hacia arriba la cantidad de threads total para que sea multiplo del tamanio del work-group
+        const size_t problemSize[2] = { (size_t)n, (size_t)n };
+        if(!tuneNDRange(clQueue, kernel, 2, problemSize, workGroupSize, ndRangeSize))
+            return EXIT_FAILURE;
+        error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, ProfiledEvent(kernelName));
+        if(checkError(error, "clEnqueueNDRangeKernel"))
+            return EXIT_FAILURE;
+    }
     
     /// Download de los resultados
     // Esta vez indicamos que la operacion sea sincronica, por lo que el CPU va a quedar esperando
     // a que se ejecuten las tareas anteriores de la cola (paso 2 y 3) asi como esta tarea
-    error= clEnqueueReadBuffer(clQueue, dB, CL_TRUE, 0, matrixBytes, hB, 0, NULL, NULL);
-    if(checkError(error, "clEnqueueReadBuffer"))
+    // En zero-copy no hay copia: se mapea el buffer para leerlo desde el host
+    HostBuffer& bufResult= inPlace ? bufA : bufB;
+    if(!enqueueDownload(clQueue, bufResult, CL_TRUE, ProfiledEvent(inPlace ? "bajada A" : "bajada B")))
         return EXIT_FAILURE;
 
     // Obtengo tiempo de ejecucion
-    float execTime = eventElapsed(kernelExecEvent);
+    CLProfiler::Stats kernelStats;
+    profiler.collect();
+    const float execTime = profiler.getStats(kernelName, kernelStats) ? kernelStats.total : 0;
+    // Se lee y se escribe cada elemento una vez
+    const double bandwidth= execTime > 0 ? 2.0 * matrixBytes / (execTime * 1.0e6) : 0;
     
-    cerr << "Tamanio matriz:\t\t\t\t(" << n << ", " << n << "), " << n * n << " elementos," << " ~" << matrixBytes/1024/1024 << " MiB." << endl;
+    cerr << "Tamanio matriz:\t\t\t\t(" << rows << ", " << cols << "), " << (size_t)rows * cols << " elementos," << " ~" << matrixBytes/1024/1024 << " MiB." << endl;
     cerr << "Cantidad de Work-groups en el Grid:\t(" << ndRangeSize[0]/workGroupSize[0] << ", " << ndRangeSize[1]/workGroupSize[1] << ")" << endl;
     cerr << "Tamanio de Work-groups:\t\t\t(" << workGroupSize[0] << ", " << workGroupSize[1] << ")" << endl;
     cerr << "Tamanio global de Grid:\t\t\t(" << ndRangeSize[0] << ", " << ndRangeSize[1] << ")" << endl;
-    cerr << "Tiempo de ejecucion:\t\t\t" << setprecision(2) << execTime << " ms." << endl;
+    cerr << "Tiempo de ejecucion:\t\t\t" << fixed << setprecision(2) << execTime << " ms, " << bandwidth << " GB/s." << endl;
+    cerr << "Memoria del host:\t\t\t" << hostMemModeName(hostMem) << endl;
+    // Tiempos de subida, kernel y bajada, y la espera de cada comando en la cola
+    profiler.finish();
 
     /// Verificacion de la salida
+    // En zero-copy hay que volver a mapear A para leerla desde el host
     cerr << "Verificando salida." << endl;
+    const float* reference= original;
+    if(!inPlace) {
+        if(!mapHostBuffer(clQueue, bufA))
+            return EXIT_FAILURE;
+        reference= (const float*)bufA.host;
+    }
+    const float* hB= (const float*)bufResult.host;
 
-    int errorCount= 0;
-    for(int i=0; i<n; i++) {
-        for(int j=0; j<n; j++) {
-            const int index= i * n + j;
-	    const int transposeIndex= j * n + i;
+    // La salida es de cols filas * rows columnas
+    size_t errorCount= 0;
+    for(int i=0; i<cols; i++) {
+        for(int j=0; j<rows; j++) {
+            const size_t index= (size_t)i * rows + j;
+	    const size_t transposeIndex= (size_t)j * cols + i;
             // Comparamos bit-a-bit porque ambos procesadores deberian implementar el estandar
             // de floating point IEEE 754-2008
-            if(hB[index] != hA[transposeIndex])
+            if(hB[index] != reference[transposeIndex])
                 errorCount++;
         }
     }
@@ -167,16 +380,18 @@ int main(int argc, char *argv[])
         cerr << errorCount << " elementos erroneos." << endl;
     
     /// Liberacion de memoria reservada
-    // libero memoria de Host
+    // libero memoria de Host y de GPU
     cerr << "Liberacion de Memoria reservada." << endl;
-    free(hA);
-    free(hB);
-    // libero memoria de GPU (cl_mems)
-    clReleaseMemObject(dA);
-    clReleaseMemObject(dB);
+    free(original);
+    releaseHostBuffer(clQueue, bufA);
+    if(!inPlace)
+        releaseHostBuffer(clQueue, bufB);
     // libero objetos de OpenCL
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
+    engine.release();
+    if(kernel)
+        clReleaseKernel(kernel);
+    if(program)
+        clReleaseProgram(program);
     clReleaseCommandQueue(clQueue);
     clReleaseContext(clContext);
     
@@ -22,6 +22,26 @@ __kernel void transpose(
 
 /*********************************************************************/
 
+// transposeRect calcula la transpuesta de una matriz rectangular A de rows * cols:
+// B (de cols * rows) = transpose(A)
+
+__kernel void transposeRect(
+    __global float* A,
+    __global float* B,
+    int rows,
+    int cols)
+{
+    const int i= get_global_id(1); // Fila de B
+    const int j= get_global_id(0); // Columna de B
+
+    if(i>=cols || j>=rows)
+        return;
+
+    B[i * rows + j]= A[j * cols + i];
+}
+
+/*********************************************************************/
+
 // transposeMatrixShMem calcula la transpuesta de una matriz de n * n:
 // B = transpose(A)
 // Esta implementacion utiliza la "Shared Memory" para logar accesos "coalescientes" a memoria global
@@ -40,16 +60,15 @@ void transposeShMem(
     const int in_i= get_global_id(1); // "Coordenada Y del NDRange" (fila i)
     const int in_j= get_global_id(0); // "Coordenada X del NDRange" (columna j)
 
-    // Verificar que estamos en el rango adecuado
-    if(in_i>=n || in_j>=n)
-        return;
-	
     // (1) Cargo bloque a la Shared Memory (lectura coalesciente)
+    // No se sale antes de la barrera: en los bloques del borde todos los threads
+    // deben llegar a barrier(), asi que solo se saltean los accesos fuera de rango
     const int local_i= get_local_id(1);
     const int local_j= get_local_id(0);
     const int indexSharedMem= local_j * BLOCKSIZE + local_i;
     const int indexGlobal= in_i * n + in_j;
-    block[indexSharedMem]= A[indexGlobal];
+    if(in_i<n && in_j<n)
+        block[indexSharedMem]= A[indexGlobal];
     
     // (2) Barrera para sincronizar los threads del bloque,
     // de manera de asegurarme que todos los threads ya escribieron la memoria compartida
@@ -58,5 +77,6 @@ void transposeShMem(
     // (3) Realizar la escritura a la matriz de salida, leyendo de memoria compartida (escritura coalesciente)
     const int out_j= get_group_id(1) * BLOCKSIZE + local_j;
     const int out_i= get_group_id(0) * BLOCKSIZE + local_i;
-    B[out_i * n + out_j]= block[local_i * BLOCKSIZE + local_j];
+    if(out_i<n && out_j<n)
+        B[out_i * n + out_j]= block[local_i * BLOCKSIZE + local_j];
 }
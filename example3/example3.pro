@@ -14,10 +14,24 @@ QMAKE_CXXFLAGS_RELEASE = -march=native -O3 -fPIC
 
 SOURCES += \
     src/main.cpp \
-    ../common/clutils.cpp
+    ../common/clutils.cpp \
+    ../common/programcache.cpp \
+    ../common/clprofiler.cpp \
+    ../common/autotuner.cpp \
+    ../common/reduce.cpp \
+    src/multigrid.cpp \
+    src/fdmblocked.cpp
 
 HEADERS += \
-    ../common/clutils.h
+    ../common/clutils.h \
+    ../common/programcache.h \
+    ../common/clprofiler.h \
+    ../common/autotuner.h \
+    ../common/reduce.h \
+    src/multigrid.h \
+    src/fdmblocked.h
 
 OTHER_FILES += \
-    src/fdmHeat.cl
+    src/fdmHeat.cl \
+    src/multigrid.cl \
+    ../common/reduce.cl
@@ -1,3 +1,6 @@
+// Los kernels con imagenes solo se compilan si el dispositivo las soporta, asi los
+// de buffers (rojo-negro y su residuo) se pueden usar en cualquier dispositivo
+#ifdef __IMAGE_SUPPORT__
 
 __kernel void fdmHeat(
     __read_only image2d_t input,
@@ -42,3 +45,190 @@ __kernel void fdmHeat(
     // Escribir resultado
     write_imagef(output, (int2)(x,y), value);
 }
+
+// Diferencia entre dos pasos consecutivos de cada celda, para medir la
+// convergencia: |current - previous|, o su cuadrado si squared != 0. El
+// resultado se reduce (maximo o suma) con common/reduce.cl.
+__kernel void fdmResidual(
+    __read_only image2d_t previous,
+    __read_only image2d_t current,
+    __global float* residual,
+    int squared)
+{
+    int x= get_global_id(0);
+    int y= get_global_id(1);
+    const int width= get_image_width(current);
+    const int height= get_image_height(current);
+    if(x>=width || y>=height)
+        return;
+
+    const sampler_t sampler= CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+    const float difference= read_imagef(current, sampler, (int2)(x,y)).x - read_imagef(previous, sampler, (int2)(x,y)).x;
+    residual[x + y * width]= squared ? difference * difference : fabs(difference);
+}
+#endif // __IMAGE_SUPPORT__
+
+// Gauss-Seidel / SOR rojo-negro en el lugar sobre un buffer de width * height
+// floats. Las celdas se colorean como un tablero de ajedrez: las rojas (color 0,
+// x + y par) solo tienen vecinas negras y viceversa, asi que todas las celdas de un
+// color se pueden actualizar en paralelo con los valores nuevos del otro color.
+// Cada work-item actualiza la celda de su color en el par de columnas 2 * x y
+// 2 * x + 1. omega es el factor de relajacion: 1 es Gauss-Seidel, entre 1 y 2 es SOR.
+__kernel void fdmHeatRedBlack(
+    __global float* data,
+    int width,
+    int height,
+    int color,
+    float omega)
+{
+    int y= get_global_id(1);
+    int x= 2 * get_global_id(0) + ((y + color) & 1);
+
+    // Las celdas del borde no se actualizan (Condicion de frontera de Dirichlet)
+    if(x<=0 || y<=0 || x>=width-1 || y>=height-1)
+        return;
+
+    const int i= x + y * width;
+    float up   = data[i - width];
+    float down = data[i + width];
+    float left = data[i - 1];
+    float right= data[i + 1];
+    float average= (up + down + left + right) / 4.0f;
+
+    // Sobre-relajacion explicita: mix solo esta definido para omega en [0, 1]
+    data[i]= omega == 1.0f ? average : data[i] + omega * (average - data[i]);
+}
+
+// Residuo de cada celda de un buffer (para Gauss-Seidel y SOR): lo que cambiaria
+// con un paso de Jacobi, el promedio de sus vecinas menos su valor, en valor
+// absoluto o al cuadrado si squared != 0. En el borde es 0.
+__kernel void fdmResidualBuffer(
+    __global const float* data,
+    int width,
+    int height,
+    __global float* residual,
+    int squared)
+{
+    int x= get_global_id(0);
+    int y= get_global_id(1);
+    if(x>=width || y>=height)
+        return;
+
+    const int i= x + y * width;
+    float difference= 0.0f;
+    if(x>0 && y>0 && x<width-1 && y<height-1)
+        difference= (data[i - width] + data[i + width] + data[i - 1] + data[i + 1]) / 4.0f - data[i];
+    residual[i]= squared ? difference * difference : fabs(difference);
+}
+
+// Bloqueo temporal: fdmHeatBlocked avanza hasta STEPS pasos de Jacobi por
+// ejecucion. Cada work-group de TILE_X x TILE_Y work-items carga en memoria local
+// un tile de salida de (TILE_X * CELLS_X) x (TILE_Y * CELLS_Y) celdas mas un halo
+// de STEPS celdas de cada lado, y hace los pasos en memoria local. En cada paso la
+// zona valida se achica una celda por lado, y solo se actualiza esa zona, asi que
+// despues de steps <= STEPS pasos el tile de salida es exacto.
+// Cada work-item actualiza varias celdas, asi que el tile de salida es mas grande
+// que el work-group y el halo se reparte entre mas celdas: por celda y paso se leen
+// (1 + halo / tile) / steps celdas de memoria global y se escribe 1 / steps (ver
+// FDMBlockedConfig::trafficReduction en fdmblocked.h).
+// Cada paso hace las mismas operaciones en el mismo orden que fdmHeat, asi que el
+// resultado es identico bit a bit.
+// Se compila con -D STEPS=<k> -D TILE_X=<x> -D TILE_Y=<y> -D CELLS_X=<cx>
+// -D CELLS_Y=<cy>, y se ejecuta con work-groups de TILE_X x TILE_Y y un NDRange
+// de un work-item cada CELLS_X x CELLS_Y celdas.
+#ifdef __IMAGE_SUPPORT__
+#ifndef STEPS
+#define STEPS 4
+#endif
+#ifndef TILE_X
+#define TILE_X 16
+#endif
+#ifndef TILE_Y
+#define TILE_Y 16
+#endif
+#ifndef CELLS_X
+#define CELLS_X 1
+#endif
+#ifndef CELLS_Y
+#define CELLS_Y 1
+#endif
+
+// Tile de salida, tile con halo y celdas del tile con halo por work-item
+#define GROUP_SIZE (TILE_X * TILE_Y)
+#define OUTPUT_W (TILE_X * CELLS_X)
+#define OUTPUT_H (TILE_Y * CELLS_Y)
+#define BLOCK_W (OUTPUT_W + 2 * STEPS)
+#define BLOCK_H (OUTPUT_H + 2 * STEPS)
+#define BLOCK_CELLS (BLOCK_W * BLOCK_H)
+#define ITEM_CELLS ((BLOCK_CELLS + GROUP_SIZE - 1) / GROUP_SIZE)
+
+__kernel __attribute__((reqd_work_group_size(TILE_X, TILE_Y, 1)))
+void fdmHeatBlocked(
+    __read_only image2d_t input,
+    __write_only image2d_t output,
+    int steps)
+{
+    // Un solo tile en memoria local: los valores nuevos de cada paso se guardan en
+    // registros y se escriben despues de que todos leyeron los anteriores
+    __local float block[BLOCK_CELLS];
+
+    const int width= get_image_width(output);
+    const int height= get_image_height(output);
+    const int lid= get_local_id(0) + get_local_id(1) * TILE_X;
+    // Posicion en la imagen de la celda (0, 0) del tile con halo
+    const int originX= get_group_id(0) * OUTPUT_W - STEPS;
+    const int originY= get_group_id(1) * OUTPUT_H - STEPS;
+    const sampler_t sampler= CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+    // Carga del tile con halo. Las celdas fuera de la imagen solo son vecinas de
+    // celdas del borde, que no se actualizan, asi que su valor no importa.
+    for(int i= lid; i<BLOCK_CELLS; i+= GROUP_SIZE)
+        block[i]= read_imagef(input, sampler, (int2)(originX + i % BLOCK_W, originY + i / BLOCK_W)).x;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int s=0; s<steps; s++) {
+        // Zona valida despues de este paso: a mas de s celdas del borde del tile
+        const int lo= s + 1;
+        float next[ITEM_CELLS];
+        for(int j=0; j<ITEM_CELLS; j++) {
+            const int i= lid + j * GROUP_SIZE;
+            const int bx= i % BLOCK_W;
+            const int by= i / BLOCK_W;
+            const int x= originX + bx;
+            const int y= originY + by;
+            // Borde de la imagen (Dirichlet), afuera de la imagen o afuera de la zona
+            // valida: la celda no cambia
+            if(i>=BLOCK_CELLS || bx<lo || by<lo || bx>=BLOCK_W-lo || by>=BLOCK_H-lo ||
+               x<=0 || y<=0 || x>=width-1 || y>=height-1) {
+                next[j]= i<BLOCK_CELLS ? block[i] : 0.0f;
+            } else {
+                float up   = block[i - BLOCK_W];
+                float down = block[i + BLOCK_W];
+                float left = block[i - 1];
+                float right= block[i + 1];
+                next[j]= (up + down + left + right) / 4.0f;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for(int j=0; j<ITEM_CELLS; j++) {
+            const int i= lid + j * GROUP_SIZE;
+            if(i<BLOCK_CELLS)
+                block[i]= next[j];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    // Cada work-item escribe CELLS_X x CELLS_Y celdas del tile de salida, separadas
+    // por el tamanio del work-group para que las escrituras sean contiguas
+    for(int cy=0; cy<CELLS_Y; cy++) {
+        for(int cx=0; cx<CELLS_X; cx++) {
+            const int ox= get_local_id(0) + cx * TILE_X;
+            const int oy= get_local_id(1) + cy * TILE_Y;
+            const int x= originX + STEPS + ox;
+            const int y= originY + STEPS + oy;
+            if(x<width && y<height)
+                write_imagef(output, (int2)(x,y), block[(oy + STEPS) * BLOCK_W + ox + STEPS]);
+        }
+    }
+}
+#endif // __IMAGE_SUPPORT__
@@ -0,0 +1,47 @@
+#include "fdmblocked.h"
+
+#include <sstream>
+
+using namespace std;
+
+// Maximo de celdas por work-item en cada dimension (los registros de cada
+// work-item crecen con el cuadrado)
+static const int maxCells= 4;
+
+bool FDMBlockedConfig::init(int steps, size_t tileX, size_t tileY, cl_ulong localMemSize)
+{
+    this->steps= steps;
+    this->tileX= tileX;
+    this->tileY= tileY;
+    for(cells= maxCells; cells >= 1; cells/= 2) {
+        const size_t blockCells= (outputX() + 2 * steps) * (outputY() + 2 * steps);
+        if(blockCells * sizeof(cl_float) <= localMemSize)
+            return true;
+    }
+    cells= 0;
+    return false;
+}
+
+string FDMBlockedConfig::options() const
+{
+    ostringstream options;
+    options << "-D STEPS=" << steps << " -D TILE_X=" << tileX << " -D TILE_Y=" << tileY
+            << " -D CELLS_X=" << cells << " -D CELLS_Y=" << cells;
+    return options.str();
+}
+
+void FDMBlockedConfig::ndRange(int width, int height, size_t* ndRangeSize) const
+{
+    ndRangeSize[0]= (width + outputX() - 1) / outputX() * tileX;
+    ndRangeSize[1]= (height + outputY() - 1) / outputY() * tileY;
+}
+
+double FDMBlockedConfig::readsPerWrite() const
+{
+    return (double)(outputX() + 2 * steps) * (outputY() + 2 * steps) / (outputX() * outputY());
+}
+
+double FDMBlockedConfig::trafficReduction() const
+{
+    return 2.0 * steps / (readsPerWrite() + 1.0);
+}
@@ -0,0 +1,48 @@
+/*
+ * fdmblocked.h
+ *
+ * Configuracion de fdmHeatBlocked (fdmHeat.cl), el Jacobi con bloqueo temporal
+ * que usan example3 y bench.
+ *
+ * Cada work-group carga en memoria local un tile de salida mas un halo de steps
+ * celdas de cada lado y avanza steps pasos antes de escribir el tile. El halo se
+ * lee una vez por ejecucion, asi que su costo se reparte entre las celdas del
+ * tile: para acercarse a una lectura y una escritura cada steps pasos, cada
+ * work-item actualiza cells x cells celdas y el tile es cells veces mas grande
+ * por lado que el work-group.
+ */
+
+#ifndef FDMBLOCKED_H
+#define FDMBLOCKED_H
+
+#include <CL/cl.h>
+
+#include <string>
+
+struct FDMBlockedConfig {
+    int steps;        // Pasos por ejecucion (ancho del halo)
+    size_t tileX;     // Work-group de tileX x tileY
+    size_t tileY;
+    int cells;        // Celdas por work-item en cada dimension
+
+    // Lados del tile de salida de cada work-group
+    size_t outputX() const { return tileX * cells; }
+    size_t outputY() const { return tileY * cells; }
+
+    // Elige las celdas por work-item (4, 2 o 1) para steps pasos y work-groups de
+    // tileX x tileY: las mas posibles cuyo tile con halo entra en localMemSize bytes.
+    // Devuelve false si ni con una celda por work-item entra
+    bool init(int steps, size_t tileX, size_t tileY, cl_ulong localMemSize);
+
+    // Opciones para compilar fdmHeat.cl
+    std::string options() const;
+    // NDRange para un sistema de width x height
+    void ndRange(int width, int height, size_t* ndRangeSize) const;
+    // Celdas leidas de memoria global por celda escrita (el tile con su halo sobre el tile)
+    double readsPerWrite() const;
+    // Accesos a memoria global por celda y paso de fdmHeat (una lectura y una escritura)
+    // sobre los de fdmHeatBlocked
+    double trafficReduction() const;
+};
+
+#endif // FDMBLOCKED_H
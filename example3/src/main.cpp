@@ -6,28 +6,202 @@
 #include <CL/cl.h>
 // Utilidades propias para OpenCL
 #include "clutils.h"
+#include "clprofiler.h"
+#include "autotuner.h"
+#include "programcache.h"
+#include "reduce.h"
+#include "multigrid.h"
+#include "fdmblocked.h"
+
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 
 // Utilizamos la clase QImage de Qt para cargar y escribir en imagenes .png
 #include <QImage>
 
 using namespace std;
 
+// Maximo de pasos por ejecucion de fdmHeatBlocked (el halo crece con los pasos)
+static const int maxStepsPerLaunch= 16;
+
+// Encola iterations pasos de kernel alternando entre current y next (el "ping
+// pong"). Con stepsPerLaunch > 1 el kernel es fdmHeatBlocked y cada ejecucion
+// avanza hasta stepsPerLaunch pasos (la ultima, los que falten). Al terminar,
+// current es la imagen con el ultimo paso y next la anterior.
+// Devuelve false en caso de error
+static bool simulate(cl_command_queue queue, cl_kernel kernel, const char* name, int stepsPerLaunch,
+                     int iterations, cl_mem& current, cl_mem& next,
+                     const size_t* ndRangeSize, const size_t* workGroupSize)
+{
+    cl_int error= CL_SUCCESS;
+    for(int done=0; done<iterations; done+=stepsPerLaunch) {
+        error |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&current);
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&next);
+        if(stepsPerLaunch > 1) {
+            const cl_int steps= min(stepsPerLaunch, iterations - done);
+            error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&steps);
+        }
+
+        error |= clEnqueueNDRangeKernel(queue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, ProfiledEvent(name));
+        if(checkError(error, "clEnqueueNDRangeKernel"))
+            return false;
+        swap(current, next);
+    }
+    return true;
+}
+
+// Calcula el residuo de la iteracion: ejecuta residualKernel (fdmResidual o
+// fdmResidualBuffer, con sus argumentos ya seteados), que escribe en dResidual el
+// cambio de cada celda, y lo reduce en el dispositivo con reduction: el maximo de
+// los valores absolutos, o con l2 la raiz de la suma de sus cuadrados. Solo se baja
+// el resultado.
+// Devuelve false en caso de error
+static bool residual(cl_command_queue queue, cl_kernel residualKernel, Reduction& reduction, bool l2,
+                     cl_mem dResidual, int cells, const size_t* ndRangeSize, const size_t* workGroupSize,
+                     float& result)
+{
+    CLProfiler& profiler= CLProfiler::instance();
+    cl_int error= clEnqueueNDRangeKernel(queue, residualKernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, ProfiledEvent("fdmResidual"));
+    if(checkError(error, "residual: clEnqueueNDRangeKernel"))
+        return false;
+
+    cl_event partialEvent, finalEvent;
+    if(!reduction.reduce(queue, l2 ? REDUCE_SUM : REDUCE_MAX, REDUCE_FLOAT, dResidual, cells, &result, 0,
+                         &partialEvent, &finalEvent))
+        return false;
+    profiler.record("reduce residuo (1)", partialEvent);
+    profiler.record("reduce residuo (2)", finalEvent);
+    clReleaseEvent(partialEvent);
+    clReleaseEvent(finalEvent);
+    if(l2)
+        result= sqrtf(result);
+    return true;
+}
+
+// Encola iterations iteraciones de fdmHeatRedBlack sobre data, en el lugar: cada
+// iteracion actualiza las celdas rojas y despues las negras, que ya ven los valores
+// nuevos de sus vecinas rojas
+// Devuelve false en caso de error
+static bool relax(cl_command_queue queue, cl_kernel kernel, const char* name, int iterations, cl_mem data,
+                  const size_t* ndRangeSize, const size_t* workGroupSize)
+{
+    cl_int error= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&data);
+    for(int i=0; i<iterations; i++) {
+        for(cl_int color=0; color<2; color++) {
+            error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&color);
+            error |= clEnqueueNDRangeKernel(queue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, ProfiledEvent(name));
+            if(checkError(error, "clEnqueueNDRangeKernel"))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Encola cycles V-cycles de solver sobre data
+// Devuelve false en caso de error
+static bool vCycles(cl_command_queue queue, Multigrid& solver, int cycles, cl_mem data)
+{
+    for(int i=0; i<cycles; i++)
+        if(!solver.enqueueVCycle(queue, data))
+            return false;
+    return true;
+}
 
 int main(int argc, char *argv[])
 {
+    // Procesar --device y --list-devices (seleccion del dispositivo OpenCL)
+    parseDeviceArgs(argc, argv);
+    // Los tiempos de los comandos se registran siempre; --trace=<archivo> ademas
+    // escribe el timeline en formato Chrome tracing
+    CLProfiler& profiler= CLProfiler::instance();
+    profiler.setEnabled(true);
+    profiler.parseArgs(argc, argv);
+
+    // --solver elige Jacobi (fdmHeat, con dos imagenes), Gauss-Seidel o SOR rojo-negro
+    // (fdmHeatRedBlack, en el lugar sobre un solo buffer) con factor de relajacion --omega,
+    // o multigrid (V-cycles de multigrid.cl sobre un buffer; cada iteracion es un ciclo)
+    const char* solverValue= 0;
+    const char* omegaValue= 0;
+    extractArg(argc, argv, "--solver", &solverValue);
+    extractArg(argc, argv, "--omega", &omegaValue);
+    const bool jacobi= !solverValue or strcmp(solverValue, "jacobi") == 0;
+    const bool sor= solverValue and strcmp(solverValue, "sor") == 0;
+    const bool gaussSeidel= solverValue and strcmp(solverValue, "gs") == 0;
+    const bool multigrid= solverValue and strcmp(solverValue, "mg") == 0;
+    // --steps=k avanza k pasos por ejecucion con fdmHeatBlocked (bloqueo temporal), y
+    // --verify compara el resultado con el de fdmHeat de a un paso
+    const char* stepsValue;
+    int stepsPerLaunch= 1;
+    if(extractArg(argc, argv, "--steps", &stepsValue))
+        stepsPerLaunch= stepsValue ? atoi(stepsValue) : 4;
+    const bool verify= extractArg(argc, argv, "--verify");
+    // --tolerance=t termina cuando el residuo de una iteracion es menor a t (iterations
+    // pasa a ser el maximo), midiendolo cada --check-every=N iteraciones con la norma
+    // --norm=max|l2
+    const char* toleranceValue= 0;
+    const char* checkValue= 0;
+    const char* normValue= 0;
+    const bool converge= extractArg(argc, argv, "--tolerance", &toleranceValue);
+    extractArg(argc, argv, "--check-every", &checkValue);
+    extractArg(argc, argv, "--norm", &normValue);
+    const float tolerance= toleranceValue ? atof(toleranceValue) : 1.0e-6f;
+    const int checkEvery= checkValue ? atoi(checkValue) : (multigrid ? 1 : 100);
+    const bool l2= normValue and strcmp(normValue, "l2") == 0;
+    if(stepsPerLaunch < 1 or stepsPerLaunch > maxStepsPerLaunch or argc > 2 or checkEvery < 1 or
+       (normValue and !l2 and strcmp(normValue, "max") != 0) or (!jacobi and !sor and !gaussSeidel and !multigrid) or
+       (!jacobi and (stepsPerLaunch > 1 or verify))) {
+        cerr << "usage: ./example3 [iterations] [--solver=jacobi|gs|sor|mg] [--omega=w] [--steps=k] [--verify]"
+                " [--tolerance=t] [--check-every=N] [--norm=max|l2] [--device=<spec>] [--list-devices] [--trace=<file>]" << endl;
+        cerr << "k entre 1 y " << maxStepsPerLaunch << "; --steps y --verify solo con jacobi" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* solverName= jacobi ? (stepsPerLaunch > 1 ? "fdmHeatBlocked" : "fdmHeat") :
+                            (sor ? "fdmHeatRedBlack SOR" : gaussSeidel ? "fdmHeatRedBlack GS" : "multigrid V-cycle");
+
     cl_context clContext;
     cl_command_queue clQueue;
     cl_device_id clDevice;
-    cl_kernel kernel;
+    cl_kernel kernel= NULL;
+    CLDeviceInfo deviceInfo;
 
     cerr << "Configurando OpenCL." << endl;
-    if(!setupOpenCL(clContext, clQueue, clDevice))
+    if(!setupOpenCL(clContext, clQueue, clDevice, &deviceInfo, jacobi ? DEVICE_REQUIRE_IMAGES : 0))
         return EXIT_FAILURE;
 
     cerr << "Cargando programa." << endl;
-    if(!loadKernel(clContext, &kernel, clDevice, "../src/fdmHeat.cl", "fdmHeat"))
+    if(!multigrid and !loadKernel(clContext, &kernel, clDevice, "../src/fdmHeat.cl", jacobi ? "fdmHeat" : "fdmHeatRedBlack"))
         return EXIT_FAILURE;
 
+    // fdmHeatBlocked se compila con la cantidad de pasos, la forma del work-group y
+    // las celdas por work-item, que fijan el tamanio del tile en memoria local
+    cl_program blockedProgram= NULL;
+    cl_kernel blockedKernel= NULL;
+    FDMBlockedConfig blocked;
+    if(stepsPerLaunch > 1) {
+        const size_t tileX= 16;
+        const size_t tileY= deviceInfo.maxWorkGroupSize >= 256 ? 16 : 8;
+        if(!blocked.init(stepsPerLaunch, tileX, tileY, deviceInfo.localMemSize)) {
+            cerr << "fdmHeatBlocked: el tile con " << stepsPerLaunch << " pasos no entra en la memoria local." << endl;
+            return EXIT_FAILURE;
+        }
+        cl_int error;
+        if(!loadProgram(clContext, &blockedProgram, clDevice, "../src/fdmHeat.cl", blocked.options().c_str()))
+            return EXIT_FAILURE;
+        blockedKernel= clCreateKernel(blockedProgram, "fdmHeatBlocked", &error);
+        if(checkError(error, "clCreateKernel"))
+            return EXIT_FAILURE;
+    }
+    // fdmResidual (o fdmResidualBuffer) y la reduccion del residuo, solo si se busca la convergencia
+    cl_kernel residualKernel= NULL;
+    Reduction reduction;
+    if(converge and (!loadKernel(clContext, &residualKernel, clDevice, "../src/fdmHeat.cl",
+                                 jacobi ? "fdmResidual" : "fdmResidualBuffer") or
+                     !reduction.init(clContext, clDevice)))
+        return EXIT_FAILURE;
+    printProgramCacheStats();
+
     /// Cargar estado inicial del sistema de una imagen
     // Cada pixel va a representar una celda de la simulacion
     cerr << "Cargando imagen de entrada." << endl;
@@ -38,10 +212,14 @@ int main(int argc, char *argv[])
     }
     
     // Paramatros de la simulacion
-    const int iterations= argc==2 ? atoi(argv[1]) : 1000;
+    const int iterations= argc==2 ? atoi(argv[1]) : (multigrid ? 20 : 1000);
     const int width= inputImage.width();
     const int height= inputImage.height();
     const int bytes= width * height * sizeof(float); // Tamanio en bytes del sistema
+    // Factor de relajacion: 1 es Gauss-Seidel; para SOR, por defecto el optimo para el
+    // problema de Laplace en una grilla de lado max(width, height)
+    const float omega= gaussSeidel ? 1.0f :
+                       omegaValue ? atof(omegaValue) : 2.0f / (1.0f + sinf(M_PI / max(width, height)));
 
     /// Alocacion de memoria
     cerr << "Reservando memoria." << endl;
@@ -49,21 +227,30 @@ int main(int argc, char *argv[])
     // hInput: Entrada y salida en el host (usamos el mismo buffer)
     float* hData= (float*)malloc(bytes);
 
-    // El sistema se almacena en la memoria del GPU como un "imagen de un canal" (matriz 2D)
-    // con elementos de tipo float
-    // Reservamos dos buffers para usar la tecnica de "ping pong"
+    // Con Jacobi el sistema se almacena en la memoria del GPU como un "imagen de un
+    // canal" (matriz 2D) con elementos de tipo float, y reservamos dos para usar la
+    // tecnica de "ping pong". Gauss-Seidel, SOR y multigrid actualizan un solo buffer
+    // en el lugar; multigrid ademas reserva sus niveles gruesos.
     cl_image_format format;
     format.image_channel_data_type= CL_FLOAT;
     format.image_channel_order= CL_INTENSITY;
-    cl_int error1, error2;
-    cl_mem dData1= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error1);
-    cl_mem dData2= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error2);
+    cl_int error1= CL_SUCCESS, error2= CL_SUCCESS;
+    cl_mem dData1, dData2= NULL;
+    if(jacobi) {
+        dData1= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error1);
+        dData2= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error2);
+    } else {
+        dData1= clCreateBuffer(clContext, CL_MEM_READ_WRITE, bytes, NULL, &error1);
+    }
 
     //  Verificar que se pudo reservar toda memoria
     if(!hData or checkError(error1, "clCreateImage2D") or checkError(error2, "clCreateImage2D")) {
         cerr << "Error al reservar memoria." << endl;
         return EXIT_FAILURE;
     }
+    Multigrid solver;
+    if(multigrid and !solver.init(clContext, clDevice, width, height))
+        return EXIT_FAILURE;
 
     /// Computo
     // Convertir los pixels de inputImage a los floats de hData
@@ -72,42 +259,158 @@ int main(int argc, char *argv[])
         for(int x=0; x<width; x++)
             hData[x + y * width]= qRed(inputImage.pixel(x, y)) / 255.0f;
 
+    // Work group y NDRange, elegidos por el autotuner. Para Jacobi con los parametros
+    // de la primera iteracion (dData1 -> dData2, que no modifica la entrada);
+    // fdmHeatBlocked declara su tamanio de work-group y cada work-item actualiza varias
+    // celdas, asi que no se mide y su NDRange sale de la configuracion del tile.
+    // fdmHeatRedBlack modifica el buffer, asi que se mide antes de subir los datos, y
+    // cada work-item actualiza una de las dos celdas de un par de columnas. Multigrid
+    // elige los tamanios de sus kernels.
+    cl_int error= CL_SUCCESS;
+    cl_kernel solverKernel= blockedKernel ? blockedKernel : kernel;
+    const cl_int oneStep= 1;
+    const cl_int color= 0;
+    if(jacobi) {
+        error |= clSetKernelArg(solverKernel, 0, sizeof(cl_mem), (void*)&dData1);
+        error |= clSetKernelArg(solverKernel, 1, sizeof(cl_mem), (void*)&dData2);
+        if(blockedKernel)
+            error |= clSetKernelArg(solverKernel, 2, sizeof(cl_int), (void*)&oneStep);
+    } else if(!multigrid) {
+        error |= clSetKernelArg(solverKernel, 0, sizeof(cl_mem), (void*)&dData1);
+        error |= clSetKernelArg(solverKernel, 1, sizeof(cl_int), (void*)&width);
+        error |= clSetKernelArg(solverKernel, 2, sizeof(cl_int), (void*)&height);
+        error |= clSetKernelArg(solverKernel, 3, sizeof(cl_int), (void*)&color);
+        error |= clSetKernelArg(solverKernel, 4, sizeof(cl_float), (void*)&omega);
+    }
+    const size_t problemSize[2] = { (size_t)width, (size_t)height };
+    const size_t redBlackSize[2] = { (size_t)(width + 1) / 2, (size_t)height };
+    size_t workGroupSize[2], ndRangeSize[2];
+    if(blockedKernel) {
+        workGroupSize[0]= blocked.tileX;
+        workGroupSize[1]= blocked.tileY;
+        blocked.ndRange(width, height, ndRangeSize);
+    }
+    if(!multigrid and (checkError(error, "clSetKernelArg") or
+                       (!blockedKernel and
+                        !tuneNDRange(clQueue, solverKernel, 2, jacobi ? problemSize : redBlackSize, workGroupSize, ndRangeSize))))
+        return EXIT_FAILURE;
+    // fdmResidual y fdmResidualBuffer recorren todas las celdas y escriben el cambio de
+    // cada una en dResidual. Sus argumentos son fijos salvo con Jacobi, donde las
+    // imagenes se intercambian.
+    cl_mem dResidual= NULL;
+    size_t residualGroup[2], residualRange[2];
+    if(converge) {
+        const cl_int squared= l2 ? 1 : 0;
+        dResidual= clCreateBuffer(clContext, CL_MEM_READ_WRITE, bytes, NULL, &error);
+        if(checkError(error, "clCreateBuffer"))
+            return EXIT_FAILURE;
+        error |= clSetKernelArg(residualKernel, 0, sizeof(cl_mem), (void*)&dData1);
+        if(jacobi) {
+            error |= clSetKernelArg(residualKernel, 1, sizeof(cl_mem), (void*)&dData2);
+            error |= clSetKernelArg(residualKernel, 2, sizeof(cl_mem), (void*)&dResidual);
+            error |= clSetKernelArg(residualKernel, 3, sizeof(cl_int), (void*)&squared);
+        } else {
+            error |= clSetKernelArg(residualKernel, 1, sizeof(cl_int), (void*)&width);
+            error |= clSetKernelArg(residualKernel, 2, sizeof(cl_int), (void*)&height);
+            error |= clSetKernelArg(residualKernel, 3, sizeof(cl_mem), (void*)&dResidual);
+            error |= clSetKernelArg(residualKernel, 4, sizeof(cl_int), (void*)&squared);
+        }
+        if(checkError(error, "clSetKernelArg") or
+           !tuneNDRange(clQueue, residualKernel, 2, problemSize, residualGroup, residualRange))
+            return EXIT_FAILURE;
+    }
+
     // Subir los datos de hData a dData1
-    cl_int error;
     size_t origin[3] = {0, 0, 0};
     size_t region[3] = {width, height, 1};
-    error= clEnqueueWriteImage(clQueue, dData1, CL_FALSE, origin, region, 0, 0, hData, 0, NULL, NULL);
+    if(jacobi)
+        error= clEnqueueWriteImage(clQueue, dData1, CL_FALSE, origin, region, 0, 0, hData, 0, NULL, ProfiledEvent("subida sistema"));
+    else
+        error= clEnqueueWriteBuffer(clQueue, dData1, CL_FALSE, 0, bytes, hData, 0, NULL, ProfiledEvent("subida sistema"));
     if(checkError(error, "clEnqueueWriteImage"))
         return EXIT_FAILURE;
 
-    // Ejecutar el kernel
-    // Work group y NDRange
-    size_t workGroupSize[2] = { 16, 16 };
-    size_t ndRangeSize[2];
-    ndRangeSize[0]= roundUp(width, workGroupSize[0]);
-    ndRangeSize[1]= roundUp(height, workGroupSize[1]);
-
     // Setean los parametros del kernel, y luego se encola su ejecucion
     cerr << "Ejecutando kernel." << endl;
-    bool even=false;
-    for(int i=0; i<iterations; i++) {
-        even= !(i % 2); // true cuando i es par
-
-        // Cuando no es par, invertimos el orden de los parametros del kernel
-        error |= clSetKernelArg(kernel, (even ? 0 : 1), sizeof(cl_mem), (void*)&dData1);
-        error |= clSetKernelArg(kernel, (even ? 1 : 0), sizeof(cl_mem), (void*)&dData2);
-
-        error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, NULL);
-        if(checkError(error, "clEnqueueNDRangeKernel"))
+    cl_mem dResult= dData1;
+    cl_mem dPrevious= dData2;
+    int performed= 0;
+    float lastResidual= -1;
+    if(!converge) {
+        if(jacobi ? !simulate(clQueue, solverKernel, solverName, stepsPerLaunch, iterations, dResult, dPrevious,
+                              ndRangeSize, workGroupSize) :
+           multigrid ? !vCycles(clQueue, solver, iterations, dResult) :
+           !relax(clQueue, solverKernel, solverName, iterations, dResult, ndRangeSize, workGroupSize))
             return EXIT_FAILURE;
+        performed= iterations;
+    } else {
+        // Con Jacobi, cada checkEvery pasos el ultimo se ejecuta solo, para que las dos
+        // imagenes sean pasos consecutivos, y se mide la diferencia entre ellas. Con
+        // Gauss-Seidel y SOR se mide lo que cambiaria cada celda con un paso de Jacobi
+        // (el promedio de sus vecinas menos su valor), que con Jacobi es lo mismo.
+        while(performed < iterations and !(lastResidual >= 0 and lastResidual < tolerance)) {
+            const int chunk= min(checkEvery, iterations - performed);
+            if(jacobi) {
+                if(!simulate(clQueue, solverKernel, solverName, stepsPerLaunch, chunk - 1, dResult, dPrevious,
+                             ndRangeSize, workGroupSize) or
+                   !simulate(clQueue, solverKernel, solverName, stepsPerLaunch, 1, dResult, dPrevious,
+                             ndRangeSize, workGroupSize))
+                    return EXIT_FAILURE;
+                error  = clSetKernelArg(residualKernel, 0, sizeof(cl_mem), (void*)&dPrevious);
+                error |= clSetKernelArg(residualKernel, 1, sizeof(cl_mem), (void*)&dResult);
+                if(checkError(error, "clSetKernelArg"))
+                    return EXIT_FAILURE;
+            } else if(multigrid ? !vCycles(clQueue, solver, chunk, dResult) :
+                                  !relax(clQueue, solverKernel, solverName, chunk, dResult, ndRangeSize, workGroupSize)) {
+                return EXIT_FAILURE;
+            }
+            if(!residual(clQueue, residualKernel, reduction, l2, dResidual, width * height,
+                         residualRange, residualGroup, lastResidual))
+                return EXIT_FAILURE;
+            performed+= chunk;
+        }
+        clReleaseMemObject(dResidual);
     }
 
     /// Bajar resultados
-    // Dependiendo de si la ultima iteracion fue par o no, bajamos de dData2 o dData1
-    error= clEnqueueReadImage(clQueue, (even ? dData1 : dData2), CL_TRUE, origin, region, 0, 0, hData, 0, NULL, NULL);
+    if(jacobi)
+        error= clEnqueueReadImage(clQueue, dResult, CL_TRUE, origin, region, 0, 0, hData, 0, NULL, ProfiledEvent("bajada sistema"));
+    else
+        error= clEnqueueReadBuffer(clQueue, dResult, CL_TRUE, 0, bytes, hData, 0, NULL, ProfiledEvent("bajada sistema"));
     if(checkError(error, "clEnqueueReadImage"))
         return EXIT_FAILURE;
 
+    // Verificacion: se repite la simulacion desde el estado inicial con fdmHeat de a
+    // un paso. fdmHeatBlocked hace las mismas operaciones en el mismo orden, asi que
+    // se espera una diferencia de 0.
+    float maxDifference= 0;
+    int differentCells= 0;
+    if(verify) {
+        cerr << "Verificando con fdmHeat." << endl;
+        float* hReference= (float*)malloc(bytes);
+        for(int y=0; y<height; y++)
+            for(int x=0; x<width; x++)
+                hReference[x + y * width]= qRed(inputImage.pixel(x, y)) / 255.0f;
+        error= clEnqueueWriteImage(clQueue, dData1, CL_FALSE, origin, region, 0, 0, hReference, 0, NULL, ProfiledEvent("subida sistema"));
+        if(checkError(error, "clEnqueueWriteImage"))
+            return EXIT_FAILURE;
+        size_t referenceGroup[2], referenceRange[2];
+        dResult= dData1;
+        dPrevious= dData2;
+        if(!tuneNDRange(clQueue, kernel, 2, problemSize, referenceGroup, referenceRange) or
+           !simulate(clQueue, kernel, "fdmHeat", 1, performed, dResult, dPrevious, referenceRange, referenceGroup))
+            return EXIT_FAILURE;
+        error= clEnqueueReadImage(clQueue, dResult, CL_TRUE, origin, region, 0, 0, hReference, 0, NULL, ProfiledEvent("bajada sistema"));
+        if(checkError(error, "clEnqueueReadImage"))
+            return EXIT_FAILURE;
+        for(int i=0; i<width * height; i++) {
+            if(hData[i] != hReference[i])
+                differentCells++;
+            maxDifference= max(maxDifference, fabsf(hData[i] - hReference[i]));
+        }
+        free(hReference);
+    }
+
     // Convertir los floats del sistema a pixels, utilizando una paleta de colores
     QImage palette("palette.png");
     if(palette.isNull()) {
@@ -127,11 +430,46 @@ int main(int argc, char *argv[])
     }
     outputImage.save("output.png");
 
-    cerr << "Iterations     : " << iterations << endl;
+    cerr << "Solver         : " << solverName;
+    if(sor or gaussSeidel)
+        cerr << " (omega " << omega << ")";
+    if(multigrid)
+        cerr << " (" << solver.levelCount() << " niveles)";
+    cerr << endl;
+    cerr << "Iterations     : " << performed << endl;
+    if(converge)
+        cerr << "Residual (" << (l2 ? "l2" : "max") << ")  : " << lastResidual
+             << (lastResidual < tolerance ? " < " : " >= ") << tolerance
+             << (lastResidual < tolerance ? ", convergio" : ", no convergio") << endl;
+    if(jacobi)
+        cerr << "Steps/launch   : " << stepsPerLaunch << endl;
+    if(blockedKernel)
+        cerr << "Cells/item     : " << blocked.cells << "x" << blocked.cells << " (tile " << blocked.outputX() << "x"
+             << blocked.outputY() << "), reads/write " << blocked.readsPerWrite() << ", global traffic 1/"
+             << blocked.trafficReduction() << " of fdmHeat" << endl;
     cerr << "System size    : (" << width << ", " << height << ")" << endl;
     cerr << "System cells   : " << width * height << " -> ~" << bytes/1024 << " KiB" << endl;
-    cerr << "Work-group size: (" << workGroupSize[0] << ", " << workGroupSize[1] << ")" << endl;
-    cerr << "ND-Range size  : (" << ndRangeSize[0] << ", " << ndRangeSize[1] << ")" << endl;
+    if(!multigrid) {
+        cerr << "Work-group size: (" << workGroupSize[0] << ", " << workGroupSize[1] << ")" << endl;
+        cerr << "ND-Range size  : (" << ndRangeSize[0] << ", " << ndRangeSize[1] << ")" << endl;
+    }
+    if(verify)
+        cerr << "Verification   : " << differentCells << " celdas distintas, diferencia maxima " << maxDifference << endl;
+    profiler.finish();
+
+    if(blockedKernel) {
+        clReleaseKernel(blockedKernel);
+        clReleaseProgram(blockedProgram);
+    }
+    if(residualKernel)
+        clReleaseKernel(residualKernel);
+    if(kernel)
+        clReleaseKernel(kernel);
+    solver.release();
+    clReleaseMemObject(dData1);
+    if(dData2)
+        clReleaseMemObject(dData2);
+    free(hData);
 
     cerr << "Fin." << endl;
     
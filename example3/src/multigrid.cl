@@ -0,0 +1,147 @@
+
+// Multigrid geometrico para el sistema de fdmHeat (ver multigrid.h). Cada nivel
+// resuelve 4 * u - (up + down + left + right) = rhs en su interior con el borde
+// fijo (Condicion de frontera de Dirichlet): en el nivel 0 rhs es 0 (el sistema
+// de fdmHeat) y en los siguientes es el residuo restringido, con borde 0. rhs
+// puede ser NULL, equivalente a un buffer de ceros.
+// El nivel grueso de uno de width x height tiene width / 2 + 1 x height / 2 + 1
+// celdas: la celda (X, Y) gruesa coincide con la (2 * X, 2 * Y) fina, salvo la
+// ultima columna y fila gruesas, que son el borde del nivel fino. Asi las grillas
+// quedan anidadas con cualquier tamanio, pero la distancia entre la ultima celda
+// interior y el borde derecho (o inferior) de un nivel no siempre es una celda:
+// es lastX (o lastY) veces el paso del nivel. El operador se discretiza con
+// volumenes finitos con esas distancias (stencilAt), y la interpolacion las usa
+// como pesos (coarseWeight). En el nivel 0 lastX y lastY son 1.
+
+// Pesos de los vecinos izquierdo, derecho, superior (i - width) e inferior de la
+// celda interior (x, y). Son 1 salvo junto al borde derecho o inferior.
+float4 stencilAt(int x, int y, int width, int height, float lastX, float lastY)
+{
+    const float right= x == width - 2 ? lastX : 1.0f;
+    const float down= y == height - 2 ? lastY : 1.0f;
+    // Lados del volumen de control de la celda
+    const float sizeX= 0.5f * (1.0f + right);
+    const float sizeY= 0.5f * (1.0f + down);
+    return (float4)(sizeY, sizeY / right, sizeX, sizeX / down);
+}
+
+// Peso de la celda gruesa anterior (x - 1) / 2 en la interpolacion de la celda fina
+// impar x: 1/2, salvo en la ultima celda interior de un lado impar, donde la celda
+// gruesa siguiente es el borde, a last de distancia en lugar de 1
+float coarseWeight(int x, int width, float last)
+{
+    return x == width - 2 && (width & 1) ? last / (1.0f + last) : 0.5f;
+}
+
+// Gauss-Seidel rojo-negro en el lugar sobre las celdas de color color (x + y par
+// para 0, impar para 1), como fdmHeatRedBlack pero con termino independiente (y
+// con los pesos de stencilAt, que en el nivel 0 son todos 1).
+// Cada work-item actualiza la celda de su color en el par de columnas 2 * x y
+// 2 * x + 1.
+__kernel void mgSmooth(
+    __global float* u,
+    __global const float* rhs,
+    int width,
+    int height,
+    float lastX,
+    float lastY,
+    int color)
+{
+    int y= get_global_id(1);
+    int x= 2 * get_global_id(0) + ((y + color) & 1);
+
+    if(x<=0 || y<=0 || x>=width-1 || y>=height-1)
+        return;
+
+    const int i= x + y * width;
+    const float4 w= stencilAt(x, y, width, height, lastX, lastY);
+    float sum= w.x * u[i - 1] + w.y * u[i + 1] + w.z * u[i - width] + w.w * u[i + width];
+    if(rhs)
+        sum+= rhs[i];
+    u[i]= sum / (w.x + w.y + w.z + w.w);
+}
+
+// Residuo de la celda (x, y) de un nivel: 0 en el borde
+float residualAt(__global const float* u, __global const float* rhs, int width, int height,
+                 float lastX, float lastY, int x, int y)
+{
+    if(x<=0 || y<=0 || x>=width-1 || y>=height-1)
+        return 0.0f;
+
+    const int i= x + y * width;
+    const float4 w= stencilAt(x, y, width, height, lastX, lastY);
+    float r= w.x * u[i - 1] + w.y * u[i + 1] + w.z * u[i - width] + w.w * u[i + width]
+           - (w.x + w.y + w.z + w.w) * u[i];
+    if(rhs)
+        r+= rhs[i];
+    return r;
+}
+
+// Calcula el residuo del nivel fino y lo restringe al grueso con la traspuesta de
+// la interpolacion de mgProlong: ponderacion completa (pesos 4 al centro, 2 a los
+// lados y 1 a las esquinas, sobre 16) multiplicada por 4, porque el paso de la
+// grilla gruesa es el doble, y con el peso de coarseWeight para la celda fina
+// siguiente. Tambien pone en 0 la correccion gruesa, que es la estimacion inicial
+// del nivel siguiente.
+__kernel void mgRestrict(
+    __global const float* u,
+    __global const float* rhs,
+    int width,
+    int height,
+    float lastX,
+    float lastY,
+    __global float* coarseU,
+    __global float* coarseRhs,
+    int coarseWidth,
+    int coarseHeight)
+{
+    int x= get_global_id(0);
+    int y= get_global_id(1);
+    if(x>=coarseWidth || y>=coarseHeight)
+        return;
+
+    const int i= x + y * coarseWidth;
+    coarseU[i]= 0.0f;
+    if(x==0 || y==0 || x==coarseWidth-1 || y==coarseHeight-1) {
+        coarseRhs[i]= 0.0f;
+        return;
+    }
+
+    const int fx= 2 * x;
+    const int fy= 2 * y;
+    const float weightsX[3] = { 0.5f, 1.0f, coarseWeight(fx + 1, width, lastX) };
+    const float weightsY[3] = { 0.5f, 1.0f, coarseWeight(fy + 1, height, lastY) };
+    float sum= 0.0f;
+    for(int dy=0; dy<3; dy++)
+        for(int dx=0; dx<3; dx++)
+            sum+= weightsX[dx] * weightsY[dy] * residualAt(u, rhs, width, height, lastX, lastY, fx + dx - 1, fy + dy - 1);
+    coarseRhs[i]= sum;
+}
+
+// Interpola bilinealmente la correccion del nivel grueso y la suma al interior del
+// nivel fino. Las celdas finas pares toman el valor de su celda gruesa, y las
+// impares el promedio (con los pesos de coarseWeight) de las dos (o cuatro)
+// gruesas que las rodean.
+__kernel void mgProlong(
+    __global float* u,
+    int width,
+    int height,
+    float lastX,
+    float lastY,
+    __global const float* coarseU,
+    int coarseWidth)
+{
+    int x= get_global_id(0);
+    int y= get_global_id(1);
+    if(x<=0 || y<=0 || x>=width-1 || y>=height-1)
+        return;
+
+    const int i= x / 2 + (y / 2) * coarseWidth;
+    const int dx= x & 1;
+    const int dy= (y & 1) * coarseWidth;
+    const float wx= dx ? coarseWeight(x, width, lastX) : 1.0f;
+    const float wy= dy ? coarseWeight(y, height, lastY) : 1.0f;
+    const float correction= wy * (wx * coarseU[i] + (1.0f - wx) * coarseU[i + dx])
+                          + (1.0f - wy) * (wx * coarseU[i + dy] + (1.0f - wx) * coarseU[i + dx + dy]);
+    u[x + y * width]+= correction;
+}
@@ -0,0 +1,200 @@
+#include "multigrid.h"
+#include "clutils.h"
+#include "clprofiler.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// Los niveles se achican mientras los dos lados sean mayores a este
+static const int coarsestSide= 8;
+// Iteraciones de Gauss-Seidel en el nivel mas grueso (de a lo sumo 8 celdas de
+// lado, donde convergen rapido) en lugar de seguir bajando
+static const int coarsestIterations= 32;
+
+Multigrid::Multigrid()
+{
+    program= NULL;
+    smoothKernel= NULL;
+    restrictKernel= NULL;
+    prolongKernel= NULL;
+    workGroupSize[0]= 1;
+    workGroupSize[1]= 1;
+    preSmooth= 2;
+    postSmooth= 2;
+}
+
+bool Multigrid::init(cl_context context, cl_device_id device, int width, int height,
+                     int preSmooth, int postSmooth, const char* path)
+{
+    release();
+    this->preSmooth= preSmooth;
+    this->postSmooth= postSmooth;
+
+    if(!loadProgram(context, &program, device, path))
+        return false;
+    cl_int error;
+    smoothKernel= clCreateKernel(program, "mgSmooth", &error);
+    if(checkError(error, "Multigrid: clCreateKernel"))
+        return false;
+    restrictKernel= clCreateKernel(program, "mgRestrict", &error);
+    if(checkError(error, "Multigrid: clCreateKernel"))
+        return false;
+    prolongKernel= clCreateKernel(program, "mgProlong", &error);
+    if(checkError(error, "Multigrid: clCreateKernel"))
+        return false;
+
+    // Los kernels se lanzan muchas veces sobre niveles de tamanios distintos (y
+    // modifican los datos), asi que no se pasan por el autotuner: work-groups de
+    // 16x8, o mas chicos si alguno de los kernels no los admite
+    size_t maxSize= 16 * 8;
+    cl_kernel kernels[3] = { smoothKernel, restrictKernel, prolongKernel };
+    for(int k=0; k<3; k++) {
+        size_t kernelMax;
+        error= clGetKernelWorkGroupInfo(kernels[k], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelMax, NULL);
+        if(checkError(error, "Multigrid: clGetKernelWorkGroupInfo"))
+            return false;
+        maxSize= min(maxSize, kernelMax);
+    }
+    workGroupSize[0]= 16;
+    workGroupSize[1]= 8;
+    while(workGroupSize[0] * workGroupSize[1] > maxSize) {
+        if(workGroupSize[1] > 1)
+            workGroupSize[1]/= 2;
+        else
+            workGroupSize[0]/= 2;
+    }
+
+    // Nivel 0: el sistema. Los niveles gruesos tienen width / 2 + 1 x height / 2 + 1,
+    // con el borde del nivel anterior como ultima columna y fila (ver multigrid.cl)
+    Level level;
+    level.width= width;
+    level.height= height;
+    level.lastX= 1.0f;
+    level.lastY= 1.0f;
+    level.u= NULL;
+    level.rhs= NULL;
+    levels.push_back(level);
+    while(level.width > coarsestSide and level.height > coarsestSide) {
+        // Con un lado impar la celda gruesa anterior al borde es la penultima fina,
+        // a 1 + last celdas finas del borde; con uno par es la ultima interior, a last
+        level.lastX= level.width % 2 ? (1.0f + level.lastX) / 2 : level.lastX / 2;
+        level.lastY= level.height % 2 ? (1.0f + level.lastY) / 2 : level.lastY / 2;
+        level.width= level.width / 2 + 1;
+        level.height= level.height / 2 + 1;
+        const size_t bytes= (size_t)level.width * level.height * sizeof(float);
+        cl_int error1, error2;
+        level.u= clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &error1);
+        level.rhs= clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &error2);
+        if(checkError(error1, "Multigrid: clCreateBuffer") or checkError(error2, "Multigrid: clCreateBuffer"))
+            return false;
+        levels.push_back(level);
+    }
+
+    return true;
+}
+
+bool Multigrid::smooth(cl_command_queue queue, const Level& level, int iterations)
+{
+    const size_t ndRangeSize[2] = { (size_t)roundUp((level.width + 1) / 2, workGroupSize[0]),
+                                    (size_t)roundUp(level.height, workGroupSize[1]) };
+    cl_int error= CL_SUCCESS;
+    error |= clSetKernelArg(smoothKernel, 0, sizeof(cl_mem), (void*)&level.u);
+    error |= clSetKernelArg(smoothKernel, 1, sizeof(cl_mem), (void*)&level.rhs);
+    error |= clSetKernelArg(smoothKernel, 2, sizeof(cl_int), (void*)&level.width);
+    error |= clSetKernelArg(smoothKernel, 3, sizeof(cl_int), (void*)&level.height);
+    error |= clSetKernelArg(smoothKernel, 4, sizeof(cl_float), (void*)&level.lastX);
+    error |= clSetKernelArg(smoothKernel, 5, sizeof(cl_float), (void*)&level.lastY);
+    for(int i=0; i<iterations; i++) {
+        for(cl_int color=0; color<2; color++) {
+            error |= clSetKernelArg(smoothKernel, 6, sizeof(cl_int), (void*)&color);
+            error |= clEnqueueNDRangeKernel(queue, smoothKernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, ProfiledEvent("mgSmooth"));
+            if(checkError(error, "Multigrid: clEnqueueNDRangeKernel"))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool Multigrid::vCycle(cl_command_queue queue, int index)
+{
+    const Level& fine= levels[index];
+    if(index == (int)levels.size() - 1)
+        return smooth(queue, fine, coarsestIterations);
+
+    const Level& coarse= levels[index + 1];
+    if(!smooth(queue, fine, preSmooth))
+        return false;
+
+    // Residuo del nivel fino -> termino independiente del grueso, con correccion inicial 0
+    const size_t coarseRange[2] = { (size_t)roundUp(coarse.width, workGroupSize[0]),
+                                    (size_t)roundUp(coarse.height, workGroupSize[1]) };
+    cl_int error= CL_SUCCESS;
+    error |= clSetKernelArg(restrictKernel, 0, sizeof(cl_mem), (void*)&fine.u);
+    error |= clSetKernelArg(restrictKernel, 1, sizeof(cl_mem), (void*)&fine.rhs);
+    error |= clSetKernelArg(restrictKernel, 2, sizeof(cl_int), (void*)&fine.width);
+    error |= clSetKernelArg(restrictKernel, 3, sizeof(cl_int), (void*)&fine.height);
+    error |= clSetKernelArg(restrictKernel, 4, sizeof(cl_float), (void*)&fine.lastX);
+    error |= clSetKernelArg(restrictKernel, 5, sizeof(cl_float), (void*)&fine.lastY);
+    error |= clSetKernelArg(restrictKernel, 6, sizeof(cl_mem), (void*)&coarse.u);
+    error |= clSetKernelArg(restrictKernel, 7, sizeof(cl_mem), (void*)&coarse.rhs);
+    error |= clSetKernelArg(restrictKernel, 8, sizeof(cl_int), (void*)&coarse.width);
+    error |= clSetKernelArg(restrictKernel, 9, sizeof(cl_int), (void*)&coarse.height);
+    error |= clEnqueueNDRangeKernel(queue, restrictKernel, 2, NULL, coarseRange, workGroupSize, 0, NULL, ProfiledEvent("mgRestrict"));
+    if(checkError(error, "Multigrid: clEnqueueNDRangeKernel"))
+        return false;
+
+    if(!vCycle(queue, index + 1))
+        return false;
+
+    // Sumar la correccion interpolada al nivel fino
+    const size_t fineRange[2] = { (size_t)roundUp(fine.width, workGroupSize[0]),
+                                  (size_t)roundUp(fine.height, workGroupSize[1]) };
+    error |= clSetKernelArg(prolongKernel, 0, sizeof(cl_mem), (void*)&fine.u);
+    error |= clSetKernelArg(prolongKernel, 1, sizeof(cl_int), (void*)&fine.width);
+    error |= clSetKernelArg(prolongKernel, 2, sizeof(cl_int), (void*)&fine.height);
+    error |= clSetKernelArg(prolongKernel, 3, sizeof(cl_float), (void*)&fine.lastX);
+    error |= clSetKernelArg(prolongKernel, 4, sizeof(cl_float), (void*)&fine.lastY);
+    error |= clSetKernelArg(prolongKernel, 5, sizeof(cl_mem), (void*)&coarse.u);
+    error |= clSetKernelArg(prolongKernel, 6, sizeof(cl_int), (void*)&coarse.width);
+    error |= clEnqueueNDRangeKernel(queue, prolongKernel, 2, NULL, fineRange, workGroupSize, 0, NULL, ProfiledEvent("mgProlong"));
+    if(checkError(error, "Multigrid: clEnqueueNDRangeKernel"))
+        return false;
+
+    return smooth(queue, fine, postSmooth);
+}
+
+bool Multigrid::enqueueVCycle(cl_command_queue queue, cl_mem data)
+{
+    if(levels.empty()) {
+        cerr << "Multigrid::enqueueVCycle: no se llamo a init" << endl;
+        return false;
+    }
+    levels[0].u= data;
+    return vCycle(queue, 0);
+}
+
+void Multigrid::release()
+{
+    // El nivel 0 es el buffer del sistema, que no es nuestro
+    for(size_t i=1; i<levels.size(); i++) {
+        if(levels[i].u)
+            clReleaseMemObject(levels[i].u);
+        if(levels[i].rhs)
+            clReleaseMemObject(levels[i].rhs);
+    }
+    levels.clear();
+    if(smoothKernel)
+        clReleaseKernel(smoothKernel);
+    if(restrictKernel)
+        clReleaseKernel(restrictKernel);
+    if(prolongKernel)
+        clReleaseKernel(prolongKernel);
+    if(program)
+        clReleaseProgram(program);
+    program= NULL;
+    smoothKernel= NULL;
+    restrictKernel= NULL;
+    prolongKernel= NULL;
+}
@@ -0,0 +1,73 @@
+/*
+ * multigrid.h
+ *
+ * Solver multigrid geometrico (V-cycle) del sistema de fdmHeat en un buffer de
+ * width * height floats, con las celdas del borde fijas.
+ *
+ * Jacobi, Gauss-Seidel y SOR solo suavizan bien el error de alta frecuencia: el
+ * calor avanza una celda por iteracion, asi que necesitan O(n^2) iteraciones en
+ * una grilla de n x n. Cada V-cycle suaviza unas pocas veces en cada nivel, pasa
+ * el residuo a una grilla de la mitad de lado (restriccion), resuelve ahi la
+ * correccion con el mismo esquema y la interpola de vuelta (prolongacion), asi
+ * que el error de todas las frecuencias se reduce en un factor casi constante por
+ * ciclo (alrededor de 0.05) y el costo de cada uno es O(n^2). Cada nivel grueso
+ * toma el borde del anterior como su ultima fila y columna, asi que el factor es
+ * el mismo aunque los lados no sean 2^k + 1 (ver multigrid.cl).
+ */
+
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <CL/cl.h>
+
+#include <string>
+#include <vector>
+
+class Multigrid
+{
+public:
+    Multigrid();
+    ~Multigrid() { release(); }
+
+    // Compila los kernels de path y reserva los niveles gruesos para un sistema
+    // de width x height. preSmooth y postSmooth son las iteraciones de Gauss-Seidel
+    // rojo-negro antes y despues de la correccion en cada nivel.
+    // Devuelve false en caso de error
+    bool init(cl_context context, cl_device_id device, int width, int height,
+              int preSmooth= 2, int postSmooth= 2, const char* path= "../src/multigrid.cl");
+
+    // Encola un V-cycle sobre data (un buffer de width x height floats), en el lugar
+    // Devuelve false en caso de error
+    bool enqueueVCycle(cl_command_queue queue, cl_mem data);
+
+    // Cantidad de niveles, incluyendo el del sistema
+    int levelCount() const { return levels.size(); }
+
+    // Libera los kernels y los buffers de los niveles gruesos
+    void release();
+
+private:
+    struct Level {
+        int width, height;
+        // Distancia de la ultima celda interior al borde derecho e inferior, en
+        // pasos del nivel (1 en el nivel 0, ver multigrid.cl)
+        float lastX, lastY;
+        // Aproximacion y termino independiente; en el nivel 0 u es el buffer del
+        // sistema y rhs es NULL
+        cl_mem u, rhs;
+    };
+
+    // Encola iterations iteraciones de Gauss-Seidel rojo-negro sobre el nivel
+    bool smooth(cl_command_queue queue, const Level& level, int iterations);
+    // Encola un V-cycle desde el nivel index
+    bool vCycle(cl_command_queue queue, int index);
+
+    cl_program program;
+    cl_kernel smoothKernel, restrictKernel, prolongKernel;
+    size_t workGroupSize[2];
+
+    std::vector<Level> levels;
+    int preSmooth, postSmooth;
+};
+
+#endif // MULTIGRID_H
@@ -16,14 +16,22 @@ QMAKE_CXXFLAGS_RELEASE = -march=native -O3 -fPIC
 SOURCES += \
     src/main.cpp \
     ../common/clutils.cpp \
+    ../common/programcache.cpp \
+    ../common/clprofiler.cpp \
+    ../common/autotuner.cpp \
     src/fdmheat.cpp \
     src/fdmheatwidget.cpp \
+    src/framewriter.cpp \
     src/setupclgl.cpp
 
 HEADERS += \
     ../common/clutils.h \
+    ../common/programcache.h \
+    ../common/clprofiler.h \
+    ../common/autotuner.h \
     src/fdmheat.h \
     src/fdmheatwidget.h \
+    src/framewriter.h \
     src/setupclgl.h
 
 OTHER_FILES += \
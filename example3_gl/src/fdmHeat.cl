@@ -42,3 +42,34 @@ __kernel void fdmHeat(
     // Escribir resultado
     write_imagef(output, (int2)(x,y), value);
 }
+
+// Gauss-Seidel / SOR rojo-negro en el lugar sobre un buffer de width * height
+// floats. Las celdas se colorean como un tablero de ajedrez: las rojas (color 0,
+// x + y par) solo tienen vecinas negras y viceversa, asi que todas las celdas de un
+// color se pueden actualizar en paralelo con los valores nuevos del otro color.
+// Cada work-item actualiza la celda de su color en el par de columnas 2 * x y
+// 2 * x + 1. omega es el factor de relajacion: 1 es Gauss-Seidel, entre 1 y 2 es SOR.
+__kernel void fdmHeatRedBlack(
+    __global float* data,
+    int width,
+    int height,
+    int color,
+    float omega)
+{
+    int y= get_global_id(1);
+    int x= 2 * get_global_id(0) + ((y + color) & 1);
+
+    // Las celdas del borde no se actualizan (Condicion de frontera de Dirichlet)
+    if(x<=0 || y<=0 || x>=width-1 || y>=height-1)
+        return;
+
+    const int i= x + y * width;
+    float up   = data[i - width];
+    float down = data[i + width];
+    float left = data[i - 1];
+    float right= data[i + 1];
+    float average= (up + down + left + right) / 4.0f;
+
+    // Sobre-relajacion explicita: mix solo esta definido para omega en [0, 1]
+    data[i]= omega == 1.0f ? average : data[i] + omega * (average - data[i]);
+}
@@ -1,24 +1,63 @@
 #include "fdmheat.h"
+#include "programcache.h"
+#include "clprofiler.h"
+#include "autotuner.h"
 
-FDMHeat::FDMHeat(cl_context context, cl_command_queue queue, cl_device_id device) :
+#include <cmath>
+#include <climits>
+#include <cstring>
+
+// Maximo de pasos por tanda, que acota la demora con que se ven el pincel y los
+// cambios de la simulacion
+const int FDMHeat::maxBatchSize= 1024;
+// Maximo de trazos de pincel por ejecucion de heatBrush
+static const int maxStrokesPerLaunch= 256;
+
+FDMHeat::FDMHeat(cl_context context, cl_command_queue queue, cl_device_id device, FDMSolver solver, float omega) :
     QThread()
 {
     clContext= context;
     clQueue= queue;
     clDevice= device;
+    this->solver= solver;
+    this->omega= solver == FDM_GAUSS_SEIDEL ? 1.0f : omega;
 
     firstRun= true;
     suspended= false;
+
+    batchSize= 1;
+    adaptiveBatch= true;
+    batchPeriod= 1000.0f / 60;
+
+    // El solver escribe en el snapshot 0, el 1 es el intermedio y el widget lee el 2
+    for(int i=0; i<3; i++) {
+        snapshots[i].data= NULL;
+        snapshots[i].written= NULL;
+        snapshots[i].read= NULL;
+    }
+    writeSlot= 0;
+    middleSlot= 1;
+    readSlot= 2;
+    snapshotsEnabled= true;
+
+    dStrokes= NULL;
+    strokesCapacity= 0;
+
+    nextStroke= 0;
+    stopIteration= 0;
+    frameWriter= NULL;
+    frameEvery= 1;
 }
 
 bool FDMHeat::loadFromImage(QString path)
 {
     // En la primera llamada a loadFromImage cargamos el kernel
     if(firstRun) {
-        if(!loadKernel(clContext, &kernel, clDevice, "../src/fdmHeat.cl", "fdmHeat"))
+        if(!loadKernel(clContext, &kernel, clDevice, "../src/fdmHeat.cl", isInPlace() ? "fdmHeatRedBlack" : "fdmHeat"))
             return false;
-        if(!loadKernel(clContext, &brushKernel, clDevice, "../src/heatBrush.cl", "heatBrush"))
+        if(!loadKernel(clContext, &brushKernel, clDevice, "../src/heatBrush.cl", isInPlace() ? "heatBrushBuffer" : "heatBrush"))
             return false;
+        printProgramCacheStats();
     }
 
     QImage image(path);
@@ -34,20 +73,57 @@ bool FDMHeat::loadFromImage(QString path)
     if(!firstRun) {
         free(hData);
         clReleaseMemObject(dData1);
-        clReleaseMemObject(dData2);
+        if(dData2)
+            clReleaseMemObject(dData2);
+        for(int i=0; i<3; i++) {
+            if(snapshots[i].data)
+                clReleaseMemObject(snapshots[i].data);
+            snapshots[i].data= NULL;
+            if(snapshots[i].written)
+                clReleaseEvent(snapshots[i].written);
+            if(snapshots[i].read)
+                clReleaseEvent(snapshots[i].read);
+            snapshots[i].written= NULL;
+            snapshots[i].read= NULL;
+        }
     }
 
-    // Reservamos buffers
+    // Reservamos buffers: dos imagenes para el ping pong de Jacobi, o un solo buffer
+    // que Gauss-Seidel y SOR actualizan en el lugar
     hData= (float*)malloc(bytes);
 
     cl_image_format format;
     format.image_channel_data_type= CL_FLOAT;
     format.image_channel_order= CL_INTENSITY;
-    cl_int error1, error2;
-    dData1= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error1);
-    dData2= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error2);
+    cl_int error1= CL_SUCCESS, error2= CL_SUCCESS;
+    dData2= NULL;
+    if(isInPlace()) {
+        dData1= clCreateBuffer(clContext, CL_MEM_READ_WRITE, bytes, NULL, &error1);
+        dataInput= dData1;
+        dataOutput= dData1;
+        // Factor de relajacion optimo para el problema de Laplace en una grilla de lado max(width, height)
+        if(solver == FDM_SOR and omega <= 0)
+            omega= 2.0f / (1.0f + sinf(M_PI / qMax(width, height)));
+    } else {
+        dData1= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error1);
+        dData2= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error2);
+        // El estado inicial esta en dData1, como si fuera la salida de una iteracion
+        dataInput= dData2;
+        dataOutput= dData1;
+    }
+
+    // Snapshots que ve el widget, del mismo tipo que el sistema. Sin widget no se
+    // reservan: serian tres copias mas del sistema en el dispositivo
+    cl_int snapshotErrors[3] = { CL_SUCCESS, CL_SUCCESS, CL_SUCCESS };
+    for(int i=0; i<3 and snapshotsEnabled; i++) {
+        if(isInPlace())
+            snapshots[i].data= clCreateBuffer(clContext, CL_MEM_READ_WRITE, bytes, NULL, &snapshotErrors[i]);
+        else
+            snapshots[i].data= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &snapshotErrors[i]);
+    }
 
-    if(!hData or checkError(error1, "clCreateImage2D") or checkError(error2, "clCreateImage2D")) {
+    if(!hData or checkError(error1, "clCreateImage2D") or checkError(error2, "clCreateImage2D") or
+       checkError(snapshotErrors[0] | snapshotErrors[1] | snapshotErrors[2], "clCreateImage2D")) {
         qDebug() << "FDMHeat::loadFromImage: Error al reservar memoria.";
         return false;
     }
@@ -64,10 +140,17 @@ bool FDMHeat::loadFromImage(QString path)
     cl_int error;
     size_t origin[3] = {0, 0, 0};
     size_t region[3] = {width, height, 1};
-    error= clEnqueueWriteImage(clQueue, dData1, CL_FALSE, origin, region, 0, 0, hData, 0, NULL, NULL);
+    if(isInPlace())
+        error= clEnqueueWriteBuffer(clQueue, dData1, CL_FALSE, 0, bytes, hData, 0, NULL, ProfiledEvent("subida sistema"));
+    else
+        error= clEnqueueWriteImage(clQueue, dData1, CL_FALSE, origin, region, 0, 0, hData, 0, NULL, ProfiledEvent("subida sistema"));
     if(checkError(error, "clEnqueueWriteImage"))
         return false;
 
+    // El widget muestra el estado inicial hasta que termine la primera tanda
+    if(snapshotsEnabled and !publishSnapshot())
+        return false;
+
     firstRun= false;
     return true;
 }
@@ -75,40 +158,333 @@ bool FDMHeat::loadFromImage(QString path)
 // Codigo del nuevo hilo
 void FDMHeat::run()
 {
-    // Work group y NDRange del kernel
-    size_t workGroupSize[2] = { 16, 16 };
-    size_t ndRangeSize[2];
-    ndRangeSize[0]= roundUp(width, workGroupSize[0]);
-    ndRangeSize[1]= roundUp(height, workGroupSize[1]);
+    // Work group y NDRange del kernel, elegidos por el autotuner. El autotuner ejecuta
+    // el kernel varias veces, asi que mide sobre copias del sistema: sobre los datos
+    // reales adelantaria la simulacion, y con Gauss-Seidel y SOR haria pasadas rojas
+    // sin las negras. Con Gauss-Seidel y SOR cada work-item actualiza una de las dos
+    // celdas de un par de columnas.
+    cl_mem scratch[2] = { NULL, NULL };
+    cl_int error1, error2= CL_SUCCESS;
+    if(isInPlace()) {
+        scratch[0]= clCreateBuffer(clContext, CL_MEM_READ_WRITE, bytes, NULL, &error1);
+        if(error1 == CL_SUCCESS)
+            error1= clEnqueueCopyBuffer(clQueue, dData1, scratch[0], 0, 0, bytes, 0, NULL, NULL);
+    } else {
+        cl_image_format format;
+        format.image_channel_data_type= CL_FLOAT;
+        format.image_channel_order= CL_INTENSITY;
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {width, height, 1};
+        scratch[0]= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error1);
+        scratch[1]= clCreateImage2D(clContext, CL_MEM_READ_WRITE, &format, width, height, 0, NULL, &error2);
+        if(error1 == CL_SUCCESS)
+            error1= clEnqueueCopyImage(clQueue, dData1, scratch[0], origin, origin, region, 0, NULL, NULL);
+    }
+
+    const cl_int red= 0;
+    cl_int error= error1 | error2;
+    error |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&scratch[0]);
+    if(isInPlace()) {
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_int), (void*)&width);
+        error |= clSetKernelArg(kernel, 2, sizeof(cl_int), (void*)&height);
+        error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&red);
+        error |= clSetKernelArg(kernel, 4, sizeof(cl_float), (void*)&omega);
+    } else {
+        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&scratch[1]);
+    }
+    const size_t problemSize[2] = { isInPlace() ? (size_t)(width + 1) / 2 : (size_t)width, (size_t)height };
+    const bool tuned= !checkError(error, "FDMHeat::run: clSetKernelArg") and
+                      tuneNDRange(clQueue, kernel, 2, problemSize, workGroupSize, ndRangeSize);
+    for(int i=0; i<2; i++)
+        if(scratch[i])
+            clReleaseMemObject(scratch[i]);
+    // Gauss-Seidel y SOR no vuelven a setear el sistema en cada iteracion
+    if(!tuned or checkError(clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dData1), "FDMHeat::run: clSetKernelArg")) {
+        qDebug() << "FDMHeat::run: Error al configurar el kernel.";
+        return;
+    }
 
-    bool even= true;
     iteration= 0;
+    even= true;
+    if(batchSize < 1)
+        batchSize= 1;
+
+    // Tanda encolada en la vuelta anterior, que puede estar ejecutandose todavia
+    cl_event pending= NULL;
+    int pendingSteps= 0;
+    double lastCompletion= hostTimeMs();
+    // Iteraciones encoladas; las tandas se cortan en las iteraciones con trazos
+    // o cuadros programados
+    int done= 0;
+    nextStroke= 0;
+    if(!runScheduled(done))
+        return;
 
-    // Iterar hasta que se setee el semaforo finish (con stop())
-    while(!finish.tryAcquire()) {
+    // Iterar hasta que se setee el semaforo finish (con stop()) o se llegue a stopIteration
+    while(!finish.tryAcquire() and (stopIteration <= 0 or done < stopIteration)) {
+        // Los trazos de pincel acumulados se dibujan antes de cada tanda, sobre el
+        // resultado de la anterior. Al final de cada tanda se publica una copia del
+        // resultado para el widget.
+        const int steps= qMin(batchSize, nextScheduled(done) - done);
+        cl_event batchEvent;
         dataLock.lock();
-        // Seteamos las referencias a los ping pong buffers segun si iteration es par o no
-        dataInput= even ? dData1 : dData2;
-        dataOutput= even ? dData2 : dData1;
+        const bool enqueued= flushStrokes() and enqueueBatch(steps, &batchEvent) and
+                             (!snapshotsEnabled or publishSnapshot());
         dataLock.unlock();
+        if(!enqueued)
+            break;
+        done+= steps;
+        if(!runScheduled(done)) {
+            clReleaseEvent(batchEvent);
+            break;
+        }
 
-        // Ejecutamos el kernel, sin descargar los resultados
-        cl_int error;
-        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dataInput);
-        error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dataOutput);
+        // Mientras el dispositivo ejecuta esta tanda esperamos la anterior. Este es
+        // un thread separado, asi que podemos "trabarlo".
+        if(pending)
+            waitBatch(pending, pendingSteps, lastCompletion);
+        pending= batchEvent;
+        pendingSteps= steps;
+    }
+    if(pending)
+        waitBatch(pending, pendingSteps, lastCompletion);
 
-        error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, NULL);
-        checkError(error, "FDMHeat::run: clEnqueueNDRangeKernel");
+    qDebug() << "FDMHeat::run: Terminando thread.";
+}
 
-        // Esperar a que termine de ejecutarse el kernel
-        // Este es un thread separado, asi que podemos "trabarlo"
-        clFinish(clQueue);
+bool FDMHeat::enqueueBatch(int steps, cl_event* event)
+{
+    CLProfiler& profiler= CLProfiler::instance();
+    const char* name= solver == FDM_SOR ? "fdmHeatRedBlack SOR" :
+                      solver == FDM_GAUSS_SEIDEL ? "fdmHeatRedBlack GS" : "fdmHeat";
+    cl_int error= CL_SUCCESS;
+    for(int i=0; i<steps; i++) {
+        const bool last= i == steps - 1;
+        if(isInPlace()) {
+            // Gauss-Seidel o SOR rojo-negro: las celdas rojas y despues las negras del
+            // unico buffer
+            for(cl_int color=0; color<2; color++) {
+                error |= clSetKernelArg(kernel, 3, sizeof(cl_int), (void*)&color);
+                error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL,
+                                                last and color == 1 ? event : ProfiledEvent(name));
+            }
+        } else {
+            // Seteamos las referencias a los ping pong buffers segun si iteration es par o no
+            dataInput= even ? dData1 : dData2;
+            dataOutput= even ? dData2 : dData1;
+            even= !even;
 
-        iteration.ref();
-        even= !even; // true cuando iteration es par
+            error |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dataInput);
+            error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void*)&dataOutput);
+            error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL,
+                                            last ? event : ProfiledEvent(name));
+        }
+        if(checkError(error, "FDMHeat::enqueueBatch: clEnqueueNDRangeKernel"))
+            return false;
     }
+    profiler.record(name, *event);
 
-    qDebug() << "FDMHeat::run: Terminando thread.";
+    // Enviar la tanda al dispositivo sin esperarla
+    error= clFlush(clQueue);
+    return !checkError(error, "FDMHeat::enqueueBatch: clFlush");
+}
+
+void FDMHeat::waitBatch(cl_event event, int steps, double& lastCompletion)
+{
+    cl_int error= clWaitForEvents(1, &event);
+    checkError(error, "FDMHeat::waitBatch: clWaitForEvents");
+    clReleaseEvent(event);
+    iteration.fetchAndAddOrdered(steps);
+
+    // Con las tandas encoladas de a dos, el tiempo entre terminaciones es el de
+    // ejecucion de la tanda. Se ajusta la cantidad de pasos para que dure
+    // batchPeriod, promediando con la anterior para que no oscile.
+    const double now= hostTimeMs();
+    const double stepMs= (now - lastCompletion) / steps;
+    lastCompletion= now;
+    if(adaptiveBatch and stepMs > 0) {
+        const int target= qBound(1, (int)(batchPeriod / stepMs), maxBatchSize);
+        batchSize= qMax(1, (batchSize + target) / 2);
+    }
+}
+
+int FDMHeat::nextScheduled(int done)
+{
+    int next= INT_MAX;
+    if(stopIteration > 0)
+        next= stopIteration;
+    if(nextStroke < strokes.size())
+        next= qMin(next, strokes[nextStroke].iteration);
+    if(frameWriter)
+        next= qMin(next, (done / frameEvery + 1) * frameEvery);
+    return next;
+}
+
+bool FDMHeat::runScheduled(int done)
+{
+    bool drawn= false;
+    while(nextStroke < strokes.size() and strokes[nextStroke].iteration <= done) {
+        const ScriptedStroke& stroke= strokes[nextStroke];
+        drawStroke(stroke.from, stroke.to, stroke.radius, stroke.hot, stroke.shape);
+        nextStroke++;
+        drawn= true;
+    }
+    // Dibujarlos ya, para que el cuadro de esta iteracion los incluya
+    if(drawn) {
+        dataLock.lock();
+        const bool flushed= flushStrokes();
+        dataLock.unlock();
+        if(!flushed)
+            return false;
+    }
+    if(frameWriter and done % frameEvery == 0)
+        return enqueueFrame(done);
+    return true;
+}
+
+bool FDMHeat::enqueueFrame(int done)
+{
+    float* data= (float*)malloc(bytes);
+    if(!data) {
+        qDebug() << "FDMHeat::enqueueFrame: Error al reservar memoria.";
+        return false;
+    }
+
+    // La bajada no bloquea: el thread de frameWriter espera su evento
+    cl_event ready;
+    cl_int error;
+    dataLock.lock();
+    if(isInPlace()) {
+        error= clEnqueueReadBuffer(clQueue, dataOutput, CL_FALSE, 0, bytes, data, 0, NULL, &ready);
+    } else {
+        const size_t origin[3] = {0, 0, 0};
+        const size_t region[3] = {(size_t)width, (size_t)height, 1};
+        error= clEnqueueReadImage(clQueue, dataOutput, CL_FALSE, origin, region, 0, 0, data, 0, NULL, &ready);
+    }
+    error |= clFlush(clQueue);
+    dataLock.unlock();
+    if(checkError(error, "FDMHeat::enqueueFrame: clEnqueueRead")) {
+        free(data);
+        return false;
+    }
+    CLProfiler::instance().record("bajada cuadro", ready);
+
+    frameWriter->push(done, width, height, data, ready);
+    return true;
+}
+
+bool FDMHeat::loadStrokes(QString path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "FDMHeat::loadStrokes: Could not load" << path;
+        return false;
+    }
+
+    QTextStream in(&file);
+    int line= 0;
+    while(!in.atEnd()) {
+        const QString text= in.readLine().trimmed();
+        line++;
+        if(text.isEmpty() or text.startsWith('#'))
+            continue;
+
+        QStringList fields= text.split(QRegExp("\\s+"));
+        ScriptedStroke stroke;
+        stroke.shape= BRUSH_DISC;
+        if(fields.size() > 5 and fields.last() == "gauss") {
+            stroke.shape= BRUSH_GAUSSIAN;
+            fields.removeLast();
+        }
+        bool ok[7] = { false, false, false, false, false, true, true };
+        const bool valid= (fields.size() == 5 or fields.size() == 7) and (fields[4] == "hot" or fields[4] == "cold");
+        if(valid) {
+            stroke.iteration= fields[0].toInt(&ok[0]);
+            stroke.from= QPointF(fields[1].toFloat(&ok[1]), fields[2].toFloat(&ok[2]));
+            stroke.radius= fields[3].toFloat(&ok[3]);
+            stroke.hot= fields[4] == "hot";
+            stroke.to= stroke.from;
+            if(fields.size() == 7)
+                stroke.to= QPointF(fields[5].toFloat(&ok[5]), fields[6].toFloat(&ok[6]));
+        }
+        if(!valid or !ok[0] or !ok[1] or !ok[2] or !ok[3] or !ok[5] or !ok[6]) {
+            qDebug() << "FDMHeat::loadStrokes:" << path << "linea" << line << "invalida:" << text;
+            return false;
+        }
+        strokes.append(stroke);
+    }
+
+    // Los trazos de la misma iteracion se aplican en el orden del archivo
+    qStableSort(strokes.begin(), strokes.end());
+    return true;
+}
+
+bool FDMHeat::publishSnapshot()
+{
+    // La copia espera a que termine el render que leia el snapshot antes de que el
+    // widget lo devolviera
+    Snapshot& snapshot= snapshots[writeSlot];
+    const cl_uint waitCount= snapshot.read ? 1 : 0;
+    cl_event written;
+    cl_int error;
+    if(isInPlace()) {
+        error= clEnqueueCopyBuffer(clQueue, dataOutput, snapshot.data, 0, 0, bytes, waitCount,
+                                   snapshot.read ? &snapshot.read : NULL, &written);
+    } else {
+        const size_t origin[3] = {0, 0, 0};
+        const size_t region[3] = {(size_t)width, (size_t)height, 1};
+        error= clEnqueueCopyImage(clQueue, dataOutput, snapshot.data, origin, origin, region, waitCount,
+                                  snapshot.read ? &snapshot.read : NULL, &written);
+    }
+    if(checkError(error, "FDMHeat::publishSnapshot: clEnqueueCopy"))
+        return false;
+    CLProfiler::instance().record("snapshot", written);
+
+    if(snapshot.read)
+        clReleaseEvent(snapshot.read);
+    if(snapshot.written)
+        clReleaseEvent(snapshot.written);
+    snapshot.read= NULL;
+    snapshot.written= written;
+
+    // El render de la otra cola espera el evento de la copia, asi que hay que enviarla
+    // al dispositivo antes de publicarla; si no, la copia recien se envia con la
+    // tanda siguiente (o nunca, si el solver esta suspendido)
+    error= clFlush(clQueue);
+    if(checkError(error, "FDMHeat::publishSnapshot: clFlush"))
+        return false;
+
+    // Intercambiar con el intermedio, marcandolo como nuevo. fetchAndStoreOrdered
+    // publica los cambios al snapshot antes que el indice.
+    writeSlot= middleSlot.fetchAndStoreOrdered(writeSlot | snapshotFresh) & snapshotIndex;
+    return true;
+}
+
+bool FDMHeat::acquireSnapshot(cl_mem* data, cl_event* written)
+{
+    if(!(middleSlot.fetchAndAddOrdered(0) & snapshotFresh))
+        return false;
+
+    readSlot= middleSlot.fetchAndStoreOrdered(readSlot) & snapshotIndex;
+    *data= snapshots[readSlot].data;
+    *written= snapshots[readSlot].written;
+    return true;
+}
+
+void FDMHeat::releaseSnapshot(cl_event read)
+{
+    Snapshot& snapshot= snapshots[readSlot];
+    if(snapshot.read)
+        clReleaseEvent(snapshot.read);
+    clRetainEvent(read);
+    snapshot.read= read;
+}
+
+void FDMHeat::setBatchSize(int steps)
+{
+    adaptiveBatch= steps <= 0;
+    if(steps > 0)
+        batchSize= qMin(steps, maxBatchSize);
 }
 
 void FDMHeat::suspend()
@@ -127,31 +503,118 @@ void FDMHeat::resume()
     suspended= false;
 }
 
-void FDMHeat::drawHeatQuad(QPoint center, int size, bool hot)
+void FDMHeat::drawStroke(QPointF from, QPointF to, float radius, bool hot, BrushShape shape)
 {
-    // Work group y NDRange del kernel
-    size_t workGroupSize[2] = { 16, 16 };
-    size_t ndRangeSize[2];
-    ndRangeSize[0]= roundUp(width, workGroupSize[0]);
-    ndRangeSize[1]= roundUp(height, workGroupSize[1]);
+    BrushStroke stroke;
+    stroke.x0= from.x();
+    stroke.y0= from.y();
+    stroke.x1= to.x();
+    stroke.y1= to.y();
+    stroke.radius= radius;
+    stroke.value= hot ? 1.0f : 0.0f;
+    stroke.shape= shape;
+    stroke.padding= 0;
 
-    if(!suspended)
-        dataLock.lock();
+    strokeLock.lock();
+    pendingStrokes.append(stroke);
+    strokeLock.unlock();
 
-    int bx= center.x();
-    int by= center.y();
-    float value= hot ? 1.0f : 0.0f;
+    // Suspendido no hay tandas, asi que dibujamos y publicamos el resultado ya
+    // (suspend() tomo dataLock desde este mismo thread)
+    if(suspended and flushStrokes() and snapshotsEnabled)
+        publishSnapshot();
+}
 
-    cl_int error;
-    error  = clSetKernelArg(brushKernel, 0, sizeof(cl_mem), (void*)&dataOutput);
-    error |= clSetKernelArg(brushKernel, 1, sizeof(int), (void*)&bx);
-    error |= clSetKernelArg(brushKernel, 2, sizeof(int), (void*)&by);
-    error |= clSetKernelArg(brushKernel, 3, sizeof(int), (void*)&size);
-    error |= clSetKernelArg(brushKernel, 4, sizeof(float), (void*)&value);
+// Libera la copia de los trazos cuando termina su subida
+static void CL_CALLBACK freeStrokes(cl_event, cl_int, void* data)
+{
+    free(data);
+}
 
-    error |= clEnqueueNDRangeKernel(clQueue, brushKernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, NULL);
-    checkError(error, "FDMHeat::drawHeatQuad: clEnqueueNDRangeKernel");
+bool FDMHeat::flushStrokes()
+{
+    strokeLock.lock();
+    QVector<BrushStroke> pending= pendingStrokes;
+    pendingStrokes.clear();
+    strokeLock.unlock();
 
-    if(!suspended)
-        dataLock.unlock();
+    CLProfiler& profiler= CLProfiler::instance();
+    for(int first=0; first<pending.size(); first+=maxStrokesPerLaunch) {
+        const int count= qMin(maxStrokesPerLaunch, pending.size() - first);
+        const BrushStroke* batch= pending.constData() + first;
+
+        // Rectangulo que contiene a los trazos, recortado al sistema
+        int minX= width, minY= height, maxX= 0, maxY= 0;
+        for(int i=0; i<count; i++) {
+            const BrushStroke& stroke= batch[i];
+            minX= qMin(minX, (int)floorf(qMin(stroke.x0, stroke.x1) - stroke.radius));
+            minY= qMin(minY, (int)floorf(qMin(stroke.y0, stroke.y1) - stroke.radius));
+            maxX= qMax(maxX, (int)ceilf(qMax(stroke.x0, stroke.x1) + stroke.radius) + 1);
+            maxY= qMax(maxY, (int)ceilf(qMax(stroke.y0, stroke.y1) + stroke.radius) + 1);
+        }
+        minX= qMax(minX, 0);
+        minY= qMax(minY, 0);
+        maxX= qMin(maxX, width);
+        maxY= qMin(maxY, height);
+        if(minX >= maxX or minY >= maxY)
+            continue;
+
+        // Subir los trazos sin bloquear; la copia de host se libera al terminar la subida
+        cl_int error;
+        if(count > strokesCapacity) {
+            if(dStrokes)
+                clReleaseMemObject(dStrokes);
+            strokesCapacity= maxStrokesPerLaunch;
+            dStrokes= clCreateBuffer(clContext, CL_MEM_READ_ONLY, strokesCapacity * sizeof(BrushStroke), NULL, &error);
+            if(checkError(error, "FDMHeat::flushStrokes: clCreateBuffer")) {
+                dStrokes= NULL;
+                strokesCapacity= 0;
+                return false;
+            }
+        }
+        const size_t strokeBytes= count * sizeof(BrushStroke);
+        void* upload= malloc(strokeBytes);
+        if(!upload) {
+            qDebug() << "FDMHeat::flushStrokes: Error al reservar memoria.";
+            return false;
+        }
+        memcpy(upload, batch, strokeBytes);
+        cl_event uploadEvent;
+        error= clEnqueueWriteBuffer(clQueue, dStrokes, CL_FALSE, 0, strokeBytes, upload, 0, NULL, &uploadEvent);
+        if(checkError(error, "FDMHeat::flushStrokes: clEnqueueWriteBuffer")) {
+            free(upload);
+            return false;
+        }
+        error= clSetEventCallback(uploadEvent, CL_COMPLETE, freeStrokes, upload);
+        profiler.record("subida trazos", uploadEvent);
+        clReleaseEvent(uploadEvent);
+        if(checkError(error, "FDMHeat::flushStrokes: clSetEventCallback"))
+            return false;
+
+        // Con Jacobi el kernel lee de una copia del rectangulo en la otra imagen, que la
+        // proxima iteracion sobreescribe de todas formas
+        const size_t offset[2] = { (size_t)minX, (size_t)minY };
+        const size_t size[2] = { (size_t)(maxX - minX), (size_t)(maxY - minY) };
+        error= CL_SUCCESS;
+        if(isInPlace()) {
+            error |= clSetKernelArg(brushKernel, 0, sizeof(cl_mem), (void*)&dataOutput);
+            error |= clSetKernelArg(brushKernel, 1, sizeof(int), (void*)&width);
+        } else {
+            const size_t origin[3] = { offset[0], offset[1], 0 };
+            const size_t region[3] = { size[0], size[1], 1 };
+            error |= clEnqueueCopyImage(clQueue, dataOutput, dataInput, origin, origin, region, 0, NULL, ProfiledEvent("copia pincel"));
+            error |= clSetKernelArg(brushKernel, 0, sizeof(cl_mem), (void*)&dataInput);
+            error |= clSetKernelArg(brushKernel, 1, sizeof(cl_mem), (void*)&dataOutput);
+        }
+        error |= clSetKernelArg(brushKernel, 2, sizeof(cl_mem), (void*)&dStrokes);
+        error |= clSetKernelArg(brushKernel, 3, sizeof(int), (void*)&count);
+
+        // Solo sobre el rectangulo, con el global offset en su esquina. El tamanio de
+        // work-group lo elige la implementacion: el rectangulo cambia en cada llamada y
+        // el autotuner no puede repetir el kernel (los trazos gaussianos se acumulan).
+        error |= clEnqueueNDRangeKernel(clQueue, brushKernel, 2, offset, size, NULL, 0, NULL, ProfiledEvent("heatBrush"));
+        if(checkError(error, "FDMHeat::flushStrokes: clEnqueueNDRangeKernel"))
+            return false;
+    }
+    return true;
 }
@@ -6,13 +6,39 @@
 #define CL_USE_DEPRECATED_OPENCL_1_1_APIS
 
 #include "clutils.h"
+#include "framewriter.h"
+
+// Metodo de resolucion del sistema
+enum FDMSolver {
+    FDM_JACOBI,        // fdmHeat con dos imagenes ("ping pong")
+    FDM_GAUSS_SEIDEL,  // fdmHeatRedBlack en el lugar sobre un buffer
+    FDM_SOR            // fdmHeatRedBlack con sobre-relajacion
+};
+
+// Forma del pincel (ver heatBrush.cl)
+enum BrushShape {
+    BRUSH_DISC,      // Las celdas cubiertas toman el valor del trazo
+    BRUSH_GAUSSIAN   // Se mezclan con el valor con un peso gaussiano de la distancia
+};
+
+// Trazo de pincel, con el mismo formato que en heatBrush.cl
+struct BrushStroke {
+    cl_float x0, y0, x1, y1;
+    cl_float radius;
+    cl_float value;
+    cl_int shape;
+    cl_int padding;
+};
 
 class FDMHeat : public QThread
 {
 Q_OBJECT
 
 public:
-    FDMHeat(cl_context context, cl_command_queue queue, cl_device_id device);
+    // omega es el factor de relajacion de FDM_SOR; con 0 se usa el optimo para el
+    // tamanio del sistema
+    FDMHeat(cl_context context, cl_command_queue queue, cl_device_id device,
+            FDMSolver solver= FDM_JACOBI, float omega= 0);
 
     bool loadFromImage(QString path);
 
@@ -23,21 +49,80 @@ public:
     void resume();
     bool isSuspended() { return suspended; }
 
+    // El thread encola las iteraciones en tandas de batchSize pasos seguidos, sin
+    // esperar entre pasos, y solo se sincroniza con el evento de la ultima de cada
+    // tanda. Con steps > 0 las tandas son de steps pasos (hasta maxBatchSize); con 0
+    // se ajustan para durar alrededor de setBatchPeriod ms (por defecto).
+    void setBatchSize(int steps);
+    void setBatchPeriod(float ms) { batchPeriod= ms; }
+    static const int maxBatchSize;
+
     // Puede llamarse en cualquier momento
     int getIteration() { return iteration; }
 
-    void drawHeatQuad(QPoint center, int size, bool hot);
-
-    // Puede llamarse solo cuando el sistema esta suspendido
-    cl_mem getOutputData() { return dataOutput; }
+    // Pincel: segmento de from a to (un disco si son iguales) de radio radius. Los
+    // trazos se acumulan y al final de la tanda en curso (o enseguida si el sistema
+    // esta suspendido) se dibujan todos con una sola ejecucion de heatBrush, solo
+    // sobre el rectangulo que los contiene. Puede llamarse en cualquier momento.
+    void drawStroke(QPointF from, QPointF to, float radius, bool hot, BrushShape shape= BRUSH_DISC);
+    void drawHeatQuad(QPoint center, int size, bool hot) { drawStroke(center, center, size, hot); }
+
+    // Snapshots del sistema para el widget (triple buffer sin locks). Al final de cada
+    // tanda el solver copia el resultado al snapshot que tiene para escribir y lo
+    // intercambia con el intermedio mediante un indice atomico; el widget intercambia
+    // el suyo por el intermedio cuando hay uno nuevo. Ninguno de los dos espera al
+    // otro: la sincronizacion en el dispositivo es con los eventos de cada snapshot.
+    //
+    // acquireSnapshot devuelve false si no se publico un snapshot desde la llamada
+    // anterior; si no, data pasa a ser del widget hasta la proxima llamada, y los
+    // comandos que lo lean deben esperar a written. Con Jacobi es una imagen; con
+    // Gauss-Seidel y SOR (isInPlace()) es un buffer de getWidth() * getHeight() floats.
+    // releaseSnapshot registra el evento del ultimo comando que lee el snapshot
+    // adquirido, que el solver espera antes de volver a escribirlo.
+    bool acquireSnapshot(cl_mem* data, cl_event* written);
+    void releaseSnapshot(cl_event read);
+    bool isInPlace() { return solver != FDM_JACOBI; }
 
     int getWidth() { return width; }
     int getHeight() { return height; }
 
+    // Modo sin ventana (--headless en main.cpp). Se configura antes de loadFromImage
+    // y de start().
+    // Sin snapshots no se reservan ni se copia el resultado de cada tanda (no hay
+    // widget que lo lea)
+    void setSnapshotsEnabled(bool enable) { snapshotsEnabled= enable; }
+    // run() termina al completar iterations iteraciones (con 0, cuando se llama a stop())
+    void setStopIteration(int iterations) { stopIteration= iterations; }
+    // Cada every iteraciones (y al comenzar) se baja el sistema y se pasa a writer
+    void setFrameWriter(FrameWriter* writer, int every) { frameWriter= writer; frameEvery= every; }
+    // Lee trazos de pincel de path, que run() aplica al completar la iteracion de cada
+    // uno. Cada linea es un trazo "iteracion x y radio hot|cold [x1 y1] [gauss]": un
+    // disco en (x, y), o un segmento hasta (x1, y1), opcionalmente con forma gaussiana.
+    // Las lineas vacias y las que empiezan con # se ignoran.
+    // Devuelve false en caso de error
+    bool loadStrokes(QString path);
+
 protected:
     void run();
 
 private:
+    // Encola steps iteraciones; event es el evento de la ultima
+    bool enqueueBatch(int steps, cl_event* event);
+    // Copia dataOutput al snapshot de escritura, envia la copia al dispositivo (clFlush)
+    // y lo publica. Se llama con dataLock tomado.
+    bool publishSnapshot();
+    // Dibuja los trazos pendientes. Se llama con dataLock tomado.
+    bool flushStrokes();
+    // Primera iteracion despues de done en la que hay un trazo, un cuadro o el fin
+    int nextScheduled(int done);
+    // Aplica los trazos y encola el cuadro de la iteracion done
+    bool runScheduled(int done);
+    // Encola la bajada de dataOutput y la pasa a frameWriter
+    bool enqueueFrame(int done);
+    // Espera la tanda de steps iteraciones de event, la suma a iteration y ajusta
+    // batchSize con el tiempo desde lastCompletion
+    void waitBatch(cl_event event, int steps, double& lastCompletion);
+
     QAtomicInt iteration;
     bool firstRun;
     QSemaphore finish;
@@ -47,21 +132,70 @@ private:
     int height;
     int bytes;
 
+    FDMSolver solver;
+    float omega;
+
     // Buffers en GPU y CPU
     float* hData;
 
     cl_mem dData1;
-    cl_mem dData2;
+    cl_mem dData2;     // Solo con Jacobi
     QMutex dataLock;
     cl_mem dataInput;  // Referencias para el ping pong buffer, siempre
     cl_mem dataOutput; // son iguales a dData1/dData2 o el inverso
 
+    // Triple buffer de snapshots. writeSlot es del solver y readSlot del widget;
+    // middleSlot tiene el indice del intermedio, con snapshotFresh si se publico y
+    // el widget todavia no lo tomo.
+    struct Snapshot {
+        cl_mem data;
+        cl_event written; // Copia del resultado al snapshot
+        cl_event read;    // Ultimo comando del widget que lo lee
+    };
+    Snapshot snapshots[3];
+    int writeSlot;
+    int readSlot;
+    QAtomicInt middleSlot;
+    static const int snapshotIndex= 3;
+    static const int snapshotFresh= 4;
+    bool snapshotsEnabled;
+
+    // Modo sin ventana
+    struct ScriptedStroke {
+        int iteration;
+        QPointF from;
+        QPointF to;
+        float radius;
+        bool hot;
+        BrushShape shape;
+        bool operator<(const ScriptedStroke& other) const { return iteration < other.iteration; }
+    };
+    QList<ScriptedStroke> strokes;
+    int nextStroke;
+    int stopIteration;
+    FrameWriter* frameWriter;
+    int frameEvery;
+
     cl_context clContext;
     cl_command_queue clQueue;
     cl_device_id clDevice;
     
     cl_kernel kernel;
     cl_kernel brushKernel;
+
+    // Trazos de pincel pendientes y buffer en el que se suben
+    QMutex strokeLock;
+    QVector<BrushStroke> pendingStrokes;
+    cl_mem dStrokes;
+    int strokesCapacity;
+    size_t workGroupSize[2];
+    size_t ndRangeSize[2];
+
+    // Tandas de iteraciones
+    int batchSize;
+    bool adaptiveBatch;
+    float batchPeriod;
+    bool even; // Con Jacobi, true cuando la proxima iteracion lee de dData1
 };
 
 #endif // FDMHEAT_H
@@ -2,6 +2,12 @@
 
 #include <GL/glu.h>
 
+#include "clprofiler.h"
+#include "autotuner.h"
+
+// Radio del pincel, en celdas del sistema
+static const float brushRadius= 25.0f;
+
 FDMHeatWidget::FDMHeatWidget(QSize maxSize) :
     QGLWidget()
 {
@@ -9,7 +15,7 @@ FDMHeatWidget::FDMHeatWidget(QSize maxSize) :
     maxHeight= maxSize.height();
 
     system= 0;
-    lastIteration= 0;
+    renderTuned= false;
 
     // Cada vez que displayTimer se dispare, actualizar el render
     connect(&displayTimer, SIGNAL(timeout()), this, SLOT(updateGL()));
@@ -18,6 +24,7 @@ FDMHeatWidget::FDMHeatWidget(QSize maxSize) :
 
     drawing= false;
     drawingHot= false;
+    brushShape= BRUSH_DISC;
     setMouseTracking(true);
 }
 
@@ -43,19 +50,29 @@ void FDMHeatWidget::initializeGL()
 void FDMHeatWidget::initializeCL()
 {
     // Configurar OpenCL con soporte de OpenGL
-    if(!setupOpenCLGL(clContext, clQueue, clDevice)) {
+    CLDeviceInfo info;
+    if(!setupOpenCLGL(clContext, clQueue, clDevice, &info)) {
         qDebug() << "FDMHeatWidget::initializeCL: Error al configurar OpenCL.";
         return;
     }
+    glEvents= info.hasExtension("cl_khr_gl_event");
+
+    // Cola separada para el solver
+    cl_int error;
+    computeQueue= clCreateCommandQueue(clContext, clDevice, CL_QUEUE_PROFILING_ENABLE, &error);
+    if(checkError(error, "clCreateCommandQueue"))
+        return;
+    CLProfiler::instance().setQueueName(computeQueue, "computo");
+    CLProfiler::instance().setQueueName(clQueue, "render");
 
-    if(!loadKernel(clContext, &renderKernel, clDevice, "../src/systemToImage.cl", "systemToImage")) {
+    if(!loadKernel(clContext, &renderKernel, clDevice, "../src/systemToImage.cl", "systemToImage") or
+       !loadKernel(clContext, &renderBufferKernel, clDevice, "../src/systemToImage.cl", "systemBufferToImage")) {
         qDebug() << "FDMHeatWidget::initializeCL: Error al cargar kernel.";
         return;
     }
 
     // Mapear la memoria la textura en OpenCL
     // Desde OpenCL solo vamos a escribir en la textura.
-    cl_int error;
     textureMem= clCreateFromGLTexture2D(clContext, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, texture, &error);
     if(checkError(error, "clCreateFromGLTexture2D"))
         return;
@@ -65,7 +82,7 @@ void FDMHeatWidget::initializeCL()
     if(palette.isNull())
         return;
     paletteMem= clCreateBuffer(clContext, CL_MEM_READ_ONLY, palette.byteCount(), NULL, &error);
-    error |= clEnqueueWriteBuffer(clQueue, paletteMem, CL_FALSE, 0, palette.byteCount(), palette.bits(), 0, NULL, NULL);
+    error |= clEnqueueWriteBuffer(clQueue, paletteMem, CL_FALSE, 0, palette.byteCount(), palette.bits(), 0, NULL, ProfiledEvent("subida paleta"));
     if(checkError(error, "clCreateBuffer"))
         return;
 
@@ -109,12 +126,8 @@ void FDMHeatWidget::paintGL()
     if(!system)
         return;
 
-    // Si se actualizo el sistema, actualizamos la textura
-    int iteration= system->getIteration();
-    if((iteration != lastIteration and !system->isSuspended()) or drawing) {
-        updateSystemTexture();
-        lastIteration= iteration;
-    }
+    // Si el sistema publico un snapshot nuevo, actualizamos la textura
+    updateSystemTexture();
 
     glBindTexture(GL_TEXTURE_2D, texture);
     glMatrixMode(GL_MODELVIEW);
@@ -135,37 +148,73 @@ void FDMHeatWidget::paintGL()
 
 void FDMHeatWidget::updateSystemTexture()
 {
-    cl_int error;
+    // Snapshot mas reciente del sistema; el render nunca espera al solver
+    cl_mem systemData;
+    cl_event written;
+    if(!system->acquireSnapshot(&systemData, &written))
+        return;
 
-    error= clEnqueueAcquireGLObjects(clQueue, 1, &textureMem, 0, 0, 0);
+    cl_int error;
+    CLProfiler& profiler= CLProfiler::instance();
+    // Procesar los tiempos de los comandos ya terminados, sin esperar a los pendientes
+    profiler.collect(false);
+
+    // Sin cl_khr_gl_event OpenGL tiene que terminar de usar la textura antes del acquire
+    if(!glEvents)
+        glFinish();
+    error= clEnqueueAcquireGLObjects(clQueue, 1, &textureMem, 0, 0, ProfiledEvent("acquire GL"));
     if(checkError(error, "clEnqueueAcquireGLObjects"))
         return;
 
-    // Work group y NDRange de renderKernel
-    size_t workGroupSize[2] = { 16, 16 };
-    size_t ndRangeSize[2];
-    ndRangeSize[0]= roundUp(system->getWidth(), workGroupSize[0]);
-    ndRangeSize[1]= roundUp(system->getHeight(), workGroupSize[1]);
-
-    bool suspended= system->isSuspended();
-    if(!suspended)
-        system->suspend();
-
-    // Ejecutamos el kernel para renderizar el sistema en una imagen
-    cl_mem systemData= system->getOutputData();
-    error  = clSetKernelArg(renderKernel, 0, sizeof(cl_mem), (void*)&systemData);
-    error |= clSetKernelArg(renderKernel, 1, sizeof(cl_mem), (void*)&textureMem);
-    error |= clSetKernelArg(renderKernel, 2, sizeof(cl_mem), (void*)&paletteMem);
-
-    error |= clEnqueueNDRangeKernel(clQueue, renderKernel, 2, NULL, ndRangeSize, workGroupSize, 0, NULL, NULL);
-    checkError(error, "FDMHeatWidget::updateSystemTexture: clEnqueueNDRangeKernel");
-
-    if(!suspended)
-        system->resume();
+    // Ejecutamos el kernel para renderizar el sistema en una imagen, despues de la
+    // copia del snapshot en la cola de computo. Con Gauss-Seidel y SOR el sistema es un buffer, y el kernel
+    // recibe ademas su tamanio.
+    const bool inPlace= system->isInPlace();
+    cl_kernel kernel= inPlace ? renderBufferKernel : renderKernel;
+    const int systemWidth= system->getWidth();
+    const int systemHeight= system->getHeight();
+    const int extra= inPlace ? 2 : 0;
+    error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&systemData);
+    if(inPlace) {
+        error |= clSetKernelArg(kernel, 1, sizeof(int), (void*)&systemWidth);
+        error |= clSetKernelArg(kernel, 2, sizeof(int), (void*)&systemHeight);
+    }
+    error |= clSetKernelArg(kernel, 1 + extra, sizeof(cl_mem), (void*)&textureMem);
+    error |= clSetKernelArg(kernel, 2 + extra, sizeof(cl_mem), (void*)&paletteMem);
+
+    // Work group y NDRange elegidos en setSystem (sin work-group si no se pudo elegir)
+    cl_event renderEvent;
+    error |= clEnqueueNDRangeKernel(clQueue, kernel, 2, NULL, renderRange, renderTuned ? renderLocal : NULL,
+                                    1, &written, &renderEvent);
+    if(!checkError(error, "FDMHeatWidget::updateSystemTexture: clEnqueueNDRangeKernel")) {
+        profiler.record(inPlace ? "systemBufferToImage" : "systemToImage", renderEvent);
+        // El solver no vuelve a escribir el snapshot hasta que termine el render
+        system->releaseSnapshot(renderEvent);
+        clReleaseEvent(renderEvent);
+    }
 
-    error= clEnqueueReleaseGLObjects(clQueue, 1, &textureMem, 0, 0, 0);
+    cl_event releaseEvent;
+    error= clEnqueueReleaseGLObjects(clQueue, 1, &textureMem, 0, 0, &releaseEvent);
     if (checkError(error, "clEnqueueReleaseGLObjects"))
         return;
+    profiler.record("release GL", releaseEvent);
+
+    // Sin cl_khr_gl_event OpenCL tiene que terminar con la textura antes de que OpenGL
+    // la dibuje; con la extension alcanza con enviar los comandos, y el solver espera
+    // el evento del render antes de volver a escribir el snapshot
+    if(!glEvents)
+        clWaitForEvents(1, &releaseEvent);
+    else
+        clFlush(clQueue);
+    clReleaseEvent(releaseEvent);
+}
+
+void FDMHeatWidget::setDisplayFramerate(float hz)
+{
+    displayTimer.start(1000/hz);
+    // Cada cuadro ve al menos una tanda nueva
+    if(system)
+        system->setBatchPeriod(500/hz);
 }
 
 void FDMHeatWidget::setSystem(FDMHeat* sys)
@@ -174,13 +223,69 @@ void FDMHeatWidget::setSystem(FDMHeat* sys)
     displayTimer.stop();
     // Actualizamos los parametros
     system= sys;
-    lastIteration= 0;
+    system->setBatchPeriod(displayTimer.interval() / 2.0f);
+    // Elegimos el work-group del render para el tamanio del sistema
+    renderTuned= tuneRender();
+    if(!renderTuned) {
+        qDebug() << "FDMHeatWidget::setSystem: Error al elegir el work-group del render, lo elige OpenCL.";
+        renderRange[0]= system->getWidth();
+        renderRange[1]= system->getHeight();
+    }
     // Actualizamos el tamanio del render
     resizeGL(width(), height());
     // Reanudamos el render
     displayTimer.start();
 }
 
+bool FDMHeatWidget::tuneRender()
+{
+    // El autotuner ejecuta el kernel varias veces, asi que no puede leer un snapshot
+    // (lo escribe la cola de computo) ni escribir la textura (es de OpenGL): se mide
+    // con un sistema en cero y una imagen de salida propios
+    const bool inPlace= system->isInPlace();
+    cl_kernel kernel= inPlace ? renderBufferKernel : renderKernel;
+    const int systemWidth= system->getWidth();
+    const int systemHeight= system->getHeight();
+    QVector<float> zeros(systemWidth * systemHeight, 0.0f);
+
+    cl_image_format systemFormat;
+    systemFormat.image_channel_data_type= CL_FLOAT;
+    systemFormat.image_channel_order= CL_INTENSITY;
+    cl_image_format outputFormat;
+    outputFormat.image_channel_data_type= CL_UNORM_INT8;
+    outputFormat.image_channel_order= CL_RGBA;
+    cl_int error1, error2;
+    cl_mem scratchSystem= inPlace ?
+        clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, zeros.size() * sizeof(float), zeros.data(), &error1) :
+        clCreateImage2D(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &systemFormat, systemWidth, systemHeight, 0,
+                        zeros.data(), &error1);
+    cl_mem scratchOutput= clCreateImage2D(clContext, CL_MEM_WRITE_ONLY, &outputFormat, systemWidth, systemHeight, 0,
+                                          NULL, &error2);
+    bool ok= !checkError(error1, "FDMHeatWidget::tuneRender: clCreate") and
+             !checkError(error2, "FDMHeatWidget::tuneRender: clCreateImage2D");
+
+    if(ok) {
+        const int extra= inPlace ? 2 : 0;
+        cl_int error;
+        error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&scratchSystem);
+        if(inPlace) {
+            error |= clSetKernelArg(kernel, 1, sizeof(int), (void*)&systemWidth);
+            error |= clSetKernelArg(kernel, 2, sizeof(int), (void*)&systemHeight);
+        }
+        error |= clSetKernelArg(kernel, 1 + extra, sizeof(cl_mem), (void*)&scratchOutput);
+        error |= clSetKernelArg(kernel, 2 + extra, sizeof(cl_mem), (void*)&paletteMem);
+        const size_t problemSize[2] = { (size_t)systemWidth, (size_t)systemHeight };
+        ok= !checkError(error, "FDMHeatWidget::tuneRender: clSetKernelArg") and
+            tuneNDRange(clQueue, kernel, 2, problemSize, renderLocal, renderRange);
+    }
+
+    if(scratchSystem)
+        clReleaseMemObject(scratchSystem);
+    if(scratchOutput)
+        clReleaseMemObject(scratchOutput);
+    return ok;
+}
+
 //
 // Full screen
 //
@@ -206,6 +311,9 @@ void FDMHeatWidget::keyPressEvent(QKeyEvent* event)
     case Qt::Key_F:
         setFullScreen(!isFullScreen());
         break;
+    case Qt::Key_G:
+        brushShape= brushShape == BRUSH_DISC ? BRUSH_GAUSSIAN : BRUSH_DISC;
+        break;
     case Qt::Key_Space:
         if(system->isSuspended())
             system->resume();
@@ -221,6 +329,8 @@ void FDMHeatWidget::mousePressEvent(QMouseEvent* event)
 {
     drawing= true;
     drawingHot= event->button() == Qt::RightButton;
+    lastBrushPos= toSystem(event->pos());
+    system->drawStroke(lastBrushPos, lastBrushPos, brushRadius, drawingHot, brushShape);
 }
 
 void FDMHeatWidget::mouseReleaseEvent(QMouseEvent* event)
@@ -233,15 +343,18 @@ void FDMHeatWidget::mouseMoveEvent(QMouseEvent* event)
     if(!drawing)
         return;
 
-    QPoint widgetPos= event->pos();
+    // Un segmento desde la posicion anterior, para que el trazo no quede cortado
+    // cuando el mouse se mueve rapido
+    QPointF systemPos= toSystem(event->pos());
+    system->drawStroke(lastBrushPos, systemPos, brushRadius, drawingHot, brushShape);
+    lastBrushPos= systemPos;
+}
 
+QPointF FDMHeatWidget::toSystem(QPoint widgetPos)
+{
     // Pasar de cordenadas del widget a coordenadas del sistema
     float widthRatio= (float)system->getWidth() / (width()-2*borderWidth);
     float heightRatio= (float)system->getHeight() / (height()-2*borderHeight);
 
-    QPoint systemPos;
-    systemPos.rx()= (widgetPos.x()-borderWidth) * widthRatio;
-    systemPos.ry()= (widgetPos.y()-borderHeight) * heightRatio;
-
-    system->drawHeatQuad(systemPos, 25, drawingHot);
+    return QPointF((widgetPos.x()-borderWidth) * widthRatio, (widgetPos.y()-borderHeight) * heightRatio);
 }
@@ -16,10 +16,13 @@ public:
 
     void setSystem(FDMHeat* sys);
 
-    void setDisplayFramerate(float hz) { displayTimer.start(1000/hz); } // render period 33 ms. 
+    // Tambien ajusta las tandas de iteraciones del sistema a la mitad del periodo
+    void setDisplayFramerate(float hz); // render period 33 ms. 
 
     cl_context getCLContext() { return clContext; }
-    cl_command_queue getCLQueue() { return clQueue; }
+    // Cola para el solver; el render usa una propia, asi que se pueden ejecutar a la
+    // vez y se ordenan solo con los eventos de los snapshots
+    cl_command_queue getCLComputeQueue() { return computeQueue; }
     cl_device_id getCLDevice() { return clDevice; }
 
     void waitCLConfig() { clConfigReady.acquire(); }
@@ -36,7 +39,10 @@ protected:
 private:
     void initializeCL();
     void updateSystemTexture();
+    // Elige el work-group del render para el sistema actual. Devuelve false en caso de error
+    bool tuneRender();
     void setFullScreen(bool fullScreen);
+    QPointF toSystem(QPoint widgetPos);
 
     int maxWidth;
     int maxHeight;
@@ -45,16 +51,24 @@ private:
 
     // Referencia al sistema que visualizamos
     FDMHeat* system;
-    int lastIteration;
 
     // OpenCL
     cl_context clContext;
-    cl_command_queue clQueue;
+    cl_command_queue clQueue;      // Render, paleta y acquire/release de la textura
+    cl_command_queue computeQueue; // Solver y pincel
     cl_device_id clDevice;
+    // Con cl_khr_gl_event acquire y release sincronizan con OpenGL implicitamente; si
+    // no, hay que esperar a OpenGL antes del acquire y a OpenCL despues del release
+    bool glEvents;
 
-    cl_kernel renderKernel;
+    cl_kernel renderKernel;       // systemToImage, para el sistema en una imagen (Jacobi)
+    cl_kernel renderBufferKernel; // systemBufferToImage, para el sistema en un buffer
     cl_mem textureMem; // texture mapeada a OpenCL
     cl_mem paletteMem; // constant memory donde cargamos la paleta
+    // Work-group y NDRange del render, elegidos en setSystem
+    bool renderTuned;
+    size_t renderLocal[2];
+    size_t renderRange[2];
     // OpenGL
     GLuint texture;
 
@@ -62,6 +76,8 @@ private:
 
     bool drawing;
     bool drawingHot;
+    BrushShape brushShape; // G alterna entre disco y gaussiano
+    QPointF lastBrushPos;  // En coordenadas del sistema
     int borderWidth;
     int borderHeight;
 };
@@ -0,0 +1,76 @@
+#include "framewriter.h"
+
+FrameWriter::FrameWriter(QString directory, QImage palette, int maxPending) :
+    QThread()
+{
+    this->directory= directory;
+    this->palette= palette;
+    this->maxPending= maxPending;
+    finishing= false;
+    written= 0;
+}
+
+void FrameWriter::push(int iteration, int width, int height, float* data, cl_event ready)
+{
+    Frame frame;
+    frame.iteration= iteration;
+    frame.width= width;
+    frame.height= height;
+    frame.data= data;
+    frame.ready= ready;
+
+    mutex.lock();
+    while(frames.size() >= maxPending)
+        notFull.wait(&mutex);
+    frames.enqueue(frame);
+    notEmpty.wakeOne();
+    mutex.unlock();
+}
+
+void FrameWriter::finish()
+{
+    mutex.lock();
+    finishing= true;
+    notEmpty.wakeOne();
+    mutex.unlock();
+}
+
+// Codigo del nuevo hilo
+void FrameWriter::run()
+{
+    QDir().mkpath(directory);
+
+    while(true) {
+        mutex.lock();
+        while(frames.isEmpty() and !finishing)
+            notEmpty.wait(&mutex);
+        if(frames.isEmpty()) {
+            mutex.unlock();
+            break;
+        }
+        Frame frame= frames.dequeue();
+        notFull.wakeOne();
+        mutex.unlock();
+
+        // Esperar la bajada, que se encolo sin bloquear
+        cl_int error= clWaitForEvents(1, &frame.ready);
+        clReleaseEvent(frame.ready);
+        if(!checkError(error, "FrameWriter: clWaitForEvents")) {
+            // Convertir los floats del sistema a pixels, utilizando la paleta de colores
+            QImage image(frame.width, frame.height, QImage::Format_RGB888);
+            for(int y=0; y<frame.height; y++) {
+                for(int x=0; x<frame.width; x++) {
+                    const float value= frame.data[x + y * frame.width];
+                    const uchar position= qBound(0.0f, value * 255.0f, 255.0f);
+                    image.setPixel(x, y, palette.pixel(position, 0));
+                }
+            }
+            const QString path= QString("%1/frame_%2.png").arg(directory).arg(frame.iteration, 8, 10, QChar('0'));
+            if(image.save(path))
+                written.ref();
+            else
+                qDebug() << "FrameWriter: Error al escribir" << path;
+        }
+        free(frame.data);
+    }
+}
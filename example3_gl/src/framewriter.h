@@ -0,0 +1,57 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <QtGui>
+
+#define CL_USE_DEPRECATED_OPENCL_1_1_APIS
+
+#include "clutils.h"
+
+// Thread que escribe cuadros del sistema en archivos .png, para el modo sin
+// ventana de example3_gl. El solver encola la bajada del sistema sin esperarla y
+// pasa el buffer de host con el evento de la bajada; el thread espera el evento,
+// convierte los valores con la paleta y guarda directory/frame_<iteracion>.png,
+// asi que ni la bajada ni la escritura frenan al solver. Si hay maxPending cuadros
+// sin escribir, push espera (para no acumular memoria).
+class FrameWriter : public QThread
+{
+Q_OBJECT
+
+public:
+    FrameWriter(QString directory, QImage palette, int maxPending= 4);
+
+    // Encola el cuadro de iteration. Toma posesion de data (width * height floats
+    // reservados con malloc) y de ready, el evento de la bajada.
+    void push(int iteration, int width, int height, float* data, cl_event ready);
+
+    // Termina el thread despues de escribir los cuadros pendientes
+    void finish();
+
+    int getWritten() { return written; }
+
+protected:
+    void run();
+
+private:
+    struct Frame {
+        int iteration;
+        int width;
+        int height;
+        float* data;
+        cl_event ready;
+    };
+
+    QString directory;
+    QImage palette;
+    int maxPending;
+
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    QQueue<Frame> frames;
+    bool finishing;
+
+    QAtomicInt written;
+};
+
+#endif // FRAMEWRITER_H
@@ -1,23 +1,73 @@
 
+// Trazo de pincel: segmento de (x0, y0) a (x1, y1) (un disco si los extremos son
+// iguales) de radio radius. Con forma BRUSH_DISC las celdas a distancia <= radius
+// del segmento toman value; con BRUSH_GAUSSIAN se mezclan con value con un peso
+// gaussiano de la distancia (sigma = radius / 2). Igual que BrushStroke en fdmheat.h.
+#define BRUSH_DISC 0
+#define BRUSH_GAUSSIAN 1
+
+typedef struct {
+    float x0, y0, x1, y1;
+    float radius;
+    float value;
+    int shape;
+    int padding;
+} BrushStroke;
+
+// Aplica los count trazos, en orden, al valor de la celda (x, y)
+float applyStrokes(float current, int x, int y, __global const BrushStroke* strokes, int count)
+{
+    const float2 p= (float2)(x, y);
+    for(int i=0; i<count; i++) {
+        const BrushStroke s= strokes[i];
+        // Distancia al cuadrado al punto mas cercano del segmento
+        const float2 a= (float2)(s.x0, s.y0);
+        const float2 ab= (float2)(s.x1, s.y1) - a;
+        const float length2= dot(ab, ab);
+        const float t= length2 > 0.0f ? clamp(dot(p - a, ab) / length2, 0.0f, 1.0f) : 0.0f;
+        const float2 d= p - (a + t * ab);
+        const float distance2= dot(d, d);
+        if(distance2 > s.radius * s.radius)
+            continue;
+
+        if(s.shape == BRUSH_GAUSSIAN) {
+            const float sigma= 0.5f * s.radius;
+            current= mix(current, s.value, exp(-distance2 / (2.0f * sigma * sigma)));
+        } else {
+            current= s.value;
+        }
+    }
+    return current;
+}
+
+// Dibuja los trazos sobre el sistema en una imagen (Jacobi). Se ejecuta solo sobre
+// el rectangulo que contiene a los trazos (recortado al sistema), con el global
+// offset en su esquina. Como una imagen no se puede leer y escribir en el mismo
+// kernel, input es una copia del rectangulo de output.
 __kernel void heatBrush(
-    __write_only image2d_t system,
-    int bx, int by, int size,
-    float value)
+    __read_only image2d_t input,
+    __write_only image2d_t output,
+    __global const BrushStroke* strokes,
+    int count)
 {
     int x= get_global_id(0);
     int y= get_global_id(1);
 
-    const int width= get_image_width(system);
-    const int height= get_image_height(system);
-
-    if(x>=width || y>=height)
-        return;
-
-    // Si estamos dentro del brush seteamos el valor
+    const sampler_t sampler= CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+    float value= read_imagef(input, sampler, (int2)(x, y)).x;
+    write_imagef(output, (int2)(x, y), applyStrokes(value, x, y, strokes, count));
+}
 
-    float dist= sqrt(convert_float((x-bx)*(x-bx) + (y-by)*(y-by)));
-    if(dist > size)
-        return;
+// heatBrush para el sistema en un buffer de width * height floats (Gauss-Seidel y SOR)
+__kernel void heatBrushBuffer(
+    __global float* system,
+    int width,
+    __global const BrushStroke* strokes,
+    int count)
+{
+    int x= get_global_id(0);
+    int y= get_global_id(1);
 
-    write_imagef(system, (int2)(x, y), value);
+    const int i= x + y * width;
+    system[i]= applyStrokes(system[i], x, y, strokes, count);
 }
@@ -3,9 +3,113 @@
 
 #include <fdmheat.h>
 #include <fdmheatwidget.h>
+#include "clprofiler.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// Modo sin ventana: simula iterations iteraciones sin OpenGL, en cualquier
+// dispositivo OpenCL (tambien CPUs), escribiendo opcionalmente un cuadro cada
+// frameEvery iteraciones en framesDir y aplicando los trazos de strokesPath
+static int runHeadless(FDMSolver solver, float omega, int batch, int iterations,
+                       const char* framesDir, int frameEvery, const char* strokesPath)
+{
+    cl_context context;
+    cl_command_queue queue;
+    cl_device_id device;
+    if(!setupOpenCL(context, queue, device, 0, solver == FDM_JACOBI ? DEVICE_REQUIRE_IMAGES : 0))
+        return EXIT_FAILURE;
+
+    FDMHeat heat(context, queue, device, solver, omega);
+    heat.setSnapshotsEnabled(false);
+    heat.setStopIteration(iterations);
+    heat.setBatchSize(batch);
+    if(!heat.loadFromImage("input.png") or (strokesPath and !heat.loadStrokes(strokesPath))) {
+        qDebug() << "Error al configurar FDMHeat.";
+        return EXIT_FAILURE;
+    }
+
+    QImage palette("palette.png");
+    if(framesDir and palette.isNull()) {
+        qDebug() << "Error al cargar paleta.";
+        return EXIT_FAILURE;
+    }
+    FrameWriter writer(framesDir ? framesDir : "", palette);
+    if(framesDir) {
+        heat.setFrameWriter(&writer, frameEvery);
+        writer.start();
+    }
+
+    const double start= hostTimeMs();
+    heat.start();
+    heat.wait();
+    const double elapsed= hostTimeMs() - start;
+    writer.finish();
+    writer.wait();
+
+    cerr << "Iterations     : " << heat.getIteration() << endl;
+    cerr << "System size    : (" << heat.getWidth() << ", " << heat.getHeight() << ")" << endl;
+    cerr << "Time           : " << elapsed << " ms" << endl;
+    cerr << "Iterations/s   : " << heat.getIteration() / (elapsed * 1.0e-3) << endl;
+    if(framesDir)
+        cerr << "Frames         : " << writer.getWritten() << " en " << framesDir << endl;
+    CLProfiler::instance().finish();
+
+    clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    return heat.getIteration() == iterations ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 int main(int argc, char** argv)
 {
+    // Procesar --device y --list-devices (seleccion del dispositivo OpenCL)
+    parseDeviceArgs(argc, argv);
+    // --profile registra los tiempos de los comandos OpenCL y muestra un resumen al
+    // salir, --trace=<archivo> ademas escribe el timeline en formato Chrome tracing
+    CLProfiler::instance().parseArgs(argc, argv);
+    // --solver=jacobi|gs|sor elige el metodo, y --omega=w el factor de relajacion de SOR
+    // (por defecto el optimo para el tamanio del sistema)
+    const char* solverValue= 0;
+    const char* omegaValue= 0;
+    extractArg(argc, argv, "--solver", &solverValue);
+    extractArg(argc, argv, "--omega", &omegaValue);
+    // --batch=K encola tandas de K iteraciones; por defecto se ajustan al framerate
+    const char* batchValue= 0;
+    extractArg(argc, argv, "--batch", &batchValue);
+    // --headless simula --iterations=N iteraciones sin ventana; --frames=<dir> escribe
+    // un cuadro cada --frame-every=N iteraciones y --strokes=<archivo> aplica los
+    // trazos de pincel del archivo (ver FDMHeat::loadStrokes)
+    const bool headless= extractArg(argc, argv, "--headless");
+    const char* iterationsValue= 0;
+    const char* framesDir= 0;
+    const char* frameEveryValue= 0;
+    const char* strokesPath= 0;
+    extractArg(argc, argv, "--iterations", &iterationsValue);
+    extractArg(argc, argv, "--frames", &framesDir);
+    extractArg(argc, argv, "--frame-every", &frameEveryValue);
+    extractArg(argc, argv, "--strokes", &strokesPath);
+    const int iterations= iterationsValue ? atoi(iterationsValue) : 10000;
+    const int frameEvery= frameEveryValue ? atoi(frameEveryValue) : 1000;
+    FDMSolver solver= FDM_JACOBI;
+    if(solverValue and strcmp(solverValue, "gs") == 0)
+        solver= FDM_GAUSS_SEIDEL;
+    else if(solverValue and strcmp(solverValue, "sor") == 0)
+        solver= FDM_SOR;
+    if((solverValue and solver == FDM_JACOBI and strcmp(solverValue, "jacobi") != 0) or
+       iterations < 1 or frameEvery < 1 or (!headless and (iterationsValue or framesDir or strokesPath))) {
+        qDebug() << "usage: ./example3_gl [--solver=jacobi|gs|sor] [--omega=w] [--batch=K] [--device=<spec>] [--list-devices] [--profile] [--trace=<file>]";
+        qDebug() << "       ./example3_gl --headless [--iterations=N] [--frames=<dir>] [--frame-every=N] [--strokes=<file>] [...]";
+        return EXIT_FAILURE;
+    }
+
+    if(headless) {
+        QCoreApplication app(argc, argv);
+        return runHeadless(solver, omegaValue ? atof(omegaValue) : 0, batchValue ? atoi(batchValue) : 0,
+                           iterations, framesDir, frameEvery, strokesPath);
+    }
+
     QApplication app(argc, argv);
 
     FDMHeatWidget widget;
@@ -16,16 +120,25 @@ int main(int argc, char** argv)
     // con OpenGL. Esperamos que termine de configurar OpenCL.
     widget.waitCLConfig();
 
-    FDMHeat heat(widget.getCLContext(), widget.getCLQueue(), widget.getCLDevice());
+    FDMHeat heat(widget.getCLContext(), widget.getCLComputeQueue(), widget.getCLDevice(), solver,
+                 omegaValue ? atof(omegaValue) : 0);
     if(!heat.loadFromImage("input.png")) {
         qDebug() << "Error al configurar FDMHeat.";
         return EXIT_FAILURE;
     }
+    heat.setBatchSize(batchValue ? atoi(batchValue) : 0);
     widget.setSystem(&heat);
 
     heat.start();
     
     app.setQuitOnLastWindowClosed(true);
     
-    return app.exec();
+    const int result= app.exec();
+
+    // Terminar el thread de la simulacion antes de procesar los tiempos
+    heat.stop();
+    heat.wait();
+    CLProfiler::instance().finish();
+
+    return result;
 }
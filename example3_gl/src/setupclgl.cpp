@@ -1,19 +1,22 @@
 #include "setupclgl.h"
 
-bool setupOpenCLGL(cl_context& context, cl_command_queue& queue, cl_device_id &device)
+#include <iostream>
+
+using namespace std;
+
+bool setupOpenCLGL(cl_context& context, cl_command_queue& queue, cl_device_id &device, CLDeviceInfo* info)
 {
     cl_int clError;
 
-    // Obtener informacion de la plataforma
-    cl_platform_id platform;
-    clError= clGetPlatformIDs(1, &platform, NULL);
-    if(checkError(clError, "clGetPlatformIDs"))
-        return false;
-
-    // Seleccionar la GPU por defecto
-    clError= clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-    if(checkError(clError, "clGetDeviceIDs"))
+    // Elegir un dispositivo con interoperabilidad OpenGL entre todas las plataformas
+    CLDeviceInfo selected;
+    if(!selectDevice(selected, 0, DEVICE_REQUIRE_GL_SHARING))
         return false;
+    device= selected.device;
+    cl_platform_id platform= selected.platform;
+    if(info)
+        *info= selected;
+    cerr << "Dispositivo: " << selected.name << " (" << selected.typeName() << ", " << selected.platformName << ")." << endl;
 
     // Crear contexto global para la GPU seleccionada
     cl_context_properties props[] =  {
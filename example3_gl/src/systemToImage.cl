@@ -24,3 +24,24 @@ __kernel void systemToImage(
     // Escribir resultado
     write_imagef(output, (int2)(x, y), color);
 }
+
+// systemToImage para el sistema en un buffer de width * height floats (Gauss-Seidel y SOR)
+__kernel void systemBufferToImage(
+    __global const float* system,
+    int width, int height,
+    __write_only image2d_t output,
+    __constant uchar4* palette)
+{
+    int x= get_global_id(0);
+    int y= get_global_id(1);
+
+    if(x>=width || y>=height || x>=get_image_width(output) || y>=get_image_height(output))
+        return;
+
+    float value= system[x + y * width];
+
+    int index= clamp((int)(value * 255.0f), 0, 255);
+    float4 color= convert_float4(palette[index]) / 255.0f;
+
+    write_imagef(output, (int2)(x, y), color);
+}
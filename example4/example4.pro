@@ -10,16 +10,34 @@ MOC_DIR = obj
 
 INCLUDEPATH += ./src/ ../common/ /usr/local/cuda/include /opt/AMDAPP/include
 
-LIBS += -lOpenCL
+LIBS += -lOpenCL -lpthread
 
 QMAKE_CXXFLAGS_RELEASE = -march=native -O3 -fPIC
 
 SOURCES += \
 	src/main.cpp \
-	../common/clutils.cpp
+	../common/clutils.cpp \
+	../common/programcache.cpp \
+	../common/clprofiler.cpp \
+	../common/autotuner.cpp \
+	../common/reduce.cpp \
+	../common/scan.cpp \
+	../common/histogram.cpp \
+	../common/radixsort.cpp
 
 HEADERS += \
-	../common/clutils.h
+	../common/clutils.h \
+	../common/programcache.h \
+	../common/clprofiler.h \
+	../common/autotuner.h \
+	../common/reduce.h \
+	../common/scan.h \
+	../common/histogram.h \
+	../common/radixsort.h
 
 OTHER_FILES += \
-	src/atomics.cl 
+	src/atomics.cl \
+	../common/reduce.cl \
+	../common/scan.cl \
+	../common/histogram.cl \
+	../common/radixsort.cl
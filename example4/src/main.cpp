@@ -5,26 +5,374 @@
 #include <CL/cl.h>
 // Utilidades propias para OpenCL
 #include "clutils.h"
+#include "clprofiler.h"
+#include "autotuner.h"
+#include "programcache.h"
+#include "reduce.h"
+#include "scan.h"
+#include "histogram.h"
+#include "radixsort.h"
+
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
 
 using namespace std;
 
+// Llena hA con n enteros aleatorios, de los cuales aproximadamente occurrFactor
+// (entre 0 y 1) son iguales al valor devuelto
+static int initData(int* hA, int n, float occurrFactor)
+{
+    srand(31);
+    int countingValue = rand();
+    for(int i=0; i<n; ++i) {
+	hA[i] = (float(rand())/RAND_MAX < occurrFactor) ? countingValue : rand();
+    }
+    return countingValue;
+}
+
+// Ejecuta con Reduction (common/reduce.h) la suma, el minimo, el maximo, el argmax y el
+// conteo de countingValue sobre los n enteros de dA, muestra el tiempo y el ancho de
+// banda de cada uno y los compara con el resultado en el CPU
+// Devuelve la cantidad de resultados erroneos, o -1 en caso de error
+static int runReductions(cl_context context, cl_command_queue queue, cl_device_id device,
+                         cl_mem dA, const int* hA, int n, int countingValue)
+{
+    Reduction reduction;
+    if(!reduction.init(context, device))
+        return -1;
+
+    // Resultados de referencia
+    cl_long refSum= 0;
+    cl_int refMin= hA[0], refMax= hA[0], refArgMax= 0;
+    cl_uint refCount= 0;
+    for(int i=0; i<n; i++) {
+        refSum+= hA[i];
+        refMin= min(refMin, hA[i]);
+        if(hA[i] > refMax) {
+            refMax= hA[i];
+            refArgMax= i;
+        }
+        if(hA[i] == countingValue)
+            refCount++;
+    }
+
+    const ReduceOp ops[] = { REDUCE_SUM, REDUCE_MIN, REDUCE_MAX, REDUCE_ARGMAX, REDUCE_COUNT_EQUAL };
+    const char* names[] = { "reduce sum", "reduce min", "reduce max", "reduce argmax", "reduce count" };
+    CLProfiler& profiler= CLProfiler::instance();
+    int failures= 0;
+    for(int o=0; o<5; o++) {
+        // Una ejecucion para compilar el programa y llenar caches, y otra medida
+        cl_int result[2];
+        cl_long sum= 0;
+        void* output= ops[o] == REDUCE_SUM ? (void*)&sum : (void*)result;
+        if(!reduction.reduce(queue, ops[o], REDUCE_INT, dA, n, output, &countingValue))
+            return -1;
+        cl_event partialEvent, finalEvent;
+        if(!reduction.reduce(queue, ops[o], REDUCE_INT, dA, n, output, &countingValue, &partialEvent, &finalEvent))
+            return -1;
+        const double elapsed= eventElapsed(partialEvent) + eventElapsed(finalEvent);
+        profiler.record((string(names[o]) + " (1)").c_str(), partialEvent);
+        profiler.record((string(names[o]) + " (2)").c_str(), finalEvent);
+        clReleaseEvent(partialEvent);
+        clReleaseEvent(finalEvent);
+
+        bool ok;
+        switch(ops[o]) {
+        case REDUCE_SUM:    ok= sum == refSum; break;
+        case REDUCE_MIN:    ok= result[0] == refMin; break;
+        case REDUCE_MAX:    ok= result[0] == refMax; break;
+        case REDUCE_ARGMAX: ok= result[0] == refMax and result[1] == refArgMax; break;
+        default:            ok= (cl_uint)result[0] == refCount; break;
+        }
+        if(!ok)
+            failures++;
+
+        cerr << left << setw(16) << names[o] << right << fixed << setprecision(3) << setw(10) << elapsed << " ms"
+             << setprecision(2) << setw(10) << (double)n * sizeof(int) / (elapsed * 1.0e6) << " GB/s\t"
+             << (ok ? "OK" : "ERROR") << endl;
+    }
+    return failures;
+}
+
+// Extrae con Scan (common/scan.h) los indices de los elementos de dA iguales a
+// countingValue en un arreglo contiguo, muestra el tiempo y el ancho de banda y
+// compara la cantidad y los indices con el resultado en el CPU
+// Devuelve la cantidad de resultados erroneos, o -1 en caso de error
+static int runCompaction(cl_context context, cl_command_queue queue, cl_device_id device,
+                         cl_mem dA, const int* hA, int n, int countingValue)
+{
+    Scan scan;
+    if(!scan.init(context, device))
+        return -1;
+
+    cl_int error;
+    cl_mem dIndices= clCreateBuffer(context, CL_MEM_WRITE_ONLY, n * sizeof(cl_int), NULL, &error);
+    if(checkError(error, "clCreateBuffer"))
+        return -1;
+
+    // Una ejecucion para compilar el programa y llenar caches, y otra medida
+    int count;
+    if(!scan.compact(queue, COMPACT_INT, COMPACT_EQUAL, dA, n, &countingValue, NULL, dIndices, count))
+        return -1;
+    const double start= hostTimeMs();
+    if(!scan.compact(queue, COMPACT_INT, COMPACT_EQUAL, dA, n, &countingValue, NULL, dIndices, count))
+        return -1;
+    const double elapsed= hostTimeMs() - start;
+
+    vector<cl_int> indices(max(count, 0));
+    if(count > 0) {
+        error= clEnqueueReadBuffer(queue, dIndices, CL_TRUE, 0, count * sizeof(cl_int), &indices[0], 0, NULL, NULL);
+        if(checkError(error, "clEnqueueReadBuffer"))
+            return -1;
+    }
+    clReleaseMemObject(dIndices);
+
+    // Los indices deben ser exactamente los de countingValue, en orden
+    int failures= 0, found= 0;
+    for(int i=0; i<n and !failures; i++) {
+        if(hA[i] != countingValue)
+            continue;
+        if(found >= count or indices[found] != i)
+            failures++;
+        found++;
+    }
+    if(found != count)
+        failures++;
+
+    // data se lee dos veces y se escriben las posiciones locales y los indices
+    const double bytes= (2.0 * n + n + count) * sizeof(int);
+    cerr << left << setw(16) << "compact" << right << fixed << setprecision(3) << setw(10) << elapsed << " ms"
+         << setprecision(2) << setw(10) << bytes / (elapsed * 1.0e6) << " GB/s\t"
+         << count << " elementos\t" << (failures ? "ERROR" : "OK") << endl;
+    return failures;
+}
+
+// Calcula con Histogram (common/histogram.h) el histograma de 256 bins de los n
+// enteros de dA en [0, RAND_MAX), con una sola replica por work-group y con las
+// replicas automaticas, muestra el tiempo y el ancho de banda de cada uno y los
+// compara con el histograma calculado en el CPU. Con el valor contado ocupando
+// occurrFactor de los datos, una replica serializa los atomics sobre su bin.
+// Devuelve la cantidad de resultados erroneos, o -1 en caso de error
+static int runHistograms(cl_context context, cl_command_queue queue, cl_device_id device,
+                         cl_mem dA, const int* hA, int n)
+{
+    const int bins= 256;
+    const cl_int lo= 0, hi= RAND_MAX;
+    vector<cl_uint> reference(bins, 0);
+    for(int i=0; i<n; i++)
+        if(hA[i] >= lo and hA[i] < hi)
+            reference[(cl_long)(hA[i] - lo) * bins / ((cl_long)hi - lo)]++;
+
+    CLProfiler& profiler= CLProfiler::instance();
+    int failures= 0;
+    for(int automatic=0; automatic<2; automatic++) {
+        Histogram histogram;
+        if(!histogram.init(context, device, bins, automatic ? 0 : 1))
+            return -1;
+
+        // Una ejecucion para compilar el programa y llenar caches, y otra medida
+        vector<cl_uint> result(bins);
+        if(!histogram.histogram(queue, HISTOGRAM_INT, dA, n, &lo, &hi, &result[0]))
+            return -1;
+        cl_event partialEvent, mergeEvent;
+        if(!histogram.histogram(queue, HISTOGRAM_INT, dA, n, &lo, &hi, &result[0], &partialEvent, &mergeEvent))
+            return -1;
+        const double elapsed= eventElapsed(partialEvent) + eventElapsed(mergeEvent);
+        ostringstream name;
+        name << "histogram x" << histogram.getReplicas();
+        profiler.record((name.str() + " (1)").c_str(), partialEvent);
+        profiler.record((name.str() + " (2)").c_str(), mergeEvent);
+        clReleaseEvent(partialEvent);
+        clReleaseEvent(mergeEvent);
+
+        const bool ok= result == reference;
+        if(!ok)
+            failures++;
+        cerr << left << setw(16) << name.str() << right << fixed << setprecision(3) << setw(10) << elapsed << " ms"
+             << setprecision(2) << setw(10) << (double)n * sizeof(int) / (elapsed * 1.0e6) << " GB/s\t"
+             << (ok ? "OK" : "ERROR") << endl;
+    }
+    return failures;
+}
+
+// Rango [begin, end) de un arreglo que ordena o mezcla un thread de parallelSort
+struct SortRange {
+    int* data;
+    int begin;
+    int middle;
+    int end;
+};
+
+static void* sortRange(void* arg)
+{
+    SortRange* range= (SortRange*)arg;
+    sort(range->data + range->begin, range->data + range->end);
+    return NULL;
+}
+
+static void* mergeRange(void* arg)
+{
+    SortRange* range= (SortRange*)arg;
+    inplace_merge(range->data + range->begin, range->data + range->middle, range->data + range->end);
+    return NULL;
+}
+
+// Ordena los n enteros de data en el CPU con un thread por nucleo: cada thread
+// ordena un bloque con std::sort y luego los bloques se mezclan de a pares, con
+// las mezclas de cada nivel en paralelo
+static void parallelSort(int* data, int n)
+{
+    const int threads= max((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+    vector<int> bounds;
+    for(int t=0; t<=threads; t++)
+        bounds.push_back((cl_long)n * t / threads);
+
+    vector<SortRange> ranges(threads);
+    vector<pthread_t> ids(threads);
+    for(int t=0; t<threads; t++) {
+        SortRange range= { data, bounds[t], bounds[t], bounds[t + 1] };
+        ranges[t]= range;
+        pthread_create(&ids[t], NULL, sortRange, &ranges[t]);
+    }
+    for(int t=0; t<threads; t++)
+        pthread_join(ids[t], NULL);
+
+    for(int width=1; width<threads; width*=2) {
+        ranges.clear();
+        for(int t=0; t + width < threads; t+=2 * width) {
+            SortRange range= { data, bounds[t], bounds[t + width], bounds[min(t + 2 * width, threads)] };
+            ranges.push_back(range);
+        }
+        for(size_t r=0; r<ranges.size(); r++)
+            pthread_create(&ids[r], NULL, mergeRange, &ranges[r]);
+        for(size_t r=0; r<ranges.size(); r++)
+            pthread_join(ids[r], NULL);
+    }
+}
+
+// Ordena los n enteros de dA con RadixSort (common/radixsort.h), solo las claves y
+// con sus indices como valores, con digitos de 4 y de 8 bits, y compara el tiempo
+// con std::sort y con parallelSort en el CPU. Los pares se verifican como orden
+// estable: a claves iguales, indices crecientes.
+// Devuelve la cantidad de resultados erroneos, o -1 en caso de error
+static int runSorts(cl_context context, cl_command_queue queue, cl_device_id device,
+                    cl_mem dA, const int* hA, int n)
+{
+    const size_t bytes= (size_t)n * sizeof(cl_int);
+    vector<int> reference(hA, hA + n);
+    double start= hostTimeMs();
+    sort(reference.begin(), reference.end());
+    const double sortElapsed= hostTimeMs() - start;
+    vector<int> parallel(hA, hA + n);
+    start= hostTimeMs();
+    parallelSort(&parallel[0], n);
+    const double parallelElapsed= hostTimeMs() - start;
+
+    const double mkeys= n / 1.0e3;
+    cerr << left << setw(16) << "std::sort" << right << fixed << setprecision(3) << setw(10) << sortElapsed << " ms"
+         << setprecision(2) << setw(10) << mkeys / sortElapsed << " Mkeys/s" << endl;
+    cerr << left << setw(16) << "parallelSort" << right << fixed << setprecision(3) << setw(10) << parallelElapsed << " ms"
+         << setprecision(2) << setw(10) << mkeys / parallelElapsed << " Mkeys/s\t"
+         << (parallel == reference ? "OK" : "ERROR") << endl;
+    int failures= parallel == reference ? 0 : 1;
+
+    vector<cl_int> indices(n);
+    for(int i=0; i<n; i++)
+        indices[i]= i;
+    cl_int error1, error2;
+    cl_mem dKeys= clCreateBuffer(context, CL_MEM_READ_WRITE, max(bytes, sizeof(cl_int)), NULL, &error1);
+    cl_mem dValues= clCreateBuffer(context, CL_MEM_READ_WRITE, max(bytes, sizeof(cl_int)), NULL, &error2);
+    if(checkError(error1, "clCreateBuffer") or checkError(error2, "clCreateBuffer"))
+        return -1;
+
+    vector<cl_int> keys(n), values(n);
+    for(int bits=4; bits<=8; bits+=4) {
+        RadixSort radixSort;
+        if(!radixSort.init(context, device, bits))
+            return -1;
+        for(int withValues=0; withValues<2; withValues++) {
+            // Una ejecucion para compilar el programa y llenar caches, y otra medida.
+            // La copia de los datos originales no se incluye en el tiempo.
+            double elapsed= 0;
+            for(int t=0; t<2; t++) {
+                cl_int error= clEnqueueCopyBuffer(queue, dA, dKeys, 0, 0, bytes, 0, NULL, NULL);
+                if(withValues)
+                    error |= clEnqueueWriteBuffer(queue, dValues, CL_FALSE, 0, bytes, &indices[0], 0, NULL, NULL);
+                error |= clFinish(queue);
+                if(checkError(error, "runSorts: clEnqueueCopyBuffer"))
+                    return -1;
+                start= hostTimeMs();
+                if(!radixSort.enqueueSort(queue, dKeys, withValues ? dValues : NULL, n))
+                    return -1;
+                error= clFinish(queue);
+                if(checkError(error, "runSorts: clFinish"))
+                    return -1;
+                elapsed= hostTimeMs() - start;
+            }
+
+            cl_int error= clEnqueueReadBuffer(queue, dKeys, CL_TRUE, 0, bytes, &keys[0], 0, NULL, NULL);
+            if(withValues)
+                error |= clEnqueueReadBuffer(queue, dValues, CL_TRUE, 0, bytes, &values[0], 0, NULL, NULL);
+            if(checkError(error, "runSorts: clEnqueueReadBuffer"))
+                return -1;
+            bool ok= keys == reference;
+            for(int i=0; i<n and ok and withValues; i++)
+                ok= values[i] >= 0 and values[i] < n and hA[values[i]] == keys[i] and
+                    (i == 0 or keys[i - 1] != keys[i] or values[i - 1] < values[i]);
+            if(!ok)
+                failures++;
+
+            ostringstream name;
+            name << "radix" << bits << (withValues ? " pares" : " claves");
+            cerr << left << setw(16) << name.str() << right << fixed << setprecision(3) << setw(10) << elapsed << " ms"
+                 << setprecision(2) << setw(10) << mkeys / elapsed << " Mkeys/s\t"
+                 << (ok ? "OK" : "ERROR") << endl;
+        }
+    }
+    clReleaseMemObject(dKeys);
+    clReleaseMemObject(dValues);
+    return failures;
+}
+
 int main(int argc, char *argv[])
 {
+    // Procesar --device y --list-devices (seleccion del dispositivo OpenCL)
+    parseDeviceArgs(argc, argv);
+    // Los tiempos de los comandos se registran siempre; --trace=<archivo> ademas
+    // escribe el timeline en formato Chrome tracing
+    CLProfiler& profiler= CLProfiler::instance();
+    profiler.setEnabled(true);
+    profiler.parseArgs(argc, argv);
     
     /// Argumentos de entrada al programa
     if(argc < 2) {
-      cerr << "usage: ./atomics {globalcounter|localcounter} [numberOfElements]" << endl;
+      cerr << "usage: ./atomics {globalcounter|localcounter|reduce|compact|histogram|sort} [numberOfElements] [--device=<spec>] [--list-devices] [--trace=<file>]" << endl;
       return EXIT_FAILURE;      
     }
     
+    // globalcounter y localcounter cuentan con atomics (atomics.cl); reduce ejecuta
+    // las reducciones de common/reduce.h, sin atomics globales, y compact extrae los
+    // indices del valor contado con la compactacion de common/scan.h; histogram
+    // calcula el histograma de los datos con common/histogram.h y sort los ordena con
+    // common/radixsort.h
     const char* memoryParam = argv[1];
-    if(strcmp(memoryParam, "globalcounter") != 0 and strcmp(memoryParam, "localcounter") != 0) {
-      cerr << "usage: ./atomics {globalcounter|localcounter} [numberOfElements]" << endl;
+    if(strcmp(memoryParam, "globalcounter") != 0 and strcmp(memoryParam, "localcounter") != 0 and
+       strcmp(memoryParam, "reduce") != 0 and strcmp(memoryParam, "compact") != 0 and
+       strcmp(memoryParam, "histogram") != 0 and strcmp(memoryParam, "sort") != 0) {
+      cerr << "usage: ./atomics {globalcounter|localcounter|reduce|compact|histogram|sort} [numberOfElements] [--device=<spec>] [--list-devices] [--trace=<file>]" << endl;
       cerr << "Parametro incorrecto: " << memoryParam << endl;
       return EXIT_FAILURE;      
     }
     
     const bool withSharedMemory = (strcmp(memoryParam, "localcounter")==0) ? true : false;
+    const bool withReduction = strcmp(memoryParam, "reduce")==0;
+    const bool withCompaction = strcmp(memoryParam, "compact")==0;
+    const bool withHistogram = strcmp(memoryParam, "histogram")==0;
+    const bool withSort = strcmp(memoryParam, "sort")==0;
     
     cerr << "Configurando OpenCL." << endl;
     // Crear contexto y cola de comandos de OpenCL
@@ -46,26 +394,14 @@ int main(int argc, char *argv[])
     // Cargar el programa
     //
 
-    // Cargar texto de programa a un string
+    // Crear y compilar el programa para todos los dispositivos del contexto. Si el
+    // programa ya se compilo en una ejecucion anterior se recarga el binario de la cache.
     cerr << "Cargando programa." << endl;
-    char* programText;
-    size_t programLength;
-    if(!loadProgramText("../src/atomics.cl", &programText, &programLength)) {
-        cerr << "Error al cargar archivo de programa." << endl;
-        return EXIT_FAILURE;
-    }
-    // Crear programa
     cl_int error;
     cl_program program;
-    program= clCreateProgramWithSource(clContext, 1, (const char **)&programText, (const size_t *)&programLength, &error);
-    if(checkError(error, "clCreateProgramWithSource"))
-        return EXIT_FAILURE;
-    // Compilar programa para todos los dispositivos del contexto
-    error= clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if(checkError(error, "clBuildProgram")) {
-	checkProgramBuild(program, clDevice);
+    if(!loadProgram(clContext, &program, clDevice, "../src/atomics.cl"))
         return EXIT_FAILURE;
-    }
+    printProgramCacheStats();
 
     // Crear kernel a partir del programa (un programa puede tener varios kernels)
     cl_kernel kernel;
@@ -100,11 +436,7 @@ int main(int argc, char *argv[])
 
     // 1. Lleno el arreglo de entrada hA (de CPU) con datos enteros aleatorios 
     cerr << "Inicializando datos." << endl;
-    srand(31);
-    int countingValue = rand();
-    for(int i=0; i<n; ++i) {
-	hA[i] = (float(rand())/RAND_MAX < occurrFactor) ? countingValue : rand();
-    }
+    int countingValue = initData(hA, n, occurrFactor);
     
     // count the number of ocurrences (referencia)
     uint referenceCounter = 0;
@@ -116,25 +448,36 @@ int main(int argc, char *argv[])
     // 2. Subir los datos de entrada a la GPU (de hA a dA)
     // Esta operacion se realiza de forma asincronica: se encola en el queue y el programa continua
     cerr << "Subiendo datos de entrada." << endl;
-    error= clEnqueueWriteBuffer(clQueue, dA, CL_FALSE, 0, hABytes, hA, 0, NULL, NULL);
+    error= clEnqueueWriteBuffer(clQueue, dA, CL_FALSE, 0, hABytes, hA, 0, NULL, ProfiledEvent("subida A"));
     if(checkError(error, "clEnqueueWriteBuffer"))
         return EXIT_FAILURE;
 
-    uint zero= 0;
-    error= clEnqueueWriteBuffer(clQueue, dCounter, CL_FALSE, 0, sizeof(cl_uint), &zero, 0, NULL, NULL);
-    if(checkError(error, "clEnqueueWriteBuffer"))
-        return EXIT_FAILURE;
+    if(withReduction or withCompaction or withHistogram or withSort) {
+        cerr << "Number of elements\t" << n << " (" << hABytes/1024.0/1024.0 << " MiB)" << endl;
+        int failures;
+        if(withReduction)
+            failures= runReductions(clContext, clQueue, clDevice, dA, hA, n, countingValue);
+        else if(withCompaction)
+            failures= runCompaction(clContext, clQueue, clDevice, dA, hA, n, countingValue);
+        else if(withHistogram)
+            failures= runHistograms(clContext, clQueue, clDevice, dA, hA, n);
+        else
+            failures= runSorts(clContext, clQueue, clDevice, dA, hA, n);
+        profiler.finish();
+        free(hA);
+        clReleaseMemObject(dA);
+        clReleaseMemObject(dCounter);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+        clReleaseCommandQueue(clQueue);
+        clReleaseContext(clContext);
+        if(failures)
+            cerr << (failures < 0 ? "Error al ejecutar los kernels." : "Hay resultados erroneos.") << endl;
+        return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
 
     // 3. Ejecutar el kernel
-    // Primero se determina el tamanio de work-group y la cantidad total de threads en el NDRange
-    const size_t workGroupSize= 1024;
-    // Para cada dimension se redondea hacia arriba la cantidad de threads total para que sea
-    // multiplo del tamanio del work-group
-    const size_t ndRangeSize= roundUp(n, workGroupSize);
-    
-    cl_event kernelExecEvent;
-    
-    // Setean los parametros del kernel, y luego se encola su ejecucion
+    // Setean los parametros del kernel
     cerr << "Ejecutando kernel." << endl;
     error  = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void*)&dA);
     error |= clSetKernelArg(kernel, 1, sizeof(cl_uint), (void*)&n);
@@ -146,7 +489,21 @@ int main(int argc, char *argv[])
     else {
       error |= clSetKernelArg(kernel, 3, sizeof(cl_mem), (void*)&dCounter);
     }
-    error |= clEnqueueNDRangeKernel(clQueue, kernel, 1, NULL, &ndRangeSize, &workGroupSize, 0, NULL, &kernelExecEvent);
+    if(checkError(error, "clSetKernelArg"))
+        return EXIT_FAILURE;
+
+    // Se determina el tamanio de work-group (ver autotuner.h) y la cantidad total de threads
+    // en el NDRange, redondeada hacia arriba para que sea multiplo del tamanio del work-group.
+    // El autotuner ejecuta el kernel varias veces, asi que el contador se inicializa despues.
+    const size_t problemSize= n;
+    size_t workGroupSize, ndRangeSize;
+    if(!tuneNDRange(clQueue, kernel, 1, &problemSize, &workGroupSize, &ndRangeSize))
+        return EXIT_FAILURE;
+
+    uint zero= 0;
+    error= clEnqueueWriteBuffer(clQueue, dCounter, CL_FALSE, 0, sizeof(cl_uint), &zero, 0, NULL, ProfiledEvent("reset contador"));
+    // Y se encola su ejecucion
+    error |= clEnqueueNDRangeKernel(clQueue, kernel, 1, NULL, &ndRangeSize, &workGroupSize, 0, NULL, ProfiledEvent(kernelName));
     if(checkError(error, "clEnqueueNDRangeKernel"))
         return EXIT_FAILURE;
     
@@ -154,7 +511,7 @@ int main(int argc, char *argv[])
     // Esta vez indicamos que la operacion sea sincronica, por lo que el CPU va a quedar esperando
     // a que se ejecuten las tareas anteriores de la cola (paso 2 y 3) asi como esta tarea
     uint dResult=0;
-    error= clEnqueueReadBuffer(clQueue, dCounter, CL_TRUE, 0, sizeof(cl_uint), &dResult, 0, NULL, NULL);
+    error= clEnqueueReadBuffer(clQueue, dCounter, CL_TRUE, 0, sizeof(cl_uint), &dResult, 0, NULL, ProfiledEvent("bajada contador"));
     if(checkError(error, "clEnqueueReadBuffer")) {
         return EXIT_FAILURE;
     }
@@ -163,7 +520,11 @@ int main(int argc, char *argv[])
     cerr << "Occurrence factor\t" << occurrFactor*100 << "%" << endl;
     cerr << "Work-group size\t\t" << workGroupSize<< endl;
     cerr << "ND-Range size\t\t" << ndRangeSize << endl;
-    cerr << "Tiempo de ejecucion\t" << eventElapsed(kernelExecEvent) << " ms." << endl;
+    CLProfiler::Stats kernelStats;
+    profiler.collect();
+    if(profiler.getStats(kernelName, kernelStats))
+        cerr << "Tiempo de ejecucion\t" << kernelStats.total << " ms, " << hABytes / (kernelStats.total * 1.0e6) << " GB/s." << endl;
+    profiler.finish();
     
     //
     // Verificacion
@@ -15,12 +15,18 @@ QMAKE_CXXFLAGS_RELEASE = -march=native -O3 -fPIC
 SOURCES += \
 	src/main.cpp \
 	../common/clutils.cpp \
+	../common/programcache.cpp \
+	../common/clprofiler.cpp \
+	../common/autotuner.cpp \
         src/glwidget.cpp \
         src/sphericalcoord.cpp \
 	src/setupclgl.cpp
 
 HEADERS += \
 	../common/clutils.h \
+	../common/programcache.h \
+	../common/clprofiler.h \
+	../common/autotuner.h \
         src/glwidget.h \
         src/sphericalcoord.h \
 	src/setupclgl.h
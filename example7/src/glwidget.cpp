@@ -3,6 +3,9 @@
 #include <GL/glext.h>
 
 #include "clutils.h"
+#include "programcache.h"
+#include "clprofiler.h"
+#include "autotuner.h"
 #include <CL/cl_gl.h>
 #include <GL/glx.h>
 
@@ -31,6 +34,8 @@ void GLWidget::initMembers()
     paletteImage = QImage("./palette.png");
 
     vboSize = 0;
+    localWorkSize = 0;
+    globalWorkSize = 0;
     timestep = 0.005f;
     
     fullScreen = false;
@@ -113,6 +118,7 @@ void GLWidget::initializeCL()
     cl_int error;
 
     loadKernel(clContext, &clKernel, clDevice, "../src/vboproc.cl", "vboproc");
+    printProgramCacheStats();
     
     // Creo OpenCL buffer a partir del OpenGL buffer
     qDebug() << "Creando OpenCL buffer.";
@@ -133,6 +139,29 @@ void GLWidget::initializeCL()
 	qDebug() << "OpenCL initialization error";
         return;
     }
+
+    // Tamanio de work-group elegido por el autotuner. Como ejecuta el kernel varias
+    // veces, mide sobre una copia de las particulas para no adelantar la simulacion.
+    // Si no se puede elegir, lo elige OpenCL (localWorkSize 0)
+    const size_t problemSize = vertexNumber;
+    cl_mem scratch = clCreateBuffer(clContext, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, vboSize, particles, &error);
+    bool tuned = !checkError(error, "clCreateBuffer");
+    if (tuned) {
+        error = clSetKernelArg(clKernel, 0, sizeof(cl_mem), (void*)&scratch);
+        tuned = !checkError(error, "clSetKernelArg") and
+                tuneNDRange(clQueue, clKernel, 1, &problemSize, &localWorkSize, &globalWorkSize);
+        clReleaseMemObject(scratch);
+    }
+    if (!tuned) {
+        qDebug() << "Error al elegir el tamanio de work-group, lo elige OpenCL.";
+        localWorkSize = 0;
+        globalWorkSize = problemSize;
+    }
+    error = clSetKernelArg(clKernel, 0, sizeof(cl_mem), (void*)&clvbo);
+    if(checkError(error, "clSetKernelArg")) {
+	qDebug() << "OpenCL initialization error";
+        return;
+    }
     
     // Una vez creado el kernel, decremento la referencia al programa creado
     qDebug() << "OpenCL initialized successfully";
@@ -224,30 +253,31 @@ void GLWidget::drawAxes()
 void GLWidget::runKernel() 
 {
     cl_int error;
+    CLProfiler& profiler= CLProfiler::instance();
     
     // block until all gl functions are completed
     glFinish();
     // Le doy a OpenCL el vbo que estaba usando OpenGL para renderizar
-    error = clEnqueueAcquireGLObjects(clQueue, 1, &clvbo, 0, 0, 0);
+    error = clEnqueueAcquireGLObjects(clQueue, 1, &clvbo, 0, 0, ProfiledEvent("acquire GL"));
     if (checkError(error, "clEnqueueAcquireGLObjects")) {
 	return;
     }
 
-    localWorkSize = 1024;
-    globalWorkSize = roundUp(vertexNumber, localWorkSize);
-    
-    error = clEnqueueNDRangeKernel(clQueue, clKernel, 1, NULL, &globalWorkSize, &localWorkSize, 0, 0, 0);
+    // Tamanio de work-group elegido en initializeCL
+    error = clEnqueueNDRangeKernel(clQueue, clKernel, 1, NULL, &globalWorkSize, localWorkSize ? &localWorkSize : NULL,
+                                   0, 0, ProfiledEvent("vboproc"));
     if (checkError(error, "clEnqueueNDRangeKernel")) {
 	return;
     }
 
     // unmap buffer object
-    error = clEnqueueReleaseGLObjects(clQueue, 1, &clvbo, 0, 0, 0);
+    error = clEnqueueReleaseGLObjects(clQueue, 1, &clvbo, 0, 0, ProfiledEvent("release GL"));
     if (checkError(error, "clEnqueueReleaseGLObjects")) {
 	return;
     }
 
     clFinish(clQueue);
+    profiler.collect(false);
 
 }
 
@@ -1,8 +1,16 @@
 #include <QApplication>
 #include <glwidget.h>
+#include "clutils.h"
+#include "clprofiler.h"
 
 int main(int argc, char** argv) 
 {
+    // Procesar --device y --list-devices (seleccion del dispositivo OpenCL)
+    parseDeviceArgs(argc, argv);
+    // --profile registra los tiempos de los comandos OpenCL y muestra un resumen al
+    // salir, --trace=<archivo> ademas escribe el timeline en formato Chrome tracing
+    CLProfiler::instance().parseArgs(argc, argv);
+
     QApplication app(argc, argv);
 	
     GLWidget widget(NULL, 32768);
@@ -14,5 +22,8 @@ int main(int argc, char** argv)
     timer.start();
     app.connect(&timer, SIGNAL(timeout()), &widget, SLOT(updateGL()));
 	
-    return app.exec();
+    const int result= app.exec();
+    CLProfiler::instance().finish();
+
+    return result;
 }
@@ -15,8 +15,11 @@
 //
 // El contexto OpenGL ya debe estar creado cuando se llama a esta funcion
 //
+// El dispositivo se elige con selectDevice entre los que soportan cl_khr_gl_sharing
+// (respetando --device y EAGPGPU_DEVICE); si info no es 0 se copian ahi sus capacidades
+//
 // Esta funcion esta implementada solo para Linux/X11
 
-bool setupOpenCLGL(cl_context& context, cl_command_queue& queue, cl_device_id& device);
+bool setupOpenCLGL(cl_context& context, cl_command_queue& queue, cl_device_id& device, CLDeviceInfo* info= 0);
 
 #endif // SETUPCLGL_H